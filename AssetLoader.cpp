@@ -0,0 +1,202 @@
+//--------------------------------------------------------------------------------------
+// Parallel loading of meshes and textures
+//--------------------------------------------------------------------------------------
+
+#include "AssetLoader.h"
+#include "Mesh.h"
+#include "CTexture.h"
+
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+
+CAssetLoader::CAssetLoader(unsigned int numThreads /*= 0*/)
+    : mPool(numThreads)
+{
+    mTimer.Reset();
+}
+
+
+CAssetLoader::~CAssetLoader()
+{
+    // Jobs may still be running if Finish wasn't called, and may have left textures waiting for their mip-maps
+    mPool.Wait();
+    for (auto& job : mJobs)
+    {
+        if (job.mipSource != nullptr)  gRenderDevice->Release(job.mipSource);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Adding assets
+//--------------------------------------------------------------------------------------
+
+void CAssetLoader::AddMesh(Mesh** mesh, const std::string& fileName, bool requireTangents /*= false*/)
+{
+    mJobs.emplace_back();
+    SJob* job = &mJobs.back();
+    job->fileName = fileName;
+    job->mesh = mesh;
+    job->requireTangents = requireTangents;
+    mPool.Add([this, job]() { LoadJob(*job); });
+}
+
+
+void CAssetLoader::AddTexture(CTexture* texture, const std::string& fileName)
+{
+    mJobs.emplace_back();
+    SJob* job = &mJobs.back();
+    job->fileName = fileName;
+    job->texture = texture;
+    mPool.Add([this, job]() { LoadJob(*job); });
+}
+
+
+// Runs on a worker thread. Does everything except creating the mesh device objects and generating texture mip-maps,
+// which need the owning thread. Any error is stored in the job
+void CAssetLoader::LoadJob(SJob& job)
+{
+    Timer timer;
+    timer.Reset();
+    job.worker = CThreadPool::WorkerIndex();
+
+    try
+    {
+        if (job.mesh != nullptr)
+        {
+            job.meshSource = Mesh::LoadSource(job.fileName, job.requireTangents);
+        }
+        else
+        {
+            // Read the whole texture file then decode it and create the texture here, creation only needs the
+            // device, which is free-threaded
+            std::ifstream file(job.fileName, std::ios::in | std::ios::binary | std::ios::ate);
+            if (!file.is_open())  throw std::runtime_error("Cannot open texture " + job.fileName);
+
+            std::streamoff fileSize = file.tellg();
+            if (fileSize <= 0)  throw std::runtime_error("Empty texture file " + job.fileName);
+            std::vector<char> fileData(static_cast<size_t>(fileSize));
+            file.seekg(0, std::ios::beg);
+            file.read(fileData.data(), fileSize);
+            if (file.fail())  throw std::runtime_error("Error reading texture " + job.fileName);
+
+            if (!gRenderDevice->LoadTextureFromMemory(job.fileName, fileData.data(), fileData.size(),
+                                                      job.texture->GetSpecularMap(), job.texture->GetSpecularMapSRV(),
+                                                      &job.mipSource))
+            {
+                throw std::runtime_error("Error creating texture " + job.fileName);
+            }
+        }
+    }
+    catch (std::exception& e)
+    {
+        job.error = e.what();
+    }
+
+    job.loadTime = timer.GetTime();
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Completion
+//--------------------------------------------------------------------------------------
+
+bool CAssetLoader::Finish()
+{
+    mPool.Wait();
+
+    mErrors.clear();
+    mTimings.clear();
+    for (auto& job : mJobs)
+    {
+        Timer timer;
+        timer.Reset();
+
+        // Device objects are only created for assets that loaded on their worker
+        bool fromCache = false;
+        SVertexCacheStats cacheStatsImported, cacheStatsOptimised;
+        float importTime = 0, cookTime = 0, mapTime = 0;
+        if (job.mesh != nullptr)
+        {
+            *job.mesh = nullptr;
+            if (job.error.empty())
+            {
+                try
+                {
+                    *job.mesh = new Mesh(job.fileName, *job.meshSource);
+                    fromCache = job.meshSource->fromCache;
+                    cacheStatsImported  = job.meshSource->data.cacheStatsImported;
+                    cacheStatsOptimised = job.meshSource->data.cacheStatsOptimised;
+                    importTime = job.meshSource->importTime;
+                    cookTime   = job.meshSource->cookTime;
+                    mapTime    = job.meshSource->mapTime;
+                }
+                catch (std::exception& e)
+                {
+                    job.error = e.what();
+                }
+            }
+            job.meshSource.reset(); // Release the mapping or CPU-side vertices
+        }
+        else if (job.mipSource != nullptr)
+        {
+            // Textures were created on the worker, only the mip-maps need the context
+            gRenderContext->GenerateMips(job.mipSource, *job.texture->GetSpecularMap(), *job.texture->GetSpecularMapSRV());
+            gRenderDevice->Release(job.mipSource);
+            job.mipSource = nullptr;
+        }
+
+        if (!job.error.empty())  mErrors += job.error + "\n";
+        mTimings.push_back({ job.fileName, job.loadTime, timer.GetTime(), job.worker, fromCache, job.error.empty(),
+                             cacheStatsImported, cacheStatsOptimised, importTime, cookTime, mapTime });
+    }
+    mJobs.clear();
+
+    mTotalTime = mTimer.GetTime();
+    return mErrors.empty();
+}
+
+
+void CAssetLoader::WriteReport(std::ostream& out)
+{
+    float totalLoad = 0, totalCreate = 0;
+    float totalCook = 0, totalMap = 0; // Meshes imported and cooked this run, and the cooked file mapping times of all meshes
+    unsigned int numCooked = 0, numMapped = 0;
+    out << "Asset loading on " << NumThreads() << " threads\n";
+    out << std::fixed << std::setprecision(2);
+    for (auto& timing : mTimings)
+    {
+        out << std::left << std::setw(32) << timing.fileName << std::right
+            << " load "   << std::setw(8) << timing.loadTime   * 1000 << "ms"
+            << " create " << std::setw(8) << timing.createTime * 1000 << "ms"
+            << " worker " << timing.worker
+            << (timing.fromCache ? " cooked" : "") << (timing.succeeded ? "" : " FAILED") << "\n";
+        if (timing.cacheStatsOptimised.triangles > 0)
+        {
+            out << "    " << timing.cacheStatsOptimised.triangles << " triangles, " << timing.cacheStatsOptimised.vertices << " vertices,"
+                << " ACMR " << timing.cacheStatsImported.ACMR() << " -> " << timing.cacheStatsOptimised.ACMR()
+                << " ATVR " << timing.cacheStatsImported.ATVR() << " -> " << timing.cacheStatsOptimised.ATVR() << "\n";
+        }
+        if (!timing.fromCache && timing.importTime > 0)
+        {
+            out << "    cold: import " << timing.importTime * 1000 << "ms, cook " << timing.cookTime * 1000 << "ms;"
+                << " warm: map " << timing.mapTime * 1000 << "ms\n";
+            totalCook += timing.importTime + timing.cookTime;
+            ++numCooked;
+        }
+        if (timing.mapTime > 0)
+        {
+            totalMap += timing.mapTime;
+            ++numMapped;
+        }
+        totalLoad   += timing.loadTime;
+        totalCreate += timing.createTime;
+    }
+    out << "Sum of load times " << totalLoad * 1000 << "ms, create times " << totalCreate * 1000
+        << "ms, total elapsed " << mTotalTime * 1000 << "ms\n";
+    out << "Meshes imported and cooked: " << numCooked << " in " << totalCook * 1000 << "ms, cooked files mapped: "
+        << numMapped << " in " << totalMap * 1000 << "ms\n";
+}
@@ -0,0 +1,111 @@
+//--------------------------------------------------------------------------------------
+// Parallel loading of meshes and textures
+//--------------------------------------------------------------------------------------
+// Each asset added to the loader becomes a job on a pool of worker threads, which does the CPU-side work: reading
+// the file, importing or memory-mapping the mesh (see MeshCache.h) and building its vertices. Textures are also
+// decoded and created on the workers, as that only needs the device, which is free-threaded. Finish runs on the
+// thread that owns the context and does the rest: creating the mesh objects and generating texture mip-maps.
+//
+// A failed asset doesn't stop the others loading, Finish returns every error together. The time taken by each
+// asset on its worker and on the owning thread is recorded and can be written out as a report.
+
+#ifndef _ASSET_LOADER_H_INCLUDED_
+#define _ASSET_LOADER_H_INCLUDED_
+
+#include "Common.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+#include "MeshOptimiser.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <ostream>
+
+class Mesh;
+class CTexture;
+struct SMeshSource;
+
+
+class CAssetLoader
+{
+public:
+    // Uses the given number of worker threads, 0 for one per hardware thread
+    CAssetLoader(unsigned int numThreads = 0);
+    ~CAssetLoader();
+
+    // Queue a mesh to load, the mesh pointer is set by Finish (nullptr if the mesh failed to load). Loading on a
+    // worker starts immediately
+    void AddMesh(Mesh** mesh, const std::string& fileName, bool requireTangents = false);
+
+    // Queue a texture to load into the given texture object, which is filled in by Finish
+    void AddTexture(CTexture* texture, const std::string& fileName);
+
+    // Wait for the workers then finish the assets on this thread, which must own the context. Returns false if any
+    // asset failed
+    bool Finish();
+
+    // All error messages from the last Finish, one per line
+    const std::string& Errors()  { return mErrors; }
+
+
+    //-------------------------------------
+    // Statistics
+    //-------------------------------------
+
+    struct SAssetTiming
+    {
+        std::string fileName;
+        float       loadTime;   // Seconds spent on the worker thread (reading, importing, building vertices, decoding)
+        float       createTime; // Seconds spent in Finish (creating mesh objects, generating mip-maps)
+        int         worker;     // Index of the worker thread that loaded the asset
+        bool        fromCache;  // Mesh loaded from the cooked mesh cache
+        bool        succeeded;
+        SVertexCacheStats cacheStatsImported;  // Meshes only, see MeshOptimiser.h
+        SVertexCacheStats cacheStatsOptimised;
+        float       importTime; // Meshes only, seconds spent on each step of loadTime (see SMeshSource). Import and cook
+        float       cookTime;   // are 0 for meshes from the cache
+        float       mapTime;
+    };
+    const std::vector<SAssetTiming>& Timings()  { return mTimings; }
+
+    // Seconds from the loader's creation to the end of Finish
+    float TotalTime()  { return mTotalTime; }
+
+    unsigned int NumThreads()  { return mPool.NumThreads(); }
+
+    // Write a table of the asset timings, with the vertex cache statistics of each mesh. The time to import and cook
+    // each mesh (a cold start) is compared with the time to map its cooked file (a warm start)
+    void WriteReport(std::ostream& out);
+
+
+private:
+    struct SJob
+    {
+        std::string fileName;
+        Mesh**      mesh    = nullptr; // One of these is set depending on the type of asset
+        CTexture*   texture = nullptr;
+        bool        requireTangents = false;
+
+        // Results from the worker
+        std::unique_ptr<SMeshSource> meshSource;
+        ID3D11Resource*              mipSource = nullptr; // Decoded texture image waiting for GenerateMips
+        std::string                  error;
+        float                        loadTime = 0;
+        int                          worker   = -1;
+    };
+
+    void LoadJob(SJob& job); // Runs on a worker thread
+
+    Timer             mTimer;
+    std::deque<SJob>  mJobs; // Deque so jobs don't move while workers are using them. Declared before the pool
+    CThreadPool       mPool; // so the workers are stopped before the jobs are destroyed
+
+    std::string               mErrors;
+    std::vector<SAssetTiming> mTimings;
+    float                     mTotalTime = 0;
+};
+
+
+#endif //_ASSET_LOADER_H_INCLUDED_
@@ -0,0 +1,28 @@
+//--------------------------------------------------------------------------------------
+// Light Model Vertex Shader - Instanced
+//--------------------------------------------------------------------------------------
+// Basic matrix transformations only, taking the world matrix from the instance data
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+SimplePixelShaderInput main(BasicInstancedVertex modelVertex)
+{
+    SimplePixelShaderInput output; // This is the data the pixel shader requires from this vertex shader
+
+    float4x4 worldMatrix = InstanceWorldMatrix(modelVertex.world0, modelVertex.world1, modelVertex.world2, modelVertex.world3);
+
+    float4 modelPosition = float4(modelVertex.position, 1); 
+
+    float4 worldPosition     = mul(worldMatrix,       modelPosition);
+    float4 viewPosition      = mul(gViewMatrix,       worldPosition);
+    output.projectedPosition = mul(gProjectionMatrix, viewPosition);
+
+    output.uv = modelVertex.uv;
+
+    return output; // Ouput data sent down the pipeline (to the pixel shader)
+}
@@ -56,14 +56,14 @@ void CLight::SetPosition(const CVector3 &pos)
 	mpBody->SetPosition(pos);
 }
 
-const CVector3& CLight::GetFacing() const
+CVector3 CLight::GetFacing() const
 {
 	return Normalise(mpBody->WorldMatrix().GetZAxis());
 }
 
-const CVector3& CLight::GetPosition() const
+CVector3 CLight::GetPosition() const
 {
-	return mpBody->Position();
+	return mpBody->WorldPosition();
 }
 
 //Return a constant reference to the colour.
@@ -78,6 +78,15 @@ float CLight::GetStrength() const
 	return mStrength;
 }
 
+//Light falls off with 1/distance, so the range is where the brightest colour channel drops to the cutoff level.
+float CLight::GetRange() const
+{
+	const float cutoff = 0.02f;
+	float brightest = mColour.x > mColour.y ? mColour.x : mColour.y;
+	brightest = brightest > mColour.z ? brightest : mColour.z;
+	return mStrength * brightest / cutoff;
+}
+
 void CLight::Render()
 {
 	mpBody->Render();
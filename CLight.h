@@ -25,12 +25,17 @@ public:
 	void Render();
 	void Release();
 
+	Model* GetModel() { return mpBody; }
+
 	void SetPosition(const CVector3 &pos);
 
-	const CVector3& GetFacing() const;
-	const CVector3& GetPosition() const;
+	// World space, also for lights attached to something (see GetModel)
+	CVector3 GetFacing() const;
+	CVector3 GetPosition() const;
 	const CVector3& GetColour() const;
 	float GetStrength() const;
+	//Distance beyond which the light is too dim to matter. Shaders fade the light out to nothing at this range
+	float GetRange() const;
 	~CLight();
 };
 
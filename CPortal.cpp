@@ -1,32 +1,26 @@
 #include "CPortal.h"
+#include "Mesh.h"
+#include "SceneFile.h"
 
 
 
 CPortal::CPortal(Mesh* mesh, const CVector3 & startingPos, const CVector3 &startingRotation)
 {
 	mpBody = new Model(mesh, startingPos, startingRotation);
-	mCamera = new Camera(startingPos + (-5 * Normalise(mpBody->WorldMatrix().GetZAxis())),
-						 startingRotation + CVector3{ ToRadians(20.0f), ToRadians(345.0f), 0 });
-}
 
+	// The camera sits behind the portal looking slightly down and across it, and follows the portal as it moves
+	mCamera = new Camera({ 0, 0, -5 }, { ToRadians(20.0f), ToRadians(345.0f), 0 });
+	mCamera->AttachTo(Model::Transforms(), mpBody->Transform());
 
-CPortal::~CPortal()
-{
+	// The portal's surface is the body's z = 0 plane, facing +z. Everything between the camera and the surface is
+	// clipped, including the portal itself (hence the plane is just in front of it). The portal camera's frustum has
+	// the same near plane, so frustum culling also skips every model entirely behind the surface
+	mCamera->SetObliqueNearPlane({ 0, 0, SurfaceClipOffset }, { 0, 0, 1 });
 }
 
-ID3D11Texture2D** CPortal::GetPortalTexture()
-{
-	return &mTexture;
-}
 
-ID3D11ShaderResourceView** CPortal::GetPortalTextureSRV()
-{
-	return &mTextureSRV;
-}
-
-ID3D11RenderTargetView** CPortal::GetPortalRenderTarget()
+CPortal::~CPortal()
 {
-	return &mRenderTarget;
 }
 
 Camera* CPortal::GetCamera()
@@ -57,9 +51,7 @@ void CPortal::SetCamRotation(const CVector3& rotation)
 
 void CPortal::Release()
 {
-	if (mTexture) mTexture->Release();
-	if (mTextureSRV) mTextureSRV->Release();
-	if (mRenderTarget) mRenderTarget->Release();
+	mTarget = nullptr; // Released by the pool it came from
 	delete mCamera;
 	mCamera = nullptr;
 	delete mpBody;
@@ -72,33 +64,66 @@ void CPortal::Render()
 	mpBody->Render();
 }
 
-void CPortal::Control(float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,
-					  KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward)
+bool CPortal::IsInFrustum(const CFrustum& frustum)
 {
-	mpBody->Control(frameTime, turnUp, turnDown, turnLeft, turnRight, turnCW, turnCCW, moveForward, moveBackward);
+	return mpBody->IsInFrustum(frustum);
 }
 
-bool CPortal::CreateTexture(const D3D11_TEXTURE2D_DESC &portalDesc, const D3D11_SHADER_RESOURCE_VIEW_DESC &srDesc)
+float CPortal::ScreenArea(const CMatrix4x4& viewProjectionMatrix, CVector2* screenSize)
 {
-	if (FAILED(gD3DDevice->CreateTexture2D(&portalDesc, NULL, &mTexture)))
+	CMatrix4x4 m = mpBody->WorldMatrix() * viewProjectionMatrix;
+	const CVector3& boxMin = mpBody->GetMesh()->BoundsMin();
+	const CVector3& boxMax = mpBody->GetMesh()->BoundsMax();
+	float minX = 1, maxX = -1, minY = 1, maxY = -1;
+	for (int corner = 0; corner < 8; ++corner)
 	{
-		gLastError = "Error creating portal texture";
-		return false;
+		CVector3 p = { (corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z };
+		float clipZ = p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32;
+		if (clipZ < 0)
+		{
+			if (screenSize)  *screenSize = { 1, 1 };
+			return 1;
+		}
+		float invW = 1 / (p.x * m.e03 + p.y * m.e13 + p.z * m.e23 + m.e33);
+		float x = (p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30) * invW;
+		float y = (p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31) * invW;
+		if (x < minX)  minX = x;
+		if (x > maxX)  maxX = x;
+		if (y < minY)  minY = y;
+		if (y > maxY)  maxY = y;
 	}
 
-	// We created the portal texture above, now we get a "view" of it as a render target, i.e. get a special pointer to the texture that
-	// we use when rendering to it (see RenderScene function below)
-	if (FAILED(gD3DDevice->CreateRenderTargetView(mTexture, NULL, &mRenderTarget)))
+	// The screen is -1 to 1 both ways, an area of 4
+	float width  = ((maxX < 1.0f) ? maxX : 1.0f) - ((minX > -1.0f) ? minX : -1.0f);
+	float height = ((maxY < 1.0f) ? maxY : 1.0f) - ((minY > -1.0f) ? minY : -1.0f);
+	if (width <= 0 || height <= 0)
 	{
-		gLastError = "Error creating portal render target view";
-		return false;
+		if (screenSize)  *screenSize = { 0, 0 };
+		return 0;
 	}
+	if (screenSize)  *screenSize = { width * 0.5f, height * 0.5f };
+	return width * height * 0.25f;
+}
 
-	if (FAILED(gD3DDevice->CreateShaderResourceView(mTexture, &srDesc, &mTextureSRV)))
-	{
-		gLastError = "Error creating portal shader resource view";
-		return false;
-	}
+bool CPortal::NeedsUpdate(float screenArea)
+{
+	++mFramesSinceUpdate;
+	if (screenArea <= 0)  return false;
+	if (!mHasContent)  return true;
+	if (screenArea < BarelyVisibleArea)  return false;
+	if (mUpdateInterval == ScenePortal_OnDemand)  return mUpdateRequested;
+	return mFramesSinceUpdate >= mUpdateInterval;
+}
+
+void CPortal::Updated()
+{
+	mFramesSinceUpdate = 0;
+	mUpdateRequested = false;
+	mHasContent = true;
+}
 
-	return true;
-}
\ No newline at end of file
+void CPortal::Control(float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,
+					  KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward)
+{
+	mpBody->Control(frameTime, turnUp, turnDown, turnLeft, turnRight, turnCW, turnCCW, moveForward, moveBackward);
+}
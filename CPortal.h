@@ -2,6 +2,7 @@
 #include "Model.h"
 #include "CVector3.h"
 #include "Camera.h"
+#include "PortalTargets.h"
 
 class CPortal
 {
@@ -9,26 +10,55 @@ private:
 	Model* mpBody;
 	Camera* mCamera;
 
-	ID3D11Texture2D*          mTexture = nullptr; // This object represents the memory used by the texture on the GPU
-	ID3D11ShaderResourceView* mTextureSRV = nullptr; // This object is used to give shaders access to the texture above (SRV = shader resource view)
-	ID3D11RenderTargetView* mRenderTarget = nullptr; // This object is used when we want to render to the texture above
+	SPortalTarget* mTarget = nullptr; // Texture the portal's view is rendered to, from the scene's pool (see PortalTargets.h)
+
+	// Update policy, see NeedsUpdate
+	unsigned int mUpdateInterval = 1;
+	unsigned int mFramesSinceUpdate = 0;
+	bool mUpdateRequested = false;
+	bool mHasContent = false; // False until the texture is first rendered
 
 public:
 	CPortal(Mesh* mesh, const CVector3 &startingPos = { 0,0,0 }, const CVector3 & startingRotation = { 0,0,0 });
 	~CPortal();
 	
-	ID3D11Texture2D** GetPortalTexture();
-	ID3D11ShaderResourceView** GetPortalTextureSRV();
-	ID3D11RenderTargetView** GetPortalRenderTarget();
+	// The portal's render target, null until it is first given one
+	SPortalTarget* GetTarget() { return mTarget; }
+	void SetTarget(SPortalTarget* target) { mTarget = target; }
+	ID3D11ShaderResourceView* GetPortalTextureSRV() { return mTarget ? mTarget->textureSRV : nullptr; }
 	
 	Camera* GetCamera();
+	Model* GetModel() { return mpBody; }
 	void SetPosition(const CVector3& pos);
 	void SetRotation(const CVector3& rotation);
 	void SetCamPosition(const CVector3& pos);
 	void SetCamRotation(const CVector3& rotation);
-	bool CreateTexture(const D3D11_TEXTURE2D_DESC &portalDesc, const D3D11_SHADER_RESOURCE_VIEW_DESC &srDesc);
 	void Release();
 	void Render();
+	bool IsInFrustum(const CFrustum& frustum);
+
+	// Fraction of the screen covered by the portal's bounding box for the given camera matrices, clipped to the
+	// screen. Treated as the whole screen if the box crosses the camera's near plane. Optionally also returns the
+	// width and height of the box on screen, as fractions of the screen's
+	float ScreenArea(const CMatrix4x4& viewProjectionMatrix, CVector2* screenSize = nullptr);
+
+	// Frames between updates of the portal's texture: 1 for every frame, or ScenePortal_OnDemand (0) to only update
+	// after RequestUpdate, for portals whose view rarely changes
+	void SetUpdateInterval(unsigned int frames) { mUpdateInterval = frames; }
+	void RequestUpdate() { mUpdateRequested = true; }
+
+	// Call once a frame with the screen area the main camera sees of the portal (0 if it can't see it at all).
+	// Returns true if the texture should be rendered this frame. Portals that can't be seen, or that cover only a
+	// sliver of the screen, keep their last texture. Otherwise the update interval decides. Call Updated after rendering
+	bool NeedsUpdate(float screenArea);
+	void Updated();
+	bool HasContent() { return mHasContent; }
+
+	// Portals covering less than this fraction of the screen keep their last texture (once they have one)
+	static constexpr float BarelyVisibleArea = 0.002f;
+
+	// Distance in front of the portal's surface of its camera's oblique near plane
+	static constexpr float SurfaceClipOffset = 0.01f;
 	void Control(float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,
 				 KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward);
 
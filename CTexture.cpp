@@ -24,6 +24,6 @@ ID3D11ShaderResourceView** CTexture::GetSpecularMapSRV()
 
 void CTexture::Release()
 {
-	if (mSpecularMapSRV)    mSpecularMapSRV->Release();
-	if (mSpecularMap)       mSpecularMap->Release();
+	if (mSpecularMapSRV)    gRenderDevice->Release(mSpecularMapSRV);
+	if (mSpecularMap)       gRenderDevice->Release(mSpecularMap);
 }
\ No newline at end of file
@@ -59,7 +59,9 @@ void Camera::Control(float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode
 void Camera::UpdateMatrices()
 {
     // "World" matrix for the camera - treat it like a model at first
-    mWorldMatrix = MatrixRotationZ(mRotation.z) * MatrixRotationX(mRotation.x) * MatrixRotationY(mRotation.y) * MatrixTranslation(mPosition);
+    CMatrix4x4 localMatrix = MatrixFromTRS(mPosition, mRotation, { 1, 1, 1 });
+    mWorldMatrix = localMatrix;
+    if (mParentTransforms != nullptr)  mWorldMatrix = mWorldMatrix * mParentTransforms->WorldMatrix(mParent);
 
     // View matrix is the usual matrix used for the camera in shaders, it is the inverse of the world matrix (see lectures)
     mViewMatrix = InverseAffine(mWorldMatrix);
@@ -76,6 +78,34 @@ void Camera::UpdateMatrices()
                                       0.0f,   0.0f, scaleZa,   1.0f,
                                       0.0f,   0.0f, scaleZb,   0.0f };
 
+    // Oblique near plane (see Eric Lengyel, "Oblique View Frustum Depth Projection and Clipping"). The depth column of
+    // the projection is replaced by the view space plane, so clip space z is 0 on the plane and negative behind it.
+    // The plane is scaled so the far plane still passes through the far corner of the frustum on the plane's side
+    if (mProjection == EProjection::ObliqueNear)
+    {
+        // The plane in view space. The view matrix undoes the parent's world matrix then the camera's local matrix, so
+        // only the local matrix is needed to bring the plane from the parent's space: the normal along each of the
+        // camera's axes, and the camera's distance from the plane
+        float c[4] = { Dot(localMatrix.GetXAxis(), mNearPlaneNormal),
+                       Dot(localMatrix.GetYAxis(), mNearPlaneNormal),
+                       Dot(localMatrix.GetZAxis(), mNearPlaneNormal),
+                       Dot(localMatrix.GetPosition() - mNearPlanePoint, mNearPlaneNormal) };
+
+        // Only usable if the camera (the view space origin) is behind the plane
+        if (c[3] < 0)
+        {
+            // View space point of the far corner of the frustum on the plane's side, scale the plane so it projects to depth 1
+            float qx = ((c[0] > 0) ? 1.0f : (c[0] < 0) ? -1.0f : 0.0f) / scaleX;
+            float qy = ((c[1] > 0) ? 1.0f : (c[1] < 0) ? -1.0f : 0.0f) / scaleY;
+            float qw = (1.0f - scaleZa) / scaleZb;
+            float scale = 1.0f / (c[0] * qx + c[1] * qy + c[2] + c[3] * qw);
+            mProjectionMatrix.e02 = c[0] * scale;
+            mProjectionMatrix.e12 = c[1] * scale;
+            mProjectionMatrix.e22 = c[2] * scale;
+            mProjectionMatrix.e32 = c[3] * scale;
+        }
+    }
+
     // The view-projection matrix combines the two matrices usually used for the camera into one, which can save a multiply in the shaders (optional)
     mViewProjectionMatrix = mViewMatrix * mProjectionMatrix;
 }
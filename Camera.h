@@ -2,12 +2,19 @@
 // Class encapsulating a camera
 //--------------------------------------------------------------------------------------
 // Holds position, rotation, near/far clip and field of view. These to a view and projection matrices as required
+//
+// The projection can instead use an oblique near plane: any plane in front of the camera replaces the near clip plane,
+// so everything on the camera's side of it is clipped by the GPU. Portal cameras use the plane of the portal, so
+// nothing between the camera and the portal is drawn. Only the projection's depth is changed, so x, y and w (the view
+// depth) are as for the normal projection. Depth precision suffers the more the plane is tilted from the view
+// direction, and the far plane is tilted too, so it cuts closer in some directions than the far clip distance
 
 #include "Common.h"
 #include "CVector3.h"
 #include "CMatrix4x4.h"
 #include "MathHelpers.h"
 #include "Input.h"
+#include "TransformSystem.h"
 
 #ifndef _CAMERA_H_INCLUDED_
 #define _CAMERA_H_INCLUDED_
@@ -33,11 +40,45 @@ public:
 	              KeyCode moveForward, KeyCode moveBackward, KeyCode moveLeft, KeyCode moveRight);
 
 
+	// Attach the camera to an entry in a transform system (e.g. a model's), after which its position and rotation
+	// are relative to that entry and it follows it. An invalid handle detaches it. Control moves an attached camera
+	// along its world axes, so is best kept for unattached cameras
+	void AttachTo(CTransformSystem& transforms, STransformHandle parent)
+	{
+		mParentTransforms = parent.Valid() ? &transforms : nullptr;
+		mParent = parent;
+	}
+
+
+	//-------------------------------------
+	// Projection
+	//-------------------------------------
+
+	enum class EProjection
+	{
+		Perspective, // Near and far clip planes at the clip distances
+		ObliqueNear, // The near clip plane is the plane given to SetObliqueNearPlane
+	};
+
+	// Use an oblique near plane through the given point with the given normal, relative to the parent for attached
+	// cameras. Everything on the side the normal points away from is clipped. If the camera isn't on that side (i.e.
+	// the plane isn't in front of it) the normal perspective projection is used until it is
+	void SetObliqueNearPlane(const CVector3& point, const CVector3& normal)
+	{
+		mProjection = EProjection::ObliqueNear;
+		mNearPlanePoint = point;
+		mNearPlaneNormal = normal;
+	}
+	void SetPerspective()  { mProjection = EProjection::Perspective; }
+
+	EProjection Projection()  { return mProjection; }
+
+
 	//-------------------------------------
 	// Data access
 	//-------------------------------------
 
-	// Getters / setters
+	// Getters / setters. These are relative to the parent for attached cameras
 	CVector3 Position()  { return mPosition; }
 	CVector3 Rotation()  { return mRotation;	}
 	void SetPosition(CVector3 position)  { mPosition = position; }
@@ -51,6 +92,8 @@ public:
 	void SetNearClip(float nearClip)  { mNearClip = nearClip; }
 	void SetFarClip (float farClip )  { mFarClip  = farClip;  }
 
+	CVector3 WorldPosition()  { UpdateMatrices(); return mWorldMatrix.GetPosition(); }
+
 	// Read only access to camera matrices, updated on request from position, rotation and camera settings
 	CMatrix4x4 ViewMatrix()            { UpdateMatrices(); return mViewMatrix;           }
 	CMatrix4x4 ProjectionMatrix()      { UpdateMatrices(); return mProjectionMatrix;     }
@@ -68,6 +111,10 @@ private:
 	CVector3 mPosition;
 	CVector3 mRotation;
 
+	// Transform the camera is attached to, if any
+	CTransformSystem* mParentTransforms = nullptr;
+	STransformHandle  mParent;
+
 	// Camera settings: field of view, aspect ratio, near and far clip plane distances.
 	// Note that the FOVx angle is measured in radians (radians = degrees * PI/180) from left to right of screen
 	float mFOVx;
@@ -75,6 +122,11 @@ private:
 	float mNearClip;
 	float mFarClip;
 
+	// Projection mode and the oblique near plane, relative to the parent
+	EProjection mProjection = EProjection::Perspective;
+	CVector3    mNearPlanePoint;
+	CVector3    mNearPlaneNormal;
+
 	// Current view, projection and combined view-projection matrices (DirectX matrix type)
 	CMatrix4x4 mWorldMatrix; // Easiest to treat the camera like a model and give it a "world" matrix...
 	CMatrix4x4 mViewMatrix;  // ...then the view matrix used in the shaders is the inverse of its world matrix
@@ -4,12 +4,13 @@
 #ifndef _COMMON_H_INCLUDED_
 #define _COMMON_H_INCLUDED_
 
-#include <windows.h>
-#include <d3d11.h>
+#include "RenderTypes.h" // Windows and Direct3D types, or enough of them to build without the Windows SDK
 #include <string>
 
+#include "CVector2.h"
 #include "CVector3.h"
 #include "CMatrix4x4.h"
+#include "RenderBackend.h"
 
 
 //--------------------------------------------------------------------------------------
@@ -28,10 +29,13 @@ extern int gViewportWidth;
 extern int gViewportHeight;
 
 
-// Important DirectX variables
+// Important DirectX variables. The Direct3D device, context and swap chain are only used during setup, all other
+// code renders through the render backend below so it can also run headless
 extern ID3D11Device*           gD3DDevice;
 extern ID3D11DeviceContext*    gD3DContext;
 extern IDXGISwapChain*         gSwapChain;
+extern IRenderDevice*          gRenderDevice;            // Creates and releases GPU resources
+extern IRenderContext*         gRenderContext;           // Sets GPU state and draws
 extern ID3D11RenderTargetView* gBackBufferRenderTarget;  // Back buffer is where we render to
 extern ID3D11DepthStencilView* gDepthStencil;            // The depth buffer contains a depth for each back buffer pixel
 
@@ -44,10 +48,11 @@ extern const float MOVEMENT_SPEED;
 // when a serious error occurs
 extern std::string gLastError;
 
+// Lights are sent to the shaders in structured buffers (see LightClusters.h). A light has no effect beyond its range
 struct PointLight
 {
 	CVector3 position;
-	float padding1;
+	float range;
 	CVector3 colour;
 	float padding2;
 };
@@ -55,13 +60,15 @@ struct PointLight
 struct Spotlight
 {
 	CVector3 position;
-	float padding1;
+	float range;
 	CVector3 colour;
 	float padding2;
 	CVector3 facing;
 	float cosHalfAngle;
 	CMatrix4x4 viewMatrix;
 	CMatrix4x4 projectionMatrix;
+	CVector2 shadowAtlasScale;  // Position of the light's tile in the shadow atlas, see CSceneManager::UpdateShadowAtlas
+	CVector2 shadowAtlasOffset;
 };
 
 
@@ -74,27 +81,41 @@ struct Spotlight
 // We hold them together in a structure and send the whole thing to a "constant buffer" on the GPU each frame when
 // we have finished updating the scene. There is a structure in the shader code that exactly matches this one
 struct PerFrameConstants
+{
+    CVector3   ambientColour;
+    float      specularPower;
+
+	float wiggle;
+	unsigned int clusterCountX; // Number of light clusters across the screen and in depth
+	unsigned int clusterCountY;
+	unsigned int clusterCountZ;
+};
+
+extern PerFrameConstants gPerFrameConstants;      // This variable holds the CPU-side constant buffer described above
+extern ID3D11Buffer*     gPerFrameConstantBuffer; // This variable controls the GPU-side constant buffer matching to the above structure
+
+
+
+// Data for one view of the scene - the main camera, a portal camera or a light rendering its shadow map. A frame
+// renders several views, so this is updated several times per frame, but only holds what differs between them
+struct PerViewConstants
 {
     // These are the matrices used to position the camera
     CMatrix4x4 viewMatrix;
     CMatrix4x4 projectionMatrix;
     CMatrix4x4 viewProjectionMatrix; // The above two matrices multiplied together to combine their effects
 
-    CVector3   ambientColour;
-    float      specularPower;
-
     CVector3   cameraPosition;
-    float      padding5;
+	float clusterDepthScale; // Depth slice of the light clusters at view depth z is log(z) * scale + bias, see LightClusters.h
 
-	CVector3 lightStackTops; //Point light, Spot Light, Directional Light
-	float wiggle;
-
-	PointLight pointLights[3];
-	Spotlight spotlights[2];
+	float clusterDepthBias;
+	float padding5;
+	float padding6;
+	float padding7;
 };
 
-extern PerFrameConstants gPerFrameConstants;      // This variable holds the CPU-side constant buffer described above
-extern ID3D11Buffer*     gPerFrameConstantBuffer; // This variable controls the GPU-side constant buffer matching to the above structure
+extern PerViewConstants gPerViewConstants;      // This variable holds the CPU-side constant buffer described above
+extern ID3D11Buffer*    gPerViewConstantBuffer; // This variable controls the GPU-side constant buffer matching to the above structure
 
 
 
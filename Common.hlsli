@@ -50,10 +50,11 @@ struct NormalMappingPixelShaderInput
 
 
 
+// Lights are read from structured buffers (below). A light has no effect beyond its range
 struct PointLight
 {
     float3 position;
-    float padding1;
+    float range;
     float3 colour;
     float padding2;
 };
@@ -61,13 +62,15 @@ struct PointLight
 struct Spotlight
 {
     float3 position;
-    float padding1;
+    float range;
     float3 colour;
     float lightConeAngle;
     float3 facing;
     float cosHalfAngle;
     float4x4 viewMatrix;
     float4x4 projectionMatrix;
+    float2 shadowAtlasScale;  // Position of the light's tile in the shadow atlas: atlas UV = offset + shadow map UV * scale
+    float2 shadowAtlasOffset; // A scale of 0 means the light has no tile
 };
 
 // This structure is similar to the one above but for the light models, which aren't themselves lit
@@ -87,6 +90,48 @@ struct TangentVertex
     float2 uv : uv;
 };
 
+// Instanced versions of the vertex structures above. Each instance of a mesh drawn with DrawIndexedInstanced also
+// reads its own world matrix from a second vertex buffer, one row per element (see Mesh::SetInstancedBuffers)
+struct BasicInstancedVertex
+{
+    float3 position : position;
+    float3 normal   : normal;
+    float2 uv       : uv;
+
+    float4 world0 : instanceWorld0;
+    float4 world1 : instanceWorld1;
+    float4 world2 : instanceWorld2;
+    float4 world3 : instanceWorld3;
+};
+
+struct TangentInstancedVertex
+{
+    float3 position : position;
+    float3 normal : normal;
+    float3 tangent : tangent;
+    float2 uv : uv;
+
+    float4 world0 : instanceWorld0;
+    float4 world1 : instanceWorld1;
+    float4 world2 : instanceWorld2;
+    float4 world3 : instanceWorld3;
+};
+
+// Rebuild an instance world matrix from its rows. The C++ matrices arrive transposed (as gWorldMatrix does), so
+// the result is used in the same way: mul(worldMatrix, modelPosition)
+float4x4 InstanceWorldMatrix(float4 world0, float4 world1, float4 world2, float4 world3)
+{
+    return transpose(float4x4(world0, world1, world2, world3));
+}
+
+// Depth held in a spotlight's tile of the shadow atlas at the given UV in the light's own shadow map. The UV is
+// clamped to the tile so a neighbouring light's tile is never read. Lights without a tile cast no shadows
+float SpotlightShadowDepth(Texture2D shadowAtlas, SamplerState shadowSampler, Spotlight light, float2 shadowMapUV)
+{
+    if (light.shadowAtlasScale.x == 0)  return 1.0f;
+    return shadowAtlas.SampleLevel(shadowSampler, light.shadowAtlasOffset + saturate(shadowMapUV) * light.shadowAtlasScale, 0).r;
+}
+
 //--------------------------------------------------------------------------------------
 // Constant Buffers
 //--------------------------------------------------------------------------------------
@@ -95,25 +140,31 @@ struct TangentVertex
 // They are called constants but that only means they are constant for the duration of a single GPU draw call.
 // These "constants" correspond to variables in C++ that we will change per-model, or per-frame etc.
 
-// In this exercise the matrices used to position the camera are updated from C++ to GPU every frame along with lighting information
+// Lighting information that is the same for every view of the scene is updated from C++ to GPU once per frame
 // These variables must match exactly the gPerFrameConstants structure in Scene.cpp
 cbuffer PerFrameConstants : register(b0) // The b0 gives this constant buffer the number 0 - used in the C++ code
+{
+    float3   gAmbientColour;
+    float    gSpecularPower;
+
+    float gWiggle; // Used for wiggle.
+    uint3 gClusterCounts; // Number of light clusters across the screen and in depth
+}
+
+// The matrices used to position the camera are updated once for each view rendered (main camera, portal cameras and
+// the lights' shadow maps)
+// These variables must match exactly the gPerViewConstants structure in Scene.cpp
+cbuffer PerViewConstants : register(b2) // The b2 gives this constant buffer the number 2 - used in the C++ code
 {
     float4x4 gViewMatrix;
     float4x4 gProjectionMatrix;
     float4x4 gViewProjectionMatrix; // The above two matrices multiplied together to combine their effects
-    
-    float3   gAmbientColour;
-    float    gSpecularPower;
 
     float3   gCameraPosition;
-    float    padding5;
-    
-    float3 lightStackTops; //Point light, Spot Light, Directional Light
-    float gWiggle; // Used for wiggle.
-    
-    PointLight pointLights[3];
-    Spotlight spotlights[2];
+    float    gClusterDepthScale; // Depth slice of the light clusters at view depth z is log(z) * scale + bias
+
+    float    gClusterDepthBias;
+    float3   padding5;
 }
 // Note constant buffers are not structs: we don't use the name of the constant buffer, these are really just a collection of global variables (hence the 'g')
 
@@ -130,3 +181,50 @@ cbuffer PerModelConstants : register(b1) // The b1 gives this constant buffer th
     float3   gObjectColour;
     float    gWiggleStrength;  // How much the model wiggles.
 }
+
+
+//--------------------------------------------------------------------------------------
+// Clustered lighting
+//--------------------------------------------------------------------------------------
+
+// The view frustum is divided into clusters, each with a list of the lights that can reach it (see LightClusters.h).
+// Lit pixel shaders find the cluster of their pixel and only loop over its lights
+StructuredBuffer<PointLight> PointLights   : register(t6); // Every light in the scene
+StructuredBuffer<Spotlight>  Spotlights    : register(t7);
+StructuredBuffer<uint2>      LightClusters : register(t8); // First entry in the index list, then number of point lights | number of spotlights << 16
+StructuredBuffer<uint>       LightIndices  : register(t9); // The lights of each cluster, point lights first
+
+struct LightCluster
+{
+    uint firstLight;
+    uint numPointLights;
+    uint numSpotlights;
+};
+
+// Find the light cluster containing a world position. The point lights are indexed by LightIndices[firstLight + i],
+// the spotlights by LightIndices[firstLight + numPointLights + i]
+LightCluster FindLightCluster(float3 worldPosition)
+{
+    // Clusters are an even grid across the screen, and in depth get thicker with distance
+    float4 clipPosition = mul(gViewProjectionMatrix, float4(worldPosition, 1.0f));
+    float2 screenPosition = saturate(clipPosition.xy / clipPosition.w * 0.5f + 0.5f);
+    uint3 cell;
+    cell.xy = min((uint2)(screenPosition * gClusterCounts.xy), gClusterCounts.xy - 1);
+    cell.z  = (uint)clamp(log(clipPosition.w) * gClusterDepthScale + gClusterDepthBias, 0.0f, gClusterCounts.z - 1.0f);
+
+    uint2 cluster = LightClusters[(cell.z * gClusterCounts.y + cell.y) * gClusterCounts.x + cell.x];
+    LightCluster result;
+    result.firstLight     = cluster.x;
+    result.numPointLights = cluster.y & 0xFFFF;
+    result.numSpotlights  = cluster.y >> 16;
+    return result;
+}
+
+// Smooth fade of a light's strength to zero at its range, so lights can be left out of clusters beyond it
+float LightRangeFalloff(float distance, float range)
+{
+    float ratio = distance / range;
+    ratio *= ratio;
+    float fade = saturate(1.0f - ratio * ratio);
+    return fade * fade;
+}
@@ -0,0 +1,404 @@
+//--------------------------------------------------------------------------------------
+// Direct3D 11 render backend
+//--------------------------------------------------------------------------------------
+
+#include "D3D11RenderBackend.h"
+
+#include <WICTextureLoader.h>
+#include <DDSTextureLoader.h>
+#include <atlbase.h> // C-string to unicode conversion function CA2CT
+#include <d3dcompiler.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+
+//--------------------------------------------------------------------------------------
+// Device
+//--------------------------------------------------------------------------------------
+
+HRESULT CD3D11RenderDevice::CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Buffer** buffer)
+{
+    return mDevice->CreateBuffer(desc, initialData, buffer);
+}
+
+HRESULT CD3D11RenderDevice::CreateTexture2D(const D3D11_TEXTURE2D_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Texture2D** texture)
+{
+    return mDevice->CreateTexture2D(desc, initialData, texture);
+}
+
+
+HRESULT CD3D11RenderDevice::CreateShaderResourceView(ID3D11Resource* resource, const D3D11_SHADER_RESOURCE_VIEW_DESC* desc, ID3D11ShaderResourceView** view)
+{
+    return mDevice->CreateShaderResourceView(resource, desc, view);
+}
+
+HRESULT CD3D11RenderDevice::CreateRenderTargetView(ID3D11Resource* resource, const D3D11_RENDER_TARGET_VIEW_DESC* desc, ID3D11RenderTargetView** view)
+{
+    return mDevice->CreateRenderTargetView(resource, desc, view);
+}
+
+HRESULT CD3D11RenderDevice::CreateDepthStencilView(ID3D11Resource* resource, const D3D11_DEPTH_STENCIL_VIEW_DESC* desc, ID3D11DepthStencilView** view)
+{
+    return mDevice->CreateDepthStencilView(resource, desc, view);
+}
+
+
+HRESULT CD3D11RenderDevice::CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC* elements, UINT numElements,
+                                              const void* shaderByteCode, SIZE_T byteCodeLength, ID3D11InputLayout** layout)
+{
+    return mDevice->CreateInputLayout(elements, numElements, shaderByteCode, byteCodeLength, layout);
+}
+
+// Very advanced topic: When creating a vertex layout for geometry (see Mesh.cpp), you need the signature
+// (bytecode) of a shader that uses that vertex layout. This is an annoying requirement and tends to create
+// unnecessary coupling between shaders and vertex buffers.
+// This is a trick to simplify things - pass a vertex layout to this function and it will write and compile
+// a temporary shader to match. You don't need to know about the actual shaders in use in the app.
+// Release the signature (called a ID3DBlob!) after use. Returns nullptr on failure.
+static ID3DBlob* CreateSignatureForVertexLayout(const D3D11_INPUT_ELEMENT_DESC vertexLayout[], int numElements)
+{
+    std::string shaderSource = "float4 main(";
+    for (int elt = 0; elt < numElements; ++elt)
+    {
+        auto& format = vertexLayout[elt].Format;
+        // This list should be more complete for production use
+        if      (format == DXGI_FORMAT_R32G32B32A32_FLOAT) shaderSource += "float4";
+        else if (format == DXGI_FORMAT_R32G32B32_FLOAT)    shaderSource += "float3";
+        else if (format == DXGI_FORMAT_R32G32_FLOAT)       shaderSource += "float2";
+        else if (format == DXGI_FORMAT_R32_FLOAT)          shaderSource += "float";
+        else return nullptr; // Unsupported type in layout
+
+        uint8_t index = static_cast<uint8_t>(vertexLayout[elt].SemanticIndex);
+        std::string semanticName = vertexLayout[elt].SemanticName;
+        semanticName += ('0' + index);
+
+        shaderSource += " ";
+        shaderSource += semanticName;
+        shaderSource += " : ";
+        shaderSource += semanticName;
+        if (elt != numElements - 1)  shaderSource += " , ";
+    }
+    shaderSource += ") : SV_Position {return 0;}";
+
+    ID3DBlob* compiledShader;
+    HRESULT hr = D3DCompile(shaderSource.c_str(), shaderSource.length(), NULL, NULL, NULL, "main",
+        "vs_5_0", D3DCOMPILE_OPTIMIZATION_LEVEL0, 0, &compiledShader, NULL);
+    if (FAILED(hr))
+    {
+        return nullptr;
+    }
+
+    return compiledShader;
+}
+
+HRESULT CD3D11RenderDevice::CreateVertexLayout(const D3D11_INPUT_ELEMENT_DESC* elements, UINT numElements, ID3D11InputLayout** layout)
+{
+    ID3DBlob* shaderSignature = CreateSignatureForVertexLayout(elements, static_cast<int>(numElements));
+    if (shaderSignature == nullptr)  return E_INVALIDARG;
+    HRESULT hr = mDevice->CreateInputLayout(elements, numElements, shaderSignature->GetBufferPointer(),
+                                            shaderSignature->GetBufferSize(), layout);
+    shaderSignature->Release();
+    return hr;
+}
+
+
+HRESULT CD3D11RenderDevice::CreateVertexShader(const void* byteCode, SIZE_T byteCodeLength, ID3D11VertexShader** shader)
+{
+    return mDevice->CreateVertexShader(byteCode, byteCodeLength, nullptr, shader);
+}
+
+HRESULT CD3D11RenderDevice::CreatePixelShader(const void* byteCode, SIZE_T byteCodeLength, ID3D11PixelShader** shader)
+{
+    return mDevice->CreatePixelShader(byteCode, byteCodeLength, nullptr, shader);
+}
+
+
+HRESULT CD3D11RenderDevice::CreateSamplerState(const D3D11_SAMPLER_DESC* desc, ID3D11SamplerState** state)
+{
+    return mDevice->CreateSamplerState(desc, state);
+}
+
+HRESULT CD3D11RenderDevice::CreateBlendState(const D3D11_BLEND_DESC* desc, ID3D11BlendState** state)
+{
+    return mDevice->CreateBlendState(desc, state);
+}
+
+HRESULT CD3D11RenderDevice::CreateRasterizerState(const D3D11_RASTERIZER_DESC* desc, ID3D11RasterizerState** state)
+{
+    return mDevice->CreateRasterizerState(desc, state);
+}
+
+HRESULT CD3D11RenderDevice::CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC* desc, ID3D11DepthStencilState** state)
+{
+    return mDevice->CreateDepthStencilState(desc, state);
+}
+
+
+// DDS files need a different loading function from other files, so check the filename extension (case insensitive)
+static bool IsDDSFile(const std::string& filename)
+{
+    std::string dds = ".dds";
+    return filename.size() >= 4 &&
+           std::equal(dds.rbegin(), dds.rend(), filename.rbegin(), [](unsigned char a, unsigned char b) { return std::tolower(a) == std::tolower(b); });
+}
+
+
+// Using Microsoft's open source DirectX Tool Kit (DirectXTK) to simplify texture loading
+bool CD3D11RenderDevice::LoadTexture(const std::string& filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV)
+{
+    if (IsDDSFile(filename))
+    {
+        return SUCCEEDED(DirectX::CreateDDSTextureFromFile(mDevice, CA2CT(filename.c_str()), texture, textureSRV));
+    }
+    else
+    {
+        return SUCCEEDED(DirectX::CreateWICTextureFromFile(mDevice, mContext, CA2CT(filename.c_str()), texture, textureSRV));
+    }
+}
+
+
+// Only uses the device, so can run on any thread. DirectXTK generates mip-maps on the context, so formats other than
+// DDS are decoded into a single level texture here, which is copied into a texture with a full mip chain by GenerateMips
+bool CD3D11RenderDevice::LoadTextureFromMemory(const std::string& filename, const void* data, size_t size,
+                                               ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV,
+                                               ID3D11Resource** mipSource)
+{
+    *mipSource = nullptr;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (IsDDSFile(filename))
+    {
+        return SUCCEEDED(DirectX::CreateDDSTextureFromMemory(mDevice, bytes, size, texture, textureSRV));
+    }
+
+    // WIC is a COM library, so COM must be initialised on each thread that decodes (once per thread is enough)
+    static thread_local HRESULT comInitialised = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    (void)comInitialised;
+
+    ID3D11Resource* decoded = nullptr;
+    if (FAILED(DirectX::CreateWICTextureFromMemory(mDevice, bytes, size, &decoded, nullptr)))  return false;
+
+    ID3D11Texture2D* decodedTexture = nullptr;
+    if (FAILED(decoded->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&decodedTexture))))
+    {
+        decoded->Release();
+        return false;
+    }
+    D3D11_TEXTURE2D_DESC desc;
+    decodedTexture->GetDesc(&desc);
+    decodedTexture->Release();
+
+    // Formats that the hardware can't generate mip-maps for are used with the single level, as DirectXTK does
+    UINT support = 0;
+    if (FAILED(mDevice->CheckFormatSupport(desc.Format, &support)) || !(support & D3D11_FORMAT_SUPPORT_MIP_AUTOGEN))
+    {
+        if (FAILED(mDevice->CreateShaderResourceView(decoded, nullptr, textureSRV)))
+        {
+            decoded->Release();
+            return false;
+        }
+        *texture = decoded;
+        return true;
+    }
+
+    // Texture with a full mip chain (MipLevels 0), left empty until GenerateMips
+    desc.MipLevels      = 0;
+    desc.Usage          = D3D11_USAGE_DEFAULT;
+    desc.BindFlags      = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags      = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+    ID3D11Texture2D* mipped = nullptr;
+    if (FAILED(mDevice->CreateTexture2D(&desc, nullptr, &mipped)))
+    {
+        decoded->Release();
+        return false;
+    }
+    if (FAILED(mDevice->CreateShaderResourceView(mipped, nullptr, textureSRV)))
+    {
+        mipped->Release();
+        decoded->Release();
+        return false;
+    }
+    *texture = mipped;
+    *mipSource = decoded;
+    return true;
+}
+
+
+void CD3D11RenderDevice::Release(IUnknown* resource)
+{
+    if (resource)  resource->Release();
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Context
+//--------------------------------------------------------------------------------------
+
+CD3D11RenderContext::CD3D11RenderContext(ID3D11DeviceContext* context, IDXGISwapChain* swapChain)
+    : mContext(context), mSwapChain(swapChain)
+{
+    // Constant buffer offsets are an optional feature of Direct3D 11.1, check the driver supports them before
+    // getting the 11.1 context interface
+    ID3D11Device* device = nullptr;
+    mContext->GetDevice(&device);
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+    if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+        options.ConstantBufferOffsetting)
+    {
+        if (FAILED(mContext->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void**>(&mContext1))))
+        {
+            mContext1 = nullptr;
+        }
+    }
+    device->Release();
+}
+
+CD3D11RenderContext::~CD3D11RenderContext()
+{
+    if (mContext1)  mContext1->Release();
+}
+
+
+void CD3D11RenderContext::IASetInputLayout(ID3D11InputLayout* layout)
+{
+    mContext->IASetInputLayout(layout);
+}
+
+void CD3D11RenderContext::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+{
+    mContext->IASetVertexBuffers(startSlot, numBuffers, buffers, strides, offsets);
+}
+
+void CD3D11RenderContext::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+    mContext->IASetIndexBuffer(buffer, format, offset);
+}
+
+void CD3D11RenderContext::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+    mContext->IASetPrimitiveTopology(topology);
+}
+
+
+void CD3D11RenderContext::VSSetShader(ID3D11VertexShader* shader)
+{
+    mContext->VSSetShader(shader, nullptr, 0);
+}
+
+void CD3D11RenderContext::PSSetShader(ID3D11PixelShader* shader)
+{
+    mContext->PSSetShader(shader, nullptr, 0);
+}
+
+
+void CD3D11RenderContext::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+    mContext->VSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+
+void CD3D11RenderContext::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+    mContext->PSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+
+void CD3D11RenderContext::VSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers,
+                                                const UINT* firstConstants, const UINT* numConstants)
+{
+    mContext1->VSSetConstantBuffers1(startSlot, numBuffers, buffers, firstConstants, numConstants);
+}
+
+void CD3D11RenderContext::PSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers,
+                                                const UINT* firstConstants, const UINT* numConstants)
+{
+    mContext1->PSSetConstantBuffers1(startSlot, numBuffers, buffers, firstConstants, numConstants);
+}
+
+void CD3D11RenderContext::PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views)
+{
+    mContext->PSSetShaderResources(startSlot, numViews, views);
+}
+
+void CD3D11RenderContext::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+    mContext->PSSetSamplers(startSlot, numSamplers, samplers);
+}
+
+
+void CD3D11RenderContext::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargets, ID3D11DepthStencilView* depthStencil)
+{
+    mContext->OMSetRenderTargets(numViews, renderTargets, depthStencil);
+}
+
+void CD3D11RenderContext::OMSetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask)
+{
+    mContext->OMSetBlendState(state, blendFactor, sampleMask);
+}
+
+void CD3D11RenderContext::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+    mContext->OMSetDepthStencilState(state, stencilRef);
+}
+
+void CD3D11RenderContext::RSSetState(ID3D11RasterizerState* state)
+{
+    mContext->RSSetState(state);
+}
+
+void CD3D11RenderContext::RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports)
+{
+    mContext->RSSetViewports(numViewports, viewports);
+}
+
+
+void CD3D11RenderContext::ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT colour[4])
+{
+    mContext->ClearRenderTargetView(renderTarget, colour);
+}
+
+void CD3D11RenderContext::ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, UINT clearFlags, FLOAT depth, UINT8 stencil)
+{
+    mContext->ClearDepthStencilView(depthStencil, clearFlags, depth, stencil);
+}
+
+
+// The buffer must have been created with dynamic usage and CPU write access
+void CD3D11RenderContext::UpdateBuffer(ID3D11Buffer* buffer, const void* data, UINT size)
+{
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (FAILED(mContext->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))  return;
+    std::memcpy(mapped.pData, data, size);
+    mContext->Unmap(buffer, 0);
+}
+
+
+void CD3D11RenderContext::GenerateMips(ID3D11Resource* mipSource, ID3D11Resource* texture, ID3D11ShaderResourceView* textureSRV)
+{
+    mContext->CopySubresourceRegion(texture, 0, 0, 0, 0, mipSource, 0, nullptr);
+    mContext->GenerateMips(textureSRV);
+}
+
+
+void CD3D11RenderContext::Draw(UINT vertexCount, UINT startVertex)
+{
+    mContext->Draw(vertexCount, startVertex);
+}
+
+
+void CD3D11RenderContext::DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+    mContext->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+
+void CD3D11RenderContext::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance)
+{
+    mContext->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+
+void CD3D11RenderContext::Present()
+{
+    mSwapChain->Present(0, 0);
+}
@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------------
+// Direct3D 11 render backend
+//--------------------------------------------------------------------------------------
+// Implements the render backend interfaces by forwarding each call to the Direct3D device, context and
+// swap chain. The Direct3D objects are created and released by Direct3DSetup.cpp, these classes don't own them
+//
+// Constant buffer offsets need the Direct3D 11.1 context interface, which the context queries for itself. It is
+// missing on Windows 7 without the platform update, and some drivers don't support offsets even when it is present
+
+#ifndef _D3D11_RENDER_BACKEND_H_INCLUDED_
+#define _D3D11_RENDER_BACKEND_H_INCLUDED_
+
+#include "RenderBackend.h"
+
+#include <d3d11_1.h>
+
+
+class CD3D11RenderDevice : public IRenderDevice
+{
+public:
+    CD3D11RenderDevice(ID3D11Device* device, ID3D11DeviceContext* context) : mDevice(device), mContext(context) {}
+
+    HRESULT CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Buffer** buffer) override;
+    HRESULT CreateTexture2D(const D3D11_TEXTURE2D_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Texture2D** texture) override;
+
+    HRESULT CreateShaderResourceView(ID3D11Resource* resource, const D3D11_SHADER_RESOURCE_VIEW_DESC* desc, ID3D11ShaderResourceView** view) override;
+    HRESULT CreateRenderTargetView  (ID3D11Resource* resource, const D3D11_RENDER_TARGET_VIEW_DESC*   desc, ID3D11RenderTargetView**   view) override;
+    HRESULT CreateDepthStencilView  (ID3D11Resource* resource, const D3D11_DEPTH_STENCIL_VIEW_DESC*   desc, ID3D11DepthStencilView**   view) override;
+
+    HRESULT CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC* elements, UINT numElements,
+                              const void* shaderByteCode, SIZE_T byteCodeLength, ID3D11InputLayout** layout) override;
+    HRESULT CreateVertexLayout(const D3D11_INPUT_ELEMENT_DESC* elements, UINT numElements, ID3D11InputLayout** layout) override;
+    HRESULT CreateVertexShader(const void* byteCode, SIZE_T byteCodeLength, ID3D11VertexShader** shader) override;
+    HRESULT CreatePixelShader (const void* byteCode, SIZE_T byteCodeLength, ID3D11PixelShader**  shader) override;
+
+    HRESULT CreateSamplerState     (const D3D11_SAMPLER_DESC*       desc, ID3D11SamplerState**      state) override;
+    HRESULT CreateBlendState       (const D3D11_BLEND_DESC*         desc, ID3D11BlendState**        state) override;
+    HRESULT CreateRasterizerState  (const D3D11_RASTERIZER_DESC*    desc, ID3D11RasterizerState**   state) override;
+    HRESULT CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC* desc, ID3D11DepthStencilState** state) override;
+
+    bool LoadTexture(const std::string& filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV) override;
+    bool LoadTextureFromMemory(const std::string& filename, const void* data, size_t size,
+                               ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV,
+                               ID3D11Resource** mipSource) override;
+
+    void Release(IUnknown* resource) override;
+
+private:
+    ID3D11Device*        mDevice;
+    ID3D11DeviceContext* mContext; // Needed by the texture loader to generate mip-maps
+};
+
+
+class CD3D11RenderContext : public IRenderContext
+{
+public:
+    CD3D11RenderContext(ID3D11DeviceContext* context, IDXGISwapChain* swapChain);
+    ~CD3D11RenderContext();
+
+    void IASetInputLayout(ID3D11InputLayout* layout) override;
+    void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets) override;
+    void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset) override;
+    void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override;
+
+    void VSSetShader(ID3D11VertexShader* shader) override;
+    void PSSetShader(ID3D11PixelShader*  shader) override;
+
+    void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers) override;
+    void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers) override;
+    void VSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers,
+                               const UINT* firstConstants, const UINT* numConstants) override;
+    void PSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers,
+                               const UINT* firstConstants, const UINT* numConstants) override;
+    void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views) override;
+    void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) override;
+
+    void OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargets, ID3D11DepthStencilView* depthStencil) override;
+    void OMSetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask) override;
+    void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef) override;
+    void RSSetState(ID3D11RasterizerState* state) override;
+    void RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports) override;
+
+    void ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT colour[4]) override;
+    void ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, UINT clearFlags, FLOAT depth, UINT8 stencil) override;
+
+    void UpdateBuffer(ID3D11Buffer* buffer, const void* data, UINT size) override;
+    void GenerateMips(ID3D11Resource* mipSource, ID3D11Resource* texture, ID3D11ShaderResourceView* textureSRV) override;
+
+    void Draw(UINT vertexCount, UINT startVertex) override;
+    void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex) override;
+    void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance) override;
+
+    void Present() override;
+
+    bool SupportsConstantBufferOffsets() override  { return mContext1 != nullptr; }
+
+private:
+    ID3D11DeviceContext*  mContext;
+    ID3D11DeviceContext1* mContext1 = nullptr; // Null if constant buffer offsets are not supported. This one is owned
+    IDXGISwapChain*       mSwapChain;
+};
+
+
+#endif //_D3D11_RENDER_BACKEND_H_INCLUDED_
@@ -3,9 +3,12 @@
 //--------------------------------------------------------------------------------------
 
 #include "Direct3DSetup.h"
-#include "Shader.h"
 #include "Common.h"
+#include "HeadlessRenderBackend.h"
+#ifdef _WIN32
+#include "D3D11RenderBackend.h"
 #include <d3d11.h>
+#endif
 #include <vector>
 
 
@@ -18,6 +21,10 @@
 ID3D11Device*        gD3DDevice  = nullptr; // D3D device for overall features
 ID3D11DeviceContext* gD3DContext = nullptr; // D3D context for specific rendering tasks
 
+// The render backend used by all code outside this file, either Direct3D or headless
+IRenderDevice*  gRenderDevice  = nullptr;
+IRenderContext* gRenderContext = nullptr;
+
 // Swap chain and back buffer
 IDXGISwapChain*         gSwapChain              = nullptr;
 ID3D11RenderTargetView* gBackBufferRenderTarget = nullptr;
@@ -31,6 +38,10 @@ ID3D11DepthStencilView* gDepthStencil        = nullptr; // The depth buffer refe
 //--------------------------------------------------------------------------------------
 // Initialise / uninitialise Direct3D
 //--------------------------------------------------------------------------------------
+// Only on Windows, other platforms can only render headless
+
+#ifdef _WIN32
+
 // Returns false on failure
 bool InitDirect3D()
 {
@@ -62,6 +73,8 @@ bool InitDirect3D()
         gLastError = "Error creating Direct3D device";
         return false;
     }
+    gRenderDevice  = new CD3D11RenderDevice(gD3DDevice, gD3DContext);
+    gRenderContext = new CD3D11RenderContext(gD3DContext, gSwapChain);
 
 
     // Get a "render target view" of back-buffer - standard behaviour
@@ -137,6 +150,60 @@ void ShutdownDirect3D()
     if (gBackBufferRenderTarget) gBackBufferRenderTarget->Release();
     if (gSwapChain)              gSwapChain->Release();
     if (gD3DDevice)              gD3DDevice->Release();
+
+    delete gRenderContext;  gRenderContext = nullptr;
+    delete gRenderDevice;   gRenderDevice  = nullptr;
+}
+
+#endif //_WIN32
+
+
+
+//--------------------------------------------------------------------------------------
+// Initialise / uninitialise headless rendering
+//--------------------------------------------------------------------------------------
+
+CHeadlessRenderContext* InitHeadlessRenderer()
+{
+    auto device  = new CHeadlessRenderDevice;
+    auto context = new CHeadlessRenderContext;
+    gRenderDevice  = device;
+    gRenderContext = context;
+
+    // Placeholders for the back buffer and depth buffer so the scene has targets to render to
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width  = gViewportWidth;
+    desc.Height = gViewportHeight;
+    ID3D11Texture2D* backBuffer;
+    if (FAILED(device->CreateTexture2D(&desc, nullptr, &backBuffer)) ||
+        FAILED(device->CreateRenderTargetView(backBuffer, nullptr, &gBackBufferRenderTarget)) ||
+        FAILED(device->CreateTexture2D(&desc, nullptr, &gDepthStencilTexture)) ||
+        FAILED(device->CreateDepthStencilView(gDepthStencilTexture, nullptr, &gDepthStencil)))
+    {
+        gLastError = "Error creating headless back buffer";
+        ShutdownHeadlessRenderer();
+        return nullptr;
+    }
+
+    return context;
+}
+
+
+void ShutdownHeadlessRenderer()
+{
+    // The back buffer texture isn't kept, it is freed with the device
+    if (gRenderDevice)
+    {
+        gRenderDevice->Release(gDepthStencil);
+        gRenderDevice->Release(gDepthStencilTexture);
+        gRenderDevice->Release(gBackBufferRenderTarget);
+    }
+    gBackBufferRenderTarget = nullptr;
+    gDepthStencilTexture    = nullptr;
+    gDepthStencil           = nullptr;
+
+    delete gRenderContext;  gRenderContext = nullptr;
+    delete gRenderDevice;   gRenderDevice  = nullptr;
 }
 
 
@@ -5,11 +5,20 @@
 // Initialisation of Direct3D and main resources
 //--------------------------------------------------------------------------------------
 
-// Returns false on failure
+// Windows only. Returns false on failure
 bool InitDirect3D();
 
 // Release the memory held by all objects created
 void ShutdownDirect3D();
 
 
+// Use the headless render backend instead of Direct3D - no window or GPU is needed. Sets up the same globals as
+// InitDirect3D, with placeholder back buffer and depth buffer. Use the returned context to read the command log
+class CHeadlessRenderContext;
+CHeadlessRenderContext* InitHeadlessRenderer();
+
+// Release the headless render backend
+void ShutdownHeadlessRenderer();
+
+
 #endif //_DIRECT3D_SETUP_H_INCLUDED_
@@ -0,0 +1,342 @@
+//--------------------------------------------------------------------------------------
+// Sorted queue of draw commands
+//--------------------------------------------------------------------------------------
+
+#include "DrawQueue.h"
+#include "Model.h"
+#include "Mesh.h"
+#include "GraphicsHelpers.h"
+
+#include <utility>
+
+
+//--------------------------------------------------------------------------------------
+// Sort keys
+//--------------------------------------------------------------------------------------
+
+// Hash a state object pointer down to the given number of bits (Fibonacci hashing), null gives 0
+static uint64_t KeyBits(const void* object, int bits)
+{
+    if (object == nullptr)  return 0;
+    uint64_t hash = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(object)) * 0x9E3779B97F4A7C15ull;
+    return hash >> (64 - bits);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Building the queue
+//--------------------------------------------------------------------------------------
+
+void CDrawQueue::Clear()
+{
+    mItems.clear();
+    mSortEntries.clear();
+}
+
+
+void CDrawQueue::Add(unsigned int pass, const SDrawState& state, Model* model, const CVector3& objectColour /*= { 1, 1, 1 }*/)
+{
+    uint64_t key = (static_cast<uint64_t>(pass & 0xf)              << 60) |
+                   (KeyBits(state.rasterizerState, 4)              << 56) |
+                   (KeyBits(state.vertexShader, 8)                 << 48) |
+                   (KeyBits(state.pixelShader,  8)                 << 40) |
+                   (KeyBits(state.textures[0], 12)                 << 28) |
+                   (KeyBits(state.textures[1], 12)                 << 16) |
+                    KeyBits(model->GetMesh(), 16);
+
+    mSortEntries.push_back({ key, static_cast<unsigned int>(mItems.size()) });
+    mItems.push_back({ state, model, objectColour });
+}
+
+
+// Least significant digit radix sort, one byte of the key per pass. The sort is stable so items with equal keys
+// keep the order they were added. Passes where every key has the same digit (common in the upper bits) are skipped
+void CDrawQueue::Sort()
+{
+    const size_t numEntries = mSortEntries.size();
+    if (numEntries < 2)  return;
+
+    mSortScratch.resize(numEntries);
+    SSortEntry* source      = mSortEntries.data();
+    SSortEntry* destination = mSortScratch.data();
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        size_t counts[256] = {};
+        for (size_t i = 0; i < numEntries; ++i)
+        {
+            ++counts[(source[i].key >> shift) & 0xff];
+        }
+        if (counts[(source[0].key >> shift) & 0xff] == numEntries)  continue;
+
+        // Convert counts to the position of the first entry with each digit value
+        size_t position = 0;
+        for (auto& count : counts)
+        {
+            size_t digitCount = count;
+            count = position;
+            position += digitCount;
+        }
+
+        for (size_t i = 0; i < numEntries; ++i)
+        {
+            destination[counts[(source[i].key >> shift) & 0xff]++] = source[i];
+        }
+        std::swap(source, destination);
+    }
+
+    // Result may have finished in the scratch buffer
+    if (source != mSortEntries.data())  mSortEntries.swap(mSortScratch);
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Submission
+//--------------------------------------------------------------------------------------
+
+template <class T>
+bool CDrawQueue::NeedsBind(T*& current, T* wanted, unsigned int numBinds /*= 1*/)
+{
+    if (mCurrentValid && current == wanted)
+    {
+        mBindsSkipped += numBinds;
+        return false;
+    }
+    current = wanted;
+    mBindsIssued += numBinds;
+    return true;
+}
+
+
+// Returns true if the two items can be drawn in the same instanced draw - everything but the world matrix must match
+bool CDrawQueue::CanInstance(const SDrawItem& a, const SDrawItem& b)
+{
+    const SDrawState& sa = a.state;
+    const SDrawState& sb = b.state;
+    return sa.instancedVertexShader == sb.instancedVertexShader && sa.vertexShader == sb.vertexShader &&
+           sa.pixelShader == sb.pixelShader && sa.rasterizerState == sb.rasterizerState &&
+           sa.blendState == sb.blendState && sa.depthStencilState == sb.depthStencilState && sa.sampler == sb.sampler &&
+           sa.textures[0] == sb.textures[0] && sa.textures[1] == sb.textures[1] &&
+           a.model->GetMesh() == b.model->GetMesh() &&
+           a.objectColour.x == b.objectColour.x && a.objectColour.y == b.objectColour.y && a.objectColour.z == b.objectColour.z &&
+           a.model->WiggleStrength() == b.model->WiggleStrength();
+}
+
+
+bool CDrawQueue::CreateInstanceBuffer()
+{
+    if (mInstanceBuffer != nullptr)  return true;
+
+    D3D11_BUFFER_DESC bufferDesc;
+    bufferDesc.ByteWidth           = MaxInstances * sizeof(CMatrix4x4);
+    bufferDesc.Usage               = D3D11_USAGE_DYNAMIC; // Rewritten for every batch
+    bufferDesc.BindFlags           = D3D11_BIND_VERTEX_BUFFER;
+    bufferDesc.CPUAccessFlags      = D3D11_CPU_ACCESS_WRITE;
+    bufferDesc.MiscFlags           = 0;
+    bufferDesc.StructureByteStride = 0;
+    if (FAILED(gRenderDevice->CreateBuffer(&bufferDesc, nullptr, &mInstanceBuffer)))
+    {
+        mInstanceBuffer = nullptr;
+        return false;
+    }
+    mInstanceMatrices.resize(MaxInstances);
+    return true;
+}
+
+
+// The arena is larger than the 64KB a constant buffer can normally be, which is allowed when constant buffer offsets
+// are supported. Its size is doubled until it fits, so a growing scene only replaces it a few times
+bool CDrawQueue::ReserveConstantArena(unsigned int numSlots)
+{
+    if (mArenaBuffer != nullptr && numSlots <= mArenaCapacity)  return true;
+
+    unsigned int capacity = (mArenaCapacity > 0) ? mArenaCapacity : MinArenaSlots;
+    while (capacity < numSlots)  capacity *= 2;
+
+    if (mArenaBuffer)  gRenderDevice->Release(mArenaBuffer);
+    mArenaBuffer   = nullptr;
+    mArenaCapacity = 0;
+
+    D3D11_BUFFER_DESC bufferDesc;
+    bufferDesc.ByteWidth           = capacity * sizeof(SArenaSlot);
+    bufferDesc.Usage               = D3D11_USAGE_DYNAMIC; // Rewritten for every submit
+    bufferDesc.BindFlags           = D3D11_BIND_CONSTANT_BUFFER;
+    bufferDesc.CPUAccessFlags      = D3D11_CPU_ACCESS_WRITE;
+    bufferDesc.MiscFlags           = 0;
+    bufferDesc.StructureByteStride = 0;
+    if (FAILED(gRenderDevice->CreateBuffer(&bufferDesc, nullptr, &mArenaBuffer)))
+    {
+        mArenaBuffer = nullptr;
+        return false;
+    }
+    mArenaCapacity = capacity;
+    mArenaSlots.resize(capacity);
+    return true;
+}
+
+
+void CDrawQueue::ReleaseResources()
+{
+    if (mInstanceBuffer)  gRenderDevice->Release(mInstanceBuffer);
+    mInstanceBuffer = nullptr;
+    if (mArenaBuffer)  gRenderDevice->Release(mArenaBuffer);
+    mArenaBuffer   = nullptr;
+    mArenaCapacity = 0;
+}
+
+
+// Each batch is an item and the run of following items that can be drawn in the same instanced call
+void CDrawQueue::FindBatches()
+{
+    mBatches.clear();
+
+    const size_t numEntries = mSortEntries.size();
+    size_t entry = 0;
+    while (entry < numEntries)
+    {
+        SDrawItem& item = mItems[mSortEntries[entry].item];
+
+        size_t batchEnd = entry + 1;
+        if (mInstancing && item.state.instancedVertexShader != nullptr)
+        {
+            while (batchEnd < numEntries && batchEnd - entry < MaxInstances &&
+                   CanInstance(item, mItems[mSortEntries[batchEnd].item]))
+            {
+                ++batchEnd;
+            }
+        }
+        mBatches.push_back({ static_cast<unsigned int>(entry), static_cast<unsigned int>(batchEnd - entry) });
+        entry = batchEnd;
+    }
+}
+
+
+void CDrawQueue::BatchConstants(const SBatch& batch, PerModelConstants& constants)
+{
+    SDrawItem& item = mItems[mSortEntries[batch.firstEntry].item];
+    item.model->WriteConstants(constants);
+    constants.objectColour = item.objectColour;
+
+    // The instanced shaders take the world matrix from the instance data. Shaders that still read the world matrix
+    // from the constant buffer (e.g. the normal mapping pixel shader) are given world space data instead, so it is
+    // set to the identity
+    if (batch.numInstances > 1)  constants.worldMatrix = MatrixIdentity();
+}
+
+
+void CDrawQueue::Submit()
+{
+    if (mItems.empty())  return;
+    mTimer.Reset();
+
+    // Other code may have changed any state since the last submit, so the first item binds everything. Textures
+    // and sampler are optional so they are reset to null (unknown) in case the first item doesn't set them
+    mCurrent = SDrawState();
+    mCurrentMesh = nullptr;
+    mCurrentMeshInstanced = false;
+    mCurrentValid = false;
+
+    // If the instance buffer can't be created, draw everything individually
+    if (mInstancing && !CreateInstanceBuffer())  mInstancing = false;
+
+    FindBatches();
+    const unsigned int numBatches = static_cast<unsigned int>(mBatches.size());
+
+    // Write the constants of every draw into the arena and send them all at once. Each draw binds its own slot below
+    bool useArena = mConstantArena && gRenderContext->SupportsConstantBufferOffsets() && ReserveConstantArena(numBatches);
+    if (useArena)
+    {
+        for (unsigned int b = 0; b < numBatches; ++b)
+        {
+            BatchConstants(mBatches[b], mArenaSlots[b].constants);
+        }
+        gRenderContext->UpdateBuffer(mArenaBuffer, mArenaSlots.data(), numBatches * sizeof(SArenaSlot));
+        ++mConstantUploads;
+    }
+    else
+    {
+        // Every draw uses the same per-model constant buffer, only its contents change. Model::Render would bind it
+        // to both shaders for each draw
+        gRenderContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+        gRenderContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+        mBindsIssued  += 2;
+        mBindsSkipped += 2 * (numBatches - 1);
+    }
+
+    for (unsigned int b = 0; b < numBatches; ++b)
+    {
+        const SBatch& batch = mBatches[b];
+        SDrawItem&  item  = mItems[mSortEntries[batch.firstEntry].item];
+        SDrawState& state = item.state;
+        unsigned int numInstances = batch.numInstances;
+        bool instanced = (numInstances > 1);
+
+        ID3D11VertexShader* vertexShader = instanced ? state.instancedVertexShader : state.vertexShader;
+        if (NeedsBind(mCurrent.vertexShader,      vertexShader))             gRenderContext->VSSetShader(vertexShader);
+        if (NeedsBind(mCurrent.pixelShader,       state.pixelShader))        gRenderContext->PSSetShader(state.pixelShader);
+        if (NeedsBind(mCurrent.rasterizerState,   state.rasterizerState))    gRenderContext->RSSetState(state.rasterizerState);
+        if (NeedsBind(mCurrent.blendState,        state.blendState))         gRenderContext->OMSetBlendState(state.blendState, nullptr, 0xffffff);
+        if (NeedsBind(mCurrent.depthStencilState, state.depthStencilState))  gRenderContext->OMSetDepthStencilState(state.depthStencilState, 0);
+
+        if (state.sampler != nullptr && NeedsBind(mCurrent.sampler, state.sampler))
+        {
+            gRenderContext->PSSetSamplers(0, 1, &state.sampler);
+        }
+        for (int t = 0; t < 2; ++t)
+        {
+            if (state.textures[t] != nullptr && NeedsBind(mCurrent.textures[t], state.textures[t]))
+            {
+                gRenderContext->PSSetShaderResources(mTextureSlots[t], 1, &state.textures[t]);
+            }
+        }
+
+        // Vertex buffer(s), index buffer, layout and topology. Instanced draws use a different layout and an
+        // extra vertex buffer, so switching between instanced and single draws of a mesh needs a rebind
+        Mesh* mesh = item.model->GetMesh();
+        if (instanced != mCurrentMeshInstanced)  mCurrentMesh = nullptr;
+        if (NeedsBind(mCurrentMesh, mesh, 4))
+        {
+            if (instanced)  mesh->SetInstancedBuffers(mInstanceBuffer);
+            else            mesh->SetBuffers();
+            mCurrentMeshInstanced = instanced;
+        }
+
+        mCurrentValid = true;
+
+        // Per-model constants are either this draw's slot of the arena, or uploaded to the per-model buffer now
+        if (useArena)
+        {
+            UINT firstConstant = b * (sizeof(SArenaSlot) / 16);
+            UINT numConstants  = sizeof(SArenaSlot) / 16;
+            gRenderContext->VSSetConstantBuffers1(1, 1, &mArenaBuffer, &firstConstant, &numConstants);
+            gRenderContext->PSSetConstantBuffers1(1, 1, &mArenaBuffer, &firstConstant, &numConstants);
+            mBindsIssued += 2;
+        }
+        else
+        {
+            BatchConstants(batch, gPerModelConstants);
+            UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants);
+            ++mConstantUploads;
+        }
+
+        if (instanced)
+        {
+            for (unsigned int i = 0; i < numInstances; ++i)
+            {
+                mInstanceMatrices[i] = mItems[mSortEntries[batch.firstEntry + i].item].model->WorldMatrix();
+            }
+            gRenderContext->UpdateBuffer(mInstanceBuffer, mInstanceMatrices.data(), numInstances * sizeof(CMatrix4x4));
+            mesh->DrawInstanced(numInstances);
+        }
+        else
+        {
+            mesh->Draw();
+        }
+
+        mDrawCalls   += mesh->NumSubMeshes(); // One draw per sub-mesh, all from the buffers set above
+        mModelsDrawn += numInstances;
+    }
+
+    mSubmitTime += mTimer.GetTime();
+}
@@ -0,0 +1,205 @@
+//--------------------------------------------------------------------------------------
+// Sorted queue of draw commands
+//--------------------------------------------------------------------------------------
+// Render passes add one item per model, holding everything that must be bound to draw it. Each item gets a
+// 64-bit sort key built from (most significant first):
+//     pass (4 bits) | rasterizer state (4) | vertex & pixel shader (16) | textures (24) | mesh (16)
+// The pass is chosen by the caller and keeps layers that depend on order (e.g. blended models after opaque
+// ones) apart. The other fields are hashes of the state objects, so items with identical state end up next to
+// each other after sorting. A hash collision can only cost an extra bind, as the submitter compares the real
+// state when deciding what to bind.
+//
+// The submitter sets only the state that differs from the previous item. Binds issued and skipped (compared to
+// binding everything for every draw) are counted until the statistics are reset.
+//
+// Consecutive items (after sorting) that are identical apart from their world matrix - same state, mesh, object
+// colour and wiggle strength - are drawn together with one DrawIndexedInstanced call if their state gives an
+// instanced vertex shader. The world matrices of the batch are copied into a per-instance vertex buffer.
+//
+// The per-model constants of every draw in a submit are written one after another into a constant arena and sent to
+// the GPU with a single upload. Each draw then binds its own 256-byte slot of the arena with a constant buffer offset
+// (Direct3D 11.1). This avoids mapping the per-model constant buffer for every draw, which makes the driver rename
+// the buffer each time. If the backend doesn't support constant buffer offsets, each draw uploads its constants to
+// the per-model constant buffer as before.
+
+#ifndef _DRAW_QUEUE_H_INCLUDED_
+#define _DRAW_QUEUE_H_INCLUDED_
+
+#include "Common.h"
+#include "Timer.h"
+
+#include <vector>
+#include <cstdint>
+
+class Model;
+class Mesh;
+
+
+// State needed for a single draw. Null textures or sampler mean the draw doesn't use them, so whatever is
+// currently bound is left alone
+struct SDrawState
+{
+    ID3D11VertexShader*       vertexShader      = nullptr;
+    ID3D11PixelShader*        pixelShader       = nullptr;
+    ID3D11RasterizerState*    rasterizerState   = nullptr;
+    ID3D11BlendState*         blendState        = nullptr;
+    ID3D11DepthStencilState*  depthStencilState = nullptr;
+    ID3D11SamplerState*       sampler           = nullptr; // Sampler slot 0
+    ID3D11ShaderResourceView* textures[2]       = {};      // Texture slot 0 and the second texture slot given to the queue
+
+    // Version of the vertex shader that reads the world matrix from instance data, used in place of the vertex
+    // shader when several identical draws are batched. Null if the draws can't be instanced
+    ID3D11VertexShader*       instancedVertexShader = nullptr;
+};
+
+
+class CDrawQueue
+{
+public:
+    // The second texture of each draw (normal map, portal texture etc.) is bound to the given slot
+    CDrawQueue(UINT secondTextureSlot) : mTextureSlots{ 0, secondTextureSlot } {}
+
+    // Release the GPU buffers used for instance data and the constant arena
+    void ReleaseResources();
+
+    // Remove all items, ready for the next pass
+    void Clear();
+
+    // Add a model to draw with the given state. The pass must be less than 16, lower passes are drawn first.
+    // The object colour is sent to the per-model constant buffer (used to tint light models)
+    void Add(unsigned int pass, const SDrawState& state, Model* model, const CVector3& objectColour = { 1, 1, 1 });
+
+    // Sort the items by key (radix sort)
+    void Sort();
+
+    // Draw all the items in order, skipping binds that would repeat the state of the previous item
+    void Submit();
+
+    unsigned int NumItems()  { return static_cast<unsigned int>(mItems.size()); }
+
+    // Enable or disable batching identical draws into instanced draws (enabled by default)
+    void SetInstancing(bool enabled)  { mInstancing = enabled; }
+    bool Instancing()                 { return mInstancing;    }
+
+    // Enable or disable sending per-model constants through the constant arena (enabled by default). Without it, or
+    // if the backend doesn't support constant buffer offsets, the constants are uploaded separately for each draw
+    void SetConstantArena(bool enabled)  { mConstantArena = enabled; }
+    bool ConstantArena()                 { return mConstantArena;    }
+
+
+    //-------------------------------------
+    // Statistics
+    //-------------------------------------
+
+    // Number of state binds made, and number avoided because the state was already bound, since the last reset
+    unsigned int BindsIssued()   { return mBindsIssued;  }
+    unsigned int BindsSkipped()  { return mBindsSkipped; }
+
+    // Number of draw calls made and models drawn by them since the last reset. Instancing draws several models per call
+    unsigned int DrawCalls()     { return mDrawCalls;   }
+    unsigned int ModelsDrawn()   { return mModelsDrawn; }
+
+    // Number of per-model constant uploads since the last reset - one per submit with the constant arena, otherwise one per draw
+    unsigned int ConstantUploads()  { return mConstantUploads; }
+
+    // Seconds spent in Submit since the last reset, i.e. the CPU cost of sending the queue to the GPU
+    float SubmitTime()  { return mSubmitTime; }
+
+    void ResetStatistics()
+    {
+        mBindsIssued = mBindsSkipped = mDrawCalls = mModelsDrawn = mConstantUploads = 0;
+        mSubmitTime = 0;
+    }
+
+
+private:
+    struct SDrawItem
+    {
+        SDrawState state;
+        Model*     model;
+        CVector3   objectColour;
+    };
+
+    // Items are sorted indirectly - only the keys and item indexes move
+    struct SSortEntry
+    {
+        uint64_t     key;
+        unsigned int item;
+    };
+
+    // Consecutive items (in sorted order) drawn with one call
+    struct SBatch
+    {
+        unsigned int firstEntry;
+        unsigned int numInstances;
+    };
+
+    // Per-model constants of one draw in the constant arena. Constant buffer offsets must be multiples of 16
+    // constants (256 bytes), so each draw's constants are padded to that size
+    struct SArenaSlot
+    {
+        PerModelConstants constants;
+        unsigned char     padding[256 - sizeof(PerModelConstants)];
+    };
+
+    // Maximum models in a single instanced draw, larger batches are split
+    static const unsigned int MaxInstances = 1024;
+
+    // Size of the constant arena when first created, in draws. It grows if a submit has more draws than this
+    static const unsigned int MinArenaSlots = 1024;
+
+    // Returns true if the given state needs binding, updating the current state and statistics
+    template <class T>
+    bool NeedsBind(T*& current, T* wanted, unsigned int numBinds = 1);
+
+    // Returns true if the two items can be drawn in the same instanced draw
+    static bool CanInstance(const SDrawItem& a, const SDrawItem& b);
+
+    // Create the instance buffer if it doesn't exist yet, returns false on failure
+    bool CreateInstanceBuffer();
+
+    // Make sure the constant arena has room for the given number of draws, replacing it with a larger buffer if not.
+    // Returns false on failure
+    bool ReserveConstantArena(unsigned int numSlots);
+
+    // Split the sorted items into the draws that will be made, filling mBatches
+    void FindBatches();
+
+    // Per-model constants for a batch. The world matrix comes from the instance data for instanced draws
+    void BatchConstants(const SBatch& batch, PerModelConstants& constants);
+
+    UINT mTextureSlots[2];
+
+    std::vector<SDrawItem>  mItems;
+    std::vector<SSortEntry> mSortEntries;
+    std::vector<SSortEntry> mSortScratch; // Second buffer for radix sort passes
+    std::vector<SBatch>     mBatches;     // Draws made by the current submit
+
+    // State bound by the previous item in Submit. Not valid until the first item has been bound
+    SDrawState mCurrent;
+    Mesh*      mCurrentMesh = nullptr;
+    bool       mCurrentMeshInstanced = false; // Whether the current mesh was bound with the instance buffer
+    bool       mCurrentValid = false;
+
+    // Per-instance world matrices for the batch being drawn and the GPU buffer they are copied to
+    bool                    mInstancing = true;
+    std::vector<CMatrix4x4> mInstanceMatrices;
+    ID3D11Buffer*           mInstanceBuffer = nullptr;
+
+    // Per-model constants for every draw in a submit and the GPU buffer they are uploaded to
+    bool                     mConstantArena = true;
+    std::vector<SArenaSlot>  mArenaSlots;
+    ID3D11Buffer*            mArenaBuffer = nullptr;
+    unsigned int             mArenaCapacity = 0; // Size of the buffer above, in slots
+
+    unsigned int mBindsIssued  = 0;
+    unsigned int mBindsSkipped = 0;
+    unsigned int mDrawCalls    = 0;
+    unsigned int mModelsDrawn  = 0;
+    unsigned int mConstantUploads = 0;
+    float        mSubmitTime   = 0;
+    Timer        mTimer;
+};
+
+
+#endif //_DRAW_QUEUE_H_INCLUDED_
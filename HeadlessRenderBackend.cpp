@@ -0,0 +1,344 @@
+//--------------------------------------------------------------------------------------
+// Headless render backend
+//--------------------------------------------------------------------------------------
+
+#include "HeadlessRenderBackend.h"
+
+
+//--------------------------------------------------------------------------------------
+// Command log
+//--------------------------------------------------------------------------------------
+
+const char* RenderCommandName(ERenderCommand command)
+{
+    static const char* names[] =
+    {
+        "SetInputLayout", "SetVertexBuffer", "SetIndexBuffer", "SetTopology", "SetVertexShader", "SetPixelShader",
+        "SetVSConstantBuffer", "SetPSConstantBuffer", "SetPSShaderResource", "SetPSSampler", "SetRenderTargets",
+        "SetBlendState", "SetDepthStencilState", "SetRasterizerState", "SetViewport", "ClearRenderTarget",
+        "ClearDepthStencil", "UpdateBuffer", "GenerateMips", "Draw", "DrawIndexed", "DrawIndexedInstanced", "Present"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == static_cast<int>(ERenderCommand::NumCommands), "Command name missing");
+
+    return names[static_cast<int>(command)];
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Device
+//--------------------------------------------------------------------------------------
+
+CHeadlessRenderDevice::~CHeadlessRenderDevice()
+{
+    for (auto object : mObjects)  delete object;
+}
+
+
+template <class T>
+HRESULT CHeadlessRenderDevice::NewObject(T** handle, unsigned int byteSize /*= 0*/)
+{
+    if (handle == nullptr)  return S_FALSE; // Direct3D validates the parameters without creating anything in this case
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    SObject* object = new SObject{ mNextId++, byteSize };
+    mObjects.insert(object);
+    *handle = reinterpret_cast<T*>(object);
+    return S_OK;
+}
+
+// Releasing an object that was already released (or not made by this device) is ignored
+void CHeadlessRenderDevice::Release(IUnknown* resource)
+{
+    if (resource == nullptr)  return;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    SObject* object = reinterpret_cast<SObject*>(resource);
+    if (mObjects.erase(object) > 0)  delete object;
+}
+
+unsigned int CHeadlessRenderDevice::NumObjects()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return static_cast<unsigned int>(mObjects.size());
+}
+
+unsigned int CHeadlessRenderDevice::ObjectId(const void* handle)
+{
+    return handle ? static_cast<const SObject*>(handle)->id : 0;
+}
+
+
+HRESULT CHeadlessRenderDevice::CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* /*initialData*/, ID3D11Buffer** buffer)
+{
+    if (desc == nullptr || desc->ByteWidth == 0)  return E_INVALIDARG;
+    return NewObject(buffer, desc->ByteWidth);
+}
+
+HRESULT CHeadlessRenderDevice::CreateTexture2D(const D3D11_TEXTURE2D_DESC* desc, const D3D11_SUBRESOURCE_DATA* /*initialData*/, ID3D11Texture2D** texture)
+{
+    if (desc == nullptr || desc->Width == 0 || desc->Height == 0)  return E_INVALIDARG;
+    return NewObject(texture);
+}
+
+
+HRESULT CHeadlessRenderDevice::CreateShaderResourceView(ID3D11Resource* resource, const D3D11_SHADER_RESOURCE_VIEW_DESC* /*desc*/, ID3D11ShaderResourceView** view)
+{
+    if (resource == nullptr)  return E_INVALIDARG;
+    return NewObject(view);
+}
+
+HRESULT CHeadlessRenderDevice::CreateRenderTargetView(ID3D11Resource* resource, const D3D11_RENDER_TARGET_VIEW_DESC* /*desc*/, ID3D11RenderTargetView** view)
+{
+    if (resource == nullptr)  return E_INVALIDARG;
+    return NewObject(view);
+}
+
+HRESULT CHeadlessRenderDevice::CreateDepthStencilView(ID3D11Resource* resource, const D3D11_DEPTH_STENCIL_VIEW_DESC* /*desc*/, ID3D11DepthStencilView** view)
+{
+    if (resource == nullptr)  return E_INVALIDARG;
+    return NewObject(view);
+}
+
+
+HRESULT CHeadlessRenderDevice::CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC* elements, UINT numElements,
+                                                 const void* /*shaderByteCode*/, SIZE_T /*byteCodeLength*/, ID3D11InputLayout** layout)
+{
+    if (elements == nullptr || numElements == 0)  return E_INVALIDARG;
+    return NewObject(layout);
+}
+
+HRESULT CHeadlessRenderDevice::CreateVertexLayout(const D3D11_INPUT_ELEMENT_DESC* elements, UINT numElements, ID3D11InputLayout** layout)
+{
+    if (elements == nullptr || numElements == 0)  return E_INVALIDARG;
+    return NewObject(layout);
+}
+
+HRESULT CHeadlessRenderDevice::CreateVertexShader(const void* byteCode, SIZE_T byteCodeLength, ID3D11VertexShader** shader)
+{
+    if (byteCode == nullptr || byteCodeLength == 0)  return E_INVALIDARG;
+    return NewObject(shader);
+}
+
+HRESULT CHeadlessRenderDevice::CreatePixelShader(const void* byteCode, SIZE_T byteCodeLength, ID3D11PixelShader** shader)
+{
+    if (byteCode == nullptr || byteCodeLength == 0)  return E_INVALIDARG;
+    return NewObject(shader);
+}
+
+
+HRESULT CHeadlessRenderDevice::CreateSamplerState(const D3D11_SAMPLER_DESC* desc, ID3D11SamplerState** state)
+{
+    if (desc == nullptr)  return E_INVALIDARG;
+    return NewObject(state);
+}
+
+HRESULT CHeadlessRenderDevice::CreateBlendState(const D3D11_BLEND_DESC* desc, ID3D11BlendState** state)
+{
+    if (desc == nullptr)  return E_INVALIDARG;
+    return NewObject(state);
+}
+
+HRESULT CHeadlessRenderDevice::CreateRasterizerState(const D3D11_RASTERIZER_DESC* desc, ID3D11RasterizerState** state)
+{
+    if (desc == nullptr)  return E_INVALIDARG;
+    return NewObject(state);
+}
+
+HRESULT CHeadlessRenderDevice::CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC* desc, ID3D11DepthStencilState** state)
+{
+    if (desc == nullptr)  return E_INVALIDARG;
+    return NewObject(state);
+}
+
+
+bool CHeadlessRenderDevice::LoadTexture(const std::string& /*filename*/, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV)
+{
+    return SUCCEEDED(NewObject(texture)) && SUCCEEDED(NewObject(textureSRV));
+}
+
+bool CHeadlessRenderDevice::LoadTextureFromMemory(const std::string& /*filename*/, const void* data, size_t size,
+                                                  ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV,
+                                                  ID3D11Resource** mipSource)
+{
+    if (data == nullptr || size == 0)  return false;
+    return SUCCEEDED(NewObject(texture, static_cast<unsigned int>(size))) && SUCCEEDED(NewObject(textureSRV)) &&
+           SUCCEEDED(NewObject(mipSource));
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Context
+//--------------------------------------------------------------------------------------
+
+void CHeadlessRenderContext::Record(ERenderCommand type, unsigned int slot, const void* resource, unsigned int value /*= 0*/)
+{
+    ++mCounts[static_cast<int>(type)];
+    if (mRecording)  mCommands.push_back({ type, slot, CHeadlessRenderDevice::ObjectId(resource), value });
+}
+
+
+void CHeadlessRenderContext::IASetInputLayout(ID3D11InputLayout* layout)
+{
+    Record(ERenderCommand::SetInputLayout, 0, layout);
+}
+
+void CHeadlessRenderContext::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* /*offsets*/)
+{
+    for (UINT i = 0; i < numBuffers; ++i)  Record(ERenderCommand::SetVertexBuffer, startSlot + i, buffers[i], strides[i]);
+}
+
+void CHeadlessRenderContext::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT /*offset*/)
+{
+    Record(ERenderCommand::SetIndexBuffer, 0, buffer, static_cast<unsigned int>(format));
+}
+
+void CHeadlessRenderContext::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+    Record(ERenderCommand::SetTopology, 0, nullptr, static_cast<unsigned int>(topology));
+}
+
+
+void CHeadlessRenderContext::VSSetShader(ID3D11VertexShader* shader)
+{
+    Record(ERenderCommand::SetVertexShader, 0, shader);
+}
+
+void CHeadlessRenderContext::PSSetShader(ID3D11PixelShader* shader)
+{
+    Record(ERenderCommand::SetPixelShader, 0, shader);
+}
+
+
+void CHeadlessRenderContext::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+    for (UINT i = 0; i < numBuffers; ++i)  Record(ERenderCommand::SetVSConstantBuffer, startSlot + i, buffers[i]);
+}
+
+void CHeadlessRenderContext::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+    for (UINT i = 0; i < numBuffers; ++i)  Record(ERenderCommand::SetPSConstantBuffer, startSlot + i, buffers[i]);
+}
+
+void CHeadlessRenderContext::VSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers,
+                                                   const UINT* firstConstants, const UINT* /*numConstants*/)
+{
+    for (UINT i = 0; i < numBuffers; ++i)  Record(ERenderCommand::SetVSConstantBuffer, startSlot + i, buffers[i], firstConstants[i]);
+}
+
+void CHeadlessRenderContext::PSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers,
+                                                   const UINT* firstConstants, const UINT* /*numConstants*/)
+{
+    for (UINT i = 0; i < numBuffers; ++i)  Record(ERenderCommand::SetPSConstantBuffer, startSlot + i, buffers[i], firstConstants[i]);
+}
+
+void CHeadlessRenderContext::PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views)
+{
+    for (UINT i = 0; i < numViews; ++i)  Record(ERenderCommand::SetPSShaderResource, startSlot + i, views[i]);
+}
+
+void CHeadlessRenderContext::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+    for (UINT i = 0; i < numSamplers; ++i)  Record(ERenderCommand::SetPSSampler, startSlot + i, samplers[i]);
+}
+
+
+void CHeadlessRenderContext::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargets, ID3D11DepthStencilView* depthStencil)
+{
+    unsigned int firstTarget = (numViews > 0) ? CHeadlessRenderDevice::ObjectId(renderTargets[0]) : 0;
+    Record(ERenderCommand::SetRenderTargets, numViews, depthStencil, firstTarget);
+}
+
+void CHeadlessRenderContext::OMSetBlendState(ID3D11BlendState* state, const FLOAT /*blendFactor*/[4], UINT /*sampleMask*/)
+{
+    Record(ERenderCommand::SetBlendState, 0, state);
+}
+
+void CHeadlessRenderContext::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+    Record(ERenderCommand::SetDepthStencilState, 0, state, stencilRef);
+}
+
+void CHeadlessRenderContext::RSSetState(ID3D11RasterizerState* state)
+{
+    Record(ERenderCommand::SetRasterizerState, 0, state);
+}
+
+void CHeadlessRenderContext::RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports)
+{
+    for (UINT i = 0; i < numViewports; ++i)
+    {
+        Record(ERenderCommand::SetViewport, i, nullptr, static_cast<unsigned int>(viewports[i].Width));
+    }
+}
+
+
+void CHeadlessRenderContext::ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT /*colour*/[4])
+{
+    Record(ERenderCommand::ClearRenderTarget, 0, renderTarget);
+}
+
+void CHeadlessRenderContext::ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, UINT clearFlags, FLOAT /*depth*/, UINT8 /*stencil*/)
+{
+    Record(ERenderCommand::ClearDepthStencil, 0, depthStencil, clearFlags);
+}
+
+
+void CHeadlessRenderContext::UpdateBuffer(ID3D11Buffer* buffer, const void* /*data*/, UINT size)
+{
+    mBytesUploaded += size;
+    Record(ERenderCommand::UpdateBuffer, 0, buffer, size);
+}
+
+
+void CHeadlessRenderContext::GenerateMips(ID3D11Resource* /*mipSource*/, ID3D11Resource* texture, ID3D11ShaderResourceView* /*textureSRV*/)
+{
+    Record(ERenderCommand::GenerateMips, 0, texture);
+}
+
+
+void CHeadlessRenderContext::Draw(UINT vertexCount, UINT startVertex)
+{
+    Record(ERenderCommand::Draw, startVertex, nullptr, vertexCount);
+}
+
+
+void CHeadlessRenderContext::DrawIndexed(UINT indexCount, UINT startIndex, INT /*baseVertex*/)
+{
+    Record(ERenderCommand::DrawIndexed, startIndex, nullptr, indexCount);
+}
+
+
+void CHeadlessRenderContext::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT /*startIndex*/,
+                                                  INT /*baseVertex*/, UINT /*startInstance*/)
+{
+    Record(ERenderCommand::DrawIndexedInstanced, instanceCount, nullptr, indexCountPerInstance);
+}
+
+
+void CHeadlessRenderContext::Present()
+{
+    Record(ERenderCommand::Present, 0, nullptr);
+}
+
+
+//-------------------------------------
+// Command log access
+//-------------------------------------
+
+void CHeadlessRenderContext::Clear()
+{
+    mCommands.clear();
+    for (auto& count : mCounts)  count = 0;
+    mBytesUploaded = 0;
+}
+
+void CHeadlessRenderContext::WriteLog(std::ostream& out)
+{
+    for (auto& command : mCommands)
+    {
+        out << RenderCommandName(command.type) << " slot=" << command.slot << " resource=" << command.resource
+            << " value=" << command.value << "\n";
+    }
+}
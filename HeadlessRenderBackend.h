@@ -0,0 +1,210 @@
+//--------------------------------------------------------------------------------------
+// Headless render backend
+//--------------------------------------------------------------------------------------
+// A render backend that needs no GPU. The device hands out placeholder handles for resources and the context
+// records every call in a command log instead of executing it. Used to run and profile the render loop
+// (e.g. CSceneManager::RenderScene) on machines without Direct3D hardware, and to check what the loop submits.
+// Needs no Windows SDK, so it is the backend of the portable build (CMakeLists.txt), e.g. the HeadlessFrame tool.
+
+#ifndef _HEADLESS_RENDER_BACKEND_H_INCLUDED_
+#define _HEADLESS_RENDER_BACKEND_H_INCLUDED_
+
+#include "RenderBackend.h"
+
+#include <unordered_set>
+#include <mutex>
+#include <vector>
+#include <ostream>
+
+
+//--------------------------------------------------------------------------------------
+// Command log
+//--------------------------------------------------------------------------------------
+
+enum class ERenderCommand : unsigned char
+{
+    SetInputLayout,
+    SetVertexBuffer,
+    SetIndexBuffer,
+    SetTopology,
+    SetVertexShader,
+    SetPixelShader,
+    SetVSConstantBuffer,
+    SetPSConstantBuffer,
+    SetPSShaderResource,
+    SetPSSampler,
+    SetRenderTargets,
+    SetBlendState,
+    SetDepthStencilState,
+    SetRasterizerState,
+    SetViewport,
+    ClearRenderTarget,
+    ClearDepthStencil,
+    UpdateBuffer,
+    GenerateMips,
+    Draw,
+    DrawIndexed,
+    DrawIndexedInstanced,
+    Present,
+    NumCommands
+};
+
+// Name of a command for logging
+const char* RenderCommandName(ERenderCommand command);
+
+// A single recorded command. Binds that cover several slots are recorded as one command per slot
+struct SRenderCommand
+{
+    ERenderCommand type;
+    unsigned int   slot;     // Binding slot. Number of render targets for SetRenderTargets, first vertex or index for Draw and DrawIndexed,
+                             // instance count for DrawIndexedInstanced
+    unsigned int   resource; // Id of the object bound, cleared, updated or given mip-maps (0 for null). Depth buffer for SetRenderTargets
+    unsigned int   value;    // Bytes for UpdateBuffer, vertex or index count (per instance) for draws, first render target id for SetRenderTargets,
+                             // first constant for constant buffers
+};
+
+
+//--------------------------------------------------------------------------------------
+// Device
+//--------------------------------------------------------------------------------------
+
+class CHeadlessRenderDevice : public IRenderDevice
+{
+public:
+    CHeadlessRenderDevice() {}
+    ~CHeadlessRenderDevice();
+
+    HRESULT CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Buffer** buffer) override;
+    HRESULT CreateTexture2D(const D3D11_TEXTURE2D_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Texture2D** texture) override;
+
+    HRESULT CreateShaderResourceView(ID3D11Resource* resource, const D3D11_SHADER_RESOURCE_VIEW_DESC* desc, ID3D11ShaderResourceView** view) override;
+    HRESULT CreateRenderTargetView  (ID3D11Resource* resource, const D3D11_RENDER_TARGET_VIEW_DESC*   desc, ID3D11RenderTargetView**   view) override;
+    HRESULT CreateDepthStencilView  (ID3D11Resource* resource, const D3D11_DEPTH_STENCIL_VIEW_DESC*   desc, ID3D11DepthStencilView**   view) override;
+
+    HRESULT CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC* elements, UINT numElements,
+                              const void* shaderByteCode, SIZE_T byteCodeLength, ID3D11InputLayout** layout) override;
+    HRESULT CreateVertexLayout(const D3D11_INPUT_ELEMENT_DESC* elements, UINT numElements, ID3D11InputLayout** layout) override;
+    HRESULT CreateVertexShader(const void* byteCode, SIZE_T byteCodeLength, ID3D11VertexShader** shader) override;
+    HRESULT CreatePixelShader (const void* byteCode, SIZE_T byteCodeLength, ID3D11PixelShader**  shader) override;
+
+    HRESULT CreateSamplerState     (const D3D11_SAMPLER_DESC*       desc, ID3D11SamplerState**      state) override;
+    HRESULT CreateBlendState       (const D3D11_BLEND_DESC*         desc, ID3D11BlendState**        state) override;
+    HRESULT CreateRasterizerState  (const D3D11_RASTERIZER_DESC*    desc, ID3D11RasterizerState**   state) override;
+    HRESULT CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC* desc, ID3D11DepthStencilState** state) override;
+
+    // Does not read the file, just creates placeholder texture and view handles. Loading from memory always gives a
+    // mip source too, so the caller's GenerateMips path is run
+    bool LoadTexture(const std::string& filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV) override;
+    bool LoadTextureFromMemory(const std::string& filename, const void* data, size_t size,
+                               ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV,
+                               ID3D11Resource** mipSource) override;
+
+    // Frees the placeholder object. Objects not released are freed with the device
+    void Release(IUnknown* resource) override;
+
+    // Number of objects created and not yet released
+    unsigned int NumObjects();
+
+    // Id of an object created by a headless device (ids start at 1 and are never reused), 0 for null
+    static unsigned int ObjectId(const void* handle);
+
+private:
+    // The handles given out are pointers to these. They are never dereferenced as Direct3D objects
+    struct SObject
+    {
+        unsigned int id;
+        unsigned int byteSize; // Size of buffers, 0 for other objects
+    };
+
+    // Create a new placeholder object and return it as the requested handle type
+    template <class T>
+    HRESULT NewObject(T** handle, unsigned int byteSize = 0);
+
+    std::unordered_set<SObject*> mObjects;    // Each allocated separately, so handles stay valid until released
+    unsigned int                 mNextId = 1;
+    std::mutex                   mMutex;      // Objects can be created and released on any thread, as with a Direct3D device
+};
+
+
+//--------------------------------------------------------------------------------------
+// Context
+//--------------------------------------------------------------------------------------
+
+class CHeadlessRenderContext : public IRenderContext
+{
+public:
+    void IASetInputLayout(ID3D11InputLayout* layout) override;
+    void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets) override;
+    void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset) override;
+    void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override;
+
+    void VSSetShader(ID3D11VertexShader* shader) override;
+    void PSSetShader(ID3D11PixelShader*  shader) override;
+
+    void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers) override;
+    void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers) override;
+    void VSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers,
+                               const UINT* firstConstants, const UINT* numConstants) override;
+    void PSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers,
+                               const UINT* firstConstants, const UINT* numConstants) override;
+    void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views) override;
+    void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) override;
+
+    void OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargets, ID3D11DepthStencilView* depthStencil) override;
+    void OMSetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask) override;
+    void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef) override;
+    void RSSetState(ID3D11RasterizerState* state) override;
+    void RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports) override;
+
+    void ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT colour[4]) override;
+    void ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, UINT clearFlags, FLOAT depth, UINT8 stencil) override;
+
+    void UpdateBuffer(ID3D11Buffer* buffer, const void* data, UINT size) override;
+    void GenerateMips(ID3D11Resource* mipSource, ID3D11Resource* texture, ID3D11ShaderResourceView* textureSRV) override;
+
+    void Draw(UINT vertexCount, UINT startVertex) override;
+    void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex) override;
+    void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance) override;
+
+    void Present() override;
+
+    // Supported unless turned off below
+    bool SupportsConstantBufferOffsets() override  { return mConstantBufferOffsets; }
+
+    // Pretend to be a device without constant buffer offsets, to test and profile the code that copes without them
+    void SetConstantBufferOffsets(bool supported)  { mConstantBufferOffsets = supported; }
+
+
+    //-------------------------------------
+    // Command log access
+    //-------------------------------------
+
+    const std::vector<SRenderCommand>& Commands()  { return mCommands; }
+
+    // Number of commands of the given type recorded since the last clear
+    unsigned int Count(ERenderCommand type)  { return mCounts[static_cast<int>(type)]; }
+
+    // Total bytes passed to UpdateBuffer since the last clear
+    unsigned int BytesUploaded()  { return mBytesUploaded; }
+
+    // Set this to false to keep only the counts above - avoids the log growing when profiling many frames
+    void SetRecording(bool recording)  { mRecording = recording; }
+
+    // Empty the log and reset the counts
+    void Clear();
+
+    // Write the log as text, one command per line
+    void WriteLog(std::ostream& out);
+
+private:
+    void Record(ERenderCommand type, unsigned int slot, const void* resource, unsigned int value = 0);
+
+    std::vector<SRenderCommand> mCommands;
+    unsigned int mCounts[static_cast<int>(ERenderCommand::NumCommands)] = {};
+    unsigned int mBytesUploaded = 0;
+    bool         mRecording = true;
+    bool         mConstantBufferOffsets = true;
+};
+
+
+#endif //_HEADLESS_RENDER_BACKEND_H_INCLUDED_
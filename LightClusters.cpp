@@ -0,0 +1,440 @@
+//--------------------------------------------------------------------------------------
+// Clustered forward lighting - binning lights into clusters of the view frustum
+//--------------------------------------------------------------------------------------
+
+#include "LightClusters.h"
+#include "MathSIMD.h"
+
+#include <cmath>
+#include <algorithm>
+#include <iomanip>
+
+
+// Spotlights are flagged in the (cluster, light) pairs so they can be packed after the point lights
+static const uint32_t SpotlightFlag = 0x80000000u;
+
+
+CLightClusters::CLightClusters(unsigned int countX /*= 16*/, unsigned int countY /*= 9*/, unsigned int countZ /*= 24*/,
+                               unsigned int maxLightIndices /*= 128 * 1024*/)
+    : mCountX(countX), mCountY(countY), mCountZ(countZ), mMaxLightIndices(maxLightIndices)
+{
+    mSliceSize = mCountX * mCountY + 3;
+    mSlices.resize(mCountZ);
+    mClusters.resize(NumClusters());
+    mPointCounts.resize(NumClusters());
+    mSpotCounts.resize(NumClusters());
+}
+
+
+//--------------------------------------------------------------------------------------
+// GPU resources
+//--------------------------------------------------------------------------------------
+
+bool CLightClusters::CreateResources(unsigned int maxPointLights, unsigned int maxSpotlights)
+{
+    // Counts are packed into 16 bits for each cluster
+    mMaxPointLights = (maxPointLights < 0xFFFF) ? maxPointLights : 0xFFFF;
+    mMaxSpotlights  = (maxSpotlights  < 0xFFFF) ? maxSpotlights  : 0xFFFF;
+
+    const UINT strides[NumBuffers]  = { sizeof(PointLight), sizeof(Spotlight), sizeof(SCluster), sizeof(uint32_t) };
+    const UINT elements[NumBuffers] = { mMaxPointLights, mMaxSpotlights, NumClusters(), mMaxLightIndices };
+    for (int i = 0; i < NumBuffers; ++i)
+    {
+        D3D11_BUFFER_DESC bufferDesc;
+        bufferDesc.ByteWidth           = strides[i] * (elements[i] > 0 ? elements[i] : 1);
+        bufferDesc.Usage               = D3D11_USAGE_DYNAMIC; // Rewritten every frame
+        bufferDesc.BindFlags           = D3D11_BIND_SHADER_RESOURCE;
+        bufferDesc.CPUAccessFlags      = D3D11_CPU_ACCESS_WRITE;
+        bufferDesc.MiscFlags           = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        bufferDesc.StructureByteStride = strides[i];
+        if (FAILED(gRenderDevice->CreateBuffer(&bufferDesc, nullptr, &mBuffers[i])))
+        {
+            mBuffers[i] = nullptr;
+            ReleaseResources();
+            return false;
+        }
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format              = DXGI_FORMAT_UNKNOWN; // Structured buffers have no format
+        srvDesc.ViewDimension       = D3D11_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.FirstElement = 0;
+        srvDesc.Buffer.NumElements  = bufferDesc.ByteWidth / strides[i];
+        if (FAILED(gRenderDevice->CreateShaderResourceView(mBuffers[i], &srvDesc, &mBufferSRVs[i])))
+        {
+            mBufferSRVs[i] = nullptr;
+            ReleaseResources();
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void CLightClusters::ReleaseResources()
+{
+    for (int i = 0; i < NumBuffers; ++i)
+    {
+        if (mBufferSRVs[i])  gRenderDevice->Release(mBufferSRVs[i]);
+        if (mBuffers[i])     gRenderDevice->Release(mBuffers[i]);
+        mBufferSRVs[i] = nullptr;
+        mBuffers[i] = nullptr;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Cluster bounds
+//--------------------------------------------------------------------------------------
+
+// Build the view space bounds of each cluster. projX and projY are the x and y scales from the projection matrix,
+// so a point at view depth z is at the edge of the screen when x = z / projX
+void CLightClusters::BuildSlices(float projX, float projY, float nearClip, float farClip)
+{
+    mProjX = projX;
+    mProjY = projY;
+    mNearClip = nearClip;
+    mFarClip = farClip;
+
+    // Slice k covers depths near * (far / near)^(k / countZ) to the same for k + 1
+    float logDepthRange = std::log(farClip / nearClip);
+    mDepthScale = mCountZ / logDepthRange;
+    mDepthBias  = -std::log(nearClip) * mDepthScale;
+
+    for (unsigned int k = 0; k < mCountZ; ++k)
+    {
+        SSlice& slice = mSlices[k];
+        slice.minZ = nearClip * std::exp(logDepthRange * k / mCountZ);
+        slice.maxZ = nearClip * std::exp(logDepthRange * (k + 1) / mCountZ);
+        slice.centreZ = (slice.minZ + slice.maxZ) * 0.5f;
+        float halfDepth = (slice.maxZ - slice.minZ) * 0.5f;
+
+        slice.minX.assign(mSliceSize, 0);  slice.maxX.assign(mSliceSize, 0);
+        slice.minY.assign(mSliceSize, 0);  slice.maxY.assign(mSliceSize, 0);
+        slice.centreX.assign(mSliceSize, 0);  slice.centreY.assign(mSliceSize, 0);  slice.radius.assign(mSliceSize, 0);
+        for (unsigned int j = 0; j < mCountY; ++j)
+        {
+            for (unsigned int i = 0; i < mCountX; ++i)
+            {
+                // Screen edges of the cluster (-1 to 1), widest at whichever end of the slice is further from the centre
+                float left   = -1.0f + 2.0f * i / mCountX;
+                float right  = -1.0f + 2.0f * (i + 1) / mCountX;
+                float bottom = -1.0f + 2.0f * j / mCountY;
+                float top    = -1.0f + 2.0f * (j + 1) / mCountY;
+
+                unsigned int c = j * mCountX + i;
+                slice.minX[c] = ((left   < 0) ? left   * slice.maxZ : left   * slice.minZ) / projX;
+                slice.maxX[c] = ((right  > 0) ? right  * slice.maxZ : right  * slice.minZ) / projX;
+                slice.minY[c] = ((bottom < 0) ? bottom * slice.maxZ : bottom * slice.minZ) / projY;
+                slice.maxY[c] = ((top    > 0) ? top    * slice.maxZ : top    * slice.minZ) / projY;
+
+                float halfX = (slice.maxX[c] - slice.minX[c]) * 0.5f;
+                float halfY = (slice.maxY[c] - slice.minY[c]) * 0.5f;
+                slice.centreX[c] = slice.minX[c] + halfX;
+                slice.centreY[c] = slice.minY[c] + halfY;
+                slice.radius[c]  = std::sqrt(halfX * halfX + halfY * halfY + halfDepth * halfDepth);
+            }
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Overlap tests, four clusters at a time
+//--------------------------------------------------------------------------------------
+
+#ifdef MATH_USE_SSE
+
+// Sphere against the bounding boxes of four clusters: the squared distance from the centre to the nearest point of
+// each box is compared to the squared radius
+unsigned int CLightClusters::SphereMask(const SSlice& slice, unsigned int first, const CVector3& centre, float radius)
+{
+    const __m128 zero = _mm_setzero_ps();
+    __m128 x = _mm_set1_ps(centre.x);
+    __m128 y = _mm_set1_ps(centre.y);
+    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&slice.minX[first]), x), _mm_sub_ps(x, _mm_loadu_ps(&slice.maxX[first]))), zero);
+    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&slice.minY[first]), y), _mm_sub_ps(y, _mm_loadu_ps(&slice.maxY[first]))), zero);
+
+    // All the clusters in a slice have the same depth range
+    float dz = (centre.z < slice.minZ) ? slice.minZ - centre.z : (centre.z > slice.maxZ) ? centre.z - slice.maxZ : 0.0f;
+
+    __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_set1_ps(dz * dz));
+    return _mm_movemask_ps(_mm_cmple_ps(distanceSquared, _mm_set1_ps(radius * radius)));
+}
+
+// Cone against the bounding spheres of four clusters. A cluster is outside the cone if it is entirely beyond the
+// sides of the cone, in front of its range or behind the light
+unsigned int CLightClusters::ConeMask(const SSlice& slice, unsigned int first, const CVector3& position, const CVector3& facing,
+                                      float range, float cosHalfAngle, float sinHalfAngle)
+{
+    __m128 vx = _mm_sub_ps(_mm_loadu_ps(&slice.centreX[first]), _mm_set1_ps(position.x));
+    __m128 vy = _mm_sub_ps(_mm_loadu_ps(&slice.centreY[first]), _mm_set1_ps(position.y));
+    __m128 vz = _mm_set1_ps(slice.centreZ - position.z);
+    __m128 radius = _mm_loadu_ps(&slice.radius[first]);
+
+    // Distance along the cone's axis, and from the cluster centre to the nearest point on the side of the cone
+    __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+    __m128 axial = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_set1_ps(facing.x)), _mm_mul_ps(vy, _mm_set1_ps(facing.y))),
+                              _mm_mul_ps(vz, _mm_set1_ps(facing.z)));
+    __m128 perpendicular = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lengthSquared, _mm_mul_ps(axial, axial)), _mm_setzero_ps()));
+    __m128 sideDistance = _mm_sub_ps(_mm_mul_ps(perpendicular, _mm_set1_ps(cosHalfAngle)), _mm_mul_ps(axial, _mm_set1_ps(sinHalfAngle)));
+
+    __m128 inside = _mm_and_ps(_mm_cmple_ps(sideDistance, radius),
+                    _mm_and_ps(_mm_cmple_ps(axial, _mm_add_ps(radius, _mm_set1_ps(range))),
+                               _mm_cmpge_ps(axial, _mm_sub_ps(_mm_setzero_ps(), radius))));
+    return _mm_movemask_ps(inside);
+}
+
+#else
+
+unsigned int CLightClusters::SphereMask(const SSlice& slice, unsigned int first, const CVector3& centre, float radius)
+{
+    float dz = (centre.z < slice.minZ) ? slice.minZ - centre.z : (centre.z > slice.maxZ) ? centre.z - slice.maxZ : 0.0f;
+    unsigned int mask = 0;
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        unsigned int c = first + i;
+        float dx = (centre.x < slice.minX[c]) ? slice.minX[c] - centre.x : (centre.x > slice.maxX[c]) ? centre.x - slice.maxX[c] : 0.0f;
+        float dy = (centre.y < slice.minY[c]) ? slice.minY[c] - centre.y : (centre.y > slice.maxY[c]) ? centre.y - slice.maxY[c] : 0.0f;
+        if (dx * dx + dy * dy + dz * dz <= radius * radius)  mask |= 1u << i;
+    }
+    return mask;
+}
+
+unsigned int CLightClusters::ConeMask(const SSlice& slice, unsigned int first, const CVector3& position, const CVector3& facing,
+                                      float range, float cosHalfAngle, float sinHalfAngle)
+{
+    unsigned int mask = 0;
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        unsigned int c = first + i;
+        CVector3 v = { slice.centreX[c] - position.x, slice.centreY[c] - position.y, slice.centreZ - position.z };
+        float axial = Dot(v, facing);
+        float perpendicularSquared = Dot(v, v) - axial * axial;
+        float perpendicular = std::sqrt(perpendicularSquared > 0 ? perpendicularSquared : 0.0f);
+        float sideDistance = perpendicular * cosHalfAngle - axial * sinHalfAngle;
+        float radius = slice.radius[c];
+        if (sideDistance <= radius && axial <= radius + range && axial >= -radius)  mask |= 1u << i;
+    }
+    return mask;
+}
+
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Binning
+//--------------------------------------------------------------------------------------
+
+void CLightClusters::SetLights(const PointLight* pointLights, unsigned int numPointLights, const Spotlight* spotlights, unsigned int numSpotlights)
+{
+    if (numPointLights > mMaxPointLights)  numPointLights = mMaxPointLights;
+    if (numSpotlights  > mMaxSpotlights)   numSpotlights  = mMaxSpotlights;
+    mPointLights.assign(pointLights, pointLights + numPointLights);
+    mSpotlights.assign(spotlights, spotlights + numSpotlights);
+
+    if (mBuffers[PointLightBuffer] != nullptr && numPointLights > 0)
+    {
+        gRenderContext->UpdateBuffer(mBuffers[PointLightBuffer], mPointLights.data(), numPointLights * sizeof(PointLight));
+    }
+    if (mBuffers[SpotlightBuffer] != nullptr && numSpotlights > 0)
+    {
+        gRenderContext->UpdateBuffer(mBuffers[SpotlightBuffer], mSpotlights.data(), numSpotlights * sizeof(Spotlight));
+    }
+}
+
+
+// Add (cluster, light) pairs for every cluster the mask function reports as overlapping. The clusters tested are
+// limited to the rows, columns and slices that the light's bounding sphere covers
+template <class MaskFunction>
+void CLightClusters::BinLight(uint32_t light, const CVector3& centre, float radius, MaskFunction mask)
+{
+    float minZ = centre.z - radius;
+    float maxZ = centre.z + radius;
+    if (maxZ < mNearClip || minZ > mFarClip)  return;
+
+    int firstSlice = (minZ > mNearClip) ? static_cast<int>(std::log(minZ) * mDepthScale + mDepthBias) : 0;
+    int lastSlice  = (maxZ < mFarClip)  ? static_cast<int>(std::log(maxZ) * mDepthScale + mDepthBias) : mCountZ - 1;
+    if (firstSlice < 0)  firstSlice = 0;
+    if (lastSlice > static_cast<int>(mCountZ) - 1)  lastSlice = mCountZ - 1;
+
+    // Screen area (-1 to 1) covered by the box around the sphere, which is between the projections of its corners.
+    // If the sphere crosses the near clip plane it could cover any part of the screen
+    int firstColumn = 0, lastColumn = mCountX - 1;
+    int firstRow    = 0, lastRow    = mCountY - 1;
+    if (minZ > mNearClip)
+    {
+        float left   = (centre.x - radius) * mProjX / ((centre.x - radius < 0) ? minZ : maxZ);
+        float right  = (centre.x + radius) * mProjX / ((centre.x + radius > 0) ? minZ : maxZ);
+        float bottom = (centre.y - radius) * mProjY / ((centre.y - radius < 0) ? minZ : maxZ);
+        float top    = (centre.y + radius) * mProjY / ((centre.y + radius > 0) ? minZ : maxZ);
+        if (right < -1.0f || left > 1.0f || top < -1.0f || bottom > 1.0f)  return;
+
+        if (left   > -1.0f)  firstColumn = static_cast<int>((left   * 0.5f + 0.5f) * mCountX);
+        if (right  <  1.0f)  lastColumn  = static_cast<int>((right  * 0.5f + 0.5f) * mCountX);
+        if (bottom > -1.0f)  firstRow    = static_cast<int>((bottom * 0.5f + 0.5f) * mCountY);
+        if (top    <  1.0f)  lastRow     = static_cast<int>((top    * 0.5f + 0.5f) * mCountY);
+        if (lastColumn > static_cast<int>(mCountX) - 1)  lastColumn = mCountX - 1;
+        if (lastRow    > static_cast<int>(mCountY) - 1)  lastRow    = mCountY - 1;
+    }
+
+    unsigned int clustersInSlice = mCountX * mCountY;
+    for (int k = firstSlice; k <= lastSlice; ++k)
+    {
+        const SSlice& slice = mSlices[k];
+        for (int j = firstRow; j <= lastRow; ++j)
+        {
+            // Four clusters at a time along the row, any beyond the last column are ignored
+            for (int i = firstColumn; i <= lastColumn; i += 4)
+            {
+                unsigned int first = j * mCountX + i;
+                unsigned int bits = mask(slice, first);
+                if (bits == 0)  continue;
+                for (int lane = 0; lane < 4 && i + lane <= lastColumn; ++lane)
+                {
+                    if (bits & (1u << lane))  mPairs.push_back({ k * clustersInSlice + first + lane, light });
+                }
+            }
+        }
+    }
+}
+
+
+// Transform a direction (w = 0) by a matrix
+static CVector3 TransformDirection(const CMatrix4x4& m, const CVector3& v)
+{
+    return { v.x * m.e00 + v.y * m.e10 + v.z * m.e20,
+             v.x * m.e01 + v.y * m.e11 + v.z * m.e21,
+             v.x * m.e02 + v.y * m.e12 + v.z * m.e22 };
+}
+
+
+void CLightClusters::Bin(const CMatrix4x4& viewMatrix, const CMatrix4x4& projectionMatrix, float nearClip, float farClip)
+{
+    mTimer.Reset();
+
+    if (projectionMatrix.e00 != mProjX || projectionMatrix.e11 != mProjY || nearClip != mNearClip || farClip != mFarClip)
+    {
+        BuildSlices(projectionMatrix.e00, projectionMatrix.e11, nearClip, farClip);
+    }
+
+    //// Find the clusters each light overlaps ////
+
+    // Point lights are binned before spotlights so that packing (which keeps the order) puts them first in each cluster
+    mPairs.clear();
+    for (uint32_t i = 0; i < mPointLights.size(); ++i)
+    {
+        CVector3 centre = viewMatrix.TransformPoint(mPointLights[i].position);
+        float radius = mPointLights[i].range;
+        BinLight(i, centre, radius,
+                 [&](const SSlice& slice, unsigned int first) { return SphereMask(slice, first, centre, radius); });
+    }
+
+    for (uint32_t i = 0; i < mSpotlights.size(); ++i)
+    {
+        const Spotlight& light = mSpotlights[i];
+        CVector3 position = viewMatrix.TransformPoint(light.position);
+        CVector3 facing = TransformDirection(viewMatrix, light.facing);
+        float range = light.range;
+        float cosHalfAngle = light.cosHalfAngle;
+        float sinHalfAngle = std::sqrt(1.0f - cosHalfAngle * cosHalfAngle);
+
+        // Sphere around the lit region of the cone (the part of a sphere of the light's range inside the cone).
+        // Wide cones use the sphere through the rim, narrow ones the sphere through the rim and the light
+        CVector3 centre;
+        float radius;
+        if (cosHalfAngle < 0.7071f)
+        {
+            centre = position + facing * (range * cosHalfAngle);
+            radius = range * sinHalfAngle;
+        }
+        else
+        {
+            radius = range / (2.0f * cosHalfAngle);
+            centre = position + facing * radius;
+        }
+
+        // The cheaper sphere test first, the cone test only when the sphere overlaps some clusters
+        BinLight(i | SpotlightFlag, centre, radius,
+                 [&](const SSlice& slice, unsigned int first)
+                 {
+                     unsigned int mask = SphereMask(slice, first, centre, radius);
+                     return mask ? mask & ConeMask(slice, first, position, facing, range, cosHalfAngle, sinHalfAngle) : 0;
+                 });
+    }
+
+
+    //// Pack the lights of each cluster into one list ////
+
+    // Count the lights in each cluster, then give each cluster its range of the list
+    std::fill(mPointCounts.begin(), mPointCounts.end(), 0);
+    std::fill(mSpotCounts.begin(),  mSpotCounts.end(),  0);
+    for (auto& pair : mPairs)
+    {
+        if (pair.light & SpotlightFlag)  ++mSpotCounts[pair.cluster];
+        else                             ++mPointCounts[pair.cluster];
+    }
+
+    uint32_t numIndices = 0;
+    mMaxLightsInCluster = 0;
+    mIndicesDropped = 0;
+    for (unsigned int c = 0; c < NumClusters(); ++c)
+    {
+        // If the list is full the remaining lights of the cluster are dropped, spotlights first
+        uint32_t space = mMaxLightIndices - numIndices;
+        uint32_t numPoints = (mPointCounts[c] < space) ? mPointCounts[c] : space;
+        uint32_t numSpots  = (mSpotCounts[c] < space - numPoints) ? mSpotCounts[c] : space - numPoints;
+        mIndicesDropped += mPointCounts[c] + mSpotCounts[c] - numPoints - numSpots;
+
+        mClusters[c].firstLight = numIndices;
+        mClusters[c].counts = numPoints | (numSpots << 16);
+        numIndices += numPoints + numSpots;
+        if (numPoints + numSpots > mMaxLightsInCluster)  mMaxLightsInCluster = numPoints + numSpots;
+
+        // Reuse the counts as the next free entry for each cluster's point lights and spotlights
+        mPointCounts[c] = 0;
+        mSpotCounts[c]  = 0;
+    }
+
+    mLightIndices.resize(numIndices);
+    for (auto& pair : mPairs)
+    {
+        const SCluster& cluster = mClusters[pair.cluster];
+        uint32_t numPoints = cluster.counts & 0xFFFF;
+        if (pair.light & SpotlightFlag)
+        {
+            uint32_t& next = mSpotCounts[pair.cluster];
+            if (next < (cluster.counts >> 16))  mLightIndices[cluster.firstLight + numPoints + next++] = pair.light & ~SpotlightFlag;
+        }
+        else
+        {
+            uint32_t& next = mPointCounts[pair.cluster];
+            if (next < numPoints)  mLightIndices[cluster.firstLight + next++] = pair.light;
+        }
+    }
+
+    mBinTime = mTimer.GetTime();
+}
+
+
+void CLightClusters::Upload(UINT firstSlot)
+{
+    if (mBuffers[ClusterBuffer] == nullptr)  return;
+
+    gRenderContext->UpdateBuffer(mBuffers[ClusterBuffer], mClusters.data(), NumClusters() * sizeof(SCluster));
+    if (!mLightIndices.empty())
+    {
+        gRenderContext->UpdateBuffer(mBuffers[IndexBuffer], mLightIndices.data(), NumLightIndices() * sizeof(uint32_t));
+    }
+    gRenderContext->PSSetShaderResources(firstSlot, NumBuffers, mBufferSRVs);
+}
+
+
+void CLightClusters::WriteReport(std::ostream& out)
+{
+    out << "Light clusters " << mCountX << "x" << mCountY << "x" << mCountZ << ", " << mPointLights.size()
+        << " point lights, " << mSpotlights.size() << " spotlights\n";
+    out << std::fixed << std::setprecision(3);
+    out << "Bin time " << mBinTime * 1000 << "ms, light indices " << NumLightIndices() << " (average "
+        << static_cast<float>(NumLightIndices()) / NumClusters() << " per cluster, most " << mMaxLightsInCluster
+        << "), dropped " << mIndicesDropped << "\n";
+}
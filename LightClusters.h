@@ -0,0 +1,159 @@
+//--------------------------------------------------------------------------------------
+// Clustered forward lighting - binning lights into clusters of the view frustum
+//--------------------------------------------------------------------------------------
+// The camera's view frustum is divided into a grid of clusters ("froxels"): an even grid across the screen and
+// slices in depth that get thicker with distance (logarithmic, so each cluster is roughly cube shaped). Each frame
+// every point light's sphere and spotlight's cone is tested against the clusters, four at a time with SIMD (see
+// MathSIMD.h), and each cluster gets a list of the lights that can reach it. The lists are packed together into one
+// compact index list.
+//
+// The lights, the cluster grid and the index list are uploaded in structured buffers. The lit pixel shaders find the
+// cluster of their pixel (FindLightCluster in Common.hlsli) and only loop over the lights in its list, rather than
+// over every light in the scene.
+//
+// Binning is done on the CPU without the device, so can be run and timed headlessly. Only CreateResources and
+// Upload use the render backend.
+
+#ifndef _LIGHT_CLUSTERS_H_INCLUDED_
+#define _LIGHT_CLUSTERS_H_INCLUDED_
+
+#include "Common.h"
+#include "Timer.h"
+
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+
+class CLightClusters
+{
+public:
+    // A grid of countX x countY clusters across the screen, with countZ depth slices. The index list holds up to
+    // maxLightIndices entries, lights that don't fit are left out of their clusters (counted in IndicesDropped)
+    CLightClusters(unsigned int countX = 16, unsigned int countY = 9, unsigned int countZ = 24,
+                   unsigned int maxLightIndices = 128 * 1024);
+
+    // Create the structured buffers and views for the given maximum number of lights. Returns false on failure
+    bool CreateResources(unsigned int maxPointLights, unsigned int maxSpotlights);
+    void ReleaseResources();
+
+
+    //-------------------------------------
+    // Binning
+    //-------------------------------------
+
+    // Set the lights for this frame and upload them. The position, range, facing and cosHalfAngle are used for
+    // binning. Lights beyond the maximum given to CreateResources are ignored
+    void SetLights(const PointLight* pointLights, unsigned int numPointLights, const Spotlight* spotlights, unsigned int numSpotlights);
+
+    // Bin the lights into clusters for a camera with the given matrices and clip distances. The projection must be
+    // a centred perspective projection (as from MakeProjectionMatrix)
+    void Bin(const CMatrix4x4& viewMatrix, const CMatrix4x4& projectionMatrix, float nearClip, float farClip);
+
+    // Upload the clusters from the last Bin and bind the four light buffers to consecutive pixel shader slots from
+    // the given slot: point lights, spotlights, cluster grid, light index list (t6-t9 in Common.hlsli)
+    void Upload(UINT firstSlot);
+
+
+    //-------------------------------------
+    // Shader constants
+    //-------------------------------------
+
+    unsigned int CountX()  { return mCountX; }
+    unsigned int CountY()  { return mCountY; }
+    unsigned int CountZ()  { return mCountZ; }
+
+    // The depth slice of a view space depth z is floor(log(z) * DepthScale + DepthBias)
+    float DepthScale()  { return mDepthScale; }
+    float DepthBias()   { return mDepthBias;  }
+
+
+    //-------------------------------------
+    // Results and statistics
+    //-------------------------------------
+
+    // Each cluster holds the first entry of its lights in the index list, then its point lights and spotlights
+    struct SCluster
+    {
+        uint32_t firstLight;
+        uint32_t counts; // Number of point lights in the low 16 bits, spotlights in the high 16 bits
+    };
+    const std::vector<SCluster>& Clusters()      { return mClusters;     }
+    const std::vector<uint32_t>& LightIndices()  { return mLightIndices; }
+
+    unsigned int NumClusters()     { return mCountX * mCountY * mCountZ; }
+    unsigned int NumLightIndices() { return static_cast<unsigned int>(mLightIndices.size()); }
+    unsigned int MaxLightsInCluster()  { return mMaxLightsInCluster; }
+    unsigned int IndicesDropped()      { return mIndicesDropped;     }
+
+    // Seconds taken by the last Bin
+    float BinTime()  { return mBinTime; }
+
+    // Write a summary of the last Bin
+    void WriteReport(std::ostream& out);
+
+
+private:
+    // Bounds of the clusters in one depth slice in view space, structure of arrays so four clusters can be tested at
+    // once. Each cluster has a bounding box and a bounding sphere, all share the slice's depth range. The arrays are
+    // padded so four clusters can be read from any cluster, results for the padding are ignored
+    struct SSlice
+    {
+        float minZ, maxZ, centreZ;
+        std::vector<float> minX, maxX, minY, maxY;
+        std::vector<float> centreX, centreY, radius;
+    };
+
+    // Build the slice bounds for the given projection, only done when it changes
+    void BuildSlices(float projX, float projY, float nearClip, float farClip);
+
+    // Masks of the four clusters from the given one that overlap a sphere or a cone (bit set if overlapping)
+    static unsigned int SphereMask(const SSlice& slice, unsigned int first, const CVector3& centre, float radius);
+    static unsigned int ConeMask(const SSlice& slice, unsigned int first, const CVector3& position, const CVector3& facing,
+                                 float range, float cosHalfAngle, float sinHalfAngle);
+
+    // Add a light index to every cluster overlapping the light. Only the clusters overlapping the screen area and
+    // depth range of the given bounding sphere of the light are tested
+    template <class MaskFunction>
+    void BinLight(uint32_t light, const CVector3& centre, float radius, MaskFunction mask);
+
+    unsigned int mCountX, mCountY, mCountZ;
+    unsigned int mSliceSize; // Clusters per slice plus padding
+    unsigned int mMaxLightIndices;
+
+    // Projection the slices were built for
+    float mProjX = 0, mProjY = 0, mNearClip = 0, mFarClip = 0;
+    float mDepthScale = 0, mDepthBias = 0;
+    std::vector<SSlice> mSlices;
+
+    // Lights for this frame
+    std::vector<PointLight> mPointLights;
+    std::vector<Spotlight>  mSpotlights;
+    unsigned int mMaxPointLights = 0;
+    unsigned int mMaxSpotlights = 0;
+
+    // Binning results. Lights are first added as (cluster, light) pairs, which are counted and packed into the lists
+    struct SClusterLight
+    {
+        uint32_t cluster;
+        uint32_t light;
+    };
+    std::vector<SClusterLight> mPairs;
+    std::vector<SCluster>      mClusters;
+    std::vector<uint32_t>      mLightIndices;
+    std::vector<uint32_t>      mPointCounts; // Per-cluster counts while packing
+    std::vector<uint32_t>      mSpotCounts;
+    unsigned int mMaxLightsInCluster = 0;
+    unsigned int mIndicesDropped = 0;
+
+    Timer mTimer;
+    float mBinTime = 0;
+
+    // GPU buffers and views: point lights, spotlights, cluster grid, light indices
+    enum { PointLightBuffer, SpotlightBuffer, ClusterBuffer, IndexBuffer, NumBuffers };
+    ID3D11Buffer*             mBuffers[NumBuffers]     = {};
+    ID3D11ShaderResourceView* mBufferSRVs[NumBuffers]  = {};
+};
+
+
+#endif //_LIGHT_CLUSTERS_H_INCLUDED_
@@ -0,0 +1,59 @@
+//--------------------------------------------------------------------------------------
+// View frustum class, six planes used to test if objects can be seen by a camera
+//--------------------------------------------------------------------------------------
+
+#include "CFrustum.h"
+#include <cmath>
+
+
+/*-----------------------------------------------------------------------------------------
+    Constructors
+-----------------------------------------------------------------------------------------*/
+
+// Construct by extracting the planes from a combined view-projection matrix (DirectX clip space, 0 <= z <= w)
+// A point is inside when -w <= x <= w, -w <= y <= w and 0 <= z <= w, where x, y, z and w are the dot products
+// of the point with the matrix columns. Each of those conditions gives one plane (Gribb & Hartmann method)
+CFrustum::CFrustum(const CMatrix4x4& vp)
+{
+    planes[Left]   = { { vp.e03 + vp.e00, vp.e13 + vp.e10, vp.e23 + vp.e20 }, vp.e33 + vp.e30 };
+    planes[Right]  = { { vp.e03 - vp.e00, vp.e13 - vp.e10, vp.e23 - vp.e20 }, vp.e33 - vp.e30 };
+    planes[Bottom] = { { vp.e03 + vp.e01, vp.e13 + vp.e11, vp.e23 + vp.e21 }, vp.e33 + vp.e31 };
+    planes[Top]    = { { vp.e03 - vp.e01, vp.e13 - vp.e11, vp.e23 - vp.e21 }, vp.e33 - vp.e31 };
+    planes[Near]   = { { vp.e02,          vp.e12,          vp.e22          }, vp.e32          };
+    planes[Far]    = { { vp.e03 - vp.e02, vp.e13 - vp.e12, vp.e23 - vp.e22 }, vp.e33 - vp.e32 };
+
+    // Normalise the planes so the sphere test can compare distances with the radius
+    for (auto& plane : planes)
+    {
+        float invLength = 1.0f / Length(plane.normal);
+        plane.normal *= invLength;
+        plane.d *= invLength;
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Member functions
+-----------------------------------------------------------------------------------------*/
+
+// Returns false if the given world space sphere is entirely outside the frustum
+bool CFrustum::IsSphereVisible(const CVector3& centre, float radius) const
+{
+    for (auto& plane : planes)
+    {
+        if (Dot(plane.normal, centre) + plane.d < -radius)  return false;
+    }
+    return true;
+}
+
+// Returns false if the given world space axis aligned box (centre and half-size in each axis) is entirely outside the frustum
+bool CFrustum::IsBoxVisible(const CVector3& centre, const CVector3& extents) const
+{
+    for (auto& plane : planes)
+    {
+        // Distance the box reaches towards the plane normal
+        float reach = extents.x * std::abs(plane.normal.x) + extents.y * std::abs(plane.normal.y) + extents.z * std::abs(plane.normal.z);
+        if (Dot(plane.normal, centre) + plane.d < -reach)  return false;
+    }
+    return true;
+}
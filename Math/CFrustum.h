@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// View frustum class, six planes used to test if objects can be seen by a camera
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+
+#ifndef _CFRUSTUM_H_DEFINED_
+#define _CFRUSTUM_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+
+class CFrustum
+{
+// Concrete class - public access
+public:
+    // A plane is stored as a normal and distance, points p on the inside of the plane have Dot(normal, p) + d >= 0
+    struct Plane
+    {
+        CVector3 normal;
+        float    d;
+    };
+
+    enum EPlane { Left, Right, Bottom, Top, Near, Far, NumPlanes };
+
+    Plane planes[NumPlanes];
+
+
+    /*-----------------------------------------------------------------------------------------
+        Constructors
+    -----------------------------------------------------------------------------------------*/
+
+    // Default constructor - leaves planes uninitialised (for performance)
+    CFrustum() {}
+
+    // Construct by extracting the planes from a combined view-projection matrix (DirectX clip space, 0 <= z <= w)
+    CFrustum(const CMatrix4x4& viewProjectionMatrix);
+
+
+    /*-----------------------------------------------------------------------------------------
+        Member functions
+    -----------------------------------------------------------------------------------------*/
+
+    // Returns false if the given world space sphere is entirely outside the frustum
+    bool IsSphereVisible(const CVector3& centre, float radius) const;
+
+    // Returns false if the given world space axis aligned box (centre and half-size in each axis) is entirely outside the frustum
+    bool IsBoxVisible(const CVector3& centre, const CVector3& extents) const;
+};
+
+
+#endif // _CFRUSTUM_H_DEFINED_
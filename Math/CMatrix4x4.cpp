@@ -3,6 +3,102 @@
 //--------------------------------------------------------------------------------------
 
 #include "CMatrix4x4.h"
+#include "MathSIMD.h"
+
+
+/*-----------------------------------------------------------------------------------------
+    SIMD kernels
+-----------------------------------------------------------------------------------------*/
+// Each row of a matrix fits exactly into one SSE register. These kernels are selected at
+// compile time (see MathSIMD.h), the scalar versions of each function are kept for other platforms
+
+#ifdef MATH_USE_SSE
+
+// Multiply two matrices held as 16 floats each. All four result rows are calculated before any
+// are stored so the output can be the same as either input (used by operator*=)
+static inline void MatrixMultiplySSE(const float* m1, const float* m2, float* mOut)
+{
+    __m128 row0 = _mm_loadu_ps(m2);
+    __m128 row1 = _mm_loadu_ps(m2 + 4);
+    __m128 row2 = _mm_loadu_ps(m2 + 8);
+    __m128 row3 = _mm_loadu_ps(m2 + 12);
+
+    __m128 result[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        __m128 m1Row = _mm_loadu_ps(m1 + i * 4);
+        __m128 r01 = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(m1Row, m1Row, _MM_SHUFFLE(0, 0, 0, 0)), row0),
+                                _mm_mul_ps(_mm_shuffle_ps(m1Row, m1Row, _MM_SHUFFLE(1, 1, 1, 1)), row1));
+        __m128 r23 = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(m1Row, m1Row, _MM_SHUFFLE(2, 2, 2, 2)), row2),
+                                _mm_mul_ps(_mm_shuffle_ps(m1Row, m1Row, _MM_SHUFFLE(3, 3, 3, 3)), row3));
+        result[i] = _mm_add_ps(r01, r23);
+    }
+
+    _mm_storeu_ps(mOut,      result[0]);
+    _mm_storeu_ps(mOut + 4,  result[1]);
+    _mm_storeu_ps(mOut + 8,  result[2]);
+    _mm_storeu_ps(mOut + 12, result[3]);
+}
+
+// Cross product of the x,y,z parts of two registers, w of the result is 0
+static inline __m128 CrossSSE(__m128 a, __m128 b)
+{
+    __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// Split 4 packed CVector3s (12 floats in 3 registers) into separate x, y and z registers
+static inline void DeinterleaveSSE(__m128 a, __m128 b, __m128 c, __m128& x, __m128& y, __m128& z)
+{
+    // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+    x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0));
+}
+
+// Reverse of the above, pack separate x, y and z registers back into 4 CVector3s
+static inline void InterleaveSSE(__m128 x, __m128 y, __m128 z, __m128& a, __m128& b, __m128& c)
+{
+    a = _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+    b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+    c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+// Transform blocks of 4 vectors at a time, returns how many were processed. Pass translate = false for normals
+static std::size_t TransformBlocksSSE(const CMatrix4x4& m, const CVector3* in, CVector3* out, std::size_t count, bool translate)
+{
+    __m128 m00 = _mm_set1_ps(m.e00), m01 = _mm_set1_ps(m.e01), m02 = _mm_set1_ps(m.e02);
+    __m128 m10 = _mm_set1_ps(m.e10), m11 = _mm_set1_ps(m.e11), m12 = _mm_set1_ps(m.e12);
+    __m128 m20 = _mm_set1_ps(m.e20), m21 = _mm_set1_ps(m.e21), m22 = _mm_set1_ps(m.e22);
+    __m128 m30 = _mm_set1_ps(translate ? m.e30 : 0.0f);
+    __m128 m31 = _mm_set1_ps(translate ? m.e31 : 0.0f);
+    __m128 m32 = _mm_set1_ps(translate ? m.e32 : 0.0f);
+
+    std::size_t blocks = count / 4;
+    const float* src = &in->x;
+    float*       dst = &out->x;
+    for (std::size_t i = 0; i < blocks; ++i, src += 12, dst += 12)
+    {
+        __m128 x, y, z;
+        DeinterleaveSSE(_mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8), x, y, z);
+
+        __m128 outX = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m00), _mm_mul_ps(y, m10)), _mm_add_ps(_mm_mul_ps(z, m20), m30));
+        __m128 outY = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m01), _mm_mul_ps(y, m11)), _mm_add_ps(_mm_mul_ps(z, m21), m31));
+        __m128 outZ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m02), _mm_mul_ps(y, m12)), _mm_add_ps(_mm_mul_ps(z, m22), m32));
+
+        __m128 a, b, c;
+        InterleaveSSE(outX, outY, outZ, a, b, c);
+        _mm_storeu_ps(dst,     a);
+        _mm_storeu_ps(dst + 4, b);
+        _mm_storeu_ps(dst + 8, c);
+    }
+    return blocks * 4;
+}
+
+#endif // MATH_USE_SSE
+
 
 /*-----------------------------------------------------------------------------------------
     Member functions
@@ -30,6 +126,9 @@ CVector3 CMatrix4x4::GetRow(int iRow) const
 // Post-multiply this matrix by the given one
 CMatrix4x4& CMatrix4x4::operator*=(const CMatrix4x4& m)
 {
+#ifdef MATH_USE_SSE
+    MatrixMultiplySSE(&e00, &m.e00, &e00);
+#else
     if (this == &m)
     {
         // Special case of multiplying by self - no copy optimisations so use binary version
@@ -71,6 +170,7 @@ CMatrix4x4& CMatrix4x4::operator*=(const CMatrix4x4& m)
         e31 = t1;
         e32 = t2;
     }
+#endif
     return *this;
 }
 
@@ -84,6 +184,9 @@ CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2)
 {
     CMatrix4x4 mOut;
 
+#ifdef MATH_USE_SSE
+    MatrixMultiplySSE(&m1.e00, &m2.e00, &mOut.e00);
+#else
     mOut.e00 = m1.e00*m2.e00 + m1.e01*m2.e10 + m1.e02*m2.e20 + m1.e03*m2.e30;
     mOut.e01 = m1.e00*m2.e01 + m1.e01*m2.e11 + m1.e02*m2.e21 + m1.e03*m2.e31;
     mOut.e02 = m1.e00*m2.e02 + m1.e01*m2.e12 + m1.e02*m2.e22 + m1.e03*m2.e32;
@@ -103,6 +206,7 @@ CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2)
     mOut.e31 = m1.e30*m2.e01 + m1.e31*m2.e11 + m1.e32*m2.e21 + m1.e33*m2.e31;
     mOut.e32 = m1.e30*m2.e02 + m1.e31*m2.e12 + m1.e32*m2.e22 + m1.e33*m2.e32;
     mOut.e33 = m1.e30*m2.e03 + m1.e31*m2.e13 + m1.e32*m2.e23 + m1.e33*m2.e33;
+#endif
 
     return mOut;
 }
@@ -192,12 +296,86 @@ CMatrix4x4 MatrixScaling(const float s)
 }
 
 
+// Return a complete world matrix built from translation, rotation and scale. Gives the same result as
+//     MatrixScaling(scale) * MatrixRotationZ(rotation.z) * MatrixRotationX(rotation.x) * MatrixRotationY(rotation.y) * MatrixTranslation(position)
+// but writes the matrix directly without building and multiplying the five separate matrices
+CMatrix4x4 MatrixFromTRS(const CVector3& position, const CVector3& rotation, const CVector3& scale)
+{
+    float sX = std::sin(rotation.x);
+    float cX = std::cos(rotation.x);
+    float sY = std::sin(rotation.y);
+    float cY = std::cos(rotation.y);
+    float sZ = std::sin(rotation.z);
+    float cZ = std::cos(rotation.z);
+
+    // Rows of the combined Z, X, Y rotations, each scaled by the matching scale component
+    float sXsY = sX * sY;
+    float sXcY = sX * cY;
+    return CMatrix4x4{ scale.x * (cZ * cY + sZ * sXsY), scale.x * sZ * cX, scale.x * (sZ * sXcY - cZ * sY), 0,
+                       scale.y * (cZ * sXsY - sZ * cY), scale.y * cZ * cX, scale.y * (sZ * sY + cZ * sXcY), 0,
+                       scale.z * cX * sY,               scale.z * -sX,     scale.z * cX * cY,               0,
+                       position.x,                      position.y,        position.z,                      1 };
+}
+
+// As above but with the rotation held in a quaternion (which must be normalised)
+CMatrix4x4 MatrixFromTRS(const CVector3& position, const CQuaternion& rotation, const CVector3& scale)
+{
+    float x2 = rotation.x + rotation.x;
+    float y2 = rotation.y + rotation.y;
+    float z2 = rotation.z + rotation.z;
+    float xx = rotation.x * x2, yy = rotation.y * y2, zz = rotation.z * z2;
+    float xy = rotation.x * y2, xz = rotation.x * z2, yz = rotation.y * z2;
+    float wx = rotation.w * x2, wy = rotation.w * y2, wz = rotation.w * z2;
+
+    return CMatrix4x4{ scale.x * (1 - yy - zz), scale.x * (xy + wz),     scale.x * (xz - wy),     0,
+                       scale.y * (xy - wz),     scale.y * (1 - xx - zz), scale.y * (yz + wx),     0,
+                       scale.z * (xz + wy),     scale.z * (yz - wx),     scale.z * (1 - xx - yy), 0,
+                       position.x,              position.y,              position.z,              1 };
+}
+
+
 // Return the inverse of given matrix assuming that it is an affine matrix
 // Advanced calulation needed to get the view matrix from the camera's positioning matrix
 CMatrix4x4 InverseAffine(const CMatrix4x4& m)
 {
     CMatrix4x4 mOut;
 
+#ifdef MATH_USE_SSE
+    // The inverse of the upper left 3x3 has the cross products of its rows as columns, divided by the determinant
+    const __m128 maskXYZ = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    __m128 row0 = _mm_and_ps(_mm_loadu_ps(&m.e00), maskXYZ);
+    __m128 row1 = _mm_and_ps(_mm_loadu_ps(&m.e10), maskXYZ);
+    __m128 row2 = _mm_and_ps(_mm_loadu_ps(&m.e20), maskXYZ);
+    __m128 pos  = _mm_loadu_ps(&m.e30);
+
+    __m128 col0 = CrossSSE(row1, row2);
+    __m128 col1 = CrossSSE(row2, row0);
+    __m128 col2 = CrossSSE(row0, row1);
+
+    // Determinant is dot product of first row with first column (w is zero so can sum all four elements)
+    __m128 det = _mm_mul_ps(row0, col0);
+    det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2, 3, 0, 1)));
+    det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1, 0, 3, 2)));
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    col0 = _mm_mul_ps(col0, invDet);
+    col1 = _mm_mul_ps(col1, invDet);
+    col2 = _mm_mul_ps(col2, invDet);
+    __m128 zero = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(col0, col1, col2, zero); // Columns now hold the rows of the inverse, with w = 0
+
+    // Transform negative translation by inverted 3x3 to get inverse, w = 1 for affine matrix
+    __m128 t = _mm_mul_ps(_mm_shuffle_ps(pos, pos, _MM_SHUFFLE(0, 0, 0, 0)), col0);
+    t = _mm_add_ps(t, _mm_mul_ps(_mm_shuffle_ps(pos, pos, _MM_SHUFFLE(1, 1, 1, 1)), col1));
+    t = _mm_add_ps(t, _mm_mul_ps(_mm_shuffle_ps(pos, pos, _MM_SHUFFLE(2, 2, 2, 2)), col2));
+    t = _mm_sub_ps(_mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f), t);
+
+    _mm_storeu_ps(&mOut.e00, col0);
+    _mm_storeu_ps(&mOut.e10, col1);
+    _mm_storeu_ps(&mOut.e20, col2);
+    _mm_storeu_ps(&mOut.e30, t);
+#else
+
     // Calculate determinant of upper left 3x3
     float det0 = m.e11*m.e22 - m.e12*m.e21;
     float det1 = m.e12*m.e20 - m.e10*m.e22;
@@ -228,11 +406,51 @@ CMatrix4x4 InverseAffine(const CMatrix4x4& m)
     mOut.e13 = 0.0f;
     mOut.e23 = 0.0f;
     mOut.e33 = 1.0f;
+#endif
 
     return mOut;
 }
 
 
+/*-----------------------------------------------------------------------------------------
+  Batch transforms
+-----------------------------------------------------------------------------------------*/
+
+// Transform an array of points (w = 1) by the given matrix, writing the results to another array.
+// The output array can be the same as the input array
+void TransformPoints(const CMatrix4x4& m, const CVector3* points, CVector3* result, std::size_t count)
+{
+    std::size_t i = 0;
+#ifdef MATH_USE_SSE
+    i = TransformBlocksSSE(m, points, result, count, true);
+#endif
+    for (; i < count; ++i)
+    {
+        CVector3 p = points[i];
+        result[i].x = p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30;
+        result[i].y = p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31;
+        result[i].z = p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32;
+    }
+}
+
+// Transform an array of normals or other vectors (w = 0) by the given matrix - translation is ignored.
+// Results are not renormalised, and are only correct normals if the matrix has no non-uniform scaling
+void TransformNormals(const CMatrix4x4& m, const CVector3* normals, CVector3* result, std::size_t count)
+{
+    std::size_t i = 0;
+#ifdef MATH_USE_SSE
+    i = TransformBlocksSSE(m, normals, result, count, false);
+#endif
+    for (; i < count; ++i)
+    {
+        CVector3 n = normals[i];
+        result[i].x = n.x * m.e00 + n.y * m.e10 + n.z * m.e20;
+        result[i].y = n.x * m.e01 + n.y * m.e11 + n.z * m.e21;
+        result[i].z = n.x * m.e02 + n.y * m.e12 + n.z * m.e22;
+    }
+}
+
+
 // Make this matrix an affine 3D transformation matrix to face from current position to given target (in the Z direction)
 // Will retain the matrix's current scaling
 void CMatrix4x4::FaceTarget(const CVector3& target)
@@ -258,9 +476,9 @@ void CMatrix4x4::FaceTarget(const CVector3& target)
 CVector3 CMatrix4x4::GetEulerAngles()
 {
 	// Calculate matrix scaling
-	float scaleX = sqrt( e00*e00 + e01*e01 + e02*e02 );
-	float scaleY = sqrt( e10*e10 + e11*e11 + e12*e12 );
-	float scaleZ = sqrt( e20*e20 + e21*e21 + e22*e22 );
+	float scaleX = std::sqrt( e00*e00 + e01*e01 + e02*e02 );
+	float scaleY = std::sqrt( e10*e10 + e11*e11 + e12*e12 );
+	float scaleZ = std::sqrt( e20*e20 + e21*e21 + e22*e22 );
 
 	// Calculate inverse scaling to extract rotational values only
 	float invScaleX = 1.0f / scaleX;
@@ -270,10 +488,10 @@ CVector3 CMatrix4x4::GetEulerAngles()
 	float sX, cX, sY, cY, sZ, cZ;
 
     sX = -e21 * invScaleZ;
-    cX = sqrt( 1.0f - sX*sX );
+    cX = std::sqrt( 1.0f - sX*sX );
 
     // If no gimbal lock...
-    if (abs(cX) > 0.001f)
+    if (std::abs(cX) > 0.001f)
     {
 	    float invCX = 1.0f / cX;
 	    sZ = e01 * invCX * invScaleX;
@@ -290,6 +508,6 @@ CVector3 CMatrix4x4::GetEulerAngles()
 	    cY =  e00 * invScaleX;
     }
 
-	return { atan2(sX, cX), atan2(sY, cY), atan2(sZ, cZ) };
+	return { std::atan2(sX, cX), std::atan2(sY, cY), std::atan2(sZ, cZ) };
 }
 
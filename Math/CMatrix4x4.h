@@ -7,7 +7,9 @@
 #define _CMATRIX4X4_H_DEFINED_
 
 #include "CVector3.h"
+#include "CQuaternion.h"
 #include <cmath>
+#include <cstddef>
 
 
 // Matrix class
@@ -42,6 +44,14 @@ public:
     CVector3 GetEulerAngles();
     CVector3 GetScale() const  { return { Length(GetXAxis()), Length(GetYAxis()) , Length(GetZAxis()) }; }
 
+    // Transform a single point (w = 1) by this matrix
+    CVector3 TransformPoint(const CVector3& p) const
+    {
+        return { p.x * e00 + p.y * e10 + p.z * e20 + e30,
+                 p.x * e01 + p.y * e11 + p.z * e21 + e31,
+                 p.x * e02 + p.y * e12 + p.z * e22 + e32 };
+    }
+
     // Post-multiply this matrix by the given one
     CMatrix4x4& operator*=(const CMatrix4x4& m);
 
@@ -93,10 +103,32 @@ CMatrix4x4 MatrixScaling(const CVector3& s);
 CMatrix4x4 MatrixScaling(const float s);
 
 
+// Return a complete world matrix built from translation, rotation and scale. Gives the same result as
+//     MatrixScaling(scale) * MatrixRotationZ(rotation.z) * MatrixRotationX(rotation.x) * MatrixRotationY(rotation.y) * MatrixTranslation(position)
+// but writes the matrix directly without building and multiplying the five separate matrices
+CMatrix4x4 MatrixFromTRS(const CVector3& position, const CVector3& rotation, const CVector3& scale);
+
+// As above but with the rotation held in a quaternion (which must be normalised)
+CMatrix4x4 MatrixFromTRS(const CVector3& position, const CQuaternion& rotation, const CVector3& scale);
+
+
 
 // Return the inverse of given matrix assuming that it is an affine matrix
 // Advanced calulation needed to get the view matrix from the camera's positioning matrix
 CMatrix4x4 InverseAffine(const CMatrix4x4& m);
 
 
+/*-----------------------------------------------------------------------------------------
+  Batch transforms
+-----------------------------------------------------------------------------------------*/
+
+// Transform an array of points (w = 1) by the given matrix, writing the results to another array.
+// The output array can be the same as the input array
+void TransformPoints(const CMatrix4x4& m, const CVector3* points, CVector3* result, std::size_t count);
+
+// Transform an array of normals or other vectors (w = 0) by the given matrix - translation is ignored.
+// Results are not renormalised, and are only correct normals if the matrix has no non-uniform scaling
+void TransformNormals(const CMatrix4x4& m, const CVector3* normals, CVector3* result, std::size_t count);
+
+
 #endif // _CMATRIX4X4_H_DEFINED_
@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// Quaternion class (cut down version), to hold rotations
+//--------------------------------------------------------------------------------------
+
+#include "CQuaternion.h"
+
+
+/*-----------------------------------------------------------------------------------------
+    Operators
+-----------------------------------------------------------------------------------------*/
+
+// Quaternion multiplication - combines two rotations. Like matrices with column vectors the right-hand
+// rotation is applied first, i.e. q1 * q2 rotates by q2 then by q1
+CQuaternion operator* (const CQuaternion& q1, const CQuaternion& q2)
+{
+    return CQuaternion{ q1.w * q2.x + q1.x * q2.w + q1.y * q2.z - q1.z * q2.y,
+                        q1.w * q2.y - q1.x * q2.z + q1.y * q2.w + q1.z * q2.x,
+                        q1.w * q2.z + q1.x * q2.y - q1.y * q2.x + q1.z * q2.w,
+                        q1.w * q2.w - q1.x * q2.x - q1.y * q2.y - q1.z * q2.z };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return an identity quaternion (no rotation)
+CQuaternion QuaternionIdentity()
+{
+    return CQuaternion{ 0.0f, 0.0f, 0.0f, 1.0f };
+}
+
+// Return a quaternion of the given rotation (in radians) around the given axis (which must be normalised)
+CQuaternion QuaternionRotationAxis(const CVector3& axis, float angle)
+{
+    float s = std::sin(angle * 0.5f);
+    return CQuaternion{ axis.x * s, axis.y * s, axis.z * s, std::cos(angle * 0.5f) };
+}
+
+// Return a quaternion holding the same rotation as the given Euler angles (in radians). Uses the same
+// Z, then X, then Y order as the models and camera
+CQuaternion QuaternionFromEulerAngles(const CVector3& rotation)
+{
+    float sX = std::sin(rotation.x * 0.5f), cX = std::cos(rotation.x * 0.5f);
+    float sY = std::sin(rotation.y * 0.5f), cY = std::cos(rotation.y * 0.5f);
+    float sZ = std::sin(rotation.z * 0.5f), cZ = std::cos(rotation.z * 0.5f);
+
+    // Expanded form of QuaternionRotationAxis(Y) * QuaternionRotationAxis(X) * QuaternionRotationAxis(Z)
+    return CQuaternion{ cY * sX * cZ + sY * cX * sZ,
+                        sY * cX * cZ - cY * sX * sZ,
+                        cY * cX * sZ - sY * sX * cZ,
+                        cY * cX * cZ + sY * sX * sZ };
+}
+
+// Return unit length quaternion holding the same rotation as the given one
+CQuaternion Normalise(const CQuaternion& q)
+{
+    float lengthSq = q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w;
+
+    // Ensure quaternion is not zero length, return identity if so
+    if (IsZero(lengthSq))
+    {
+        return QuaternionIdentity();
+    }
+    else
+    {
+        float invLength = InvSqrt(lengthSq);
+        return CQuaternion{ q.x * invLength, q.y * invLength, q.z * invLength, q.w * invLength };
+    }
+}
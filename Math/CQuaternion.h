@@ -0,0 +1,68 @@
+//--------------------------------------------------------------------------------------
+// Quaternion class (cut down version), to hold rotations
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+
+#ifndef _CQUATERNION_H_DEFINED_
+#define _CQUATERNION_H_DEFINED_
+
+#include "CVector3.h"
+#include "MathHelpers.h"
+#include <cmath>
+
+class CQuaternion
+{
+// Concrete class - public access
+public:
+    // Quaternion components - x, y, z hold the rotation axis scaled by sin(angle/2), w holds cos(angle/2)
+    float x;
+    float y;
+    float z;
+    float w;
+
+    /*-----------------------------------------------------------------------------------------
+        Constructors
+    -----------------------------------------------------------------------------------------*/
+
+    // Default constructor - leaves values uninitialised (for performance)
+    CQuaternion() {}
+
+    // Construct with 4 values
+    CQuaternion(const float xIn, const float yIn, const float zIn, const float wIn)
+    {
+        x = xIn;
+        y = yIn;
+        z = zIn;
+        w = wIn;
+    }
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member operators
+-----------------------------------------------------------------------------------------*/
+
+// Quaternion multiplication - combines two rotations. Like matrices with column vectors the right-hand
+// rotation is applied first, i.e. q1 * q2 rotates by q2 then by q1
+CQuaternion operator* (const CQuaternion& q1, const CQuaternion& q2);
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return an identity quaternion (no rotation)
+CQuaternion QuaternionIdentity();
+
+// Return a quaternion of the given rotation (in radians) around the given axis (which must be normalised)
+CQuaternion QuaternionRotationAxis(const CVector3& axis, float angle);
+
+// Return a quaternion holding the same rotation as the given Euler angles (in radians). Uses the same
+// Z, then X, then Y order as the models and camera
+CQuaternion QuaternionFromEulerAngles(const CVector3& rotation);
+
+// Return unit length quaternion holding the same rotation as the given one
+CQuaternion Normalise(const CQuaternion& q);
+
+
+#endif // _CQUATERNION_H_DEFINED_
@@ -0,0 +1,17 @@
+//--------------------------------------------------------------------------------------
+// Compile-time selection of SIMD code paths for the maths library
+//--------------------------------------------------------------------------------------
+// All x64 builds have SSE2, and 32-bit builds have it by default (/arch:SSE2). Building with
+// /arch:AVX or /arch:AVX2 re-encodes the same intrinsics with VEX instructions, so there is
+// only one set of SIMD kernels. Define MATH_NO_SIMD to force the portable scalar code instead.
+
+#ifndef _MATH_SIMD_H_DEFINED_
+#define _MATH_SIMD_H_DEFINED_
+
+#if !defined(MATH_NO_SIMD) && (defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define MATH_USE_SSE
+    #include <emmintrin.h>
+#endif
+
+
+#endif // _MATH_SIMD_H_DEFINED_
@@ -1,19 +1,38 @@
 //--------------------------------------------------------------------------------------
 // Class encapsulating a mesh
 //--------------------------------------------------------------------------------------
-// The mesh class splits the mesh into sub-meshes that only use one texture each.
-// ** THIS VERSION WILL ONLY KEEP THE FIRST SUB-MESH OTHER PARTS WILL BE MISSING **
-// ** DO NOT USE THIS VERSION FOR PROJECTS **
+// The mesh class splits the mesh into sub-meshes that only use one texture each. All the sub-meshes share one
+// vertex buffer and one index buffer, so a multi-part mesh only needs its buffers set once to draw every part.
 // The class also doesn't load textures, filters or shaders as the outer code is
 // expected to select these things. A later lab will introduce a more robust loader.
 
-#include "common.h"
+#include "Common.h"
+#include "MeshCache.h"
 
 #include <string>
+#include <memory>
+#include <vector>
 
 #ifndef _MESH_H_INCLUDED_
 #define _MESH_H_INCLUDED_
 
+// Mesh data loaded on the CPU, ready to create the GPU buffers from (see Mesh::LoadSource)
+struct SMeshSource
+{
+    SMeshData       data;
+    CCookedMeshFile cookedFile; // The data points into this mapping when loaded from the cooked mesh cache...
+    std::unique_ptr<unsigned char[]> vertices; // ...or into these arrays when imported
+    std::unique_ptr<unsigned char[]> indices;
+    bool            fromCache = false;
+
+    // Seconds spent on each step of loading. A mesh from the cache is only mapped. An imported mesh is cooked, then
+    // its new cooked file is mapped (and checked) once, so the cold and warm start costs can be compared per mesh
+    float           importTime = 0;
+    float           cookTime   = 0;
+    float           mapTime    = 0;
+};
+
+
 class Mesh
 {
 public:
@@ -23,21 +42,74 @@ public:
     Mesh(const std::string& fileName, bool requireTangents = false);
     ~Mesh();
 
+    // Two stage loading, so meshes can be loaded on worker threads (see AssetLoader). LoadSource does all the
+    // file reading, importing and vertex building and can be called from any thread. The constructor taking the
+    // result only creates the GPU objects, so should be called on the thread that owns the device. Both throw a
+    // std::runtime_error exception on failure
+    static std::unique_ptr<SMeshSource> LoadSource(const std::string& fileName, bool requireTangents = false);
+    Mesh(const std::string& fileName, const SMeshSource& source);
+
     // The render function assumes shaders, matrices, textures, samplers etc. have been set up already.
     // It simply draws this mesh with whatever settings the GPU is currently using.
     void Render();
 
+    // The two halves of Render, so several draws of the same mesh only need to set the buffers once
+    void SetBuffers(); // Set vertex & index buffers, vertex layout and topology
+    void Draw();       // Draw every sub-mesh using the currently set buffers, which must be this mesh's
+
+    // Draw a single sub-mesh using the currently set buffers, e.g. to change textures between the parts
+    void DrawSubMesh(unsigned int subMesh);
+    unsigned int    NumSubMeshes()                   { return static_cast<unsigned int>(mSubMeshes.size()); }
+    const SSubMesh& SubMesh(unsigned int subMesh)    { return mSubMeshes[subMesh]; }
+
+    // Instanced versions of the above. The instance buffer holds one world matrix per instance and is read by the
+    // instanced vertex shaders (e.g. ShadowMappingInstanced_vs)
+    void SetInstancedBuffers(ID3D11Buffer* instanceBuffer);
+    void DrawInstanced(unsigned int numInstances);
+
+
+    // Model space bounds of the mesh, calculated at load time for culling
+    const CVector3& BoundsMin()      { return mBoundsMin; }
+    const CVector3& BoundsMax()      { return mBoundsMax; }
+    const CVector3& BoundingCentre() { return mBoundingCentre; }
+    float           BoundingRadius() { return mBoundingRadius; }
+
+    // Vertex positions and triangles kept on the CPU for the occlusion buffer (see OcclusionBuffer.h). The indices
+    // are into the whole position list, not relative to a sub-mesh
+    const std::vector<CVector3>& Positions()  { return mPositions; }
+    const std::vector<uint32_t>& Indices()    { return mIndices;   }
+
+    // True if the mesh was loaded from the cooked mesh cache rather than imported from the source file
+    bool LoadedFromCache()  { return mLoadedFromCache; }
+
 
 private:
+    void CreateBuffers(const SMeshData& data, const std::string& fileName);
+
+    bool               mLoadedFromCache = false;
+
     unsigned int       mVertexSize;             // Size in bytes of a single vertex (depends on what it contains, uvs, tangents etc.)
     ID3D11InputLayout* mVertexLayout = nullptr; // DirectX specification of data held in a single vertex
+    ID3D11InputLayout* mInstancedVertexLayout = nullptr; // As above plus the per-instance world matrix from a second buffer
 
     // GPU-side vertex and index buffers
     unsigned int       mNumVertices;
     ID3D11Buffer*      mVertexBuffer = nullptr;
 
     unsigned int       mNumIndices;
+    DXGI_FORMAT        mIndexFormat;            // 16 or 32-bit indices
     ID3D11Buffer*      mIndexBuffer  = nullptr;
+
+    std::vector<SSubMesh> mSubMeshes;          // Ranges of the shared buffers drawn with each material
+
+    // Axis aligned bounding box and bounding sphere in model space
+    CVector3           mBoundsMin;
+    CVector3           mBoundsMax;
+    CVector3           mBoundingCentre;
+    float              mBoundingRadius;
+
+    std::vector<CVector3> mPositions;
+    std::vector<uint32_t> mIndices;
 };
 
 
@@ -0,0 +1,365 @@
+//--------------------------------------------------------------------------------------
+// Cooked mesh cache
+//--------------------------------------------------------------------------------------
+
+#include "MeshCache.h"
+
+#include <fstream>
+#include <thread>
+#include <functional>
+#include <cstring>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Cooked file format
+//--------------------------------------------------------------------------------------
+// A cooked file is the header, then the vertex layout elements, then the sub-mesh table, then the vertex data, then
+// the index data.
+// Every section is a multiple of 4 bytes so all the data in the mapping is aligned
+
+static const uint32_t COOKED_MESH_ID      = 0x4853454d; // "MESH"
+static const uint32_t COOKED_MESH_VERSION = 3;          // Increase when the format or the importer output changes
+
+static const char* COOKED_MESH_FOLDER = "MeshCache";
+
+struct SCookedMeshHeader
+{
+    uint32_t id;
+    uint32_t version;
+    uint64_t sourceTime;  // Last write time of the source file when it was cooked
+    uint32_t importFlags; // Assimp post-processing flags used to import the source file
+
+    uint32_t vertexSize;
+    uint32_t numVertices;
+    uint32_t numIndices;
+    uint32_t indexSize;
+    uint32_t numElements;
+    uint32_t numSubMeshes;
+    uint32_t reserved;    // Zero, keeps the header a multiple of 8 bytes
+
+    float    boundsMin[3];
+    float    boundsMax[3];
+    float    boundingCentre[3];
+    float    boundingRadius;
+
+    uint32_t cacheStatsImported[3];  // Triangles, vertices and transforms, see SVertexCacheStats
+    uint32_t cacheStatsOptimised[3];
+};
+static_assert(sizeof(SCookedMeshHeader) == 112, "Cooked mesh header must have no padding");
+
+struct SCookedVertexElement
+{
+    char     semanticName[16]; // Null terminated
+    uint32_t semanticIndex;
+    uint32_t format;           // DXGI_FORMAT
+    uint32_t offset;           // Offset in the vertex
+};
+static_assert(sizeof(SCookedVertexElement) == 28, "Cooked vertex element must have no padding");
+
+struct SCookedSubMesh
+{
+    uint32_t startIndex;
+    uint32_t numIndices;
+    int32_t  baseVertex;
+    uint32_t material;
+};
+static_assert(sizeof(SCookedSubMesh) == 16, "Cooked sub-mesh must have no padding");
+
+
+// Total size of a cooked file with the given header
+static uint64_t CookedMeshSize(const SCookedMeshHeader& header)
+{
+    return sizeof(SCookedMeshHeader) + static_cast<uint64_t>(header.numElements) * sizeof(SCookedVertexElement) +
+           static_cast<uint64_t>(header.numSubMeshes) * sizeof(SCookedSubMesh) +
+           static_cast<uint64_t>(header.numVertices) * header.vertexSize + static_cast<uint64_t>(header.numIndices) * header.indexSize +
+           ((static_cast<uint64_t>(header.numIndices) * header.indexSize) & 2); // Pad 16-bit indices to 4 bytes
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Reading cooked files
+//--------------------------------------------------------------------------------------
+
+CCookedMeshFile::~CCookedMeshFile()
+{
+    Close();
+}
+
+
+void CCookedMeshFile::Close()
+{
+#ifdef _WIN32
+    if (mView)                           UnmapViewOfFile(mView);
+    if (mMapping)                        CloseHandle(mMapping);
+    if (mFile != INVALID_HANDLE_VALUE)   CloseHandle(mFile);
+    mMapping = nullptr;
+    mFile    = INVALID_HANDLE_VALUE;
+#else
+    if (mView)                           munmap(const_cast<unsigned char*>(mView), mSize);
+    if (mFile >= 0)                      close(mFile);
+    mSize = 0;
+    mFile = -1;
+#endif
+    mView = nullptr;
+}
+
+
+bool CCookedMeshFile::Open(const std::string& cookedFileName, uint64_t sourceTime, uint32_t importFlags)
+{
+    Close();
+
+    uint64_t fileSize = 0;
+#ifdef _WIN32
+    mFile = CreateFileA(cookedFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE)  return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFile, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(SCookedMeshHeader)))
+    {
+        Close();
+        return false;
+    }
+    fileSize = static_cast<uint64_t>(size.QuadPart);
+
+    mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mMapping != nullptr)  mView = static_cast<const unsigned char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+#else
+    mFile = open(cookedFileName.c_str(), O_RDONLY);
+    if (mFile < 0)  return false;
+
+    struct stat status;
+    if (fstat(mFile, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(SCookedMeshHeader)))
+    {
+        Close();
+        return false;
+    }
+    fileSize = static_cast<uint64_t>(status.st_size);
+
+    void* view = mmap(nullptr, static_cast<size_t>(fileSize), PROT_READ, MAP_PRIVATE, mFile, 0);
+    if (view != MAP_FAILED)
+    {
+        mView = static_cast<const unsigned char*>(view);
+        mSize = static_cast<size_t>(fileSize);
+    }
+#endif
+    if (mView == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    // Check the file is for the same source and settings, and the sizes in the header match the file
+    const SCookedMeshHeader& header = *reinterpret_cast<const SCookedMeshHeader*>(mView);
+    if (header.id != COOKED_MESH_ID || header.version != COOKED_MESH_VERSION ||
+        header.sourceTime != sourceTime || header.importFlags != importFlags ||
+        (header.indexSize != 2 && header.indexSize != 4) || header.vertexSize % 4 != 0 ||
+        CookedMeshSize(header) != fileSize)
+    {
+        Close();
+        return false;
+    }
+    auto elements = reinterpret_cast<const SCookedVertexElement*>(mView + sizeof(SCookedMeshHeader));
+    for (uint32_t e = 0; e < header.numElements; ++e)
+    {
+        if (std::memchr(elements[e].semanticName, 0, sizeof(elements[e].semanticName)) == nullptr)
+        {
+            Close();
+            return false;
+        }
+    }
+
+    // Sub-meshes must lie within the index and vertex data, and so must every vertex their indices refer to. The
+    // indices are used on the CPU too (e.g. by the occlusion buffer), so a bad one would read past the vertices
+    auto subMeshes = reinterpret_cast<const SCookedSubMesh*>(elements + header.numElements);
+    const unsigned char* indices = reinterpret_cast<const unsigned char*>(subMeshes + header.numSubMeshes) +
+                                   static_cast<uint64_t>(header.numVertices) * header.vertexSize;
+    for (uint32_t s = 0; s < header.numSubMeshes; ++s)
+    {
+        const SCookedSubMesh& subMesh = subMeshes[s];
+        if (static_cast<uint64_t>(subMesh.startIndex) + subMesh.numIndices > header.numIndices ||
+            subMesh.baseVertex < 0 || static_cast<uint32_t>(subMesh.baseVertex) >= header.numVertices)
+        {
+            Close();
+            return false;
+        }
+
+        uint32_t subMeshVertices = header.numVertices - static_cast<uint32_t>(subMesh.baseVertex);
+        for (uint32_t i = subMesh.startIndex; i < subMesh.startIndex + subMesh.numIndices; ++i)
+        {
+            uint32_t index = (header.indexSize == 2) ? reinterpret_cast<const uint16_t*>(indices)[i] : reinterpret_cast<const uint32_t*>(indices)[i];
+            if (index >= subMeshVertices)
+            {
+                Close();
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+void CCookedMeshFile::GetMeshData(SMeshData& data)
+{
+    const SCookedMeshHeader& header = *reinterpret_cast<const SCookedMeshHeader*>(mView);
+    auto elements = reinterpret_cast<const SCookedVertexElement*>(mView + sizeof(SCookedMeshHeader));
+
+    data.vertexElements.clear();
+    for (uint32_t e = 0; e < header.numElements; ++e)
+    {
+        data.vertexElements.push_back( { elements[e].semanticName, elements[e].semanticIndex, static_cast<DXGI_FORMAT>(elements[e].format),
+                                         0, elements[e].offset, D3D11_INPUT_PER_VERTEX_DATA, 0 } );
+    }
+
+    auto subMeshes = reinterpret_cast<const SCookedSubMesh*>(elements + header.numElements);
+    data.subMeshes.clear();
+    for (uint32_t s = 0; s < header.numSubMeshes; ++s)
+    {
+        data.subMeshes.push_back( { subMeshes[s].startIndex, subMeshes[s].numIndices, subMeshes[s].baseVertex, subMeshes[s].material } );
+    }
+
+    data.vertexSize  = header.vertexSize;
+    data.numVertices = header.numVertices;
+    data.numIndices  = header.numIndices;
+    data.indexSize   = header.indexSize;
+
+    data.vertices = subMeshes + header.numSubMeshes;
+    data.indices  = static_cast<const unsigned char*>(data.vertices) + header.numVertices * header.vertexSize;
+
+    data.boundsMin      = CVector3(header.boundsMin);
+    data.boundsMax      = CVector3(header.boundsMax);
+    data.boundingCentre = CVector3(header.boundingCentre);
+    data.boundingRadius = header.boundingRadius;
+
+    data.cacheStatsImported  = { header.cacheStatsImported[0],  header.cacheStatsImported[1],  header.cacheStatsImported[2] };
+    data.cacheStatsOptimised = { header.cacheStatsOptimised[0], header.cacheStatsOptimised[1], header.cacheStatsOptimised[2] };
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Writing cooked files
+//--------------------------------------------------------------------------------------
+
+bool WriteCookedMesh(const std::string& cookedFileName, uint64_t sourceTime, uint32_t importFlags, const SMeshData& data)
+{
+    SCookedMeshHeader header = {};
+    header.id          = COOKED_MESH_ID;
+    header.version     = COOKED_MESH_VERSION;
+    header.sourceTime  = sourceTime;
+    header.importFlags = importFlags;
+    header.vertexSize  = data.vertexSize;
+    header.numVertices = data.numVertices;
+    header.numIndices  = data.numIndices;
+    header.indexSize   = data.indexSize;
+    header.numElements = static_cast<uint32_t>(data.vertexElements.size());
+    header.numSubMeshes = static_cast<uint32_t>(data.subMeshes.size());
+    std::memcpy(header.boundsMin,      &data.boundsMin.x,      sizeof(header.boundsMin));
+    std::memcpy(header.boundsMax,      &data.boundsMax.x,      sizeof(header.boundsMax));
+    std::memcpy(header.boundingCentre, &data.boundingCentre.x, sizeof(header.boundingCentre));
+    header.boundingRadius = data.boundingRadius;
+    header.cacheStatsImported[0]  = data.cacheStatsImported.triangles;
+    header.cacheStatsImported[1]  = data.cacheStatsImported.vertices;
+    header.cacheStatsImported[2]  = data.cacheStatsImported.transforms;
+    header.cacheStatsOptimised[0] = data.cacheStatsOptimised.triangles;
+    header.cacheStatsOptimised[1] = data.cacheStatsOptimised.vertices;
+    header.cacheStatsOptimised[2] = data.cacheStatsOptimised.transforms;
+
+    std::vector<SCookedVertexElement> elements;
+    for (auto& element : data.vertexElements)
+    {
+        SCookedVertexElement cookedElement = {};
+        size_t nameLength = std::strlen(element.SemanticName);
+        if (nameLength >= sizeof(cookedElement.semanticName))  return false;
+        std::memcpy(cookedElement.semanticName, element.SemanticName, nameLength); // Rest of the name is already zero
+        cookedElement.semanticIndex = element.SemanticIndex;
+        cookedElement.format        = static_cast<uint32_t>(element.Format);
+        cookedElement.offset        = element.AlignedByteOffset;
+        elements.push_back(cookedElement);
+    }
+
+    std::vector<SCookedSubMesh> subMeshes;
+    for (auto& subMesh : data.subMeshes)
+    {
+        subMeshes.push_back( { subMesh.startIndex, subMesh.numIndices, subMesh.baseVertex, subMesh.material } );
+    }
+
+    // Temporary name is unique to the thread in case the same mesh is being cooked on two threads at once
+    std::string tempFileName = cookedFileName + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+        std::ofstream file(tempFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open())  return false;
+
+        size_t indexBytes = static_cast<size_t>(data.numIndices) * data.indexSize;
+        const uint32_t padding = 0;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(elements.data()), elements.size() * sizeof(SCookedVertexElement));
+        file.write(reinterpret_cast<const char*>(subMeshes.data()), subMeshes.size() * sizeof(SCookedSubMesh));
+        file.write(static_cast<const char*>(data.vertices), static_cast<size_t>(data.numVertices) * data.vertexSize);
+        file.write(static_cast<const char*>(data.indices), indexBytes);
+        file.write(reinterpret_cast<const char*>(&padding), indexBytes & 2);
+        if (file.fail())
+        {
+            file.close();
+            std::remove(tempFileName.c_str());
+            return false;
+        }
+    }
+
+    // Replace any existing file in one step, so a reader sees either the old or the new file
+#ifdef _WIN32
+    if (!MoveFileExA(tempFileName.c_str(), cookedFileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+    if (std::rename(tempFileName.c_str(), cookedFileName.c_str()) != 0)
+#endif
+    {
+        std::remove(tempFileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+std::string CookedMeshFileName(const std::string& sourceFileName, uint32_t importFlags)
+{
+    // Fails harmlessly if the folder exists
+#ifdef _WIN32
+    CreateDirectoryA(COOKED_MESH_FOLDER, nullptr);
+#else
+    mkdir(COOKED_MESH_FOLDER, 0777);
+#endif
+
+    // Source paths may contain folders, flatten them into the file name
+    std::string name = sourceFileName;
+    for (auto& c : name)
+    {
+        if (c == '/' || c == '\\' || c == ':')  c = '_';
+    }
+
+    char flags[16];
+    std::snprintf(flags, sizeof(flags), ".%08x", importFlags);
+    return std::string(COOKED_MESH_FOLDER) + "/" + name + flags + ".mesh";
+}
+
+
+uint64_t FileWriteTime(const std::string& fileName)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &attributes))  return 0;
+    return (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat status;
+    if (stat(fileName.c_str(), &status) != 0)  return 0;
+    return static_cast<uint64_t>(status.st_mtim.tv_sec) * 1000000000 + static_cast<uint64_t>(status.st_mtim.tv_nsec);
+#endif
+}
@@ -0,0 +1,107 @@
+//--------------------------------------------------------------------------------------
+// Cooked mesh cache
+//--------------------------------------------------------------------------------------
+// Importing a mesh with assimp (parsing plus many post-processing steps) is slow, and dominated start-up time.
+// The first time a mesh is imported the result is saved as a "cooked" file: the interleaved vertices, indices,
+// vertex layout, sub-mesh table, bounds and vertex cache statistics, exactly as they are sent to the GPU. Later runs memory-map the cooked file and create
+// the GPU buffers straight from the mapping, without parsing anything.
+//
+// Cooked files are kept in the MeshCache folder, named after the source file and the import flags used. The
+// header also records the source file's last write time, so editing the source (or changing the import flags)
+// causes the mesh to be imported and cooked again.
+
+#ifndef _MESH_CACHE_H_INCLUDED_
+#define _MESH_CACHE_H_INCLUDED_
+
+#include "Common.h"
+#include "MeshOptimiser.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// Part of a mesh drawn with one material. All sub-meshes share the mesh's vertex and index buffers, the indices of
+// each sub-mesh are relative to its base vertex
+struct SSubMesh
+{
+    unsigned int startIndex; // First index in the shared index buffer
+    unsigned int numIndices;
+    int          baseVertex; // Added to each index to find the vertex in the shared vertex buffer
+    unsigned int material;   // Material slot from the source file
+};
+
+
+// Mesh data ready to create GPU buffers from. The pointers refer to either a mapped cooked file or buffers owned by
+// the importer, so the data is only valid while they exist
+struct SMeshData
+{
+    std::vector<D3D11_INPUT_ELEMENT_DESC> vertexElements; // Semantic names also point into the source data
+
+    unsigned int vertexSize  = 0; // Bytes per vertex
+    unsigned int numVertices = 0;
+    unsigned int numIndices  = 0;
+    unsigned int indexSize   = 0; // 2 or 4 bytes
+
+    std::vector<SSubMesh> subMeshes; // Together cover all the indices
+
+    const void*  vertices = nullptr;
+    const void*  indices  = nullptr;
+
+    // Model space bounds
+    CVector3     boundsMin;
+    CVector3     boundsMax;
+    CVector3     boundingCentre;
+    float        boundingRadius = 0;
+
+    // Simulated vertex cache use of all the sub-meshes, in the order they were imported and after optimisation
+    SVertexCacheStats cacheStatsImported;
+    SVertexCacheStats cacheStatsOptimised;
+};
+
+
+// Read-only memory mapping of a cooked mesh file
+class CCookedMeshFile
+{
+public:
+    CCookedMeshFile() {}
+    ~CCookedMeshFile();
+
+    // Map the cooked file and check it matches the given source file time and import flags. Returns false if the
+    // file is missing, from an older version of the format, out of date or damaged (including any index outside the vertices)
+    bool Open(const std::string& cookedFileName, uint64_t sourceTime, uint32_t importFlags);
+
+    // Fill in the mesh data from the open file. The data points into the mapping so is valid until this object is destroyed
+    void GetMeshData(SMeshData& data);
+
+private:
+    // Mapping can't be copied
+    CCookedMeshFile(const CCookedMeshFile&) = delete;
+    CCookedMeshFile& operator=(const CCookedMeshFile&) = delete;
+
+    void Close();
+
+#ifdef _WIN32
+    HANDLE               mFile    = INVALID_HANDLE_VALUE;
+    HANDLE               mMapping = nullptr;
+#else
+    int                  mFile    = -1;
+    size_t               mSize    = 0; // Size of the mapping
+#endif
+    const unsigned char* mView    = nullptr;
+};
+
+
+// Save mesh data as a cooked file. The file is written under a temporary name and then renamed, so a partly
+// written file is never used. Safe to call from several threads. Returns false on failure
+bool WriteCookedMesh(const std::string& cookedFileName, uint64_t sourceTime, uint32_t importFlags, const SMeshData& data);
+
+// Name of the cooked file for the given source file and import flags. Creates the cache folder if necessary
+std::string CookedMeshFileName(const std::string& sourceFileName, uint32_t importFlags);
+
+// Last write time of a file (as a Windows FILETIME, or in nanoseconds since 1970 elsewhere), or 0 if the file can't
+// be found
+uint64_t FileWriteTime(const std::string& fileName);
+
+
+#endif //_MESH_CACHE_H_INCLUDED_
@@ -0,0 +1,373 @@
+//--------------------------------------------------------------------------------------
+// Loading mesh files for the Mesh class - importing with assimp and the cooked mesh cache
+//--------------------------------------------------------------------------------------
+// Kept apart from Mesh.cpp, which creates the GPU objects, as only this part needs assimp
+
+#include "Mesh.h"
+#include "MeshOptimiser.h"
+#include "Timer.h"
+#include "CVector2.h" 
+#include "CVector3.h" 
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include <memory>
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+
+
+//--------------------------------------------------------------------------------------
+// Importing
+//--------------------------------------------------------------------------------------
+
+// Assimp post-processing flags used to import meshes. Also part of the key for the cooked mesh cache
+static unsigned int ImportFlags(bool requireTangents)
+{
+    // Flags for processing the mesh. Assimp provides a huge amount of control - right click any of these
+    // and "Peek Definition" to see documention above each constant
+    unsigned int assimpFlags = aiProcess_MakeLeftHanded |
+                               aiProcess_GenSmoothNormals |
+                               aiProcess_FixInfacingNormals |
+                               aiProcess_GenUVCoords | 
+                               aiProcess_TransformUVCoords |
+                               aiProcess_FlipUVs |
+                               aiProcess_FlipWindingOrder |
+                               aiProcess_Triangulate |
+                               aiProcess_PreTransformVertices |
+                               aiProcess_JoinIdenticalVertices |
+                               aiProcess_SortByPType |
+                               aiProcess_FindInvalidData | 
+                               aiProcess_OptimizeMeshes |
+                               aiProcess_FindInstances |
+                               aiProcess_FindDegenerates |
+                               aiProcess_RemoveRedundantMaterials |
+                               aiProcess_Debone |
+                               aiProcess_RemoveComponent;
+
+    // Add tangents as required by user
+    if (requireTangents)
+    {
+        assimpFlags |= aiProcess_CalcTangentSpace;
+    }
+    return assimpFlags;
+}
+
+
+// Import a mesh file with assimp, filling in the mesh data. The vertices and indices are stored in the given arrays,
+// which the mesh data points into. Throws a std::runtime_error exception on failure
+static void ImportMesh(const std::string& fileName, bool requireTangents, unsigned int assimpFlags, SMeshData& data,
+                       std::unique_ptr<unsigned char[]>& vertices, std::unique_ptr<unsigned char[]>& indices)
+{
+    Assimp::Importer importer;
+
+    // Flags to specify what mesh data to ignore
+    // Materials are kept so each sub-mesh has a material slot. Sub-meshes sharing a material are joined by aiProcess_OptimizeMeshes
+    int removeComponents = aiComponent_LIGHTS | aiComponent_CAMERAS | aiComponent_TEXTURES | aiComponent_COLORS | 
+                           aiComponent_BONEWEIGHTS | aiComponent_ANIMATIONS;
+    if (!requireTangents)
+    {
+        removeComponents |= aiComponent_TANGENTS_AND_BITANGENTS;
+    }
+
+    // Other miscellaneous settings
+    importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 80.0f); // Smoothing angle for normals
+    importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);  // Remove points and lines (keep triangles only)
+    importer.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);                 // Remove degenerate triangles
+    importer.SetPropertyBool(AI_CONFIG_PP_DB_ALL_OR_NONE, true);            // Default to removing bones/weights from meshes that don't need skinning
+  
+    importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removeComponents);
+
+    // Import mesh with assimp given above requirements. No logger is attached: assimp's default logger is a single
+    // global object, so it can't be created and destroyed around each import when meshes load on several threads
+    const aiScene* scene = importer.ReadFile(fileName, assimpFlags);
+    if (scene == nullptr)  throw std::runtime_error("Error loading mesh (" + fileName + "). " + importer.GetErrorString());
+    if (scene->mNumMeshes == 0)  throw std::runtime_error("No usable geometry in mesh: " + fileName);
+
+
+    //-----------------------------------
+
+    // Every sub-mesh is imported into one shared vertex buffer and index buffer. The vertex layout must be the same
+    // for all of them, so it is decided from all the sub-meshes together. Sub-meshes without UVs get zero UVs if
+    // any other sub-mesh has them
+    bool hasUVs = false;
+    unsigned int numVertices = 0;
+    unsigned int numIndices  = 0;
+    unsigned int maxSubMeshVertices = 0;
+    for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+    {
+        aiMesh* assimpMesh = scene->mMeshes[m];
+        std::string subMeshName = assimpMesh->mName.C_Str();
+
+        // Check for presence of position and normal data. Tangents and UVs are optional.
+        if (!assimpMesh->HasPositions())  throw std::runtime_error("No position data for sub-mesh " + subMeshName + " in " + fileName);
+        if (!assimpMesh->HasNormals())  throw std::runtime_error("No normal data for sub-mesh " + subMeshName + " in " + fileName);
+        if (requireTangents && !assimpMesh->HasTangentsAndBitangents())  throw std::runtime_error("No tangent data for sub-mesh " + subMeshName + " in " + fileName);
+        if (!assimpMesh->HasFaces())  throw std::runtime_error("No face data in " + subMeshName + " in " + fileName);
+        if (assimpMesh->GetNumUVChannels() > 0 && assimpMesh->HasTextureCoords(0))
+        {
+            if (assimpMesh->mNumUVComponents[0] != 2)  throw std::runtime_error("Unsupported texture coordinates in " + subMeshName + " in " + fileName);
+            hasUVs = true;
+        }
+
+        numVertices += assimpMesh->mNumVertices;
+        numIndices  += assimpMesh->mNumFaces * 3;
+        if (assimpMesh->mNumVertices > maxSubMeshVertices)  maxSubMeshVertices = assimpMesh->mNumVertices;
+    }
+
+    
+    //-----------------------------------
+
+    std::vector<D3D11_INPUT_ELEMENT_DESC>& vertexElements = data.vertexElements;
+    vertexElements.clear();
+    unsigned int offset = 0;
+    
+    unsigned int positionOffset = offset;
+    vertexElements.push_back( { "Position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, positionOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 } );
+    offset += 12;
+
+    unsigned int normalOffset = offset;
+    vertexElements.push_back( { "Normal", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, normalOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 } );
+    offset += 12;
+
+    unsigned int tangentOffset = offset;
+    if (requireTangents)
+    {
+        vertexElements.push_back( { "Tangent", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, tangentOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 } );
+        offset += 12;
+    }
+    
+    unsigned int uvOffset = offset;
+    if (hasUVs)
+    {
+        vertexElements.push_back( { "UV", 0, DXGI_FORMAT_R32G32_FLOAT, 0, uvOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 } );
+        offset += 8;
+    }
+
+    unsigned int vertexSize = offset;
+
+
+    //-----------------------------------
+
+    // Create CPU-side buffers to hold current mesh data - exact content is flexible so can't use a structure for a vertex - so just a block of bytes
+    // Note: for large arrays a unique_ptr is better than a vector because vectors default-initialise all the values which is a waste of time.
+    // Indices are relative to the sub-mesh's base vertex, so 16-bit indices can be used (halving the size of the
+    // index buffer) as long as no single sub-mesh has too many vertices
+    unsigned int indexSize = (maxSubMeshVertices <= 0x10000) ? 2 : 4;
+    vertices = std::make_unique<unsigned char[]>(numVertices * vertexSize);
+    indices  = std::make_unique<unsigned char[]>(numIndices * indexSize);
+    data.subMeshes.clear();
+
+    CVector3 boundsMin = *reinterpret_cast<CVector3*>(scene->mMeshes[0]->mVertices);
+    CVector3 boundsMax = boundsMin;
+    data.cacheStatsImported  = {};
+    data.cacheStatsOptimised = {};
+    std::vector<uint32_t> subMeshIndices;
+    std::vector<uint32_t> clusters;
+
+    unsigned int baseVertex = 0;
+    unsigned int startIndex = 0;
+    for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+    {
+        aiMesh* assimpMesh = scene->mMeshes[m];
+        unsigned int subMeshVertices = assimpMesh->mNumVertices;
+        unsigned char* subMeshStart = vertices.get() + baseVertex * vertexSize;
+
+        data.subMeshes.push_back( { startIndex, assimpMesh->mNumFaces * 3, static_cast<int>(baseVertex), assimpMesh->mMaterialIndex } );
+
+
+        //-----------------------------------
+
+        // Reorder the triangles for the GPU's vertex cache and to reduce overdraw (see MeshOptimiser.h). This replaces
+        // assimp's own cache locality step, which only considers the cache
+        subMeshIndices.resize(assimpMesh->mNumFaces * 3);
+        for (unsigned int face = 0; face < assimpMesh->mNumFaces; ++face)
+        {
+            subMeshIndices[face * 3 + 0] = assimpMesh->mFaces[face].mIndices[0];
+            subMeshIndices[face * 3 + 1] = assimpMesh->mFaces[face].mIndices[1];
+            subMeshIndices[face * 3 + 2] = assimpMesh->mFaces[face].mIndices[2];
+        }
+        data.cacheStatsImported += AnalyseVertexCache(subMeshIndices.data(), subMeshIndices.size());
+
+        OptimiseVertexCache(subMeshIndices.data(), subMeshIndices.size(), subMeshVertices, gsVertexCacheSize, &clusters);
+        OptimiseOverdraw(subMeshIndices.data(), subMeshIndices.size(), reinterpret_cast<CVector3*>(assimpMesh->mVertices),
+                         subMeshVertices, clusters);
+
+
+        //-----------------------------------
+
+        // Copy mesh data from assimp to our CPU-side vertex buffer
+
+        CVector3* assimpPosition = reinterpret_cast<CVector3*>(assimpMesh->mVertices);
+        unsigned char* position = subMeshStart + positionOffset;
+        unsigned char* positionEnd = position + subMeshVertices * vertexSize;
+        while (position != positionEnd)
+        {
+            *(CVector3*)position = *assimpPosition;
+            position += vertexSize;
+            ++assimpPosition;
+        }
+
+        // Bounds of the whole mesh, used for culling
+        assimpPosition = reinterpret_cast<CVector3*>(assimpMesh->mVertices);
+        for (unsigned int v = 0; v < subMeshVertices; ++v)
+        {
+            const CVector3& p = assimpPosition[v];
+            if (p.x < boundsMin.x)  boundsMin.x = p.x;
+            if (p.y < boundsMin.y)  boundsMin.y = p.y;
+            if (p.z < boundsMin.z)  boundsMin.z = p.z;
+            if (p.x > boundsMax.x)  boundsMax.x = p.x;
+            if (p.y > boundsMax.y)  boundsMax.y = p.y;
+            if (p.z > boundsMax.z)  boundsMax.z = p.z;
+        }
+
+        CVector3* assimpNormal = reinterpret_cast<CVector3*>(assimpMesh->mNormals);
+        unsigned char* normal = subMeshStart + normalOffset;
+        unsigned char* normalEnd = normal + subMeshVertices * vertexSize;
+        while (normal != normalEnd)
+        {
+            *(CVector3*)normal = *assimpNormal;
+            normal += vertexSize;
+            ++assimpNormal;
+        }
+
+        if (requireTangents)
+        {
+          CVector3* assimpTangent = reinterpret_cast<CVector3*>(assimpMesh->mTangents);
+          unsigned char* tangent =  subMeshStart + tangentOffset;
+          unsigned char* tangentEnd = tangent + subMeshVertices * vertexSize;
+          while (tangent != tangentEnd)
+          {
+            *(CVector3*)tangent = *assimpTangent;
+            tangent += vertexSize;
+            ++assimpTangent;
+          }
+        }
+
+        if (hasUVs)
+        {
+            bool subMeshHasUVs = assimpMesh->GetNumUVChannels() > 0 && assimpMesh->HasTextureCoords(0);
+            aiVector3D* assimpUV = assimpMesh->mTextureCoords[0];
+            unsigned char* uv = subMeshStart + uvOffset;
+            unsigned char* uvEnd = uv + subMeshVertices * vertexSize;
+            while (uv != uvEnd)
+            {
+                *(CVector2*)uv = subMeshHasUVs ? CVector2(assimpUV->x, assimpUV->y) : CVector2(0, 0);
+                uv += vertexSize;
+                if (subMeshHasUVs)  ++assimpUV;
+            }
+        }
+
+
+        //-----------------------------------
+
+        // Put the vertices in the order the reordered triangles use them
+        OptimiseVertexFetch(subMeshIndices.data(), subMeshIndices.size(), subMeshStart, subMeshVertices, vertexSize);
+        data.cacheStatsOptimised += AnalyseVertexCache(subMeshIndices.data(), subMeshIndices.size());
+
+        // Copy the reordered face data to our CPU-side index buffer
+        if (indexSize == 2)
+        {
+            uint16_t* index = reinterpret_cast<uint16_t*>(indices.get()) + startIndex;
+            for (uint32_t subMeshIndex : subMeshIndices)
+            {
+                *index++ = static_cast<uint16_t>(subMeshIndex);
+            }
+        }
+        else
+        {
+            std::memcpy(reinterpret_cast<DWORD*>(indices.get()) + startIndex, subMeshIndices.data(), subMeshIndices.size() * sizeof(DWORD));
+        }
+
+        baseVertex += subMeshVertices;
+        startIndex += assimpMesh->mNumFaces * 3;
+    }
+
+
+    //-----------------------------------
+
+    // The bounding sphere is centred on the box, which is slightly looser than the minimum sphere but quick to find
+    // and good enough for culling
+    CVector3 boundingCentre = (boundsMin + boundsMax) * 0.5f;
+    float radiusSquared = 0;
+    const unsigned char* position = vertices.get() + positionOffset;
+    for (unsigned int v = 0; v < numVertices; ++v)
+    {
+        CVector3 offset = *reinterpret_cast<const CVector3*>(position) - boundingCentre;
+        float distanceSquared = Dot(offset, offset);
+        if (distanceSquared > radiusSquared)  radiusSquared = distanceSquared;
+        position += vertexSize;
+    }
+
+    data.vertexSize     = vertexSize;
+    data.numVertices    = numVertices;
+    data.numIndices     = numIndices;
+    data.indexSize      = indexSize;
+    data.vertices       = vertices.get();
+    data.indices        = indices.get();
+    data.boundsMin      = boundsMin;
+    data.boundsMax      = boundsMax;
+    data.boundingCentre = boundingCentre;
+    data.boundingRadius = std::sqrt(radiusSquared);
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Loading
+//--------------------------------------------------------------------------------------
+
+// Pass the name of the mesh file to load. Uses assimp (http://www.assimp.org/) to support many file types
+// Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
+// Will throw a std::runtime_error exception on failure (since constructors can't return errors).
+Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
+{
+    auto source = LoadSource(fileName, requireTangents);
+    CreateBuffers(source->data, fileName);
+    mLoadedFromCache = source->fromCache;
+}
+
+
+std::unique_ptr<SMeshSource> Mesh::LoadSource(const std::string& fileName, bool requireTangents /*= false*/)
+{
+    auto source = std::make_unique<SMeshSource>();
+    unsigned int assimpFlags = ImportFlags(requireTangents);
+
+    // Use the cooked version of the mesh if it is up to date (see MeshCache.h). Otherwise import the source
+    // file and cook it for next time. Failing to write the cooked file only costs time on the next run
+    std::string cookedFileName = CookedMeshFileName(fileName, assimpFlags);
+    uint64_t sourceTime = FileWriteTime(fileName);
+
+    Timer timer;
+    timer.Reset();
+    if (sourceTime != 0 && source->cookedFile.Open(cookedFileName, sourceTime, assimpFlags))
+    {
+        source->cookedFile.GetMeshData(source->data);
+        source->fromCache = true;
+        source->mapTime = timer.GetTime();
+    }
+    else
+    {
+        ImportMesh(fileName, requireTangents, assimpFlags, source->data, source->vertices, source->indices);
+        source->importTime = timer.GetTime();
+        if (sourceTime != 0)
+        {
+            timer.Reset();
+            bool cooked = WriteCookedMesh(cookedFileName, sourceTime, assimpFlags, source->data);
+            source->cookTime = timer.GetTime();
+
+            // Time what the next start will do with the file just written
+            timer.Reset();
+            CCookedMeshFile cookedFile;
+            SMeshData cookedData;
+            if (cooked && cookedFile.Open(cookedFileName, sourceTime, assimpFlags))
+            {
+                cookedFile.GetMeshData(cookedData);
+                source->mapTime = timer.GetTime();
+            }
+        }
+    }
+    return source;
+}
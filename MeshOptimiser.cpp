@@ -0,0 +1,267 @@
+//--------------------------------------------------------------------------------------
+// Mesh optimisation - triangle and vertex order for the GPU's caches
+//--------------------------------------------------------------------------------------
+
+#include "MeshOptimiser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+
+//--------------------------------------------------------------------------------------
+// Cache simulation
+//--------------------------------------------------------------------------------------
+
+SVertexCacheStats AnalyseVertexCache(const uint32_t* indices, size_t numIndices, unsigned int cacheSize)
+{
+    SVertexCacheStats stats;
+    stats.triangles = static_cast<unsigned int>(numIndices / 3);
+
+    CVertexCacheSimulator cache(cacheSize);
+    std::vector<bool> used;
+    for (size_t i = 0; i < numIndices; ++i)
+    {
+        uint32_t vertex = indices[i];
+        if (cache.Access(vertex))  ++stats.transforms;
+        if (vertex >= used.size())  used.resize(vertex + 1, false);
+        if (!used[vertex])
+        {
+            used[vertex] = true;
+            ++stats.vertices;
+        }
+    }
+    return stats;
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Vertex cache - Tipsify
+//--------------------------------------------------------------------------------------
+
+void OptimiseVertexCache(uint32_t* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize,
+                         std::vector<uint32_t>* clusters)
+{
+    // Indices left over after the last whole triangle are left where they are
+    const size_t numTriangles = numIndices / 3;
+    numIndices = numTriangles * 3;
+    if (clusters)  clusters->assign(1, 0);
+    if (numTriangles == 0)  return;
+
+    // Triangles using each vertex, as one list with a range for each vertex
+    std::vector<uint32_t> liveTriangles(numVertices, 0); // Triangles using the vertex that haven't been output yet
+    for (size_t i = 0; i < numIndices; ++i)  ++liveTriangles[indices[i]];
+    std::vector<uint32_t> adjacencyStart(numVertices + 1, 0);
+    for (size_t v = 0; v < numVertices; ++v)  adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+    std::vector<uint32_t> adjacency(numIndices);
+    std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (size_t i = 0; i < numIndices; ++i)  adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+    std::vector<uint32_t> output;
+    output.reserve(numIndices);
+    std::vector<bool>     emitted(numTriangles, false);
+    std::vector<uint32_t> cacheTime(numVertices, 0); // Time each vertex entered the (FIFO) cache
+    std::vector<uint32_t> deadEnd;                   // Recently used vertices, to continue from when fanning stops
+    std::vector<uint32_t> candidates;                // Vertices of the triangles output around the current vertex
+    uint32_t time = cacheSize + 1;
+    uint32_t cursor = 0;                             // Input vertices before this have no live triangles
+
+    const uint32_t NoVertex = 0xffffffff;
+    uint32_t fanVertex = 0;
+    while (fanVertex != NoVertex)
+    {
+        // Output every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (uint32_t a = adjacencyStart[fanVertex]; a < adjacencyStart[fanVertex + 1]; ++a)
+        {
+            uint32_t triangle = adjacency[a];
+            if (emitted[triangle])  continue;
+            emitted[triangle] = true;
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                uint32_t vertex = indices[triangle * 3 + corner];
+                output.push_back(vertex);
+                deadEnd.push_back(vertex);
+                candidates.push_back(vertex);
+                --liveTriangles[vertex];
+                if (time - cacheTime[vertex] > cacheSize)  cacheTime[vertex] = time++;
+            }
+        }
+
+        // Fan around the candidate that will still be in the cache after its remaining triangles are output (each adds
+        // at most two vertices), preferring the one that has been in the cache longest
+        uint32_t next = NoVertex;
+        int bestPriority = -1;
+        for (uint32_t vertex : candidates)
+        {
+            if (liveTriangles[vertex] == 0)  continue;
+            int priority = 0;
+            if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)  priority = static_cast<int>(time - cacheTime[vertex]);
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+
+        // Otherwise continue from the most recently used vertex with triangles left, or else the next such vertex
+        // in the input, where the cache is cold and a new cluster starts
+        while (next == NoVertex && !deadEnd.empty())
+        {
+            uint32_t vertex = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[vertex] > 0)  next = vertex;
+        }
+        if (next == NoVertex)
+        {
+            while (cursor < numVertices && liveTriangles[cursor] == 0)  ++cursor;
+            if (cursor < numVertices)
+            {
+                next = cursor;
+                if (clusters && output.size() < numIndices)  clusters->push_back(static_cast<uint32_t>(output.size() / 3));
+            }
+        }
+        fanVertex = next;
+    }
+
+    std::memcpy(indices, output.data(), numIndices * sizeof(uint32_t));
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Overdraw - cluster sorting
+//--------------------------------------------------------------------------------------
+
+void OptimiseOverdraw(uint32_t* indices, size_t numIndices, const CVector3* positions, size_t numVertices,
+                      const std::vector<uint32_t>& clusters, float threshold, unsigned int cacheSize)
+{
+    const uint32_t numTriangles = static_cast<uint32_t>(numIndices / 3);
+    if (numTriangles == 0 || numVertices == 0)  return;
+
+    // Split the cold-cache clusters further. A new cluster starts with an empty cache, so a cut is only made once the
+    // cluster so far has a miss ratio within the threshold of the whole list's, so splitting adds few transforms
+    float targetACMR = AnalyseVertexCache(indices, numIndices, cacheSize).ACMR() * threshold;
+    std::vector<uint32_t> starts;
+    CVertexCacheSimulator cache(cacheSize);
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        uint32_t end = (c + 1 < clusters.size()) ? clusters[c + 1] : numTriangles;
+        uint32_t start = clusters[c];
+        starts.push_back(start);
+        cache.Reset();
+        unsigned int misses = 0;
+        for (uint32_t triangle = start; triangle < end; ++triangle)
+        {
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                if (cache.Access(indices[triangle * 3 + corner]))  ++misses;
+            }
+
+            // Clusters of a few triangles would just be noise in the sort
+            const uint32_t MinClusterTriangles = 8;
+            uint32_t triangles = triangle + 1 - start;
+            if (triangles >= MinClusterTriangles && triangle + 1 < end && misses <= targetACMR * triangles)
+            {
+                start = triangle + 1;
+                starts.push_back(start);
+                cache.Reset();
+                misses = 0;
+            }
+        }
+    }
+    if (starts.size() < 2)  return;
+
+    // Area weighted centre of the whole mesh, then of each cluster with its area weighted normal. Cross products of
+    // the edges point out of the front of clockwise triangles
+    auto triangleCentre = [&](uint32_t triangle, float& area, CVector3& normal)
+    {
+        const CVector3& p0 = positions[indices[triangle * 3 + 0]];
+        const CVector3& p1 = positions[indices[triangle * 3 + 1]];
+        const CVector3& p2 = positions[indices[triangle * 3 + 2]];
+        normal = Cross(p1 - p0, p2 - p0);
+        area = std::sqrt(Dot(normal, normal));
+        return (p0 + p1 + p2) * (1.0f / 3.0f);
+    };
+
+    CVector3 meshCentre = { 0, 0, 0 };
+    float meshArea = 0;
+    for (uint32_t triangle = 0; triangle < numTriangles; ++triangle)
+    {
+        float area;
+        CVector3 normal;
+        CVector3 centroid = triangleCentre(triangle, area, normal);
+        meshCentre += centroid * area;
+        meshArea += area;
+    }
+    if (meshArea > 0)  meshCentre = meshCentre * (1.0f / meshArea);
+
+    // Clusters facing out from the centre are drawn first, those facing in or on the far side of the centre last
+    struct SCluster
+    {
+        uint32_t start, end;
+        float    sortKey;
+    };
+    std::vector<SCluster> sorted;
+    for (size_t c = 0; c < starts.size(); ++c)
+    {
+        SCluster cluster = { starts[c], (c + 1 < starts.size()) ? starts[c + 1] : numTriangles, 0 };
+        CVector3 centre = { 0, 0, 0 };
+        CVector3 clusterNormal = { 0, 0, 0 };
+        float clusterArea = 0;
+        for (uint32_t triangle = cluster.start; triangle < cluster.end; ++triangle)
+        {
+            float area;
+            CVector3 normal;
+            CVector3 centroid = triangleCentre(triangle, area, normal);
+            centre += centroid * area;
+            clusterNormal += normal;
+            clusterArea += area;
+        }
+        float normalLength = std::sqrt(Dot(clusterNormal, clusterNormal));
+        if (clusterArea > 0 && normalLength > 0)
+        {
+            cluster.sortKey = Dot(centre * (1.0f / clusterArea) - meshCentre, clusterNormal * (1.0f / normalLength));
+        }
+        sorted.push_back(cluster);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const SCluster& a, const SCluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<uint32_t> output;
+    output.reserve(numIndices);
+    for (auto& cluster : sorted)
+    {
+        output.insert(output.end(), indices + cluster.start * 3, indices + cluster.end * 3);
+    }
+    std::memcpy(indices, output.data(), output.size() * sizeof(uint32_t));
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Vertex fetch
+//--------------------------------------------------------------------------------------
+
+void OptimiseVertexFetch(uint32_t* indices, size_t numIndices, void* vertices, size_t numVertices, size_t vertexSize)
+{
+    const uint32_t Unused = 0xffffffff;
+    std::vector<uint32_t> newIndex(numVertices, Unused);
+    uint32_t numUsed = 0;
+    for (size_t i = 0; i < numIndices; ++i)
+    {
+        uint32_t& vertex = newIndex[indices[i]];
+        if (vertex == Unused)  vertex = numUsed++;
+        indices[i] = vertex;
+    }
+    for (auto& vertex : newIndex)
+    {
+        if (vertex == Unused)  vertex = numUsed++;
+    }
+
+    std::vector<unsigned char> oldVertices(static_cast<unsigned char*>(vertices), static_cast<unsigned char*>(vertices) + numVertices * vertexSize);
+    for (size_t v = 0; v < numVertices; ++v)
+    {
+        std::memcpy(static_cast<unsigned char*>(vertices) + newIndex[v] * vertexSize, oldVertices.data() + v * vertexSize, vertexSize);
+    }
+}
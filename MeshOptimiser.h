@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------------------------
+// Mesh optimisation - triangle and vertex order for the GPU's caches
+//--------------------------------------------------------------------------------------
+// Run on each sub-mesh when a mesh is imported, before it is cooked (see MeshCache.h), so costs nothing at load time.
+// Three passes, in this order:
+//
+// - Vertex cache: triangles are reordered so vertices shared by neighbouring triangles are still in the GPU's post
+//   transform cache when they are used again, and the vertex shader runs fewer times. Uses "Tipsify" (Sander, Nehab
+//   and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007): fan around one vertex at
+//   a time, choosing the next vertex from those just used by how long they will stay in the cache.
+// - Overdraw: the cache optimised order is cut into clusters, at points where the cache would be cold anyway and
+//   wherever a cluster can end without costing much more than a threshold of extra vertex transforms. The clusters
+//   are then sorted so those facing outwards from the mesh's centre come first, as they tend to hide the others.
+// - Vertex fetch: vertices are renumbered in the order the triangles first use them, and the vertex data reordered
+//   to match, so the GPU reads the vertex buffer mostly in sequence.
+//
+// The results are measured with a simulated FIFO post transform cache, reporting the average cache miss ratio (ACMR,
+// vertex transforms per triangle: 3 at worst, about 0.5 at best for a regular grid) and the average transform to
+// vertex ratio (ATVR, transforms per vertex used: 1 is ideal, as every vertex must be transformed at least once).
+//
+// Triangles are three indices each. Everything here is plain C++, with no device or platform code.
+
+#ifndef _MESH_OPTIMISER_H_INCLUDED_
+#define _MESH_OPTIMISER_H_INCLUDED_
+
+#include "CVector3.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+// Post transform cache size the optimisation and statistics use. Real caches vary, and a larger one than simulated
+// still benefits from the order
+static const unsigned int gsVertexCacheSize = 16;
+
+
+//-------------------------------------
+// Cache simulation
+//-------------------------------------
+
+// Simulated FIFO post transform vertex cache: a vertex that isn't one of the last cacheSize transformed is a miss,
+// and is transformed and added to the cache
+class CVertexCacheSimulator
+{
+public:
+    CVertexCacheSimulator(unsigned int cacheSize = gsVertexCacheSize) : mCacheSize(cacheSize) {}
+
+    // Empty the cache, as between draw calls
+    void Reset()  { mTimes.clear();  mTime = mCacheSize + 1; }
+
+    // Use a vertex, returning true if it was a miss
+    bool Access(uint32_t vertex)
+    {
+        if (vertex >= mTimes.size())  mTimes.resize(vertex + 1, 0);
+        if (mTime - mTimes[vertex] <= mCacheSize)  return false;
+        mTimes[vertex] = mTime++;
+        return true;
+    }
+
+private:
+    unsigned int          mCacheSize;
+    unsigned int          mTime = mCacheSize + 1; // Increases with each miss
+    std::vector<uint32_t> mTimes;                 // Time each vertex was last added to the cache, 0 if never
+};
+
+
+// Vertex cache statistics of one or more triangle lists
+struct SVertexCacheStats
+{
+    unsigned int triangles  = 0;
+    unsigned int vertices   = 0; // Distinct vertices used
+    unsigned int transforms = 0; // Cache misses
+
+    float ACMR() const  { return triangles > 0 ? static_cast<float>(transforms) / triangles : 0.0f; }
+    float ATVR() const  { return vertices  > 0 ? static_cast<float>(transforms) / vertices  : 0.0f; }
+
+    // Combine the statistics of separately drawn triangle lists (e.g. the sub-meshes of a mesh)
+    SVertexCacheStats& operator+=(const SVertexCacheStats& stats)
+    {
+        triangles  += stats.triangles;
+        vertices   += stats.vertices;
+        transforms += stats.transforms;
+        return *this;
+    }
+};
+
+// Measure a triangle list with an empty cache of the given size
+SVertexCacheStats AnalyseVertexCache(const uint32_t* indices, size_t numIndices, unsigned int cacheSize = gsVertexCacheSize);
+
+
+//-------------------------------------
+// Optimisation
+//-------------------------------------
+
+// Reorder triangles for the vertex cache (see header comment). Indices must be less than numVertices, and any left
+// over after the last whole triangle stay where they are. If clusters is given it is filled with the first triangle of
+// each run that starts with a cold cache (always including 0)
+void OptimiseVertexCache(uint32_t* indices, size_t numIndices, size_t numVertices,
+                         unsigned int cacheSize = gsVertexCacheSize, std::vector<uint32_t>* clusters = nullptr);
+
+// Reorder clusters of cache optimised triangles to reduce overdraw (see header comment). The clusters are those from
+// OptimiseVertexCache, which are split further where the vertex cache miss ratio can stay within threshold times that
+// of the whole list. A threshold of 1 keeps the cache order's misses, higher values allow more, smaller clusters
+void OptimiseOverdraw(uint32_t* indices, size_t numIndices, const CVector3* positions, size_t numVertices,
+                      const std::vector<uint32_t>& clusters, float threshold = 1.05f,
+                      unsigned int cacheSize = gsVertexCacheSize);
+
+// Renumber vertices in the order the triangles first use them and reorder the vertex data to match. Vertices no
+// triangle uses are moved to the end. The vertices are vertexSize bytes each
+void OptimiseVertexFetch(uint32_t* indices, size_t numIndices, void* vertices, size_t numVertices, size_t vertexSize);
+
+
+#endif //_MESH_OPTIMISER_H_INCLUDED_
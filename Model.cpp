@@ -9,77 +9,174 @@
 #include "Common.h"
 #include "GraphicsHelpers.h"
 #include "Mesh.h"
+#include "OcclusionBuffer.h"
 
-void Model::Render()
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+
+CTransformSystem Model::sTransforms;
+
+
+Model::Model(const Model& other)
+    : mMesh(other.mMesh),
+      mTransform(sTransforms.Add(sTransforms.Position(other.mTransform), sTransforms.Rotation(other.mTransform), sTransforms.Scale(other.mTransform))),
+      mWiggleStrength(other.mWiggleStrength)
 {
-    UpdateWorldMatrix();
+    std::copy(std::begin(other.mTextures), std::end(other.mTextures), mTextures);
+    sTransforms.SetParent(mTransform, sTransforms.Parent(other.mTransform));
+}
+
+Model::Model(Model&& other) noexcept
+    : mMesh(other.mMesh), mTransform(other.mTransform), mWiggleStrength(other.mWiggleStrength)
+{
+    std::copy(std::begin(other.mTextures), std::end(other.mTextures), mTextures);
+    other.mTransform = STransformHandle();
+}
+
+Model& Model::operator=(const Model& other)
+{
+    if (this == &other)  return *this;
+    return *this = Model(other);
+}
+
+Model& Model::operator=(Model&& other) noexcept
+{
+    if (this == &other)  return *this;
+    mMesh = other.mMesh;
+    mWiggleStrength = other.mWiggleStrength;
+    std::copy(std::begin(other.mTextures), std::end(other.mTextures), mTextures);
+    std::swap(mTransform, other.mTransform); // Other's destructor removes the old transform
+    return *this;
+}
+
+Model::~Model()
+{
+    sTransforms.Remove(mTransform);
+}
 
-    gPerModelConstants.worldMatrix = mWorldMatrix; // Update C++ side constant buffer
-	gPerModelConstants.wiggleStrength = mWiggleStrength;
-    UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
+
+void Model::Render()
+{
+    UploadConstants();
 
     // Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-    gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-    gD3DContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+    gRenderContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
+    gRenderContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
 
     mMesh->Render();
 }
 
 
+void Model::UploadConstants()
+{
+    WriteConstants(gPerModelConstants); // Update C++ side constant buffer
+    UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
+}
+
+
+void Model::WriteConstants(PerModelConstants& constants)
+{
+    constants.worldMatrix = sTransforms.WorldMatrix(mTransform);
+	constants.wiggleStrength = mWiggleStrength;
+}
+
+
+// Returns false if the model is entirely outside the given frustum, so it doesn't need to be rendered. Tests the
+// mesh bounding sphere first as it is cheapest, then the box around the transformed mesh bounding box
+bool Model::IsInFrustum(const CFrustum& frustum)
+{
+    const CMatrix4x4& m = sTransforms.WorldMatrix(mTransform);
+
+    // The wiggle vertex shader moves vertices up to 0.1 units in model space, so allow for that
+    float padding = (mWiggleStrength != 0) ? 0.1f : 0.0f;
+
+    CVector3 scale = m.GetScale();
+    float maxScale = scale.x > scale.y ? (scale.x > scale.z ? scale.x : scale.z) : (scale.y > scale.z ? scale.y : scale.z);
+    CVector3 centre = m.TransformPoint(mMesh->BoundingCentre());
+    if (!frustum.IsSphereVisible(centre, (mMesh->BoundingRadius() + padding) * maxScale))  return false;
+
+    // World space box enclosing the rotated model space box - each world axis extent is the sum of the model
+    // extents projected onto that axis
+    CVector3 modelExtents = (mMesh->BoundsMax() - mMesh->BoundsMin()) * 0.5f + CVector3{ padding, padding, padding };
+    CVector3 boxCentre = m.TransformPoint((mMesh->BoundsMin() + mMesh->BoundsMax()) * 0.5f);
+    CVector3 extents = { modelExtents.x * std::abs(m.e00) + modelExtents.y * std::abs(m.e10) + modelExtents.z * std::abs(m.e20),
+                         modelExtents.x * std::abs(m.e01) + modelExtents.y * std::abs(m.e11) + modelExtents.z * std::abs(m.e21),
+                         modelExtents.x * std::abs(m.e02) + modelExtents.y * std::abs(m.e12) + modelExtents.z * std::abs(m.e22) };
+    return frustum.IsBoxVisible(boxCentre, extents);
+}
+
+
+bool Model::IsOccluded(COcclusionBuffer& occlusionBuffer)
+{
+    // Padded for the wiggle vertex shader as in IsInFrustum
+    float padding = (mWiggleStrength != 0) ? 0.1f : 0.0f;
+    CVector3 paddingBox = { padding, padding, padding };
+    return !occlusionBuffer.IsBoxVisible(mMesh->BoundsMin() - paddingBox, mMesh->BoundsMax() + paddingBox, sTransforms.WorldMatrix(mTransform));
+}
+
+
 
 // Control the model's position and rotation using keys provided. Amount of motion performed depends on frame time
 void Model::Control(float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,
                                      KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward)
 {
-    UpdateWorldMatrix();
+    CMatrix4x4 worldMatrix = WorldMatrix();
+    CVector3 position = Position();
+    CVector3 rotation = Rotation();
+    bool changed = false;
 
 	if (KeyHeld( turnDown ))
 	{
-		mRotation.x += ROTATION_SPEED * frameTime;
+		rotation.x += ROTATION_SPEED * frameTime;
+		changed = true;
 	}
 	if (KeyHeld( turnUp ))
 	{
-		mRotation.x -= ROTATION_SPEED * frameTime;
+		rotation.x -= ROTATION_SPEED * frameTime;
+		changed = true;
 	}
 	if (KeyHeld( turnRight ))
 	{
-		mRotation.y += ROTATION_SPEED * frameTime;
+		rotation.y += ROTATION_SPEED * frameTime;
+		changed = true;
 	}
 	if (KeyHeld( turnLeft ))
 	{
-		mRotation.y -= ROTATION_SPEED * frameTime;
+		rotation.y -= ROTATION_SPEED * frameTime;
+		changed = true;
 	}
 	if (KeyHeld( turnCW ))
 	{
-		mRotation.z += ROTATION_SPEED * frameTime;
+		rotation.z += ROTATION_SPEED * frameTime;
+		changed = true;
 	}
 	if (KeyHeld( turnCCW ))
 	{
-		mRotation.z -= ROTATION_SPEED * frameTime;
+		rotation.z -= ROTATION_SPEED * frameTime;
+		changed = true;
 	}
 
 	// Local Z movement - move in the direction of the Z axis, get axis from world matrix
-    CVector3 localZDir = Normalise({ mWorldMatrix.e20, mWorldMatrix.e21, mWorldMatrix.e22 }); // normalise axis in case world matrix has scaling
+    CVector3 localZDir = Normalise({ worldMatrix.e20, worldMatrix.e21, worldMatrix.e22 }); // normalise axis in case world matrix has scaling
 	if (KeyHeld( moveForward ))
 	{
-		mPosition.x += localZDir.x * MOVEMENT_SPEED * frameTime;
-		mPosition.y += localZDir.y * MOVEMENT_SPEED * frameTime;
-		mPosition.z += localZDir.z * MOVEMENT_SPEED * frameTime;
+		position.x += localZDir.x * MOVEMENT_SPEED * frameTime;
+		position.y += localZDir.y * MOVEMENT_SPEED * frameTime;
+		position.z += localZDir.z * MOVEMENT_SPEED * frameTime;
+		changed = true;
 	}
 	if (KeyHeld( moveBackward ))
 	{
-		mPosition.x -= localZDir.x * MOVEMENT_SPEED * frameTime;
-		mPosition.y -= localZDir.y * MOVEMENT_SPEED * frameTime;
-		mPosition.z -= localZDir.z * MOVEMENT_SPEED * frameTime;
+		position.x -= localZDir.x * MOVEMENT_SPEED * frameTime;
+		position.y -= localZDir.y * MOVEMENT_SPEED * frameTime;
+		position.z -= localZDir.z * MOVEMENT_SPEED * frameTime;
+		changed = true;
 	}
-}
 
-CTexture* Model::GetTexture(int index)
-{
-	return mTexture[index];
+	if (changed)
+	{
+		SetPosition(position);
+		SetRotation(rotation);
+	}
 }
-
-void Model::UpdateWorldMatrix()
-{
-    mWorldMatrix = MatrixScaling(mScale) * MatrixRotationZ(mRotation.z) * MatrixRotationX(mRotation.x) * MatrixRotationY(mRotation.y) * MatrixTranslation(mPosition);
-}
\ No newline at end of file
@@ -7,14 +7,17 @@
 #include "Common.h"
 #include "CVector3.h"
 #include "CMatrix4x4.h"
+#include "CFrustum.h"
 #include "Input.h"
 #include "CTexture.h"
+#include "TransformSystem.h"
 
-#include <vector>
+#include <initializer_list>
 #ifndef _MODEL_H_INCLUDED_
 #define _MODEL_H_INCLUDED_
 
 class Mesh;
+class COcclusionBuffer;
 
 class Model
 {
@@ -23,82 +26,138 @@ public:
 	// Construction / Usage
 	//-------------------------------------
 
-	Model(Mesh* mesh, std::vector<CTexture*> &textures, CVector3 position = { 0,0,0 }, CVector3 rotation = { 0,0,0 }, float scale = 1)
-        : mMesh(mesh), mPosition(position), mRotation(rotation), mScale({ scale, scale, scale })
+	// Up to MaxTextures textures, null entries are left empty
+	Model(Mesh* mesh, std::initializer_list<CTexture*> textures, CVector3 position = { 0,0,0 }, CVector3 rotation = { 0,0,0 }, float scale = 1)
+        : mMesh(mesh), mTransform(sTransforms.Add(position, rotation, { scale, scale, scale }))
     {
+		unsigned int slot = 0;
 		for (auto texture : textures)
 		{
-			mTexture.push_back(texture);
+			if (slot < MaxTextures)  mTextures[slot++] = texture;
 		}
     }
 
 	Model(Mesh* mesh, CVector3 position = { 0,0,0 }, CVector3 rotation = { 0,0,0 }, float scale = 1)
-		: mMesh(mesh), mPosition(position), mRotation(rotation), mScale({ scale, scale, scale })
+		: mMesh(mesh), mTransform(sTransforms.Add(position, rotation, { scale, scale, scale }))
 	{
 	}
 
+	// A copy has its own transform, attached to the same parent. Moving hands the transform over
+	Model(const Model& other);
+	Model(Model&& other) noexcept;
+	Model& operator=(const Model& other);
+	Model& operator=(Model&& other) noexcept;
+	~Model();
+
     // The render function sets the world matrix in the per-frame constant buffer and makes that buffer available
     // to vertex & pixel shader. Then it calls Mesh:Render, which renders the geometry with current GPU settings.
     // So all other per-frame constants must have been set already along with shaders, textures, samplers, states etc.
     void Render();
 
+    // Send the world matrix and other per-model constants to the GPU without binding or drawing anything. Used when
+    // the constant buffer and mesh buffers are already bound (see DrawQueue)
+    void UploadConstants();
+
+    // Fill in the world matrix and other per-model constants without sending them, so the constants of many models
+    // can be sent together (see DrawQueue). The object colour is left alone
+    void WriteConstants(PerModelConstants& constants);
+
+    // Returns false if the model is entirely outside the given frustum (e.g. off-screen), so it doesn't need rendering
+    bool IsInFrustum(const CFrustum& frustum);
+
+    // Returns true if the model's bounding box is hidden behind the occluders in the given occlusion buffer
+    bool IsOccluded(COcclusionBuffer& occlusionBuffer);
+
 
 	// Control the model's position and rotation using keys provided. Amount of motion performed depends on frame time
 	void Control( float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,  
 				  KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward );
 
 
+    // Target is in world space. An attached model's rotation is relative to its parent, so the facing matrix is
+    // taken back into the parent's space first
     void FaceTarget(CVector3 target)
     {
-        UpdateWorldMatrix();
-        mWorldMatrix.FaceTarget(target);
-        mRotation = mWorldMatrix.GetEulerAngles();
+        CMatrix4x4 worldMatrix = WorldMatrix();
+        worldMatrix.FaceTarget(target);
+        STransformHandle parent = sTransforms.Parent(mTransform);
+        if (parent.Valid())  worldMatrix = worldMatrix * InverseAffine(sTransforms.WorldMatrix(parent));
+        SetRotation(worldMatrix.GetEulerAngles());
     }
 
-	CTexture* GetTexture(int index = 0);
+    // Attach the model to another transform (a model's, a light's, or a bare entry added to Transforms), after which
+    // its position, rotation and scale are relative to that parent. An invalid handle detaches it. Returns false if
+    // the parent is attached to this model, which would make a loop
+    bool AttachTo(STransformHandle parent)  { return sTransforms.SetParent(mTransform, parent); }
+
+	// Returns nullptr if the model has no texture in that slot
+	CTexture* GetTexture(int index = 0)  { return mTextures[index]; }
+	Mesh*     GetMesh()  { return mMesh; }
 
 	//-------------------------------------
 	// Data access
 	//-------------------------------------
 
-	// Getters / setters
-	CVector3 Position()  { return mPosition; }
-	CVector3 Rotation()  { return mRotation; }
-	CVector3 Scale()     { return mScale;    }
+	// Getters / setters. These are relative to the parent for attached models
+	CVector3 Position()  { return sTransforms.Position(mTransform); }
+	CVector3 Rotation()  { return sTransforms.Rotation(mTransform); }
+	CVector3 Scale()     { return sTransforms.Scale(mTransform);    }
 
-	void SetPosition( CVector3 position )  { mPosition = position; }
-	void SetRotation( CVector3 rotation )  { mRotation = rotation; }
+	// Setters mark the world matrix as out of date, it is rebuilt the next time it is needed or when all the
+	// transforms are updated together (see Transforms)
+	void SetPosition( CVector3 position )  { sTransforms.SetPosition(mTransform, position); }
+	void SetRotation( CVector3 rotation )  { sTransforms.SetRotation(mTransform, rotation); }
 
 	// Two ways to set scale: x,y,z separately, or all to the same value
-	void SetScale   ( CVector3 scale    )  { mScale = scale;       } 
-	void SetScale   ( float scale       )  { mScale = { scale, scale, scale };}
+	void SetScale   ( CVector3 scale    )  { sTransforms.SetScale(mTransform, scale);                   }
+	void SetScale   ( float scale       )  { sTransforms.SetScale(mTransform, { scale, scale, scale }); }
 	
 	void SetWiggleStrength(float strength) { mWiggleStrength = strength; }
+	float WiggleStrength()  { return mWiggleStrength; }
 
 	// Read only access to model world matrix, updated on request
-	CMatrix4x4 WorldMatrix()  { UpdateWorldMatrix();  return mWorldMatrix; }
+	CMatrix4x4 WorldMatrix()  { return sTransforms.WorldMatrix(mTransform); }
+	CVector3   WorldPosition()  { return WorldMatrix().GetPosition(); }
+
+	// The model's entry in the transform system, for attaching other things to it
+	STransformHandle Transform()  { return mTransform; }
+
+	// Increases each time the world matrix is rebuilt, so anything cached from the model's transform (e.g. a shadow
+	// map) can tell whether it is out of date
+	unsigned int TransformVersion()  { return sTransforms.Version(mTransform); }
+
+	// The transforms of all models. Update them all with Transforms().UpdateAll once a frame, after moving models
+	// and before rendering, so the matrices are built in batches rather than one by one as they are first used
+	static CTransformSystem& Transforms()  { return sTransforms; }
+
+
+	//-------------------------------------
+	// Statistics
+	//-------------------------------------
+
+	// Number of world matrices rebuilt (across all models) since the last reset. The scene resets this once per frame
+	// so static models, which only build their matrix once, can be seen to cost nothing per pass
+	static unsigned int WorldMatrixRebuilds()       { return sTransforms.Rebuilds(); }
+	static void         ResetWorldMatrixRebuilds()  { sTransforms.ResetRebuilds();   }
 
 
 	//-------------------------------------
 	// Private data / members
 	//-------------------------------------
 private:
-    void UpdateWorldMatrix();
-
     Mesh* mMesh;
 
-	// Position, rotation and scaling for the model
-	CVector3 mPosition;
-	CVector3 mRotation;
-	CVector3 mScale;
+	// Position, rotation and scaling for the model, and the world matrix built from them, are held in the
+	// transform system
+	STransformHandle mTransform;
 
 	float mWiggleStrength = 0;
 
-	//Model texture
-	std::vector<CTexture*> mTexture; //Textures are stored in the scene manager
+	//Model textures, held inline so drawing a model doesn't chase another pointer. Textures are stored in the scene manager
+	static const unsigned int MaxTextures = 2; //A diffuse/specular map and a normal or height map
+	CTexture* mTextures[MaxTextures] = {};
 
-	// World matrix for the model - built from the above
-	CMatrix4x4 mWorldMatrix;
+	static CTransformSystem sTransforms;
 };
 
 
@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------------------------
+// Contiguous model storage
+//--------------------------------------------------------------------------------------
+// Holds models by value in one array, rather than as separately allocated objects reached through pointers. A pass
+// over a pool reads the models in memory order, so the cache and prefetcher see one stream of data instead of a
+// miss for every model (and another for its textures, which are now held inline in the model).
+//
+// Models are addressed by handles, which stay valid as the pool grows. Pointers and references to models do not:
+// the array may move when a model is added, so they must not be kept across an Add (the draw queue only keeps them
+// for one frame, and nothing is added while rendering). Models are never removed individually, only by Clear.
+
+#ifndef _MODEL_POOL_H_INCLUDED_
+#define _MODEL_POOL_H_INCLUDED_
+
+#include "Model.h"
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+
+// Handle to a model in a pool
+struct SModelHandle
+{
+    uint32_t index = 0xffffffff;
+
+    bool Valid() const  { return index != 0xffffffff; }
+};
+
+
+class CModelPool
+{
+public:
+    // Add a model, returning its handle. Copying a model gives the copy its own transform, so move new models in
+    // (e.g. pass a temporary) to hand their transform over instead
+    SModelHandle Add(const Model& model)
+    {
+        mModels.push_back(model);
+        return { static_cast<uint32_t>(mModels.size() - 1) };
+    }
+    SModelHandle Add(Model&& model)
+    {
+        mModels.push_back(std::move(model));
+        return { static_cast<uint32_t>(mModels.size() - 1) };
+    }
+
+    // Make room for the given number of models in total, so adding up to that many doesn't move the array
+    void Reserve(size_t numModels)  { mModels.reserve(numModels); }
+
+    // Remove every model, invalidating all handles
+    void Clear()  { mModels.clear(); }
+
+    Model& operator[](SModelHandle handle)  { return mModels[handle.index]; }
+
+    size_t Size()   { return mModels.size();  }
+    bool   Empty()  { return mModels.empty(); }
+
+    // Models in the order they were added
+    std::vector<Model>::iterator begin()  { return mModels.begin(); }
+    std::vector<Model>::iterator end()    { return mModels.end();   }
+    Model& Front()  { return mModels.front(); }
+
+
+private:
+    std::vector<Model> mModels;
+};
+
+
+#endif //_MODEL_POOL_H_INCLUDED_
@@ -0,0 +1,38 @@
+//--------------------------------------------------------------------------------------
+// Normal Mapping Vertex Shader - Instanced
+//--------------------------------------------------------------------------------------
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+//****| INFO |*******************************************************************************************//
+// The normal and parallax mapping pixel shaders transform the normal and tangent they receive by
+// gWorldMatrix. An instanced draw has a different world matrix for each instance, so this shader sends the
+// normal and tangent already in world space, and the C++ side sets gWorldMatrix to the identity for the draw.
+//*******************************************************************************************************//
+NormalMappingPixelShaderInput main(TangentInstancedVertex modelVertex)
+{
+    NormalMappingPixelShaderInput output; // This is the data the pixel shader requires from this vertex shader
+
+    float4x4 worldMatrix = InstanceWorldMatrix(modelVertex.world0, modelVertex.world1, modelVertex.world2, modelVertex.world3);
+
+    float4 modelPosition = float4(modelVertex.position, 1); 
+
+    float4 worldPosition     = mul(worldMatrix,       modelPosition);
+    float4 viewPosition      = mul(gViewMatrix,       worldPosition);
+    output.projectedPosition = mul(gProjectionMatrix, viewPosition);
+
+    output.worldPosition = worldPosition.xyz;
+
+	// Normal and tangent in world space (still in the "model" outputs, see above)
+	output.modelNormal  = mul((float3x3)worldMatrix, modelVertex.normal);
+	output.modelTangent = mul((float3x3)worldMatrix, modelVertex.tangent);
+
+    output.uv = modelVertex.uv;
+
+    return output; // Ouput data sent down the pipeline (to the pixel shader)
+}
@@ -0,0 +1,270 @@
+//--------------------------------------------------------------------------------------
+// Software occlusion culling - a low resolution CPU depth buffer of the main occluders
+//--------------------------------------------------------------------------------------
+
+#include "OcclusionBuffer.h"
+#include "ThreadPool.h"
+#include "MathSIMD.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+//--------------------------------------------------------------------------------------
+// Rasterization
+//--------------------------------------------------------------------------------------
+
+void COcclusionBuffer::Begin(const CMatrix4x4& viewProjectionMatrix)
+{
+    if (mLevels.empty())
+    {
+        for (unsigned int width = Width, height = Height; ; width /= 2, height /= 2)
+        {
+            mLevels.push_back({ width, height, std::vector<float>(width * height) });
+            if (width == 1 || height == 1)  break;
+        }
+    }
+    std::fill(mLevels[0].depths.begin(), mLevels[0].depths.end(), 1.0f);
+
+    mViewProjectionMatrix = viewProjectionMatrix;
+    mTriangles.clear();
+    for (auto& bin : mBins)  bin.clear();
+}
+
+
+void COcclusionBuffer::AddOccluder(const CVector3* positions, const uint32_t* indices, unsigned int numIndices,
+                                   const CMatrix4x4& worldMatrix, bool cullBackFaces)
+{
+    // Vertices to clip space. Indices can be anywhere in the position list, so transform up to the largest
+    uint32_t numVertices = 0;
+    for (unsigned int i = 0; i < numIndices; ++i)  numVertices = std::max(numVertices, indices[i] + 1);
+    mClipPositions.resize(numVertices * 4);
+
+    CMatrix4x4 m = worldMatrix * mViewProjectionMatrix;
+    for (uint32_t v = 0; v < numVertices; ++v)
+    {
+        const CVector3& p = positions[v];
+        float* clip = &mClipPositions[v * 4];
+        clip[0] = p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30;
+        clip[1] = p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31;
+        clip[2] = p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32;
+        clip[3] = p.x * m.e03 + p.y * m.e13 + p.z * m.e23 + m.e33;
+    }
+
+    for (unsigned int i = 0; i + 2 < numIndices; i += 3)
+    {
+        // Screen position in pixels (y down) and depth of each corner. Triangles crossing the near plane are left out.
+        // Positions are snapped to an eighth of a pixel, which keeps the edge functions below exact on the screen, so
+        // triangles sharing an edge agree on which of them covers each pixel and leave no cracks
+        float x[3], y[3], z[3];
+        bool nearClipped = false;
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            const float* clip = &mClipPositions[indices[i + corner] * 4];
+            if (clip[2] < 0.0f)  { nearClipped = true;  break; }
+            float invW = 1.0f / clip[3];
+            x[corner] = std::floor((clip[0] * invW *  0.5f + 0.5f) * Width  * 8.0f + 0.5f) * 0.125f;
+            y[corner] = std::floor((clip[1] * invW * -0.5f + 0.5f) * Height * 8.0f + 0.5f) * 0.125f;
+            z[corner] = clip[2] * invW;
+        }
+        if (nearClipped)  continue;
+
+        // Twice the area, positive for clockwise triangles on screen (front facing). Back faces of two-sided models
+        // are flipped so the edge functions below are positive inside either way
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0.0f || (cullBackFaces && area < 0.0f))  continue;
+        if (area < 0.0f)
+        {
+            std::swap(x[1], x[2]);  std::swap(y[1], y[2]);  std::swap(z[1], z[2]);
+            area = -area;
+        }
+
+        // Pixels whose centres (x + 0.5, y + 0.5) may be inside, skipping triangles that cover none
+        int minX = std::max(static_cast<int>(std::ceil (std::min({ x[0], x[1], x[2] }) - 0.5f)), 0);
+        int maxX = std::min(static_cast<int>(std::floor(std::max({ x[0], x[1], x[2] }) - 0.5f)), static_cast<int>(Width) - 1);
+        int minY = std::max(static_cast<int>(std::ceil (std::min({ y[0], y[1], y[2] }) - 0.5f)), 0);
+        int maxY = std::min(static_cast<int>(std::floor(std::max({ y[0], y[1], y[2] }) - 0.5f)), static_cast<int>(Height) - 1);
+        if (minX > maxX || minY > maxY)  continue;
+
+        STriangle triangle;
+        for (int edge = 0; edge < 3; ++edge)
+        {
+            int next = (edge + 1) % 3;
+            triangle.edgeA[edge] = y[edge] - y[next];
+            triangle.edgeB[edge] = x[next] - x[edge];
+            triangle.edgeC[edge] = (y[next] - y[edge]) * x[edge] - (x[next] - x[edge]) * y[edge];
+        }
+        triangle.zA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+        triangle.zB = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+        triangle.zC = z[0] - triangle.zA * x[0] - triangle.zB * y[0];
+        triangle.minX = static_cast<uint16_t>(minX);  triangle.maxX = static_cast<uint16_t>(maxX);
+        triangle.minY = static_cast<uint16_t>(minY);  triangle.maxY = static_cast<uint16_t>(maxY);
+
+        uint32_t index = static_cast<uint32_t>(mTriangles.size());
+        mTriangles.push_back(triangle);
+        for (unsigned int tileY = minY / TileHeight; tileY <= maxY / TileHeight; ++tileY)
+        {
+            for (unsigned int tileX = minX / TileWidth; tileX <= maxX / TileWidth; ++tileX)
+            {
+                mBins[tileY * TilesX + tileX].push_back(index);
+            }
+        }
+    }
+}
+
+
+void COcclusionBuffer::Rasterize(CThreadPool* pool /*= nullptr*/)
+{
+    const unsigned int numTiles = TilesX * TilesY;
+    if (pool == nullptr)
+    {
+        for (unsigned int tile = 0; tile < numTiles; ++tile)  RasterizeTile(tile);
+    }
+    else
+    {
+        for (unsigned int tile = 0; tile < numTiles; ++tile)
+        {
+            if (!mBins[tile].empty())  pool->Add([this, tile]() { RasterizeTile(tile); });
+        }
+        pool->Wait();
+    }
+    BuildPyramid();
+}
+
+
+void COcclusionBuffer::RasterizeTile(unsigned int tile)
+{
+    const int tileMinX = (tile % TilesX) * TileWidth;
+    const int tileMinY = (tile / TilesX) * TileHeight;
+    float* depths = mLevels[0].depths.data();
+
+    for (uint32_t index : mBins[tile])
+    {
+        const STriangle& t = mTriangles[index];
+
+        // The triangle's pixels within this tile. Rows start on a group of four, the edge functions reject the
+        // extra pixels at either end
+        int minX = std::max(static_cast<int>(t.minX), tileMinX) & ~3;
+        int maxX = std::min(static_cast<int>(t.maxX), tileMinX + static_cast<int>(TileWidth)  - 1);
+        int minY = std::max(static_cast<int>(t.minY), tileMinY);
+        int maxY = std::min(static_cast<int>(t.maxY), tileMinY + static_cast<int>(TileHeight) - 1);
+
+#ifdef MATH_USE_SSE
+        const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 edgeA0 = _mm_set1_ps(t.edgeA[0]), edgeA1 = _mm_set1_ps(t.edgeA[1]), edgeA2 = _mm_set1_ps(t.edgeA[2]);
+        const __m128 zA = _mm_set1_ps(t.zA);
+        for (int y = minY; y <= maxY; ++y)
+        {
+            // The parts of each function that are constant along the row. The functions are evaluated afresh at
+            // each group of pixels rather than stepped along, as stepping would add rounding errors (see AddOccluder)
+            float py = y + 0.5f;
+            const __m128 row0 = _mm_set1_ps(t.edgeB[0] * py + t.edgeC[0]);
+            const __m128 row1 = _mm_set1_ps(t.edgeB[1] * py + t.edgeC[1]);
+            const __m128 row2 = _mm_set1_ps(t.edgeB[2] * py + t.edgeC[2]);
+            const __m128 rowZ = _mm_set1_ps(t.zB * py + t.zC);
+
+            float* row = depths + y * Width;
+            for (int x = minX; x <= maxX; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+                __m128 edge0 = _mm_add_ps(_mm_mul_ps(edgeA0, px), row0);
+                __m128 edge1 = _mm_add_ps(_mm_mul_ps(edgeA1, px), row1);
+                __m128 edge2 = _mm_add_ps(_mm_mul_ps(edgeA2, px), row2);
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, _mm_setzero_ps()), _mm_cmpge_ps(edge1, _mm_setzero_ps())),
+                                           _mm_cmpge_ps(edge2, _mm_setzero_ps()));
+                if (_mm_movemask_ps(inside) == 0)  continue;
+
+                __m128 z = _mm_add_ps(_mm_mul_ps(zA, px), rowZ);
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+            }
+        }
+#else
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float py = y + 0.5f;
+            float row0 = t.edgeB[0] * py + t.edgeC[0];
+            float row1 = t.edgeB[1] * py + t.edgeC[1];
+            float row2 = t.edgeB[2] * py + t.edgeC[2];
+            float* row = depths + y * Width;
+            for (int x = minX; x <= maxX; ++x)
+            {
+                float px = x + 0.5f;
+                if (t.edgeA[0] * px + row0 < 0.0f || t.edgeA[1] * px + row1 < 0.0f || t.edgeA[2] * px + row2 < 0.0f)  continue;
+                float z = t.zA * px + (t.zB * py + t.zC);
+                if (z < row[x])  row[x] = z;
+            }
+        }
+#endif
+    }
+}
+
+
+// Each texel of a level is the furthest of the 2x2 texels below it
+void COcclusionBuffer::BuildPyramid()
+{
+    for (size_t level = 1; level < mLevels.size(); ++level)
+    {
+        const SLevel& below = mLevels[level - 1];
+        SLevel& current = mLevels[level];
+        for (unsigned int y = 0; y < current.height; ++y)
+        {
+            const float* row0 = &below.depths[(y * 2)     * below.width];
+            const float* row1 = &below.depths[(y * 2 + 1) * below.width];
+            float* out = &current.depths[y * current.width];
+            for (unsigned int x = 0; x < current.width; ++x)
+            {
+                out[x] = std::max(std::max(row0[x * 2], row0[x * 2 + 1]), std::max(row1[x * 2], row1[x * 2 + 1]));
+            }
+        }
+    }
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Testing
+//--------------------------------------------------------------------------------------
+
+bool COcclusionBuffer::IsBoxVisible(const CVector3& boxMin, const CVector3& boxMax, const CMatrix4x4& worldMatrix)
+{
+    // Screen rectangle and nearest depth of the box's corners. The nearest point of a box is always a corner
+    CMatrix4x4 m = worldMatrix * mViewProjectionMatrix;
+    float minX = static_cast<float>(Width), maxX = 0, minY = static_cast<float>(Height), maxY = 0, minZ = 1;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        CVector3 p = { (corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z };
+        float clipZ = p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32;
+        if (clipZ < 0.0f)  return true;
+        float invW = 1.0f / (p.x * m.e03 + p.y * m.e13 + p.z * m.e23 + m.e33);
+        float x = ((p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30) * invW *  0.5f + 0.5f) * Width;
+        float y = ((p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31) * invW * -0.5f + 0.5f) * Height;
+        minX = std::min(minX, x);  maxX = std::max(maxX, x);
+        minY = std::min(minY, y);  maxY = std::max(maxY, y);
+        minZ = std::min(minZ, clipZ * invW);
+    }
+
+    // Texels the rectangle touches, clamped to the screen (the frustum test deals with boxes off the screen)
+    int x0 = std::max(static_cast<int>(minX), 0), x1 = std::min(static_cast<int>(maxX), static_cast<int>(Width)  - 1);
+    int y0 = std::max(static_cast<int>(minY), 0), y1 = std::min(static_cast<int>(maxY), static_cast<int>(Height) - 1);
+    if (x0 > x1 || y0 > y1)  return true;
+
+    // Go up the pyramid until the rectangle is no more than two texels across, when it touches at most three
+    unsigned int level = 0;
+    while (level + 1 < mLevels.size() && std::max(x1 - x0, y1 - y0) >= 2)
+    {
+        ++level;
+        x0 >>= 1;  x1 >>= 1;  y0 >>= 1;  y1 >>= 1;
+    }
+
+    const SLevel& texels = mLevels[level];
+    for (int y = y0; y <= y1; ++y)
+    {
+        for (int x = x0; x <= x1; ++x)
+        {
+            if (minZ <= texels.depths[y * texels.width + x])  return true;
+        }
+    }
+    return false;
+}
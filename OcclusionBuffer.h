@@ -0,0 +1,113 @@
+//--------------------------------------------------------------------------------------
+// Software occlusion culling - a low resolution CPU depth buffer of the main occluders
+//--------------------------------------------------------------------------------------
+// Each pass a few large models (e.g. the hills and big crates, marked "occluder" in the scene file) are rasterized
+// into a small depth buffer on the CPU. Other models are then tested against it before being queued: a model whose
+// bounding box is entirely behind the occluders over the screen area it covers is skipped.
+//
+// Rasterization works in tiles. Triangles are transformed and set up once, then listed in the bins of the tiles they
+// overlap, and each tile rasterizes its own bin. Tiles write separate parts of the buffer, so they can be shared
+// among the workers of a thread pool. Within a tile four pixels of a row are done at once with SIMD (see MathSIMD.h):
+// the three edge functions and the depth plane are evaluated for the four pixel centres together.
+//
+// After rasterizing, a hierarchical Z pyramid is built: each level holds the furthest depth of each 2x2 block of the
+// level below. A bounding box is tested at the level where its screen rectangle covers no more than a few texels.
+//
+// Everything is conservative: triangles crossing the near clip plane are left out (a hole only means less culling),
+// and boxes crossing it are always visible. Only pixels whose centre a triangle covers are written, so very thin
+// occluders occlude nothing. Depth is z/w of the projection (0 near, 1 far, as the GPU depth buffer).
+//
+// The buffer uses no device or platform code, only the math library and the thread pool.
+
+#ifndef _OCCLUSION_BUFFER_H_INCLUDED_
+#define _OCCLUSION_BUFFER_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+#include <vector>
+#include <cstdint>
+
+class CThreadPool;
+
+
+class COcclusionBuffer
+{
+public:
+    //-------------------------------------
+    // Rasterization
+    //-------------------------------------
+
+    // Clear the buffer ready for the occluders of a view
+    void Begin(const CMatrix4x4& viewProjectionMatrix);
+
+    // Transform an occluder's triangles and bin them into tiles. Positions are in model space, indices are three
+    // per triangle. Back facing triangles are left out if the model is drawn with back face culling (clockwise front
+    // faces, as the meshes are imported)
+    void AddOccluder(const CVector3* positions, const uint32_t* indices, unsigned int numIndices,
+                     const CMatrix4x4& worldMatrix, bool cullBackFaces);
+
+    // Rasterize the binned triangles and build the depth pyramid. The tiles are shared among the given pool's
+    // workers, or all done on this thread if the pool is null
+    void Rasterize(CThreadPool* pool = nullptr);
+
+
+    //-------------------------------------
+    // Testing
+    //-------------------------------------
+
+    // Returns false if the given model space box, placed by the world matrix, is hidden behind the occluders
+    bool IsBoxVisible(const CVector3& boxMin, const CVector3& boxMax, const CMatrix4x4& worldMatrix);
+
+
+    //-------------------------------------
+    // Data access and statistics
+    //-------------------------------------
+
+    static const unsigned int Width  = 256;
+    static const unsigned int Height = 128;
+
+    // Depth of a pixel at the given level of the pyramid (0 is the full resolution buffer)
+    float Depth(unsigned int level, unsigned int x, unsigned int y)  { return mLevels[level].depths[y * mLevels[level].width + x]; }
+    unsigned int NumLevels()  { return static_cast<unsigned int>(mLevels.size()); }
+
+    // Triangles set up by the last pass, after near plane and back face rejection
+    unsigned int NumTriangles()  { return static_cast<unsigned int>(mTriangles.size()); }
+
+
+private:
+    // Tiles are a multiple of four pixels wide so each row of a tile is whole groups of four
+    static const unsigned int TileWidth  = 64;
+    static const unsigned int TileHeight = 32;
+    static const unsigned int TilesX = Width  / TileWidth;
+    static const unsigned int TilesY = Height / TileHeight;
+
+    // A triangle set up for rasterizing. Each edge function a*x + b*y + c is positive inside the triangle, depth is
+    // the plane z = zA*x + zB*y + zC. All in pixels
+    struct STriangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float zA, zB, zC;
+        uint16_t minX, maxX, minY, maxY; // Pixels whose centres may be covered
+    };
+
+    void RasterizeTile(unsigned int tile);
+    void BuildPyramid();
+
+    struct SLevel
+    {
+        unsigned int width, height;
+        std::vector<float> depths;
+    };
+    std::vector<SLevel> mLevels; // Level 0 is the depth buffer itself
+
+    CMatrix4x4 mViewProjectionMatrix;
+
+    std::vector<STriangle> mTriangles;
+    std::vector<uint32_t>  mBins[TilesX * TilesY]; // Indexes into mTriangles
+
+    std::vector<float> mClipPositions; // Scratch space for an occluder's transformed vertices (x, y, z, w)
+};
+
+
+#endif //_OCCLUSION_BUFFER_H_INCLUDED_
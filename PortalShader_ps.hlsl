@@ -15,7 +15,7 @@
 // Note that textures are often called maps (because texture mapping describes wrapping a texture round a mesh).
 // Get used to people using the word "texture" and "map" interchangably.
 Texture2D DiffuseSpecularMap : register(t0); // Textures here can contain a diffuse map (main colour) in their rgb channels and a specular map (shininess) in the a channel
-Texture2D ShadowMapSpotlights[4] : register(t1); // Texture holding the view of the scene from a light
+Texture2D ShadowAtlas : register(t1); // Depth of the scene from each spotlight, in one tile per light (see ShadowAtlas.h)
 Texture2D PortalTexture      : register(t5);
 
 SamplerState TexSampler      : register(s0); // A sampler is a filter for a texture like bilinear, trilinear or anisotropic - this is the sampler used for the texture above
@@ -46,14 +46,19 @@ float4 main(LightingPixelShaderInput input) : SV_Target
 	float3 finalDiffuseLight  = 0; // Initialy assume no contribution from this light
 	float3 finalSpecularLight = 0;
      
+    // Only the lights that can reach this pixel's cluster are considered
+    LightCluster cluster = FindLightCluster(input.worldPosition);
+
     // ****** POINTLIGHTS ******* //  
-    for (int i = 0; i < lightStackTops.x; ++i)
+    for (uint i = 0; i < cluster.numPointLights; ++i)
     {
+        PointLight pointLight = PointLights[LightIndices[cluster.firstLight + i]];
+
 	    // Direction from pixel to light
-        float3 lightVector = pointLights[i].position - input.worldPosition;
+        float3 lightVector = pointLight.position - input.worldPosition;
         float3 lightDist = length(lightVector);
         float3 lightDirection = lightVector / lightDist;
-        float3 diffuseLight = (pointLights[i].colour * max(dot(input.worldNormal, lightDirection), 0) / lightDist);
+        float3 diffuseLight = (pointLight.colour * max(dot(input.worldNormal, lightDirection), 0) / lightDist) * LightRangeFalloff(lightDist.x, pointLight.range);
         finalDiffuseLight = finalDiffuseLight + diffuseLight;
 
         float3 halfway = normalize(lightDirection + cameraDirection);
@@ -61,20 +66,22 @@ float4 main(LightingPixelShaderInput input) : SV_Target
     }
 
     // ****** SPOTLIGHTS ******* //  
-    for (i = 0; i < lightStackTops.y; ++i)
+    for (i = 0; i < cluster.numSpotlights; ++i)
     {
+        Spotlight spotlight = Spotlights[LightIndices[cluster.firstLight + cluster.numPointLights + i]];
+
 	    // Direction from pixel to light
-        float3 lightDirection = normalize(spotlights[i].position - input.worldPosition);
+        float3 lightDirection = normalize(spotlight.position - input.worldPosition);
 
 	    // Check if pixel is within light cone
-        if (dot(spotlights[i].facing, -lightDirection) > spotlights[i].cosHalfAngle) //**** TODO: This condition needs to be written as the first exercise to get spotlights working
+        if (dot(spotlight.facing, -lightDirection) > spotlight.cosHalfAngle) //**** TODO: This condition needs to be written as the first exercise to get spotlights working
            // As well as the variables above, you also will need values from the constant buffers in "common.hlsli"
         {
 	        // Using the world position of the current pixel and the matrices of the light (as a camera), find the 2D position of the
 	        // pixel *as seen from the light*. Will use this to find which part of the shadow map to look at.
 	        // These are the same as the view / projection matrix multiplies in a vertex shader (can improve performance by putting these lines in vertex shader)
-            float4 lightViewPosition = mul(spotlights[i].viewMatrix, float4(input.worldPosition, 1.0f));
-            float4 lightProjection = mul(spotlights[i].projectionMatrix, lightViewPosition);
+            float4 lightViewPosition = mul(spotlight.viewMatrix, float4(input.worldPosition, 1.0f));
+            float4 lightProjection = mul(spotlight.projectionMatrix, lightViewPosition);
 
 		    // Convert 2D pixel position as viewed from light into texture coordinates for shadow map - an advanced topic related to the projection step
 		    // Detail: 2D position x & y get perspective divide, then converted from range -1->1 to UV range 0->1. Also flip V axis
@@ -86,10 +93,10 @@ float4 main(LightingPixelShaderInput input) : SV_Target
 		    
 		    // Compare pixel depth from light with depth held in shadow map of the light. If shadow map depth is less than something is nearer
 		    // to the light than this pixel - so the pixel gets no effect from this light
-            if (depthFromLight < ShadowMapSpotlights[i].Sample(PointClamp, shadowMapUV).r)
+            if (depthFromLight < SpotlightShadowDepth(ShadowAtlas, PointClamp, spotlight, shadowMapUV))
             {
-                float3 lightDist = length(spotlights[i].position - input.worldPosition);
-                float3 diffuseLight = (spotlights[i].colour * max(dot(input.worldNormal, lightDirection), 0) / lightDist); // Equations from lighting lecture
+                float3 lightDist = length(spotlight.position - input.worldPosition);
+                float3 diffuseLight = (spotlight.colour * max(dot(input.worldNormal, lightDirection), 0) / lightDist) * LightRangeFalloff(lightDist.x, spotlight.range); // Equations from lighting lecture
                 finalDiffuseLight = finalDiffuseLight + diffuseLight;
                 
                 float3 halfway = normalize(lightDirection + cameraDirection);
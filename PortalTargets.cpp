@@ -0,0 +1,172 @@
+//--------------------------------------------------------------------------------------
+// Pool of portal render targets
+//--------------------------------------------------------------------------------------
+
+#include "PortalTargets.h"
+
+
+CPortalTargetPool::CPortalTargetPool(unsigned int minSize, unsigned int maxSize)
+    : mMinSize(minSize), mMaxSize(maxSize)
+{
+    mLevels.resize(Level(mMinSize) + 1);
+}
+
+
+unsigned int CPortalTargetPool::TargetSize(unsigned int size)
+{
+    unsigned int targetSize = mMinSize;
+    while (targetSize < size && targetSize < mMaxSize)  targetSize *= 2;
+    return targetSize;
+}
+
+
+unsigned int CPortalTargetPool::Level(unsigned int targetSize)
+{
+    unsigned int level = 0;
+    for (unsigned int levelSize = mMaxSize; levelSize > targetSize; levelSize /= 2)
+    {
+        ++level;
+    }
+    return level;
+}
+
+
+SPortalTarget* CPortalTargetPool::Acquire(unsigned int size)
+{
+    unsigned int targetSize = TargetSize(size);
+    SLevel& level = mLevels[Level(targetSize)];
+    if (!level.free.empty())
+    {
+        SPortalTarget* target = level.free.back();
+        level.free.pop_back();
+        return target;
+    }
+
+    if (!level.depthStencil && !CreateDepthStencil(Level(targetSize)))  return nullptr;
+
+    std::unique_ptr<SPortalTarget> target(new SPortalTarget);
+    if (!CreateTarget(*target, targetSize))  return nullptr;
+    target->depthStencil = level.depthStencil;
+    level.targets.push_back(std::move(target));
+    return level.targets.back().get();
+}
+
+
+void CPortalTargetPool::Free(SPortalTarget* target)
+{
+    if (target == nullptr)  return;
+    mLevels[Level(target->size)].free.push_back(target);
+}
+
+
+void CPortalTargetPool::ReleaseResources()
+{
+    for (auto& level : mLevels)
+    {
+        for (auto& target : level.targets)
+        {
+            gRenderDevice->Release(target->textureSRV);
+            gRenderDevice->Release(target->renderTarget);
+            gRenderDevice->Release(target->texture);
+        }
+        level.targets.clear();
+        level.free.clear();
+
+        if (level.depthStencil)         gRenderDevice->Release(level.depthStencil);
+        if (level.depthStencilTexture)  gRenderDevice->Release(level.depthStencilTexture);
+        level.depthStencil = nullptr;
+        level.depthStencilTexture = nullptr;
+    }
+    mMemoryUsed = 0;
+}
+
+
+// Create the texture of a target with views to render to it and to use it in shaders. On failure anything created
+// is released again
+bool CPortalTargetPool::CreateTarget(SPortalTarget& target, unsigned int size)
+{
+    D3D11_TEXTURE2D_DESC textureDesc = {};
+    textureDesc.Width = size;  // Size of the portal texture determines its quality
+    textureDesc.Height = size;
+    textureDesc.MipLevels = 1; // No mip-maps when rendering to textures (or we would have to render every level)
+    textureDesc.ArraySize = 1;
+    textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // RGBA texture (8-bits each)
+    textureDesc.SampleDesc.Count = 1;
+    textureDesc.SampleDesc.Quality = 0;
+    textureDesc.Usage = D3D11_USAGE_DEFAULT;
+    textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE; // Rendered to, then passed to shaders
+    textureDesc.CPUAccessFlags = 0;
+    textureDesc.MiscFlags = 0;
+    if (FAILED(gRenderDevice->CreateTexture2D(&textureDesc, NULL, &target.texture)))
+    {
+        gLastError = "Error creating portal texture";
+        return false;
+    }
+
+    if (FAILED(gRenderDevice->CreateRenderTargetView(target.texture, NULL, &target.renderTarget)))
+    {
+        gRenderDevice->Release(target.texture);
+        gLastError = "Error creating portal render target view";
+        return false;
+    }
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Format = textureDesc.Format;
+    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Texture2D.MostDetailedMip = 0;
+    srvDesc.Texture2D.MipLevels = 1;
+    if (FAILED(gRenderDevice->CreateShaderResourceView(target.texture, &srvDesc, &target.textureSRV)))
+    {
+        gRenderDevice->Release(target.renderTarget);
+        gRenderDevice->Release(target.texture);
+        gLastError = "Error creating portal shader resource view";
+        return false;
+    }
+
+    target.size = size;
+    mMemoryUsed += size_t(size) * size * 4;
+    return true;
+}
+
+
+// Create the depth buffer shared by the targets of a level
+bool CPortalTargetPool::CreateDepthStencil(unsigned int level)
+{
+    unsigned int size = mMaxSize >> level;
+    D3D11_TEXTURE2D_DESC depthDesc = {};
+    depthDesc.Width = size;
+    depthDesc.Height = size;
+    depthDesc.MipLevels = 1;
+    depthDesc.ArraySize = 1;
+    depthDesc.Format = DXGI_FORMAT_D32_FLOAT; // Depth buffers contain a single float per pixel
+    depthDesc.SampleDesc.Count = 1;
+    depthDesc.SampleDesc.Quality = 0;
+    depthDesc.Usage = D3D11_USAGE_DEFAULT;
+    depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+    depthDesc.CPUAccessFlags = 0;
+    depthDesc.MiscFlags = 0;
+    SLevel& poolLevel = mLevels[level];
+    if (FAILED(gRenderDevice->CreateTexture2D(&depthDesc, NULL, &poolLevel.depthStencilTexture)))
+    {
+        poolLevel.depthStencilTexture = nullptr;
+        gLastError = "Error creating portal depth stencil texture";
+        return false;
+    }
+
+    D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+    dsvDesc.Format = depthDesc.Format;
+    dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+    dsvDesc.Texture2D.MipSlice = 0;
+    dsvDesc.Flags = 0;
+    if (FAILED(gRenderDevice->CreateDepthStencilView(poolLevel.depthStencilTexture, &dsvDesc, &poolLevel.depthStencil)))
+    {
+        gRenderDevice->Release(poolLevel.depthStencilTexture);
+        poolLevel.depthStencilTexture = nullptr;
+        poolLevel.depthStencil = nullptr;
+        gLastError = "Error creating portal depth stencil view";
+        return false;
+    }
+
+    mMemoryUsed += size_t(size) * size * 4;
+    return true;
+}
@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// Pool of portal render targets
+//--------------------------------------------------------------------------------------
+// Each portal renders the scene into its own texture, which is then drawn on the portal. The texture only needs as
+// many texels as the pixels the portal covers on screen, so a distant portal can use a small one and cost little to
+// render. The textures come from this pool: square, with power of two sizes between a minimum and maximum.
+//
+// A portal that changes size gives its target back and takes one of the new size. Targets given back are kept for
+// reuse rather than released, so portals moving back and forth across the screen don't create GPU objects every
+// frame. Portals are rendered one after another, so all targets of a size share one depth buffer.
+
+#ifndef _PORTAL_TARGETS_H_INCLUDED_
+#define _PORTAL_TARGETS_H_INCLUDED_
+
+#include "Common.h"
+
+#include <vector>
+#include <memory>
+
+
+// A portal's texture, with the views to render to it and read from it in shaders
+struct SPortalTarget
+{
+    unsigned int size = 0;
+    ID3D11Texture2D*          texture      = nullptr;
+    ID3D11RenderTargetView*   renderTarget = nullptr;
+    ID3D11ShaderResourceView* textureSRV   = nullptr;
+    ID3D11DepthStencilView*   depthStencil = nullptr; // Shared by all targets of this size, owned by the pool
+};
+
+
+class CPortalTargetPool
+{
+public:
+    // The minimum and maximum sizes must be powers of two, with the minimum no larger than the maximum
+    CPortalTargetPool(unsigned int minSize, unsigned int maxSize);
+
+    // Round a size up to the target size that would be given for it, no larger than the maximum
+    unsigned int TargetSize(unsigned int size);
+
+    // Get a target of the given size, rounded by TargetSize, creating it if there is no free one. Returns null
+    // on failure, with gLastError set
+    SPortalTarget* Acquire(unsigned int size);
+
+    // Give a target back to the pool for reuse. Null is ignored
+    void Free(SPortalTarget* target);
+
+    // Release every target and depth buffer. Targets handed out are no longer valid
+    void ReleaseResources();
+
+    unsigned int MinSize()  { return mMinSize; }
+    unsigned int MaxSize()  { return mMaxSize; }
+
+    // GPU memory used by the pool's textures and depth buffers in bytes, including targets waiting for reuse
+    size_t MemoryUsed()  { return mMemoryUsed; }
+
+
+private:
+    // Level 0 holds the largest targets, each level down has targets half the size
+    unsigned int Level(unsigned int targetSize);
+
+    bool CreateTarget(SPortalTarget& target, unsigned int size);
+    bool CreateDepthStencil(unsigned int level);
+
+    struct SLevel
+    {
+        std::vector<std::unique_ptr<SPortalTarget>> targets; // Every target of this size
+        std::vector<SPortalTarget*> free;                     // Those not in use by a portal
+        ID3D11Texture2D*        depthStencilTexture = nullptr;
+        ID3D11DepthStencilView* depthStencil        = nullptr;
+    };
+    std::vector<SLevel> mLevels;
+
+    unsigned int mMinSize;
+    unsigned int mMaxSize;
+    size_t       mMemoryUsed = 0;
+};
+
+
+#endif //_PORTAL_TARGETS_H_INCLUDED_
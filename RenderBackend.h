@@ -0,0 +1,138 @@
+//--------------------------------------------------------------------------------------
+// Render backend interfaces
+//--------------------------------------------------------------------------------------
+// All GPU work in the app goes through these two interfaces rather than calling Direct3D directly:
+// - IRenderDevice creates and releases resources (buffers, textures, views, shaders and states)
+// - IRenderContext sets pipeline state, uploads constant buffers and issues draws
+// The D3D11 backend (D3D11RenderBackend.h) forwards to the real device and context. The headless backend
+// (HeadlessRenderBackend.h) records every context call in a command log instead, so the scene can be
+// rendered and profiled on a machine without a GPU.
+//
+// Resource handles are still the Direct3D interface pointer types so the rest of the code is unchanged.
+// Only the backend that created a handle may use it - the headless handles are not real Direct3D objects,
+// which is why releasing must also go through the device. Without the Windows SDK the types come from
+// RenderTypes.h, so these interfaces and the headless backend also build on other platforms.
+
+#ifndef _RENDER_BACKEND_H_INCLUDED_
+#define _RENDER_BACKEND_H_INCLUDED_
+
+#include "RenderTypes.h"
+#include <string>
+#include <cstddef>
+
+
+class IRenderDevice
+{
+public:
+    virtual ~IRenderDevice() {}
+
+    //-------------------------------------
+    // Resource creation, return values as for the matching ID3D11Device functions
+    //-------------------------------------
+
+    virtual HRESULT CreateBuffer(const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Buffer** buffer) = 0;
+    virtual HRESULT CreateTexture2D(const D3D11_TEXTURE2D_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Texture2D** texture) = 0;
+
+    virtual HRESULT CreateShaderResourceView(ID3D11Resource* resource, const D3D11_SHADER_RESOURCE_VIEW_DESC* desc, ID3D11ShaderResourceView** view) = 0;
+    virtual HRESULT CreateRenderTargetView  (ID3D11Resource* resource, const D3D11_RENDER_TARGET_VIEW_DESC*   desc, ID3D11RenderTargetView**   view) = 0;
+    virtual HRESULT CreateDepthStencilView  (ID3D11Resource* resource, const D3D11_DEPTH_STENCIL_VIEW_DESC*   desc, ID3D11DepthStencilView**   view) = 0;
+
+    virtual HRESULT CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC* elements, UINT numElements,
+                                      const void* shaderByteCode, SIZE_T byteCodeLength, ID3D11InputLayout** layout) = 0;
+
+    // As above without a vertex shader to check the layout against, e.g. for a mesh, which can be drawn with any
+    // shader reading a subset of its vertex. Only float formats are supported
+    virtual HRESULT CreateVertexLayout(const D3D11_INPUT_ELEMENT_DESC* elements, UINT numElements, ID3D11InputLayout** layout) = 0;
+    virtual HRESULT CreateVertexShader(const void* byteCode, SIZE_T byteCodeLength, ID3D11VertexShader** shader) = 0;
+    virtual HRESULT CreatePixelShader (const void* byteCode, SIZE_T byteCodeLength, ID3D11PixelShader**  shader) = 0;
+
+    virtual HRESULT CreateSamplerState     (const D3D11_SAMPLER_DESC*       desc, ID3D11SamplerState**      state) = 0;
+    virtual HRESULT CreateBlendState       (const D3D11_BLEND_DESC*         desc, ID3D11BlendState**        state) = 0;
+    virtual HRESULT CreateRasterizerState  (const D3D11_RASTERIZER_DESC*    desc, ID3D11RasterizerState**   state) = 0;
+    virtual HRESULT CreateDepthStencilState(const D3D11_DEPTH_STENCIL_DESC* desc, ID3D11DepthStencilState** state) = 0;
+
+    // Load a texture from a file (DDS or any format supported by WIC), creating the texture and a view of it
+    // for shaders. Returns false on failure
+    virtual bool LoadTexture(const std::string& filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV) = 0;
+
+    // As above for a file that has already been read into memory. Only uses the device, which is free-threaded, so
+    // this can be called on any thread (the asset loader decodes on its workers). The filename is only used to select
+    // the decoder from its extension. Mip-maps need the context, so for formats other than DDS (which holds its own)
+    // mipSource is set to a texture holding the decoded image, to pass to IRenderContext::GenerateMips on the thread
+    // that owns the context. mipSource is set to null if the texture is already complete
+    virtual bool LoadTextureFromMemory(const std::string& filename, const void* data, size_t size,
+                                       ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV,
+                                       ID3D11Resource** mipSource) = 0;
+
+    // Release any resource created by this device
+    virtual void Release(IUnknown* resource) = 0;
+};
+
+
+class IRenderContext
+{
+public:
+    virtual ~IRenderContext() {}
+
+    //-------------------------------------
+    // Pipeline state, parameters as for the matching ID3D11DeviceContext functions
+    //-------------------------------------
+
+    virtual void IASetInputLayout(ID3D11InputLayout* layout) = 0;
+    virtual void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets) = 0;
+    virtual void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset) = 0;
+    virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) = 0;
+
+    virtual void VSSetShader(ID3D11VertexShader* shader) = 0;
+    virtual void PSSetShader(ID3D11PixelShader*  shader) = 0;
+
+    virtual void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers) = 0;
+    virtual void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers) = 0;
+
+    // Bind part of each constant buffer (Direct3D 11.1 constant buffer offsetting). Offsets and sizes are in 16-byte
+    // constants and must be multiples of 16. Only use these if SupportsConstantBufferOffsets returns true
+    virtual void VSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers,
+                                       const UINT* firstConstants, const UINT* numConstants) = 0;
+    virtual void PSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers,
+                                       const UINT* firstConstants, const UINT* numConstants) = 0;
+    virtual void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views) = 0;
+    virtual void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) = 0;
+
+    virtual void OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargets, ID3D11DepthStencilView* depthStencil) = 0;
+    virtual void OMSetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask) = 0;
+    virtual void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef) = 0;
+    virtual void RSSetState(ID3D11RasterizerState* state) = 0;
+    virtual void RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports) = 0;
+
+    //-------------------------------------
+    // Clears, uploads and draws
+    //-------------------------------------
+
+    virtual void ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const FLOAT colour[4]) = 0;
+    virtual void ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, UINT clearFlags, FLOAT depth, UINT8 stencil) = 0;
+
+    // Replace the entire contents of a dynamic buffer (e.g. a constant buffer) with the given data
+    virtual void UpdateBuffer(ID3D11Buffer* buffer, const void* data, UINT size) = 0;
+
+    // Complete a texture from IRenderDevice::LoadTextureFromMemory: copy the decoded image in mipSource to the top
+    // level of the texture and generate the other levels from it. Release mipSource through the device afterwards
+    virtual void GenerateMips(ID3D11Resource* mipSource, ID3D11Resource* texture, ID3D11ShaderResourceView* textureSRV) = 0;
+
+    virtual void Draw(UINT vertexCount, UINT startVertex) = 0;
+    virtual void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex) = 0;
+    virtual void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance) = 0;
+
+    // Show the finished back buffer
+    virtual void Present() = 0;
+
+    //-------------------------------------
+    // Capabilities
+    //-------------------------------------
+
+    // True if the functions above that bind part of a constant buffer can be used. Constant buffers larger than
+    // 64KB can also only be created if this is true
+    virtual bool SupportsConstantBufferOffsets() = 0;
+};
+
+
+#endif //_RENDER_BACKEND_H_INCLUDED_
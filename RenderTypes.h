@@ -0,0 +1,254 @@
+//--------------------------------------------------------------------------------------
+// Direct3D types used by the render backend interfaces
+//--------------------------------------------------------------------------------------
+// On Windows these come from the Windows SDK. Elsewhere there is no Direct3D, only the headless backend, so just
+// enough of the types is declared here for the backend interfaces and the code that renders through them to build
+// (e.g. on Linux CI). The declarations match the SDK's names and values. Interfaces are empty structs: headless
+// handles are never dereferenced, only compared and passed back to the backend.
+
+#ifndef _RENDER_TYPES_H_INCLUDED_
+#define _RENDER_TYPES_H_INCLUDED_
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <d3d11.h>
+
+#else
+
+#include <cstdint>
+#include <cstddef>
+
+
+//--------------------------------------------------------------------------------------
+// Basic types and return values
+//--------------------------------------------------------------------------------------
+
+typedef int32_t     HRESULT;
+typedef uint32_t    UINT;
+typedef int32_t     INT;
+typedef uint8_t     UINT8;
+typedef uint32_t    DWORD;
+typedef int         BOOL;
+typedef float       FLOAT;
+typedef size_t      SIZE_T;
+typedef const char* LPCSTR;
+
+typedef struct HWND__* HWND;
+
+#define S_OK           (static_cast<HRESULT>(0))
+#define S_FALSE        (static_cast<HRESULT>(1))
+#define E_FAIL         (static_cast<HRESULT>(0x80004005))
+#define E_INVALIDARG   (static_cast<HRESULT>(0x80070057))
+#define E_OUTOFMEMORY  (static_cast<HRESULT>(0x8007000E))
+
+#define SUCCEEDED(hr)  (static_cast<HRESULT>(hr) >= 0)
+#define FAILED(hr)     (static_cast<HRESULT>(hr) < 0)
+
+
+//--------------------------------------------------------------------------------------
+// Interfaces
+//--------------------------------------------------------------------------------------
+
+struct IUnknown {};
+
+struct ID3D11DeviceChild : IUnknown {};
+
+struct ID3D11Resource  : ID3D11DeviceChild {};
+struct ID3D11Buffer    : ID3D11Resource    {};
+struct ID3D11Texture2D : ID3D11Resource    {};
+
+struct ID3D11View               : ID3D11DeviceChild {};
+struct ID3D11ShaderResourceView : ID3D11View        {};
+struct ID3D11RenderTargetView   : ID3D11View        {};
+struct ID3D11DepthStencilView   : ID3D11View        {};
+
+struct ID3D11InputLayout       : ID3D11DeviceChild {};
+struct ID3D11VertexShader      : ID3D11DeviceChild {};
+struct ID3D11PixelShader       : ID3D11DeviceChild {};
+struct ID3D11SamplerState      : ID3D11DeviceChild {};
+struct ID3D11BlendState        : ID3D11DeviceChild {};
+struct ID3D11RasterizerState   : ID3D11DeviceChild {};
+struct ID3D11DepthStencilState : ID3D11DeviceChild {};
+
+// Only used by the Direct3D setup, so never created here
+struct ID3D11Device;
+struct ID3D11DeviceContext;
+struct IDXGISwapChain;
+
+
+//--------------------------------------------------------------------------------------
+// Enumerations, only the values used by the portable code
+//--------------------------------------------------------------------------------------
+
+enum DXGI_FORMAT
+{
+    DXGI_FORMAT_UNKNOWN            = 0,
+    DXGI_FORMAT_R32G32B32A32_FLOAT = 2,
+    DXGI_FORMAT_R32G32B32_FLOAT    = 6,
+    DXGI_FORMAT_R32G32_FLOAT       = 16,
+    DXGI_FORMAT_R8G8B8A8_UNORM     = 28,
+    DXGI_FORMAT_R32_TYPELESS       = 39,
+    DXGI_FORMAT_D32_FLOAT          = 40,
+    DXGI_FORMAT_R32_FLOAT          = 41,
+    DXGI_FORMAT_R32_UINT           = 42,
+    DXGI_FORMAT_R16_UINT           = 57,
+};
+
+enum D3D11_USAGE
+{
+    D3D11_USAGE_DEFAULT   = 0,
+    D3D11_USAGE_IMMUTABLE = 1,
+    D3D11_USAGE_DYNAMIC   = 2,
+    D3D11_USAGE_STAGING   = 3,
+};
+
+enum D3D11_BIND_FLAG
+{
+    D3D11_BIND_VERTEX_BUFFER   = 0x1,
+    D3D11_BIND_INDEX_BUFFER    = 0x2,
+    D3D11_BIND_CONSTANT_BUFFER = 0x4,
+    D3D11_BIND_SHADER_RESOURCE = 0x8,
+    D3D11_BIND_RENDER_TARGET   = 0x20,
+    D3D11_BIND_DEPTH_STENCIL   = 0x40,
+};
+
+enum D3D11_CPU_ACCESS_FLAG
+{
+    D3D11_CPU_ACCESS_WRITE = 0x10000,
+    D3D11_CPU_ACCESS_READ  = 0x20000,
+};
+
+enum D3D11_RESOURCE_MISC_FLAG
+{
+    D3D11_RESOURCE_MISC_GENERATE_MIPS     = 0x1,
+    D3D11_RESOURCE_MISC_BUFFER_STRUCTURED = 0x40,
+};
+
+enum D3D11_CLEAR_FLAG
+{
+    D3D11_CLEAR_DEPTH   = 0x1,
+    D3D11_CLEAR_STENCIL = 0x2,
+};
+
+enum D3D11_INPUT_CLASSIFICATION
+{
+    D3D11_INPUT_PER_VERTEX_DATA   = 0,
+    D3D11_INPUT_PER_INSTANCE_DATA = 1,
+};
+
+#define D3D11_APPEND_ALIGNED_ELEMENT 0xffffffff
+
+enum D3D11_PRIMITIVE_TOPOLOGY
+{
+    D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED     = 0,
+    D3D11_PRIMITIVE_TOPOLOGY_POINTLIST     = 1,
+    D3D11_PRIMITIVE_TOPOLOGY_LINELIST      = 2,
+    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST  = 4,
+    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP = 5,
+};
+
+enum D3D11_SRV_DIMENSION
+{
+    D3D11_SRV_DIMENSION_UNKNOWN   = 0,
+    D3D11_SRV_DIMENSION_BUFFER    = 1,
+    D3D11_SRV_DIMENSION_TEXTURE2D = 4,
+};
+
+
+//--------------------------------------------------------------------------------------
+// Descriptions
+//--------------------------------------------------------------------------------------
+
+struct D3D11_BUFFER_DESC
+{
+    UINT        ByteWidth;
+    D3D11_USAGE Usage;
+    UINT        BindFlags;
+    UINT        CPUAccessFlags;
+    UINT        MiscFlags;
+    UINT        StructureByteStride;
+};
+
+struct D3D11_SUBRESOURCE_DATA
+{
+    const void* pSysMem;
+    UINT        SysMemPitch;
+    UINT        SysMemSlicePitch;
+};
+
+struct DXGI_SAMPLE_DESC
+{
+    UINT Count;
+    UINT Quality;
+};
+
+struct D3D11_TEXTURE2D_DESC
+{
+    UINT             Width;
+    UINT             Height;
+    UINT             MipLevels;
+    UINT             ArraySize;
+    DXGI_FORMAT      Format;
+    DXGI_SAMPLE_DESC SampleDesc;
+    D3D11_USAGE      Usage;
+    UINT             BindFlags;
+    UINT             CPUAccessFlags;
+    UINT             MiscFlags;
+};
+
+struct D3D11_BUFFER_SRV
+{
+    union { UINT FirstElement; UINT ElementOffset; };
+    union { UINT NumElements;  UINT ElementWidth;  };
+};
+
+struct D3D11_TEX2D_SRV
+{
+    UINT MostDetailedMip;
+    UINT MipLevels;
+};
+
+struct D3D11_SHADER_RESOURCE_VIEW_DESC
+{
+    DXGI_FORMAT         Format;
+    D3D11_SRV_DIMENSION ViewDimension;
+    union
+    {
+        D3D11_BUFFER_SRV Buffer;
+        D3D11_TEX2D_SRV  Texture2D;
+    };
+};
+
+struct D3D11_INPUT_ELEMENT_DESC
+{
+    LPCSTR                     SemanticName;
+    UINT                       SemanticIndex;
+    DXGI_FORMAT                Format;
+    UINT                       InputSlot;
+    UINT                       AlignedByteOffset;
+    D3D11_INPUT_CLASSIFICATION InputSlotClass;
+    UINT                       InstanceDataStepRate;
+};
+
+struct D3D11_VIEWPORT
+{
+    FLOAT TopLeftX;
+    FLOAT TopLeftY;
+    FLOAT Width;
+    FLOAT Height;
+    FLOAT MinDepth;
+    FLOAT MaxDepth;
+};
+
+// The state descriptions are only filled in by the Direct3D setup code, so are only declared for the interfaces
+struct D3D11_RENDER_TARGET_VIEW_DESC;
+struct D3D11_DEPTH_STENCIL_VIEW_DESC;
+struct D3D11_SAMPLER_DESC;
+struct D3D11_BLEND_DESC;
+struct D3D11_RASTERIZER_DESC;
+struct D3D11_DEPTH_STENCIL_DESC;
+
+#endif //_WIN32
+
+#endif //_RENDER_TYPES_H_INCLUDED_
@@ -4,6 +4,9 @@
 //--------------------------------------------------------------------------------------
 
 #include "Scene.h"
+#include "AssetLoader.h"
+
+#include <sstream>
 
 
 // Constants controlling speed of movement/rotation (measured in units per second because we're using frame time)
@@ -32,6 +35,9 @@ const float MOVEMENT_SPEED = 50.0f; // 50 units per second for movement (what a
 PerFrameConstants gPerFrameConstants;      // The constants that need to be sent to the GPU each frame (see common.h for structure)
 ID3D11Buffer*     gPerFrameConstantBuffer; // The GPU buffer that will recieve the constants above
 
+PerViewConstants  gPerViewConstants;       // The constants that change for each view rendered (camera, portal or light)
+ID3D11Buffer*     gPerViewConstantBuffer;  // --"--
+
 PerModelConstants gPerModelConstants;      // As above, but constant that change per-model (e.g. world matrix)
 ID3D11Buffer*     gPerModelConstantBuffer; // --"--
 
@@ -44,26 +50,37 @@ ID3D11Buffer*     gPerModelConstantBuffer; // --"--
 bool CSceneManager::InitGeometry()
 {
     // Load mesh geometry data, just like TL-Engine this doesn't create anything in the scene. Create a Model for that.
-    // IMPORTANT NOTE: Will only keep the first object from the mesh - multipart objects will have parts missing - see later lab for more robust loader
-    try 
+    // Multipart meshes keep all their parts as sub-meshes, drawn from one shared vertex and index buffer
+    // Meshes and textures are loaded in parallel on worker threads by the asset loader, while this thread carries on
+    // with the shaders and constant buffers. The device objects are created when the loader is finished (see below).
+    // Meshes imported on a previous run are loaded from the cooked mesh cache. The asset report written below
+    // compares each mesh's cold start (import and cook) with its warm start (mapping the cooked file)
+    // The meshes and textures to load are listed in the scene file, which also describes the models built from them
+    // in InitScene. The lists are sized first as the loader keeps pointers into them
+    if (!mSceneFile.Load(mSceneFileName))
     {
-		mMeshArray[Mesh_Teapot]	= new Mesh("Teapot.x");
-        mMeshArray[Mesh_Troll]	= new Mesh("Troll.x");
-		mMeshArray[Mesh_Crate]	= new Mesh("CargoContainer.x");
-		mMeshArray[Mesh_Ground]	= new Mesh("Hills.x");
-		mMeshArray[Mesh_Light]	= new Mesh("Light.x");
-		mMeshArray[Mesh_Portal]	= new Mesh("Portal.x");
-		mMeshArray[Mesh_Sphere]	= new Mesh("Sphere.x");
-		mMeshArray[Mesh_SphereTangent] = new Mesh("Sphere.x", true);
-		mMeshArray[Mesh_Cube]	= new Mesh("Cube.x");
-		mMeshArray[Mesh_CubeTangent] = new Mesh("Cube.x", true);
-		mMeshArray[Mesh_Decal]	= new Mesh("Decal.x");
+        gLastError = mSceneFile.Error();
+        return false;
     }
-    catch (std::runtime_error e)  // Constructors cannot return error messages so use exceptions to catch mesh errors (fairly standard approach this)
+    mMeshes.resize(mSceneFile.Meshes().size(), nullptr);
+    mTextures.resize(mSceneFile.Textures().size());
+
+    CAssetLoader assetLoader;
+    for (size_t i = 0; i < mMeshes.size(); ++i)
     {
-        gLastError = e.what(); // This picks up the error message put in the exception (see Mesh.cpp)
-        return false;
+        assetLoader.AddMesh(&mMeshes[i], mSceneFile.Meshes()[i].fileName, mSceneFile.Meshes()[i].requireTangents);
+    }
+    assetLoader.AddMesh(&mLightMesh,  "Light.x");
+    assetLoader.AddMesh(&mPortalMesh, "Portal.x");
+
+    // Textures are loaded into the texture objects, which hold the ID3D11Resource that manages the GPU memory for the
+    // texture and also the ID3D11ShaderResourceView, which allows us to use the texture in shaders
+    for (size_t i = 0; i < mTextures.size(); ++i)
+    {
+        assetLoader.AddTexture(&mTextures[i], mSceneFile.Textures()[i].fileName);
     }
+    assetLoader.AddTexture(&mFlareTexture,       "Flare.jpg");
+    assetLoader.AddTexture(&mPortalFrameTexture, "tv.dds");
 
 
     // Load the shaders required for the geometry we will use (see Shader.cpp / .h)
@@ -74,59 +91,52 @@ bool CSceneManager::InitGeometry()
     }
 
 
-    // Create GPU-side constant buffers to receive the gPerFrameConstants and gPerModelConstants structures above
+    // Create GPU-side constant buffers to receive the gPerFrameConstants, gPerViewConstants and gPerModelConstants structures above
     // These allow us to pass data from CPU to shaders such as lighting information or matrices
     // See the comments above where these variable are declared and also the UpdateScene function
     gPerFrameConstantBuffer = CreateConstantBuffer(sizeof(gPerFrameConstants));
+    gPerViewConstantBuffer  = CreateConstantBuffer(sizeof(gPerViewConstants));
     gPerModelConstantBuffer = CreateConstantBuffer(sizeof(gPerModelConstants));
-    if (gPerFrameConstantBuffer == nullptr || gPerModelConstantBuffer == nullptr)
+    if (gPerFrameConstantBuffer == nullptr || gPerViewConstantBuffer == nullptr || gPerModelConstantBuffer == nullptr)
     {
         gLastError = "Error creating constant buffers";
         return false;
     }
 
+    // The lights and their clusters are sent to the shaders in structured buffers, big enough for every light
+    if (!mLightClusters.CreateResources(gsNumPointLights, gsNumSpotlights))
+    {
+        gLastError = "Error creating light cluster buffers";
+        return false;
+    }
 
-    //// Load / prepare textures on the GPU ////
-
-    // Load textures and create DirectX objects for them
-    // The LoadTexture function requires you to pass a ID3D11Resource* (e.g. &gCubeDiffuseMap), which manages the GPU memory for the
-    // texture and also a ID3D11ShaderResourceView* (e.g. &gCubeDiffuseMapSRV), which allows us to use the texture in shaders
-    // The function will fill in these pointers with usable data. The variables used here are globals found near the top of the file.
-    if (!LoadTexture("TrollDiffuseSpecular.dds",	mTextures[TrollTexture].GetSpecularMap(),	mTextures[TrollTexture].GetSpecularMapSRV())	||
-		!LoadTexture("StoneDiffuseSpecular.dds",	mTextures[StoneTexture].GetSpecularMap(),	mTextures[StoneTexture].GetSpecularMapSRV())	||
-		!LoadTexture("brick1.jpg",					mTextures[BrickTexture].GetSpecularMap(),	mTextures[BrickTexture].GetSpecularMapSRV())	||
-		!LoadTexture("Moogle.png",					mTextures[MoogleTexture].GetSpecularMap(),	mTextures[MoogleTexture].GetSpecularMapSRV())	||
-        !LoadTexture("CargoA.dds",					mTextures[CargoTexture].GetSpecularMap(),	mTextures[CargoTexture].GetSpecularMapSRV())	||
-		!LoadTexture("WoodDiffuseSpecular.dds",		mTextures[WoodTexture].GetSpecularMap(),	mTextures[WoodTexture].GetSpecularMapSRV())		||
-		!LoadTexture("WoodNormal.dds",				mTextures[WoodNormal].GetSpecularMap(),		mTextures[WoodNormal].GetSpecularMapSRV())		||
-		!LoadTexture("GrassDiffuseSpecular.dds",	mTextures[GrassTexture].GetSpecularMap(),	mTextures[GrassTexture].GetSpecularMapSRV())	||
-        !LoadTexture("MetalDiffuseSpecular.dds",	mTextures[MetalTexture].GetSpecularMap(),	mTextures[MetalTexture].GetSpecularMapSRV())	||
-		!LoadTexture("MetalNormal.dds",				mTextures[MetalNormal].GetSpecularMap(),	mTextures[MetalNormal].GetSpecularMapSRV())		||
-		!LoadTexture("PatternDiffuseSpecular.dds",	mTextures[PatternTexture].GetSpecularMap(),	mTextures[PatternTexture].GetSpecularMapSRV())	||
-		!LoadTexture("PatternNormalHeight.dds",		mTextures[PatternNormalH].GetSpecularMap(),	mTextures[PatternNormalH].GetSpecularMapSRV())	||
-		!LoadTexture("BrainDiffuseSpecular.dds",	mTextures[BrainTexture].GetSpecularMap(),	mTextures[BrainTexture].GetSpecularMapSRV())	||
-		!LoadTexture("BrainNormalHeight.dds",		mTextures[BrainNormalH].GetSpecularMap(),	mTextures[BrainNormalH].GetSpecularMapSRV())	||
-		!LoadTexture("CobbleDiffuseSpecular.dds",	mTextures[CobbleTexture].GetSpecularMap(),	mTextures[CobbleTexture].GetSpecularMapSRV())	||
-		!LoadTexture("CobbleNormalHeight.dds",		mTextures[CobbleNormalH].GetSpecularMap(),	mTextures[CobbleNormalH].GetSpecularMapSRV())	||
-		!LoadTexture("TechDiffuseSpecular.dds",		mTextures[TechTexture].GetSpecularMap(),	mTextures[TechTexture].GetSpecularMapSRV())		||
-		!LoadTexture("TechNormalHeight.dds",		mTextures[TechNormalH].GetSpecularMap(),	mTextures[TechNormalH].GetSpecularMapSRV())		||
-		!LoadTexture("WallDiffuseSpecular.dds",		mTextures[WallTexture].GetSpecularMap(),	mTextures[WallTexture].GetSpecularMapSRV())		||
-		!LoadTexture("WallNormalHeight.dds",		mTextures[WallNormalH].GetSpecularMap(),	mTextures[WallNormalH].GetSpecularMapSRV())		||
-		!LoadTexture("tv.dds",						mTextures[TVTexture].GetSpecularMap(),		mTextures[TVTexture].GetSpecularMapSRV())		||
-		!LoadTexture("Flare.jpg",					mTextures[FlareTexture].GetSpecularMap(),	mTextures[FlareTexture].GetSpecularMapSRV())	||
-		!LoadTexture("glass.jpg",					mTextures[GlassTexture].GetSpecularMap(),	mTextures[GlassTexture].GetSpecularMapSRV()))
+
+    //// Create the meshes and textures on the GPU ////
+
+    // Waits for the asset loader's workers then creates the device objects. Every asset that failed is reported, not just the first
+    if (!assetLoader.Finish())
     {
-        gLastError = "Error loading textures";
+        gLastError = assetLoader.Errors();
         return false;
     }
+    mAssetLoadTime = assetLoader.TotalTime();
+    for (auto& timing : assetLoader.Timings())
+    {
+        if (timing.fromCache)  ++mMeshesFromCache;
+    }
+
+    // Per-asset timings go to the debugger output
+    std::ostringstream assetReport;
+    assetLoader.WriteReport(assetReport);
+    OutputDebugStringA(assetReport.str().c_str());
 
 
 
-	//**** Create Shadow Map texture ****//
+	//**** Create Shadow Atlas texture ****//
 
-	// We also need a depth buffer to go with our portal
-	mShadowMapTextureDesc.Width  = mShadowMapSize; // Size of the shadow map determines quality / resolution of shadows
-	mShadowMapTextureDesc.Height = mShadowMapSize;
+	// One depth texture holds the shadow maps of all the spotlights, each light renders into its own tile
+	mShadowMapTextureDesc.Width  = mShadowAtlasSize; // Size of each light's tile in the atlas determines quality / resolution of its shadows
+	mShadowMapTextureDesc.Height = mShadowAtlasSize;
 	mShadowMapTextureDesc.MipLevels = 1; // 1 level, means just the main texture, no additional mip-maps. Usually don't use mip-maps when rendering to textures (or we would have to render every level)
 	mShadowMapTextureDesc.ArraySize = 1;
 	mShadowMapTextureDesc.Format = DXGI_FORMAT_R32_TYPELESS; // The shadow map contains a single 32-bit value [tech gotcha: have to say typeless because depth buffer and shaders see things slightly differently]
@@ -149,83 +159,22 @@ bool CSceneManager::InitGeometry()
 	mShadowMapSrvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
 	mShadowMapSrvDesc.Texture2D.MostDetailedMip = 0;
 	mShadowMapSrvDesc.Texture2D.MipLevels = 1;
-	for (unsigned short int i = 0; i < gsNumSpotlights; ++i)
+	if (FAILED(gRenderDevice->CreateTexture2D(&mShadowMapTextureDesc, NULL, &mShadowAtlasTexture)))
 	{
-		if (FAILED(gD3DDevice->CreateTexture2D(&mShadowMapTextureDesc, NULL, &mShadowMapSpotlightTexture[i])))
-		{
-			gLastError = "Error creating shadow map texture";
-			return false;
-		}
-		if (FAILED(gD3DDevice->CreateDepthStencilView(mShadowMapSpotlightTexture[i], &mShadowMapDsvDesc, &mShadowMapSpotlightDepthStencil[i])))
-		{
-			gLastError = "Error creating shadow map depth stencil view";
-			return false;
-		}
-		if (FAILED(gD3DDevice->CreateShaderResourceView(mShadowMapSpotlightTexture[i], &mShadowMapSrvDesc, &mShadowMapSpotlightSRV[i])))
-		{
-			gLastError = "Error creating shadow map shader resource view";
-			return false;
-		}
+		gLastError = "Error creating shadow atlas texture";
+		return false;
 	}
-   //*****************************//
-
-
-	//**** Create Portal Texture Description ****//
-
-	// Using a helper function to load textures from files above. Here we create the portal texture manually
-	// as we are creating a special kind of texture (one that we can render to). Many settings to prepare:
-	mPortalDesc.Width = mPortalWidth;  // Size of the portal texture determines its quality
-	mPortalDesc.Height = mPortalHeight;
-	mPortalDesc.MipLevels = 1; // No mip-maps when rendering to textures (or we would have to render every level)
-	mPortalDesc.ArraySize = 1;
-	mPortalDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // RGBA texture (8-bits each)
-	mPortalDesc.SampleDesc.Count = 1;
-	mPortalDesc.SampleDesc.Quality = 0;
-	mPortalDesc.Usage = D3D11_USAGE_DEFAULT;
-	mPortalDesc.BindFlags = D3D10_BIND_RENDER_TARGET | D3D10_BIND_SHADER_RESOURCE; // IMPORTANT: Indicate we will use texture as render target, and pass it to shaders
-	mPortalDesc.CPUAccessFlags = 0;
-	mPortalDesc.MiscFlags = 0;
-
-	// We also need to send this texture (resource) to the shaders. To do that we must create a shader-resource "view"
-	mPortalSRDesc.Format = mPortalDesc.Format;
-	mPortalSRDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	mPortalSRDesc.Texture2D.MostDetailedMip = 0;
-	mPortalSRDesc.Texture2D.MipLevels = 1;
-	
-	//**** Create Portal Depth Buffer ****//
-
-	// We also need a depth buffer to go with our portal
-	//**** This depth buffer can be shared with any other portals of the same size
-	D3D11_TEXTURE2D_DESC dbPortalDesc = {};
-	dbPortalDesc.Width = mPortalWidth;
-	dbPortalDesc.Height = mPortalHeight;
-	dbPortalDesc.MipLevels = 1;
-	dbPortalDesc.ArraySize = 1;
-	dbPortalDesc.Format = DXGI_FORMAT_D32_FLOAT; // Depth buffers contain a single float per pixel
-	dbPortalDesc.SampleDesc.Count = 1;
-	dbPortalDesc.SampleDesc.Quality = 0;
-	dbPortalDesc.Usage = D3D11_USAGE_DEFAULT;
-	dbPortalDesc.BindFlags = D3D10_BIND_DEPTH_STENCIL;
-	dbPortalDesc.CPUAccessFlags = 0;
-	dbPortalDesc.MiscFlags = 0;
-	if (FAILED(gD3DDevice->CreateTexture2D(&dbPortalDesc, NULL, &mPortalDepthStencil)))
-	{
-		gLastError = "Error creating portal depth stencil texture";
+	if (FAILED(gRenderDevice->CreateDepthStencilView(mShadowAtlasTexture, &mShadowMapDsvDesc, &mShadowAtlasDepthStencil)))
+	{
+		gLastError = "Error creating shadow atlas depth stencil view";
 		return false;
 	}
-
-	// Create the depth stencil view, i.e. indicate that the texture just created is to be used as a depth buffer
-	D3D11_DEPTH_STENCIL_VIEW_DESC portalDescDSV = {};
-	portalDescDSV.Format = dbPortalDesc.Format;
-	portalDescDSV.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	portalDescDSV.Texture2D.MipSlice = 0;
-	portalDescDSV.Flags = 0;
-	if (FAILED(gD3DDevice->CreateDepthStencilView(mPortalDepthStencil, &portalDescDSV, &mPortalDepthStencilView)))
-	{
-		gLastError = "Error creating portal depth stencil view";
+	if (FAILED(gRenderDevice->CreateShaderResourceView(mShadowAtlasTexture, &mShadowMapSrvDesc, &mShadowAtlasSRV)))
+	{
+		gLastError = "Error creating shadow atlas shader resource view";
 		return false;
 	}
-
+   //*****************************//
 
 
   	// Create all filtering modes, blending modes etc. used by the app (see State.cpp/.h)
@@ -244,29 +193,64 @@ bool CSceneManager::InitGeometry()
 bool CSceneManager::InitScene()
 {
 	//// Set up scene ////
-	NewModel(Mesh_Teapot, { StoneTexture }, { 15, 0, 0 }, 1, { 0, ToRadians(215.0f), 0 });
-	NewModel(Mesh_Crate, { CargoTexture }, { 40, 0, 30 }, 6, { 0.0f, ToRadians(-20.0f), 0.0f });
-	NewModel(Mesh_Ground, { GrassTexture }, { -20, 0, -20 });
-	NewModel(Mesh_Sphere, { WoodTexture, WoodNormal }, { -20, 12, 20 }, 1, { 0,0,0 }, 6, ps_Wiggle);
-	NewModel(Mesh_SphereTangent, { PatternTexture, PatternNormalH }, { -10, 12, -10 }, 1, { 0,0,0 }, 3, ps_WiggleParallax);
-	NewModel(Mesh_Cube, { BrickTexture, WoodTexture }, { 40, 5.5f, -30 }, 1, { 0, 0, 0 }, 1, ps_Fade);
-	NewModel(Mesh_CubeTangent, { TechTexture, TechNormalH }, { 40, 5.5f, -10 }, 1, { 0,ToRadians(45.0f),0 }, 1, ps_ParallaxMap);
-	NewModel(Mesh_CubeTangent, { PatternTexture, PatternNormalH }, { 40, 20.0f, -10 }, 1, { 0,ToRadians(45.0f),0 }, 1, ps_NormalMap);
-	NewModel(Mesh_Cube, { GlassTexture }, { 5, 10, 30 }, 1, { 0, ToRadians(180), 0 }, 0, ps_Transparent);
+	// Everything comes from the scene file loaded in InitGeometry. The models of each collection are counted first so
+	// every collection is allocated once, then all the items are created in a single pass over each list
+	Timer buildTimer;
+	buildTimer.Reset();
+
+	size_t modelCounts[gsNumOfModelPS] = {};
+	size_t twoSidedCounts[gsNumOfModelPS] = {};
+	size_t transparentCount = 0;
+	for (auto& model : mSceneFile.Models())
+	{
+		EPixelShaders shader = sMaterialShaders[static_cast<int>(model.material)];
+		if      (shader == ps_Transparent)                 ++transparentCount;
+		else if (model.flags & SceneModel_TwoSided)        ++twoSidedCounts[shader];
+		else                                               ++modelCounts[shader];
+	}
+	for (int i = 0; i < gsNumOfModelPS; ++i)
+	{
+		mModelCollection[i].Reserve(mModelCollection[i].Size() + modelCounts[i]);
+		mTeapotCollection[i].Reserve(mTeapotCollection[i].Size() + twoSidedCounts[i]);
+	}
+	mTransparentModels.Reserve(mTransparentModels.Size() + transparentCount);
+	mPortalCollection.reserve(mPortalCollection.size() + mSceneFile.Portals().size());
+
+	for (auto& model : mSceneFile.Models())
+	{
+		NewModel(model);
+	}
 
     // Light creation
-	NewLight(ELightType::spotlight, mMeshArray[Mesh_Light], { 0.8f, 0.8f, 1.0f }, { 30, 20, 0 },
-		10, mModelCollection[ps_PixelLighting].front()->Position()); //The teapot is created first.
-	NewLight(ELightType::point, mMeshArray[Mesh_Light], { 1.0f, 0.8f, 0.2f }, { -5, 30, -20 }, 50, { 0,0,0 });
+	for (auto& light : mSceneFile.Lights())
+	{
+		NewLight(light.type == ESceneLightType::Spot ? ELightType::spotlight : ELightType::point, mLightMesh,
+		         light.colour, light.position, light.strength, light.facing, light.coneAngle);
+	}
+
+	for (auto& portal : mSceneFile.Portals())
+	{
+		NewPortal(portal.position, portal.rotation, portal.updateInterval);
+	}
 
-	NewPortal({ 10, 15, 50 }, { 0, ToRadians(180), 0 });
+	// Attach the first spotlight to a pivot on the teapot, so it follows the teapot and orbits it as the pivot turns
+	if (!mTeapotCollection[ps_PixelLighting].Empty() && mLightStackTop.y > 0)
+	{
+		mLightOrbit = Model::Transforms().Add({ 0, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 });
+		Model::Transforms().SetParent(mLightOrbit, mTeapotCollection[ps_PixelLighting].Front().Transform());
+		Model* lightBody = mSpotlights[0]->GetModel();
+		lightBody->AttachTo(mLightOrbit);
+		lightBody->SetPosition({ gLightOrbit, 10, 0 });
+		lightBody->FaceTarget(Model::Transforms().WorldMatrix(mLightOrbit).GetPosition());
+	}
 
     //// Set up camera ////
 
     mCamera = new Camera();
-    mCamera->SetPosition({ 15, 30,-70 });
-    mCamera->SetRotation({ ToRadians(13), 0, 0 });
+    mCamera->SetPosition(mSceneFile.CameraPosition());
+    mCamera->SetRotation(mSceneFile.CameraRotation());
 
+    mSceneBuildTime = buildTimer.GetTime();
     return true;
 }
 
@@ -275,20 +259,23 @@ bool CSceneManager::InitScene()
 void CSceneManager::ReleaseResources()
 {
     ReleaseStates();
+    mDrawQueue.ReleaseResources();
+    mLightClusters.ReleaseResources();
 	
-	for (unsigned short int i = 0; i < mLightStackTop.y; ++i)
-	{
-		if (mShadowMapSpotlightDepthStencil[i])  mShadowMapSpotlightDepthStencil[i]->Release();
-		if (mShadowMapSpotlightSRV[i])           mShadowMapSpotlightSRV[i]->Release();
-		if (mShadowMapSpotlightTexture[i])       mShadowMapSpotlightTexture[i]->Release();
-	}
+	if (mShadowAtlasDepthStencil)  gRenderDevice->Release(mShadowAtlasDepthStencil);
+	if (mShadowAtlasSRV)           gRenderDevice->Release(mShadowAtlasSRV);
+	if (mShadowAtlasTexture)       gRenderDevice->Release(mShadowAtlasTexture);
 	for (auto &texture : mTextures)
 	{
 		texture.Release();
 	}
+	mFlareTexture.Release();
+	mPortalFrameTexture.Release();
+	mPortalTargets.ReleaseResources();
 
-    if (gPerModelConstantBuffer)  gPerModelConstantBuffer->Release();
-    if (gPerFrameConstantBuffer)  gPerFrameConstantBuffer->Release();
+    if (gPerModelConstantBuffer)  gRenderDevice->Release(gPerModelConstantBuffer);
+    if (gPerViewConstantBuffer)   gRenderDevice->Release(gPerViewConstantBuffer);
+    if (gPerFrameConstantBuffer)  gRenderDevice->Release(gPerFrameConstantBuffer);
 
     ReleaseShaders();
 
@@ -314,31 +301,31 @@ void CSceneManager::ReleaseResources()
 
     delete mCamera;    mCamera    = nullptr;
 
-	for (auto &group : mModelCollection)
-	{
-		for (auto &model : group)
-		{
-			delete model; model = nullptr;
-		}
-	}
+    Model::Transforms().Remove(mLightOrbit);
+    mLightOrbit = STransformHandle();
 
-	for (auto &shader : mTeapotCollection)
+	for (int i = 0; i < gsNumOfModelPS; ++i)
 	{
-		for (auto &model : shader)
-		{
-			delete model; model = nullptr;
-		}
+		mModelCollection[i].Clear();
+		mTeapotCollection[i].Clear();
 	}
+	mTransparentModels.Clear();
+	mOccluders.clear();
 
-	for (auto &model : mTransparentModels)
+	// Their render targets were released with the pool above
+	for (auto &portal : mPortalCollection)
 	{
-		delete model; model = nullptr;
+		portal->Release();
+		delete portal;
 	}
+	mPortalCollection.clear();
 
-	for (auto &mesh : mMeshArray)
+	for (auto &mesh : mMeshes)
 	{
 		delete mesh;     mesh = nullptr;
 	}
+	delete mLightMesh;   mLightMesh  = nullptr;
+	delete mPortalMesh;  mPortalMesh = nullptr;
 }
 
 
@@ -347,241 +334,446 @@ void CSceneManager::ReleaseResources()
 // Scene Rendering
 //--------------------------------------------------------------------------------------
 
-// Render the scene from the given light's point of view. Only renders depth buffer
-void CSceneManager::RenderDepthBufferFromLight(const CSpotlight &light)
+// Model collection of each scene file material, in the order of ESceneMaterial
+const CSceneManager::EPixelShaders CSceneManager::sMaterialShaders[static_cast<int>(ESceneMaterial::NumMaterials)] =
 {
-    // Get camera-like matrices from the spotlight, seet in the constant buffer and send over to GPU
-    gPerFrameConstants.viewMatrix           = light.CalculateViewMatrix();
-    gPerFrameConstants.projectionMatrix     = light.CalculateProjectionMatrix();
-    gPerFrameConstants.viewProjectionMatrix = gPerFrameConstants.viewMatrix * gPerFrameConstants.projectionMatrix;
-    UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
+	ps_PixelLighting, ps_Wiggle, ps_NormalMap, ps_ParallaxMap, ps_Fade, ps_WiggleParallax, ps_Transparent
+};
 
-    // Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-    gD3DContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
-    gD3DContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+// Shaders for each model collection, indexed by the pixel shader the collection is named after
+const CSceneManager::SCollectionShaders CSceneManager::sCollectionShaders[gsNumOfModelPS] =
+{
+	{ vs_Wiggle,        ps_Wiggle,        false, NumVertexShaders          }, // ps_Wiggle
+	{ vs_NormalMap,     ps_NormalMap,     true,  vs_NormalMapInstanced     }, // ps_NormalMap
+	{ vs_NormalMap,     ps_ParallaxMap,   true,  vs_NormalMapInstanced     }, // ps_ParallaxMap
+	{ vs_PixelLighting, ps_PixelLighting, false, vs_PixelLightingInstanced }, // ps_PixelLighting
+	{ vs_PixelLighting, ps_Fade,          true,  vs_PixelLightingInstanced }, // ps_Fade
+	{ vs_WiggleTangent, ps_ParallaxMap,   true,  NumVertexShaders          }, // ps_WiggleParallax
+};
 
 
-    //// Only render models that cast shadows ////
+// Add the given bytes to a 64-bit FNV-1a hash, used to build shadow map version stamps
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
 
-    // Use special depth-only rendering shaders
-    gD3DContext->VSSetShader(mVertexShaders[vs_BasicTransform], nullptr, 0);
-    gD3DContext->PSSetShader(mPixelShaders[ps_DepthOnly],       nullptr, 0);
-    
-    // States - no blending, normal depth buffer and culling
-    gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-    gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-    gD3DContext->RSSetState(gCullBackState);
 
-	// Render models - no state changes required between each object in this situation (no textures used in this step)
-	for(auto &pixelShader : mModelCollection)
-	{
-		for (auto& model : pixelShader)
-		{
-			model->Render();
-		}
-	}
-	for (auto& portal : mPortalCollection)
-	{
-		portal->Render();
-	}
+// Choose the size of each spotlight's tile in the shadow atlas. A light is given a tile in proportion to how much of
+// the screen the region it lights (its cone up to the shadow range) covers, and lights whose region is entirely off
+// screen give their tile up. Tiles are only reallocated when the size needed changes enough, as a new tile has to
+// be rendered even if nothing has moved
+void CSceneManager::UpdateShadowAtlas()
+{
+    CFrustum cameraFrustum(mCamera->ViewProjectionMatrix());
+    float tanHalfFOV = std::tan(mCamera->FOV() * 0.5f);
 
-	gD3DContext->RSSetState(gCullNoneState);
-	for (auto &pixelShader : mTeapotCollection)
-	{
-		for (auto& model : pixelShader)
-		{
-			model->Render();
-		}
-	}
+    unsigned int wantedSizes[gsNumSpotlights] = {};
+    for (unsigned short int i = 0; i < mLightStackTop.y; ++i)
+    {
+        // Sphere enclosing the light's cone up to its range (or the shadow range if that is shorter)
+        const CSpotlight& light = *mSpotlights[i];
+        float range = (light.GetRange() < mShadowRange) ? light.GetRange() : mShadowRange;
+        float halfRange = range * 0.5f;
+        float coneRadius = range * std::tan(ToRadians(light.GetConeAngle() * 0.5f));
+        CVector3 centre = light.GetPosition() + light.GetFacing() * halfRange;
+        float radius = std::sqrt(halfRange * halfRange + coneRadius * coneRadius);
+        if (!cameraFrustum.IsSphereVisible(centre, radius))  continue;
+
+        // Approximate fraction of the screen width covered by the sphere, 1 if the camera is inside it
+        float distance = Length(centre - mCamera->Position());
+        float coverage = (distance > radius) ? radius / (distance * tanHalfFOV) : 1.0f;
+        if (coverage > 1.0f)  coverage = 1.0f;
+        wantedSizes[i] = mShadowAtlas.TileSize(static_cast<unsigned int>(coverage * mShadowTileMaxSize));
+    }
 
-	gD3DContext->OMSetBlendState(gMultiplicativeBlending, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gDepthReadOnlyState, 0);
-	for (auto &model : mTransparentModels)
-	{
-		model->Render();
-	}
+    // Free the tiles that need to change first so their space can be reused. A tile is only shrunk once it is four
+    // times the size needed, so lights near a size boundary don't keep swapping tiles
+    // The stamp of a freed tile is cleared: another light may render into the tile before this light is given it
+    // back, and the stamp only describes what this light last rendered, not what the tile now holds
+    for (unsigned short int i = 0; i < gsNumSpotlights; ++i)
+    {
+        SAtlasTile& tile = mShadowTiles[i];
+        bool keep = tile.Valid() && wantedSizes[i] != 0 && tile.size >= wantedSizes[i] && tile.size < wantedSizes[i] * 4;
+        if (!keep)
+        {
+            mShadowAtlas.Free(tile);
+            tile = SAtlasTile();
+            mShadowMapStamps[i] = 0;
+        }
+    }
 
+    // Allocate the largest tiles first, which packs best. If the atlas is full try smaller tiles
+    unsigned int order[gsNumSpotlights];
+    for (unsigned int i = 0; i < gsNumSpotlights; ++i)
+    {
+        unsigned int j = i;
+        for (; j > 0 && wantedSizes[order[j - 1]] < wantedSizes[i]; --j)  order[j] = order[j - 1];
+        order[j] = i;
+    }
+    for (unsigned int i : order)
+    {
+        if (wantedSizes[i] == 0 || mShadowTiles[i].Valid())  continue;
+        for (unsigned int size = wantedSizes[i]; size >= mShadowTileMinSize && !mShadowTiles[i].Valid(); size /= 2)
+        {
+            mShadowTiles[i] = mShadowAtlas.Allocate(size);
+        }
+    }
 }
 
 
-
-// Render everything in the scene from the given camera
-// This code is common between rendering the main scene and rendering the scene in the portal
-// See RenderScene function below
-void CSceneManager::RenderSceneFromCamera(Camera* camera)
+// Render the scene from the given spotlight's point of view into its shadow map. Only renders depth buffer
+// The shadow map is given a version stamp built from the light's matrices and the transforms of every caster in its
+// frustum. If the stamp matches the one from when the map was last rendered then nothing visible to the light has
+// changed, so the map is left as it is
+unsigned int CSceneManager::RenderDepthBufferFromLight(unsigned int spotlight)
 {
-    // Set camera matrices in the constant buffer and send over to GPU
-    gPerFrameConstants.viewMatrix           = camera->ViewMatrix();
-    gPerFrameConstants.projectionMatrix     = camera->ProjectionMatrix();
-    gPerFrameConstants.viewProjectionMatrix = camera->ViewProjectionMatrix();
-    UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
+    const CSpotlight& light = *mSpotlights[spotlight];
+
+    // Lights without a tile in the shadow atlas cast no shadows
+    const SAtlasTile& tile = mShadowTiles[spotlight];
+    if (!tile.Valid())  return 0;
+
+    // Get camera-like matrices from the spotlight
+    CMatrix4x4 viewMatrix       = light.CalculateViewMatrix();
+    CMatrix4x4 projectionMatrix = light.CalculateProjectionMatrix();
+
+    // Models outside the light's frustum cannot cast a shadow into its shadow map
+    CFrustum frustum(viewMatrix * projectionMatrix);
+    unsigned int culled = 0;
 
-    // Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-    gD3DContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
-    gD3DContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+    uint64_t stamp = 0xcbf29ce484222325ull;
+    stamp = HashBytes(stamp, &viewMatrix,       sizeof(viewMatrix));
+    stamp = HashBytes(stamp, &projectionMatrix, sizeof(projectionMatrix));
+    stamp = HashBytes(stamp, &tile,             sizeof(tile)); // A new tile always needs rendering
 
 
-    //// Render lit models ////
-	    
-    // States - no blending, normal depth buffer and culling
-    gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-    gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
+    //// Only render models that cast shadows ////
+
+    // Use special depth-only rendering shaders, no textures needed. States - no blending, normal depth buffer and culling
+    SDrawState opaque;
+    opaque.vertexShader      = mVertexShaders[vs_BasicTransform];
+    opaque.instancedVertexShader = mVertexShaders[vs_BasicTransformInstanced];
+    opaque.pixelShader       = mPixelShaders[ps_DepthOnly];
+    opaque.rasterizerState   = gCullBackState;
+    opaque.blendState        = gNoBlendingState;
+    opaque.depthStencilState = gUseDepthBufferState;
+
+    // Teapots are drawn without culling
+    SDrawState teapot = opaque;
+    teapot.rasterizerState = gCullNoneState;
+
+    SDrawState transparent = opaque;
+    transparent.rasterizerState   = gCullNoneState;
+    transparent.blendState        = gMultiplicativeBlending;
+    transparent.depthStencilState = gDepthReadOnlyState;
+
+    // Each caster adds its identity and transform version to the stamp, so a caster moving, entering or leaving
+    // the frustum all change the stamp
+    auto addCaster = [&](unsigned int layer, const SDrawState& state, Model* model)
+    {
+        if (!model->IsInFrustum(frustum)) { ++culled; return; }
+        mDrawQueue.Add(layer, state, model);
 
-    // Select the approriate textures and sampler to use in the pixel shader
-    gD3DContext->PSSetSamplers(0, 1, &gAnisotropic4xSampler);
-	gD3DContext->RSSetState(gCullNoneState);
+        unsigned int version = model->TransformVersion();
+        stamp = HashBytes(stamp, &model,   sizeof(model));
+        stamp = HashBytes(stamp, &version, sizeof(version));
+    };
 
-	// Render model - it will update the model's world matrix and send it to the GPU in a constant buffer, then it will call
-   // the Mesh render function, which will set up vertex & index buffer before finally calling Draw on the GPU
+    mDrawQueue.Clear();
 	for (int i = 0; i < gsNumOfModelPS; ++i)
 	{
-		bool secondTexture = false;
-		// Select which shaders to use next
-		switch (i)
-		{
-		case ps_Wiggle:
-			gD3DContext->VSSetShader(mVertexShaders[vs_Wiggle], nullptr, 0);
-			gD3DContext->PSSetShader(mPixelShaders[ps_Wiggle], nullptr, 0);
-			break;
-		case ps_NormalMap:
-			gD3DContext->VSSetShader(mVertexShaders[vs_NormalMap], nullptr, 0);
-			gD3DContext->PSSetShader(mPixelShaders[ps_NormalMap], nullptr, 0);
-			secondTexture = true;
-			break;
-		case ps_ParallaxMap:
-			//gD3DContext->VSSetShader(mVertexShaders[vs_NormalMap], nullptr, 0);
-			gD3DContext->PSSetShader(mPixelShaders[ps_ParallaxMap], nullptr, 0);
-			secondTexture = true;
-			break;
-		case ps_PixelLighting:
-			gD3DContext->VSSetShader(mVertexShaders[vs_PixelLighting], nullptr, 0);
-			gD3DContext->PSSetShader(mPixelShaders[ps_PixelLighting], nullptr, 0);
-			break;
-		case ps_Fade:
-			//gD3DContext->VSSetShader(mVertexShaders[vs_PixelLighting], nullptr, 0); //Already set
-			gD3DContext->PSSetShader(mPixelShaders[ps_Fade], nullptr, 0);
-			secondTexture = true;
-			break;
-		case ps_WiggleParallax:
-			gD3DContext->VSSetShader(mVertexShaders[vs_WiggleTangent], nullptr, 0);
-			gD3DContext->PSSetShader(mPixelShaders[ps_ParallaxMap], nullptr, 0);
-			break;
-		}
-		if (!mTeapotCollection[i].empty())
-		{
-			for (auto &model : mTeapotCollection[i])
-			{
-				gD3DContext->PSSetShaderResources(0, 1, model->GetTexture()->GetSpecularMapSRV()); // First parameter must match texture slot number in the shader
-				if (secondTexture) gD3DContext->PSSetShaderResources(gsNumSpotlights + 1, 1, model->GetTexture(1)->GetSpecularMapSRV());
-				model->Render();
-			}
-		}
+		for (auto& model : mModelCollection[i])   addCaster(0, opaque, &model);
+		for (auto& model : mTeapotCollection[i])  addCaster(0, teapot, &model);
 	}
+	for (auto& portal : mPortalCollection)    addCaster(0, opaque, portal->GetModel());
+	for (auto &model : mTransparentModels)    addCaster(1, transparent, &model);
+
+    if (mShadowMapCaching && stamp == mShadowMapStamps[spotlight])
+    {
+        ++mShadowMapsSkipped[spotlight];
+        return culled;
+    }
+    mShadowMapStamps[spotlight] = stamp;
+    ++mShadowMapsRendered[spotlight];
+
+
+    // Select the shadow atlas as the current depth buffer, with the viewport covering the light's tile. We will not be rendering any pixel colours
+    gRenderContext->OMSetRenderTargets(0, nullptr, mShadowAtlasDepthStencil);
+    D3D11_VIEWPORT vp;
+    vp.Width  = static_cast<FLOAT>(tile.size);
+    vp.Height = static_cast<FLOAT>(tile.size);
+    vp.MinDepth = 0.0f;
+    vp.MaxDepth = 1.0f;
+    vp.TopLeftX = static_cast<FLOAT>(tile.x);
+    vp.TopLeftY = static_cast<FLOAT>(tile.y);
+    gRenderContext->RSSetViewports(1, &vp);
+
+    // Clear the tile to the far distance. The whole atlas can't be cleared as other lights may be keeping their tiles
+    // from earlier frames, so a triangle covering the viewport is drawn at the far depth instead
+    gRenderContext->IASetInputLayout(nullptr);
+    gRenderContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    gRenderContext->VSSetShader(mVertexShaders[vs_ShadowTileClear]);
+    gRenderContext->PSSetShader(nullptr);
+    gRenderContext->RSSetState(gCullNoneState);
+    gRenderContext->OMSetDepthStencilState(gOverwriteDepthState, 0);
+    gRenderContext->Draw(3, 0);
+
+    // Set the light's matrices in the per-view constant buffer and send over to GPU. The per-frame constants were
+    // sent once in RenderScene and stay bound
+    gPerViewConstants.viewMatrix           = viewMatrix;
+    gPerViewConstants.projectionMatrix     = projectionMatrix;
+    gPerViewConstants.viewProjectionMatrix = viewMatrix * projectionMatrix;
+    gPerViewConstants.cameraPosition       = light.GetPosition();
+    UpdateConstantBuffer(gPerViewConstantBuffer, gPerViewConstants);
+
+    mDrawQueue.Sort();
+    mDrawQueue.Submit();
+
+	return culled;
+}
+
+
+
+// Render everything in the scene from the given camera
+// This code is common between rendering the main scene and rendering the scene in the portal
+// See RenderScene function below
+unsigned int CSceneManager::RenderSceneFromCamera(Camera* camera, COcclusionBuffer* occlusionBuffer, unsigned int& occluded, CPortal* targetPortal)
+{
+    // Set camera matrices in the per-view constant buffer and send over to GPU
+    gPerViewConstants.viewMatrix           = camera->ViewMatrix();
+    gPerViewConstants.projectionMatrix     = camera->ProjectionMatrix();
+    gPerViewConstants.viewProjectionMatrix = camera->ViewProjectionMatrix();
+    gPerViewConstants.cameraPosition       = camera->WorldPosition();
+
+    // Bin the lights into the clusters of this camera's view, the shaders find the cluster of each pixel from the
+    // constants here
+    mLightClusters.Bin(gPerViewConstants.viewMatrix, gPerViewConstants.projectionMatrix, camera->NearClip(), camera->FarClip());
+    gPerViewConstants.clusterDepthScale = mLightClusters.DepthScale();
+    gPerViewConstants.clusterDepthBias  = mLightClusters.DepthBias();
+    UpdateConstantBuffer(gPerViewConstantBuffer, gPerViewConstants);
+    mLightClusters.Upload(6);
+
+    // Models outside the camera's frustum are skipped, they would be clipped by the GPU anyway. So are models hidden
+    // behind the occluders. A portal camera's near plane is the portal's surface, so models behind that are skipped too
+    CFrustum frustum(gPerViewConstants.viewProjectionMatrix);
+    unsigned int culled = 0;
+    occluded = 0;
+
+    // Every model is added to the draw queue with the state it needs, the queue sorts them to minimise state changes.
+    // Draws are in three layers: lit models, then light models (additive blending) then transparent models
+    // (multiplicative blending). Blending changes the result depending on order, so the layers are kept in order
+    mDrawQueue.Clear();
+
+
+    //// Lit models ////
+
+    // States - no blending, normal depth buffer and culling (except for teapots)
+    SDrawState lit;
+    lit.blendState        = gNoBlendingState;
+    lit.depthStencilState = gUseDepthBufferState;
+    lit.sampler           = gAnisotropic4xSampler;
 
-    gD3DContext->RSSetState(gCullBackState);
-    // Render model - it will update the model's world matrix and send it to the GPU in a constant buffer, then it will call
-    // the Mesh render function, which will set up vertex & index buffer before finally calling Draw on the GPU
 	for (int i = 0; i < gsNumOfModelPS; ++i)
 	{
-		bool secondTexture = false;
-		// Select which shaders to use next
-		switch (i)
+		// Select which shaders to use for this collection
+		lit.vertexShader = mVertexShaders[sCollectionShaders[i].vertexShader];
+		lit.pixelShader  = mPixelShaders[sCollectionShaders[i].pixelShader];
+		bool secondTexture = sCollectionShaders[i].secondTexture;
+		EVertexShaders instancedShader = sCollectionShaders[i].instancedVertexShader;
+		lit.instancedVertexShader = (instancedShader != NumVertexShaders) ? mVertexShaders[instancedShader] : nullptr;
+
+		lit.rasterizerState = gCullNoneState;
+		for (auto &model : mTeapotCollection[i])
 		{
-		case ps_Wiggle:
-			gD3DContext->VSSetShader(mVertexShaders[vs_Wiggle], nullptr, 0);
-			gD3DContext->PSSetShader(mPixelShaders[ps_Wiggle], nullptr, 0);
-			break;
-		case ps_NormalMap:
-			gD3DContext->VSSetShader(mVertexShaders[vs_NormalMap], nullptr, 0);
-			gD3DContext->PSSetShader(mPixelShaders[ps_NormalMap], nullptr, 0);
-			secondTexture = true;
-			break;
-		case ps_ParallaxMap:
-			//gD3DContext->VSSetShader(mVertexShaders[vs_NormalMap], nullptr, 0);
-			gD3DContext->PSSetShader(mPixelShaders[ps_ParallaxMap], nullptr, 0);
-			secondTexture = true;
-			break;
-		case ps_PixelLighting:
-			gD3DContext->VSSetShader(mVertexShaders[vs_PixelLighting], nullptr, 0);
-			gD3DContext->PSSetShader(mPixelShaders[ps_PixelLighting], nullptr, 0);
-			break;
-		case ps_Fade:
-			//gD3DContext->VSSetShader(mVertexShaders[vs_PixelLighting], nullptr, 0); //Already set
-			gD3DContext->PSSetShader(mPixelShaders[ps_Fade], nullptr, 0);
-			secondTexture = true;
-			break;
-		case ps_WiggleParallax:
-			gD3DContext->VSSetShader(mVertexShaders[vs_WiggleTangent], nullptr, 0);
-			gD3DContext->PSSetShader(mPixelShaders[ps_ParallaxMap], nullptr, 0);
-			secondTexture = true;
-			break;
+			if (!model.IsInFrustum(frustum)) { ++culled; continue; }
+			if (occlusionBuffer && model.IsOccluded(*occlusionBuffer)) { ++occluded; continue; }
+			lit.textures[0] = *model.GetTexture()->GetSpecularMapSRV();
+			lit.textures[1] = secondTexture ? *model.GetTexture(1)->GetSpecularMapSRV() : nullptr;
+			mDrawQueue.Add(0, lit, &model);
 		}
-		if (!mModelCollection[i].empty())
+
+		lit.rasterizerState = gCullBackState;
+		for (auto &model : mModelCollection[i])
 		{
-			for (auto &model : mModelCollection[i])
-			{
-				gD3DContext->PSSetShaderResources(0, 1, model->GetTexture()->GetSpecularMapSRV()); // First parameter must match texture slot number in the shader
-				if(secondTexture) gD3DContext->PSSetShaderResources(gsNumSpotlights + 1, 1, model->GetTexture(1)->GetSpecularMapSRV());
-				model->Render();
-			}
+			if (!model.IsInFrustum(frustum)) { ++culled; continue; }
+			if (occlusionBuffer && model.IsOccluded(*occlusionBuffer)) { ++occluded; continue; }
+			lit.textures[0] = *model.GetTexture()->GetSpecularMapSRV();
+			lit.textures[1] = secondTexture ? *model.GetTexture(1)->GetSpecularMapSRV() : nullptr;
+			mDrawQueue.Add(0, lit, &model);
 		}
 	}
 	
-	//// Render Portals ////
-	gD3DContext->PSSetShader(mPixelShaders[ps_Portal], nullptr, 0);
-	gD3DContext->PSSetShaderResources(0, 1, mTextures[TVTexture].GetSpecularMapSRV());
-
+	//// Portals ////
+	lit.vertexShader = mVertexShaders[vs_PixelLighting];
+	lit.instancedVertexShader = nullptr; // Each portal has its own texture so they are never batched
+	lit.pixelShader  = mPixelShaders[ps_Portal];
+	lit.textures[0]  = *mPortalFrameTexture.GetSpecularMapSRV();
 	for (auto &portal : mPortalCollection)
 	{
-		gD3DContext->PSSetShaderResources(gsNumSpotlights + 1, 1, portal->GetPortalTextureSRV());
-	
-		portal->Render();
+		if (!portal->IsInFrustum(frustum)) { ++culled; continue; }
+		lit.textures[1] = (portal == targetPortal) ? nullptr : portal->GetPortalTextureSRV();
+		mDrawQueue.Add(0, lit, portal->GetModel());
 	}
 
-    //// Render lights ////
 
-    // Select which shaders to use next
-    gD3DContext->VSSetShader(mVertexShaders[vs_BasicTransform], nullptr, 0);
-    gD3DContext->PSSetShader(mPixelShaders[ps_LightModel],      nullptr, 0);
+    //// Light models ////
 
-    // Select the texture and sampler to use in the pixel shader
-    gD3DContext->PSSetShaderResources(0, 1, mTextures[FlareTexture].GetSpecularMapSRV()); // First parameter must match texture slot number in the shaer
-    gD3DContext->PSSetSamplers(0, 1, &gAnisotropic4xSampler);
+    // States - additive blending, read-only depth buffer and no culling (standard set-up for blending)
+    SDrawState light;
+    light.vertexShader      = mVertexShaders[vs_BasicTransform];
+    light.instancedVertexShader = mVertexShaders[vs_BasicTransformInstanced];
+    light.pixelShader       = mPixelShaders[ps_LightModel];
+    light.rasterizerState   = gCullNoneState;
+    light.blendState        = gAdditiveBlendingState;
+    light.depthStencilState = gDepthReadOnlyState;
+    light.sampler           = gAnisotropic4xSampler;
+    light.textures[0]       = *mFlareTexture.GetSpecularMapSRV();
 
-    // States - additive blending, read-only depth buffer and no culling (standard set-up for blending
-    gD3DContext->OMSetBlendState(gAdditiveBlendingState, nullptr, 0xffffff);
-    gD3DContext->OMSetDepthStencilState(gDepthReadOnlyState, 0);
-    gD3DContext->RSSetState(gCullNoneState);
-
-    // Render all the lights in the array
+    // Each light model is tinted to match the colour of the light it casts
 	for (unsigned short int i = 0; i < mLightStackTop.x; ++i)
 	{
-		gPerModelConstants.objectColour = mPointLights[i]->GetColour(); // Set any per-model constants apart from the world matrix just before calling render (light colour here)
-		mPointLights[i]->Render();
+		mDrawQueue.Add(1, light, mPointLights[i]->GetModel(), mPointLights[i]->GetColour());
 	}
     for (unsigned short int i = 0; i < mLightStackTop.y; ++i)
     {
-        gPerModelConstants.objectColour = mSpotlights[i]->GetColour(); // Set any per-model constants apart from the world matrix just before calling render (light colour here)
-		mSpotlights[i]->Render();
+		mDrawQueue.Add(1, light, mSpotlights[i]->GetModel(), mSpotlights[i]->GetColour());
     }
 	for (unsigned short int i = 0; i < mLightStackTop.z; ++i)
 	{
-		gPerModelConstants.objectColour = mDirectionalLights[i]->GetColour(); // Set any per-model constants apart from the world matrix just before calling render (light colour here)
-		mDirectionalLights[i]->Render();
+		mDrawQueue.Add(1, light, mDirectionalLights[i]->GetModel(), mDirectionalLights[i]->GetColour());
 	}
 
-	gD3DContext->VSSetShader(mVertexShaders[vs_BasicTransform], nullptr, 0);
-	gD3DContext->PSSetShader(mPixelShaders[ps_Transparent], nullptr, 0);
-	gD3DContext->PSSetSamplers(0, 1, &gTrilinearSampler);
-	gD3DContext->OMSetBlendState(gMultiplicativeBlending, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gDepthReadOnlyState, 0);
-	gD3DContext->RSSetState(gCullNoneState);
+
+    //// Transparent models ////
+
+    // States - multiplicative blending, read-only depth buffer and no culling
+    SDrawState transparent;
+    transparent.vertexShader      = mVertexShaders[vs_BasicTransform];
+    transparent.instancedVertexShader = mVertexShaders[vs_BasicTransformInstanced];
+    transparent.pixelShader       = mPixelShaders[ps_Transparent];
+    transparent.rasterizerState   = gCullNoneState;
+    transparent.blendState        = gMultiplicativeBlending;
+    transparent.depthStencilState = gDepthReadOnlyState;
+    transparent.sampler           = gTrilinearSampler;
 	for (auto &model : mTransparentModels)
 	{
-		gD3DContext->PSSetShaderResources(0, 1, model->GetTexture()->GetSpecularMapSRV()); // First parameter must match texture slot number in the shader
-		model->Render();
+		if (!model.IsInFrustum(frustum)) { ++culled; continue; }
+		if (occlusionBuffer && model.IsOccluded(*occlusionBuffer)) { ++occluded; continue; }
+		transparent.textures[0] = *model.GetTexture()->GetSpecularMapSRV();
+		mDrawQueue.Add(2, transparent, &model);
 	}
 
+    mDrawQueue.Sort();
+    mDrawQueue.Submit();
+
+	return culled;
+}
+
+
+// Size of render target to give a portal whose texture should be the given number of pixels across. Portals move to a
+// larger target as soon as they need it, but only to a smaller one once their current target is four times the size
+// needed, so portals near a size boundary don't keep swapping (a new target must be rendered even if the portal's view
+// hasn't changed)
+unsigned int CSceneManager::PortalTargetSize(CPortal* portal, float pixels)
+{
+    unsigned int wantedSize = mPortalTargets.TargetSize(static_cast<unsigned int>(std::ceil(pixels)));
+    SPortalTarget* target = portal->GetTarget();
+    if (target && target->size >= wantedSize && target->size < wantedSize * 4)  return target->size;
+    return wantedSize;
+}
+
+
+// Find the portals seen this frame. Those the main camera sees are level 0, those their cameras see are level 1, and so
+// on down to the maximum depth. A portal's camera is fixed to it, so its texture shows the same view wherever it is
+// seen from: each portal is rendered at most once, sized for the largest place it is seen. The search is breadth first,
+// so each portal is found at its shallowest level and mPortalOrder lists the levels in turn
+void CSceneManager::PlanPortals(COcclusionBuffer* mainOcclusion)
+{
+    const unsigned int numPortals = static_cast<unsigned int>(mPortalCollection.size());
+    mPortalViews.assign(numPortals, SPortalView());
+    mPortalOrder.clear();
+
+    // Level 0, which can use the main camera's occlusion buffer. The texture is square and stretched over the portal,
+    // so it needs as many pixels as the larger of the portal's width and height
+    CFrustum mainFrustum(mCamera->ViewProjectionMatrix());
+    float maxPixels = static_cast<float>(mPortalTargets.MaxSize());
+    for (unsigned int i = 0; i < numPortals; ++i)
+    {
+        CPortal* portal = mPortalCollection[i];
+        if (!portal->IsInFrustum(mainFrustum))  continue;
+        if (mainOcclusion && portal->GetModel()->IsOccluded(*mainOcclusion))  continue;
+
+        CVector2 screenSize;
+        float screenArea = portal->ScreenArea(mCamera->ViewProjectionMatrix(), &screenSize);
+        if (screenArea <= 0)  continue;
+        float pixelsX = screenSize.x * gViewportWidth;
+        float pixelsY = screenSize.y * gViewportHeight;
+        float pixels = (pixelsX > pixelsY) ? pixelsX : pixelsY;
+
+        SPortalView& view = mPortalViews[i];
+        view.screenArea = screenArea;
+        view.pixels = (pixels < maxPixels) ? pixels : maxPixels;
+        view.depth = 0;
+        mPortalOrder.push_back(i);
+    }
+    if (!mPortalRecursion)  return;
+
+    // Portals seen through a portal cover a fraction of its texture, which covers a fraction of the screen. Each level
+    // down is also limited to half the texture size of the level above
+    for (unsigned int next = 0; next < mPortalOrder.size(); ++next)
+    {
+        const SPortalView parent = mPortalViews[mPortalOrder[next]];
+        if (parent.depth >= mPortalMaxDepth)  continue;
+        Camera* camera = mPortalCollection[mPortalOrder[next]]->GetCamera();
+        CFrustum frustum(camera->ViewProjectionMatrix());
+        maxPixels = static_cast<float>(mPortalTargets.MaxSize() >> (parent.depth + 1));
+
+        for (unsigned int i = 0; i < numPortals; ++i)
+        {
+            CPortal* portal = mPortalCollection[i];
+            if (!portal->IsInFrustum(frustum))  continue;
+
+            CVector2 screenSize;
+            float screenArea = portal->ScreenArea(camera->ViewProjectionMatrix(), &screenSize);
+            if (screenArea <= 0)  continue;
+            screenArea *= parent.screenArea;
+            float pixels = ((screenSize.x > screenSize.y) ? screenSize.x : screenSize.y) * parent.pixels;
+            if (pixels > maxPixels)  pixels = maxPixels;
+
+            SPortalView& view = mPortalViews[i];
+            if (view.depth == SPortalView::NotSeen)
+            {
+                view.depth = parent.depth + 1;
+                mPortalOrder.push_back(i);
+            }
+            if (screenArea > view.screenArea)  view.screenArea = screenArea;
+            if (pixels > view.pixels)  view.pixels = pixels;
+        }
+    }
+}
+
+
+void CSceneManager::BuildOcclusionBuffer(COcclusionBuffer& occlusionBuffer, Camera* camera)
+{
+    mOcclusionTimer.Reset();
+    CFrustum frustum(camera->ViewProjectionMatrix());
+    occlusionBuffer.Begin(camera->ViewProjectionMatrix());
+    for (auto& occluder : mOccluders)
+    {
+        Model& model = (*occluder.pool)[occluder.model];
+        if (!model.IsInFrustum(frustum))  continue;
+        Mesh* mesh = model.GetMesh();
+        occlusionBuffer.AddOccluder(mesh->Positions().data(), mesh->Indices().data(), static_cast<unsigned int>(mesh->Indices().size()),
+                                    model.WorldMatrix(), occluder.cullBackFaces);
+    }
+    occlusionBuffer.Rasterize(&mWorkers);
+    mOcclusionTime += mOcclusionTimer.GetTime();
 }
 
 // Rendering the scene now renders everything twice. First it renders the scene for the portal into a texture.
@@ -590,92 +782,185 @@ void CSceneManager::RenderScene()
 {
     //// Common settings ////
 
-    // Set up the light information in the constant buffer
-    // Don't send to the GPU yet, the function RenderSceneFromCamera will do that
+    // Rebuild the world matrices of everything that moved since the last frame in one batch, shared among the
+    // workers. Anything moved during the frame is rebuilt on its own when next used
+    mTransformTimer.Reset();
+    Model::Transforms().UpdateAll(&mWorkers);
+    mTransformUpdateTime = mTransformTimer.GetTime();
+    mOcclusionTime = 0;
+
+    // Give each spotlight a tile of the shadow atlas to suit how much it matters on screen
+    UpdateShadowAtlas();
+
+    // Gather the light information for the shaders. The lights are sent to the GPU here, the function
+    // RenderSceneFromCamera bins them into clusters for each camera
+	mPointLightData.resize(static_cast<size_t>(mLightStackTop.x));
+	mSpotlightData.resize(static_cast<size_t>(mLightStackTop.y));
 	for (unsigned short int i = 0; i < mLightStackTop.x; ++i)
 	{
-		gPerFrameConstants.pointLights[i].colour = mPointLights[i]->GetColour() * mPointLights[i]->GetStrength();
-		gPerFrameConstants.pointLights[i].position = mPointLights[i]->GetPosition();
+		mPointLightData[i].colour = mPointLights[i]->GetColour() * mPointLights[i]->GetStrength();
+		mPointLightData[i].position = mPointLights[i]->GetPosition();
+		mPointLightData[i].range = mPointLights[i]->GetRange();
 	}
 	for (unsigned short int i = 0; i < mLightStackTop.y; ++i)
 	{
-		gPerFrameConstants.spotlights[i].colour = mSpotlights[i]->GetColour() * mSpotlights[i]->GetStrength();
-		gPerFrameConstants.spotlights[i].position = mSpotlights[i]->GetPosition();
-		gPerFrameConstants.spotlights[i].facing = mSpotlights[i]->GetFacing();    // Additional lighting information for spotlights
-		gPerFrameConstants.spotlights[i].cosHalfAngle = mSpotlights[i]->GetCosHalfAngle(); // --"--
-		gPerFrameConstants.spotlights[i].viewMatrix = mSpotlights[i]->CalculateViewMatrix();         // Calculate camera-like matrices for...
-		gPerFrameConstants.spotlights[i].projectionMatrix = mSpotlights[i]->CalculateProjectionMatrix();   //...lights to support shadow mapping
+		mSpotlightData[i].colour = mSpotlights[i]->GetColour() * mSpotlights[i]->GetStrength();
+		mSpotlightData[i].position = mSpotlights[i]->GetPosition();
+		mSpotlightData[i].range = mSpotlights[i]->GetRange();
+		mSpotlightData[i].facing = mSpotlights[i]->GetFacing();    // Additional lighting information for spotlights
+		mSpotlightData[i].cosHalfAngle = mSpotlights[i]->GetCosHalfAngle(); // --"--
+		mSpotlightData[i].viewMatrix = mSpotlights[i]->CalculateViewMatrix();         // Calculate camera-like matrices for...
+		mSpotlightData[i].projectionMatrix = mSpotlights[i]->CalculateProjectionMatrix();   //...lights to support shadow mapping
+
+		// Where the light's shadow map is in the shadow atlas. The UVs are brought in by half a texel at each edge so
+		// point sampling at the edge of the tile doesn't read the neighbouring tile
+		const SAtlasTile& tile = mShadowTiles[i];
+		float atlasSize = static_cast<float>(mShadowAtlasSize);
+		if (tile.Valid())
+		{
+			mSpotlightData[i].shadowAtlasScale  = { (tile.size - 1) / atlasSize, (tile.size - 1) / atlasSize };
+			mSpotlightData[i].shadowAtlasOffset = { (tile.x + 0.5f) / atlasSize, (tile.y + 0.5f) / atlasSize };
+		}
+		else
+		{
+			mSpotlightData[i].shadowAtlasScale  = { 0, 0 };
+			mSpotlightData[i].shadowAtlasOffset = { 0, 0 };
+		}
 	}
-	gPerFrameConstants.lightStackTops = mLightStackTop;
+	mLightClusters.SetLights(mPointLightData.data(), static_cast<unsigned int>(mPointLightData.size()),
+	                         mSpotlightData.data(), static_cast<unsigned int>(mSpotlightData.size()));
+
+    // Constants shared by every view rendered this frame are sent to the GPU once here. Each view (lights, portals
+    // and the main camera) then only sends its own matrices in the per-view buffer
+    gPerFrameConstants.ambientColour = mAmbientColour;
+    gPerFrameConstants.specularPower = mSpecularPower;
+    gPerFrameConstants.clusterCountX = mLightClusters.CountX();
+    gPerFrameConstants.clusterCountY = mLightClusters.CountY();
+    gPerFrameConstants.clusterCountZ = mLightClusters.CountZ();
+    UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
 
-    gPerFrameConstants.ambientColour  = mAmbientColour;
-    gPerFrameConstants.specularPower  = mSpecularPower;
-    gPerFrameConstants.cameraPosition = mCamera->Position();
+    // Indicate that the constant buffers are for use in the vertex shader (VS) and pixel shader (PS)
+    gRenderContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
+    gRenderContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+    gRenderContext->VSSetConstantBuffers(2, 1, &gPerViewConstantBuffer);
+    gRenderContext->PSSetConstantBuffers(2, 1, &gPerViewConstantBuffer);
 
 	//***************************************//
     //// Render from light's point of view ////
     
-    // Only rendering from light 1 to begin with
-
-    // Setup the viewport to the size of the shadow map texture
-    D3D11_VIEWPORT vp;
-    vp.Width  = static_cast<FLOAT>(mShadowMapSize);
-    vp.Height = static_cast<FLOAT>(mShadowMapSize);
-    vp.MinDepth = 0.0f;
-    vp.MaxDepth = 1.0f;
-    vp.TopLeftX = 0;
-    vp.TopLeftY = 0;
-    gD3DContext->RSSetViewports(1, &vp);
+    // Each light renders into its own tile of the shadow atlas, and sets the viewport to match
 
+	mCulledShadow = 0;
 	for (unsigned short int i = 0; i < mLightStackTop.y; ++i)
 	{
-		// Select the shadow map texture as the current depth buffer. We will not be rendering any pixel colours
-		// Also clear the the shadow map depth buffer to the far distance
-		gD3DContext->OMSetRenderTargets(0, nullptr, mShadowMapSpotlightDepthStencil[i]);
-		gD3DContext->ClearDepthStencilView(mShadowMapSpotlightDepthStencil[i], D3D11_CLEAR_DEPTH, 1.0f, 0);
-
-		// Render the scene from the point of view of light 1 (only depth values written)
-		RenderDepthBufferFromLight(*mSpotlights[i]);
+		// Render the scene from the point of view of each light (only depth values written). Skipped if nothing
+		// the light can see has moved since its shadow map was last rendered
+		mCulledShadow += RenderDepthBufferFromLight(i);
 	}
 
+	// Set the shadow atlas in the shaders for the portal and main passes. Done once here, as any number of portals
+	// (even all of them) may be skipped this frame
+	// First parameter is the "slot", must match the Texture2D declaration in the HLSL code
+	gRenderContext->PSSetShaderResources(1, 1, &mShadowAtlasSRV);
+
 	//// Portal Scene Rendering ////
 	// Set the portal texture and portal depth buffer as the targets for rendering
 	// The portal texture will later be used on models in the main scene
 	// Setup the viewport for the portal texture size
-	vp.Width = static_cast<FLOAT>(mPortalWidth);
-	vp.Height = static_cast<FLOAT>(mPortalHeight);
-	gD3DContext->RSSetViewports(1, &vp);
-	gD3DContext->PSSetSamplers(1, 1, &gPointSampler);
-	for (auto &portal : mPortalCollection)
+	// Each portal's texture is sized to how much of the screen it covers, and the viewport matches it
+	D3D11_VIEWPORT vp;
+	vp.MinDepth = 0.0f;
+	vp.MaxDepth = 1.0f;
+	vp.TopLeftX = 0;
+	vp.TopLeftY = 0;
+	gRenderContext->PSSetSamplers(1, 1, &gPointSampler);
+	mCulledPortal = 0;
+	mOccludedPortal = 0;
+	mPortalsRendered = 0;
+	mPortalsSkipped = 0;
+	mPortalsOverBudget = 0;
+	mPortalLevels = 0;
+	mPortalTexels = 0;
+
+	// The main camera's occlusion buffer is built first so portals hidden behind occluders count as unseen
+	COcclusionBuffer* mainOcclusion = mOcclusionCulling ? &mOcclusionBuffer : nullptr;
+	if (mainOcclusion)  BuildOcclusionBuffer(*mainOcclusion, mCamera);
+	PlanPortals(mainOcclusion);
+
+	// Not every portal that is seen is rendered (see CPortal::NeedsUpdate), and each must be asked once a frame
+	for (unsigned int i = 0; i < mPortalCollection.size(); ++i)
 	{
-		gD3DContext->OMSetRenderTargets(1, portal->GetPortalRenderTarget(), mPortalDepthStencilView);
+		mPortalViews[i].render = mPortalCollection[i]->NeedsUpdate(mPortalViews[i].screenArea);
+	}
+
+	// Share the texel budget out level by level, so the deepest levels are the ones left with last frame's texture.
+	// A portal with no texture yet is always rendered
+	for (unsigned int i : mPortalOrder)
+	{
+		SPortalView& view = mPortalViews[i];
+		if (!view.render)  continue;
+		CPortal* portal = mPortalCollection[i];
+		size_t size = PortalTargetSize(portal, view.pixels);
+		if (mPortalTexels + size * size > mPortalTexelBudget && portal->HasContent())
+		{
+			view.render = false;
+			++mPortalsOverBudget;
+			continue;
+		}
+		mPortalTexels += size * size;
+	}
+
+	// Render the deepest levels first, so the portals seen in them are up to date when the levels above are rendered.
+	// Portals that see each other (or themselves) can't both be: whichever is rendered first shows the other's
+	// texture from the last time it was rendered
+	for (auto next = mPortalOrder.rbegin(); next != mPortalOrder.rend(); ++next)
+	{
+		const SPortalView& view = mPortalViews[*next];
+		if (!view.render)  continue;
+		CPortal* portal = mPortalCollection[*next];
+
+		// Swap the portal's target for one of the size chosen above if needed
+		unsigned int size = PortalTargetSize(portal, view.pixels);
+		if (!portal->GetTarget() || portal->GetTarget()->size != size)
+		{
+			mPortalTargets.Free(portal->GetTarget());
+			portal->SetTarget(mPortalTargets.Acquire(size));
+			if (!portal->GetTarget())  continue;
+		}
+		++mPortalsRendered;
+		if (view.depth + 1 > mPortalLevels)  mPortalLevels = view.depth + 1;
 
-		gD3DContext->PSSetShaderResources(1, gsNumSpotlights, mShadowMapSpotlightSRV); //Putting this line here allows shadows to work in portals.
+		SPortalTarget* target = portal->GetTarget();
+		vp.Width  = static_cast<FLOAT>(target->size);
+		vp.Height = static_cast<FLOAT>(target->size);
+		gRenderContext->RSSetViewports(1, &vp);
+		gRenderContext->OMSetRenderTargets(1, &target->renderTarget, target->depthStencil);
 
 		// Clear the portal texture to a fixed colour and the portal depth buffer to the far distance
-		gD3DContext->ClearRenderTargetView(*portal->GetPortalRenderTarget(), &mBackgroundColor.r);
-		gD3DContext->ClearDepthStencilView(mPortalDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+		gRenderContext->ClearRenderTargetView(target->renderTarget, &mBackgroundColor.r);
+		gRenderContext->ClearDepthStencilView(target->depthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
 		// Render the scene for the portal
-		RenderSceneFromCamera(portal->GetCamera());
+		COcclusionBuffer* portalOcclusion = mOcclusionCulling ? &mPortalOcclusionBuffer : nullptr;
+		if (portalOcclusion)  BuildOcclusionBuffer(*portalOcclusion, portal->GetCamera());
+		unsigned int occluded;
+		mCulledPortal += RenderSceneFromCamera(portal->GetCamera(), portalOcclusion, occluded, portal);
+		mOccludedPortal += occluded;
+		portal->Updated();
 	}
+	mPortalsSkipped = static_cast<unsigned int>(mPortalCollection.size()) - mPortalsRendered;
 
     //**************************//
 
-	// Set shadow maps in shaders
-	// First parameter is the "slot", must match the Texture2D declaration in the HLSL code
-	// In this app the diffuse map uses slot 0, the shadow maps use slots 1 onwards. If we were using other maps (e.g. normal map) then
-	// we might arrange things differently
-
     //// Main scene rendering ////
 
     // Set the back buffer as the target for rendering and select the main depth buffer.
     // When finished the back buffer is sent to the "front buffer" - which is the monitor.
-    gD3DContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
+    gRenderContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
 
     // Clear the back buffer to a fixed colour and the depth buffer to the far distance
-    gD3DContext->ClearRenderTargetView(gBackBufferRenderTarget, &mBackgroundColor.r);
-    gD3DContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+    gRenderContext->ClearRenderTargetView(gBackBufferRenderTarget, &mBackgroundColor.r);
+    gRenderContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
     // Setup the viewport to the size of the main window
     vp.Width  = static_cast<FLOAT>(gViewportWidth);
@@ -684,22 +969,21 @@ void CSceneManager::RenderScene()
     vp.MaxDepth = 1.0f;
     vp.TopLeftX = 0;
     vp.TopLeftY = 0;
-    gD3DContext->RSSetViewports(1, &vp);
+    gRenderContext->RSSetViewports(1, &vp);
 
 
     // Render the scene for the main window
-    RenderSceneFromCamera(mCamera);
+    mCulledMain = RenderSceneFromCamera(mCamera, mainOcclusion, mOccludedMain);
 
-    // Unbind shadow maps from shaders - prevents warnings from DirectX when we try to render to the shadow maps again next frame
-    std::vector<ID3D11ShaderResourceView*> nullView;
-	nullView.resize(gsNumSpotlights, nullptr);
-	gD3DContext->PSSetShaderResources(1, gsNumSpotlights, nullView.data());
+    // Unbind the shadow atlas from shaders - prevents warnings from DirectX when we try to render to the shadow maps again next frame
+    ID3D11ShaderResourceView* nullView = nullptr;
+	gRenderContext->PSSetShaderResources(1, 1, &nullView);
 
 
     //*****************************//
     // Temporary demonstration code for visualising the light's view of the scene
     //ColourRGBA white = {1,1,1};
-    //gD3DContext->ClearRenderTargetView(gBackBufferRenderTarget, &white.r);
+    //gRenderContext->ClearRenderTargetView(gBackBufferRenderTarget, &white.r);
     //RenderDepthBufferFromLight(0);
     //*****************************//
 
@@ -707,7 +991,20 @@ void CSceneManager::RenderScene()
     //// Scene completion ////
 
     // When drawing to the off-screen back buffer is complete, we "present" the image to the front buffer (the screen)
-    gSwapChain->Present(0, 0);
+    gRenderContext->Present();
+
+    // Record how many model world matrices had to be rebuilt this frame, static models should not contribute
+    mWorldMatrixRebuilds = Model::WorldMatrixRebuilds();
+    Model::ResetWorldMatrixRebuilds();
+
+    // Record the state binds made and avoided by the draw queue over all passes this frame
+    mBindsIssued  = mDrawQueue.BindsIssued();
+    mBindsSkipped = mDrawQueue.BindsSkipped();
+    mDrawCalls    = mDrawQueue.DrawCalls();
+    mModelsDrawn  = mDrawQueue.ModelsDrawn();
+    mConstantUploads = mDrawQueue.ConstantUploads();
+    mSubmitTime      = mDrawQueue.SubmitTime();
+    mDrawQueue.ResetStatistics();
 }
 
 
@@ -718,20 +1015,61 @@ void CSceneManager::RenderScene()
 // Update models and camera. frameTime is the time passed since the last frame
 void CSceneManager::UpdateScene(float frameTime)
 {
-	// Control sphere (will update its world matrix)
-	mTeapotCollection[ps_PixelLighting].front()->Control(frameTime, Key_I, Key_K, Key_J, Key_L, Key_U, Key_O, Key_Period, Key_Comma );
-
-    // Orbit the light - a bit of a cheat with the static variable [ask the tutor if you want to know what this is]
-	static float rotate = 0.0f;
-    static bool go = true;
-	mSpotlights[0]->SetPosition(mTeapotCollection[ps_PixelLighting].front()->Position() + CVector3{ cos(rotate) * gLightOrbit, 10, sin(rotate) * gLightOrbit } );
-	mSpotlights[0]->FaceTarget(mTeapotCollection[ps_PixelLighting].front()->Position());
-    if (go)  rotate -= gLightOrbitSpeed * frameTime;
-    if (KeyHit(Key_1))  go = !go;
+	// Control teapot (will update its world matrix), and orbit the first spotlight around it. Both are skipped if the
+	// scene file has no two-sided model or no spotlight
+	if (!mTeapotCollection[ps_PixelLighting].Empty())
+	{
+		Model* teapot = &mTeapotCollection[ps_PixelLighting].Front();
+		teapot->Control(frameTime, Key_I, Key_K, Key_J, Key_L, Key_U, Key_O, Key_Period, Key_Comma );
+
+		// Orbit the light - a bit of a cheat with the static variable [ask the tutor if you want to know what this is]
+		// The light is attached to a pivot on the teapot (see InitScene), so it follows the teapot and faces it
+		// without being placed here
+		static float rotate = 0.0f;
+		static bool go = true;
+		if (mLightOrbit.Valid())  Model::Transforms().SetRotation(mLightOrbit, { 0, -rotate, 0 });
+		if (go)  rotate -= gLightOrbitSpeed * frameTime;
+		if (KeyHit(Key_1))  go = !go;
+	}
 
 	// Control camera (will update its view matrix)
 	mCamera->Control(frameTime, Key_Up, Key_Down, Key_Left, Key_Right, Key_W, Key_S, Key_A, Key_D );
 
+	// Instancing stress test - add a yard of 10,000 crates (once), and toggle instancing to compare draw calls
+	static bool crateYardAdded = false;
+	if (KeyHit(Key_2) && !crateYardAdded)
+	{
+		AddCrateYard(10000);
+		crateYardAdded = true;
+	}
+	if (KeyHit(Key_3))  mDrawQueue.SetInstancing(!mDrawQueue.Instancing());
+
+	// Toggle shadow map caching, to compare with rendering every shadow map every frame
+	if (KeyHit(Key_4))  mShadowMapCaching = !mShadowMapCaching;
+
+	// Clustered lighting stress test - add hundreds of lights (once)
+	static bool lightFieldAdded = false;
+	if (KeyHit(Key_5) && !lightFieldAdded)
+	{
+		AddLightField(512, 32);
+		lightFieldAdded = true;
+	}
+
+	// Toggle sending per-model constants through the constant arena, to compare with an upload for every draw
+	if (KeyHit(Key_6))  mDrawQueue.SetConstantArena(!mDrawQueue.ConstantArena());
+
+	// Toggle occlusion culling, to compare the models drawn and frame time with it off
+	if (KeyHit(Key_C))  mOcclusionCulling = !mOcclusionCulling;
+
+	// Render portals seen through other portals
+	if (KeyHit(Key_R))  mPortalRecursion = !mPortalRecursion;
+
+	// Update portals that only update on demand
+	if (KeyHit(Key_P))
+	{
+		for (auto& portal : mPortalCollection)  portal->RequestUpdate();
+	}
+
 
     // Show frame time / FPS in the window title //
     const float fpsUpdateTime = 0.5f; // How long between updates (in seconds)
@@ -748,37 +1086,95 @@ void CSceneManager::UpdateScene(float frameTime)
         std::ostringstream frameTimeMs;
         frameTimeMs.precision(2);
         frameTimeMs << std::fixed << avgFrameTime * 1000;
+        // Shadow map counts are totals since the start, for each spotlight, after the size of its atlas tile. With
+        // many spotlights only the sums over all of them are shown
+        std::ostringstream shadowMapCounts;
+        if (mLightStackTop.y <= 4)
+        {
+            for (unsigned short int i = 0; i < mLightStackTop.y; ++i)
+            {
+                shadowMapCounts << (i > 0 ? " " : "") << mShadowTiles[i].size << ":" << mShadowMapsRendered[i] << "/" << mShadowMapsSkipped[i];
+            }
+        }
+        else
+        {
+            unsigned int tiles = 0, rendered = 0, skipped = 0;
+            for (unsigned short int i = 0; i < mLightStackTop.y; ++i)
+            {
+                if (mShadowTiles[i].Valid())  ++tiles;
+                rendered += mShadowMapsRendered[i];
+                skipped  += mShadowMapsSkipped[i];
+            }
+            shadowMapCounts << tiles << " tiles:" << rendered << "/" << skipped;
+        }
+        // Light binning time and cluster lists are for the main camera
+        std::ostringstream clusterTime;
+        clusterTime.precision(3);
+        clusterTime << std::fixed << mLightClusters.BinTime() * 1000;
+        std::ostringstream submitTime;
+        submitTime.precision(3);
+        submitTime << std::fixed << mSubmitTime * 1000;
+        std::ostringstream occlusionTime;
+        occlusionTime.precision(3);
+        occlusionTime << std::fixed << mOcclusionTime * 1000;
+        std::ostringstream transformTime;
+        transformTime.precision(3);
+        transformTime << std::fixed << mTransformUpdateTime * 1000;
         std::string windowTitle = "CO2409 Week 20: Shadow Mapping - Frame Time: " + frameTimeMs.str() +
-                                  "ms, FPS: " + std::to_string(static_cast<int>(1 / avgFrameTime + 0.5f));
+                                  "ms, FPS: " + std::to_string(static_cast<int>(1 / avgFrameTime + 0.5f)) +
+                                  ", Matrix Rebuilds: " + std::to_string(mWorldMatrixRebuilds) + " (" + transformTime.str() + "ms)" +
+                                  ", Culled (main/portals/shadows): " + std::to_string(mCulledMain) + "/" +
+                                  std::to_string(mCulledPortal) + "/" + std::to_string(mCulledShadow) +
+                                  ", Occluded (main/portals): " + std::to_string(mOccludedMain) + "/" + std::to_string(mOccludedPortal) +
+                                  (mOcclusionCulling ? " in " + occlusionTime.str() + "ms" : " [occlusion culling off]") +
+                                  ", Portals (rendered/skipped/over budget): " + std::to_string(mPortalsRendered) + "/" +
+                                  std::to_string(mPortalsSkipped) + "/" + std::to_string(mPortalsOverBudget) +
+                                  " in " + std::to_string(mPortalLevels) + " levels" + (mPortalRecursion ? "" : " [recursion off]") +
+                                  " (" + std::to_string(mPortalTexels / 1024) + "K texels, pool " + std::to_string(mPortalTargets.MemoryUsed() >> 20) + "MB)" +
+                                  ", Binds (issued/skipped): " + std::to_string(mBindsIssued) + "/" + std::to_string(mBindsSkipped) +
+                                  ", Draws (calls/models): " + std::to_string(mDrawCalls) + "/" + std::to_string(mModelsDrawn) +
+                                  (mDrawQueue.Instancing() ? "" : " [instancing off]") +
+                                  ", Submit: " + submitTime.str() + "ms (" + std::to_string(mConstantUploads) + " constant uploads)" +
+                                  (mDrawQueue.ConstantArena() ? "" : " [constant arena off]") +
+                                  ", Shadow Maps (tile:rendered/skipped): " + shadowMapCounts.str() + (mShadowMapCaching ? "" : " [caching off]") +
+                                  ", Lights (point/spot): " + std::to_string(mPointLightData.size()) + "/" + std::to_string(mSpotlightData.size()) +
+                                  " binned in " + clusterTime.str() + "ms (" + std::to_string(mLightClusters.NumLightIndices()) +
+                                  " in clusters, most " + std::to_string(mLightClusters.MaxLightsInCluster()) + ")" +
+                                  ", Asset Load: " + std::to_string(static_cast<int>(mAssetLoadTime * 1000 + 0.5f)) + "ms (" +
+                                  std::to_string(mMeshesFromCache) + "/" + std::to_string(mMeshes.size() + 2) + " cooked)" +
+                                  ", Scene Build: " + std::to_string(static_cast<int>(mSceneBuildTime * 1000 + 0.5f)) + "ms";
         SetWindowTextA(gHWnd, windowTitle.c_str());
         totalFrameTime = 0;
         frameCount = 0;
     }
 }
 
-void CSceneManager::NewModel(EMeshType meshIndex, std::vector<ETextureType> textureIndexes, CVector3 position, float scale, CVector3 rotation, float wiggleStrength, EPixelShaders shaderType)
+Model CSceneManager::CreateModel(const SSceneModel& model)
 {
-	std::vector<CTexture*> textures;
-	for (auto &index : textureIndexes)
-	{
-		textures.push_back(&mTextures[index]);
-	}
+	CTexture* texture0 = (model.textures[0] != NoSceneTexture) ? &mTextures[model.textures[0]] : nullptr;
+	CTexture* texture1 = (model.textures[1] != NoSceneTexture) ? &mTextures[model.textures[1]] : nullptr;
+	Model newModel(mMeshes[model.mesh], { texture0, texture1 }, model.position, model.rotation, model.scale);
+	newModel.SetWiggleStrength(model.wiggleStrength);
+	return newModel;
+}
+
+void CSceneManager::NewModel(const SSceneModel& model)
+{
+	// Moved into its pool below, so the pool's model keeps this transform rather than a copy adding another
+	Model newModel = CreateModel(model);
+
+	EPixelShaders shaderType = sMaterialShaders[static_cast<int>(model.material)];
 	if (shaderType == ps_Transparent)
 	{
-		mTransparentModels.push_back(new Model(mMeshArray[meshIndex], textures, position, rotation, scale));
+		mTransparentModels.Add(std::move(newModel));
+		return; // Can't occlude anything
 	}
-	if (shaderType < gsNumOfModelPS)
+
+	CModelPool* pool = (model.flags & SceneModel_TwoSided) ? &mTeapotCollection[shaderType] : &mModelCollection[shaderType];
+	SModelHandle handle = pool->Add(std::move(newModel));
+	if (model.flags & SceneModel_Occluder)
 	{
-		if (meshIndex == EMeshType::Mesh_Teapot)
-		{
-			mTeapotCollection[shaderType].push_back(new Model(mMeshArray[meshIndex], textures, position, rotation, scale));
-			mTeapotCollection[shaderType].back()->SetWiggleStrength(wiggleStrength);
-		}
-		else if (meshIndex < EMeshType::Mesh_Portal)
-		{
-			mModelCollection[shaderType].push_back(new Model(mMeshArray[meshIndex], textures, position, rotation, scale));
-			mModelCollection[shaderType].back()->SetWiggleStrength(wiggleStrength);
-		}
+		mOccluders.push_back({ pool, handle, !(model.flags & SceneModel_TwoSided) });
 	}
 }
 
@@ -806,8 +1202,67 @@ void CSceneManager::NewLight(const ELightType & type, Mesh* mesh, const CVector3
 	}
 }
 
-void CSceneManager::NewPortal(CVector3 position, CVector3 rotation)
+void CSceneManager::NewPortal(CVector3 position, CVector3 rotation, unsigned int updateInterval)
 {
-	mPortalCollection.push_back(new CPortal(mMeshArray[Mesh_Portal], position, rotation));
-	mPortalCollection.back()->CreateTexture(mPortalDesc, mPortalSRDesc);
-}
\ No newline at end of file
+	mPortalCollection.push_back(new CPortal(mPortalMesh, position, rotation));
+	mPortalCollection.back()->SetUpdateInterval(updateInterval);
+}
+
+void CSceneManager::AddCrateYard(unsigned int numCrates)
+{
+	// Uses the scene's crate mesh and texture, so does nothing if the scene file doesn't have them
+	int crateMesh = mSceneFile.FindMesh("Crate");
+	int cargoTexture = mSceneFile.FindTexture("Cargo");
+	if (crateMesh < 0 || cargoTexture < 0)  return;
+
+	SSceneModel crateModel = {};
+	crateModel.mesh = crateMesh;
+	crateModel.textures[0] = cargoTexture;
+	crateModel.textures[1] = NoSceneTexture;
+	crateModel.rotation = { 0, 0, 0 };
+	crateModel.scale = 1;
+	crateModel.material = ESceneMaterial::PixelLighting;
+
+	// Space the crates a little more than their largest horizontal size apart so they don't overlap at any rotation
+	Mesh* crate = mMeshes[crateMesh];
+	CVector3 size = crate->BoundsMax() - crate->BoundsMin();
+	float spacing = (size.x > size.z ? size.x : size.z) * 1.5f;
+
+	unsigned int rowLength = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(numCrates))));
+	CVector3 corner = { -0.5f * rowLength * spacing, 0, 200 };
+	mModelCollection[ps_PixelLighting].Reserve(mModelCollection[ps_PixelLighting].Size() + numCrates);
+	for (unsigned int i = 0; i < numCrates; ++i)
+	{
+		crateModel.position = corner + CVector3{ (i % rowLength) * spacing, 0, (i / rowLength) * spacing };
+		NewModel(crateModel);
+	}
+}
+
+
+void CSceneManager::AddLightField(unsigned int numPointLights, unsigned int numSpotlights)
+{
+	// A few colours are reused so the light models can still be drawn instanced
+	const CVector3 colours[] = { { 1.0f, 0.3f, 0.2f }, { 0.2f, 1.0f, 0.3f }, { 0.3f, 0.4f, 1.0f }, { 1.0f, 0.9f, 0.3f },
+	                             { 0.9f, 0.3f, 1.0f }, { 0.3f, 1.0f, 1.0f } };
+	const unsigned int numColours = sizeof(colours) / sizeof(colours[0]);
+	const float fieldSize = 240.0f;
+
+	// Weak point lights close to the ground, so each only reaches a few clusters
+	unsigned int rowLength = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(numPointLights))));
+	float spacing = fieldSize / rowLength;
+	for (unsigned int i = 0; i < numPointLights; ++i)
+	{
+		CVector3 position = { -0.5f * fieldSize + (i % rowLength + 0.5f) * spacing, 4, -0.5f * fieldSize + (i / rowLength + 0.5f) * spacing };
+		NewLight(ELightType::point, mLightMesh, colours[i % numColours], position, 0.5f);
+	}
+
+	// Spotlights pointing down from higher up, slightly off vertical so they have a well defined orientation
+	rowLength = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(numSpotlights))));
+	spacing = fieldSize / rowLength;
+	for (unsigned int i = 0; i < numSpotlights; ++i)
+	{
+		CVector3 position = { -0.5f * fieldSize + (i % rowLength + 0.5f) * spacing, 40, -0.5f * fieldSize + (i / rowLength + 0.5f) * spacing };
+		NewLight(ELightType::spotlight, mLightMesh, colours[i % numColours], position, 1.5f,
+		         position + CVector3{ 0, -40, 5 }, 50);
+	}
+}
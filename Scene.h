@@ -6,6 +6,7 @@
 
 #include "Mesh.h"
 #include "Model.h"
+#include "ModelPool.h"
 #include "Camera.h"
 #include "Shader.h"
 #include "Input.h"
@@ -13,6 +14,15 @@
 #include "CLight.h"
 #include "CTexture.h"
 #include "CPortal.h"
+#include "DrawQueue.h"
+#include "ShadowAtlas.h"
+#include "LightClusters.h"
+#include "OcclusionBuffer.h"
+#include "PortalTargets.h"
+#include "SceneFile.h"
+#include "TransformSystem.h"
+#include "ThreadPool.h"
+#include "Timer.h"
 
 #include "CVector2.h" 
 #include "CVector3.h" 
@@ -26,6 +36,7 @@
 #include <memory>
 #include <vector>
 #include <array>
+#include <cstdint>
 
 #ifndef _SCENE_H_INCLUDED_
 #define _SCENE_H_INCLUDED_
@@ -37,47 +48,6 @@
 class CSceneManager
 {
 private:
-	enum EMeshType
-	{
-		Mesh_Troll,
-		Mesh_Cube,
-		Mesh_CubeTangent, //Cube mesh with tangets. Loading with tangents normally causes problems for other shaders.
-		Mesh_Decal,
-		Mesh_Crate,
-		Mesh_Sphere,
-		Mesh_SphereTangent, //Sphere mesh with tangets. Loading with tangents normally causes problems for other shaders.
-		Mesh_Ground,
-		Mesh_Light,
-		Mesh_Teapot,
-		Mesh_Portal,
-	};
-	enum ETextureType
-	{
-		TrollTexture,
-		StoneTexture,
-		BrickTexture,
-		MoogleTexture,
-		CargoTexture,
-		WoodTexture,
-		WoodNormal,
-		GrassTexture,
-		MetalTexture,
-		MetalNormal,
-		PatternTexture,
-		PatternNormalH,
-		BrainTexture,
-		BrainNormalH,
-		CobbleTexture,
-		CobbleNormalH,
-		TechTexture,
-		TechNormalH,
-		WallTexture,
-		WallNormalH,
-		TVTexture,
-		FlareTexture,
-		GlassTexture,
-		NumOfTextures
-	};
 	enum EVertexShaders
 	{
 		//Pixel lit models
@@ -87,6 +57,11 @@ private:
 		//Unique usages
 		vs_BasicTransform,
 		vs_WiggleTangent,
+		vs_ShadowTileClear,
+		//Instanced versions, which take the world matrix from per-instance data (see DrawQueue)
+		vs_PixelLightingInstanced,
+		vs_NormalMapInstanced,
+		vs_BasicTransformInstanced,
 		NumVertexShaders,
 	};
 	enum EPixelShaders
@@ -109,22 +84,28 @@ private:
 	};
 	enum EMaxGroupSizes //Used to declare constant sizes of groups that don't match the number of type enums for that group (EG, mesh).
 	{
-		gsNumOfMesh = Mesh_Portal + 1,
 		gsNumOfModelPS = NumPSInCollections, //Not including portals.
-		gsNumSpotlights = 4,
-		gsNumPointLights = 3,
+		gsNumSpotlights = 64,
+		gsNumPointLights = 1024,
 		gsNumDirectionalLights = 1,
 
 	};
 
-	// Constants controlling speed of movement/rotation (measured in units per second because we're using frame time)
-	//Meshes for all models.
-	Mesh* mMeshArray[gsNumOfMesh];
+	//The scene file the scene is built from, kept so its mesh and texture names can be looked up (e.g. for the stress tests)
+	CSceneFile mSceneFile;
+	std::string mSceneFileName = "Default.scene";
+
+	//Meshes for all models, in the order the scene file lists them. The light and portal meshes are part of the
+	//engine rather than the scene so are loaded separately
+	std::vector<Mesh*> mMeshes;
+	Mesh* mLightMesh = nullptr;
+	Mesh* mPortalMesh = nullptr;
 
 	//Collections of objects.
-	std::vector<Model*> mModelCollection[gsNumOfModelPS]; //Jagged array. Not including portals (Handled seperately). Sorted according to shaders used.
-	std::vector<Model*> mTeapotCollection[gsNumOfModelPS]; //Teapots handled seperately, because they require different culling. Sorted according to shaders used.
-	std::vector<Model*> mTransparentModels; //Models that use no culling
+	//Each collection holds its models contiguously, so a pass over a collection reads memory in order (see ModelPool.h)
+	CModelPool mModelCollection[gsNumOfModelPS]; //Not including portals (Handled seperately). Sorted according to shaders used.
+	CModelPool mTeapotCollection[gsNumOfModelPS]; //Teapots handled seperately, because they require different culling. Sorted according to shaders used.
+	CModelPool mTransparentModels; //Models that use no culling
 	std::vector<CPortal*> mPortalCollection;
 
 	//Light stack
@@ -133,33 +114,87 @@ private:
 	std::array<CLight*, gsNumDirectionalLights> mDirectionalLights;
 	CVector3 mLightStackTop = { 0, 0, 0 }; //Point, spot, direction
 
-	// Textures
-	CTexture mTextures[NumOfTextures]; //The default textures for each mesh. The portal texture is the texture around the portal.
+	//Clustered lighting. The shader data of every light is gathered each frame, then the lights are binned into the
+	//clusters of each camera's view so pixels only light themselves with nearby lights (see LightClusters.h)
+	std::vector<PointLight> mPointLightData;
+	std::vector<Spotlight>  mSpotlightData;
+	CLightClusters          mLightClusters;
+
+	// Textures, in the order the scene file lists them, then the engine's own: the flare drawn on light models and the portal frame
+	std::vector<CTexture> mTextures;
+	CTexture mFlareTexture;
+	CTexture mPortalFrameTexture;
 
-	//Texture data
-	int mPortalWidth = 1024;
-	int mPortalHeight = 1024;
+	//Portal textures are sized to the pixels each portal covers on screen, within this range (see PortalTargetSize)
+	unsigned int mPortalMinSize = 64;
+	unsigned int mPortalMaxSize = 1024;
+
+	//Portals seen by other portals are rendered too, up to this many levels below those the main camera sees, and the
+	//portal textures rendered each frame are limited to this many texels in total (see PlanPortals)
+	bool         mPortalRecursion = true;
+	unsigned int mPortalMaxDepth = 3;
+	size_t       mPortalTexelBudget = 2 * 1024 * 1024;
 
 	//Shadow mapping
-	int mShadowMapSize = 1024;
+	//Size of the shadow atlas and the range of tile sizes given to each spotlight. Shadows beyond the range are not
+	//considered when deciding whether a light's shadows are visible
+	unsigned int mShadowAtlasSize = 2048;
+	unsigned int mShadowTileMaxSize = 1024;
+	unsigned int mShadowTileMinSize = 128;
+	float        mShadowRange = 200.0f;
 
 	// Vertex and pixel shader DirectX objects
 	std::array<ID3D11VertexShader*, NumVertexShaders> mVertexShaders;
 	std::array<ID3D11PixelShader*, NumPixelShaders> mPixelShaders;
 
-	//These are populated as each type of light is created.
-	ID3D11Texture2D*          mShadowMapSpotlightTexture[gsNumSpotlights]; // This object represents the memory used by the texture on the GPU
-	ID3D11DepthStencilView*   mShadowMapSpotlightDepthStencil[gsNumSpotlights]; // This object is used when we want to render to the texture above **as a depth buffer**
-	ID3D11ShaderResourceView* mShadowMapSpotlightSRV[gsNumSpotlights]; // This object is used to give shaders access to the texture above (SRV = shader resource view)
+	//Shaders used by each model collection, and whether its models use a second texture (normal or height map)
+	//The instanced vertex shader is NumVertexShaders for collections that can't be instanced
+	struct SCollectionShaders
+	{
+		EVertexShaders vertexShader;
+		EPixelShaders pixelShader;
+		bool secondTexture;
+		EVertexShaders instancedVertexShader;
+	};
+	static const SCollectionShaders sCollectionShaders[gsNumOfModelPS];
+
+	//Pixel shader (and so model collection) of each scene file material
+	static const EPixelShaders sMaterialShaders[static_cast<int>(ESceneMaterial::NumMaterials)];
+
+	//Each render pass fills this queue, which sorts the draws and removes redundant state changes. Second textures use slot 5 (the shadow atlas is slot 1)
+	CDrawQueue mDrawQueue{ 5 };
+
+	//All spotlight shadow maps are tiles in this one texture. The tiles are handed out by the atlas packer each frame (see UpdateShadowAtlas)
+	ID3D11Texture2D*          mShadowAtlasTexture = nullptr; // This object represents the memory used by the texture on the GPU
+	ID3D11DepthStencilView*   mShadowAtlasDepthStencil = nullptr; // This object is used when we want to render to the texture above **as a depth buffer**
+	ID3D11ShaderResourceView* mShadowAtlasSRV = nullptr; // This object is used to give shaders access to the texture above (SRV = shader resource view)
+	CShadowAtlas              mShadowAtlas{ mShadowAtlasSize, mShadowTileMinSize };
+	SAtlasTile                mShadowTiles[gsNumSpotlights]; // Tile of each spotlight, invalid if the light has none
 	D3D11_TEXTURE2D_DESC mShadowMapTextureDesc = {};
 	D3D11_DEPTH_STENCIL_VIEW_DESC mShadowMapDsvDesc = {};
 	D3D11_SHADER_RESOURCE_VIEW_DESC mShadowMapSrvDesc = {};
 
-	//Portals
-	ID3D11Texture2D*        mPortalDepthStencil = nullptr; // This object represents the memory used by the texture on the GPU
-	ID3D11DepthStencilView* mPortalDepthStencilView = nullptr; // This object is used when we want to use the texture above as the depth buffer
-	D3D11_TEXTURE2D_DESC mPortalDesc = {};
-	D3D11_SHADER_RESOURCE_VIEW_DESC mPortalSRDesc = {};
+	//Version stamp of each shadow map's contents (see RenderDepthBufferFromLight), and how many times each has been rendered or skipped
+	bool         mShadowMapCaching = true;
+	uint64_t     mShadowMapStamps[gsNumSpotlights] = {};
+	unsigned int mShadowMapsRendered[gsNumSpotlights] = {};
+	unsigned int mShadowMapsSkipped[gsNumSpotlights] = {};
+
+	//Portals render into textures from this pool, with a shared depth buffer for each size
+	CPortalTargetPool mPortalTargets{ mPortalMinSize, mPortalMaxSize };
+
+	//How each portal is seen this frame, indexed like the portal collection, and the seen portals in the order found
+	struct SPortalView
+	{
+		static const unsigned int NotSeen = 0xffffffff;
+
+		float screenArea = 0;         // Largest fraction of the main screen it covers, through any portals it is seen in
+		float pixels = 0;             // Largest number of pixels its texture should have across
+		unsigned int depth = NotSeen; // Portal level it is first seen at, 0 for those the main camera sees
+		bool render = false;          // Rendered this frame
+	};
+	std::vector<SPortalView>  mPortalViews;
+	std::vector<unsigned int> mPortalOrder;
 
 	//Main camera for the scene
 	Camera* mCamera;
@@ -170,10 +205,58 @@ private:
 
 	ColourRGBA mBackgroundColor = { 0.2f, 0.2f, 0.3f, 1.0f };
 
+	//Frame statistics, shown in the window title
+	unsigned int mWorldMatrixRebuilds = 0; //Model world matrices rebuilt during the last frame
+	unsigned int mCulledShadow = 0; //Models skipped by frustum culling in the last frame, summed over all shadow map passes
+	unsigned int mCulledPortal = 0; //--"-- summed over all portal passes
+	unsigned int mCulledMain = 0;   //--"-- in the main camera pass
+	unsigned int mOccludedPortal = 0; //Models inside the frustum but hidden behind occluders, summed over all portal passes
+	unsigned int mOccludedMain = 0;   //--"-- in the main camera pass
+	unsigned int mPortalsRendered = 0; //Portal textures rendered in the last frame
+	unsigned int mPortalsSkipped = 0;  //Portals that kept their last texture, as they couldn't be seen, were barely visible or weren't due an update
+	unsigned int mPortalsOverBudget = 0; //Portals that needed an update but kept their last texture to stay within the texel budget
+	unsigned int mPortalLevels = 0;    //Portal levels rendered in the last frame
+	size_t       mPortalTexels = 0;    //Texels rendered into portal textures in the last frame
+	float mOcclusionTime = 0;         //Seconds spent rasterizing occluders in the last frame, over all passes
+	Timer mOcclusionTimer;
+	unsigned int mBindsIssued = 0;  //State binds made by the draw queue in the last frame
+	unsigned int mBindsSkipped = 0; //State binds the draw queue avoided in the last frame as the state was already set
+	unsigned int mDrawCalls = 0;    //Draw calls made in the last frame, each instanced draw covers several models
+	unsigned int mModelsDrawn = 0;  //Models drawn by those calls
+	unsigned int mConstantUploads = 0; //Per-model constant uploads in the last frame, one per pass with the constant arena
+	float mSubmitTime = 0;          //Seconds spent submitting the draw queue in the last frame, over all passes
+	float mTransformUpdateTime = 0; //Seconds spent rebuilding moved models' world matrices at the start of the last frame
+	Timer mTransformTimer;
+
+	//Worker threads for work split across cores each frame (e.g. rebuilding world matrices)
+	CThreadPool mWorkers;
+
+	//Start-up statistics
+	float mAssetLoadTime = 0;         //Seconds taken to load all meshes and textures
+	unsigned int mMeshesFromCache = 0; //Meshes loaded from the cooked mesh cache rather than imported
+	float mSceneBuildTime = 0;        //Seconds taken to create the scene's models, lights and portals from the scene file
+
 	// Variables controlling light1's orbiting of the cube
 	const float gLightOrbit = 20.0f;
 	const float gLightOrbitSpeed = 0.7f;
 
+	// Pivot at the teapot that the first spotlight is attached to. Orbiting the light is just turning the pivot
+	STransformHandle mLightOrbit;
+
+	// Occlusion culling: the models marked as occluders in the scene file are rasterized into an occlusion buffer
+	// for each camera pass, and other models hidden behind them are skipped (see OcclusionBuffer.h). The main
+	// camera's buffer is built before the portal passes, which use their own, so it can also cull whole portals
+	struct SOccluder
+	{
+		CModelPool*  pool;
+		SModelHandle model;
+		bool         cullBackFaces;
+	};
+	std::vector<SOccluder> mOccluders;
+	COcclusionBuffer mOcclusionBuffer;
+	COcclusionBuffer mPortalOcclusionBuffer;
+	bool mOcclusionCulling = true;
+
 	ID3D11SamplerState* gPointSampler = nullptr;
 	ID3D11SamplerState* gTrilinearSampler = nullptr;
 	ID3D11SamplerState* gAnisotropic4xSampler = nullptr;
@@ -189,14 +272,22 @@ private:
 	ID3D11DepthStencilState* gUseDepthBufferState = nullptr;
 	ID3D11DepthStencilState* gDepthReadOnlyState = nullptr;
 	ID3D11DepthStencilState* gNoDepthBufferState = nullptr;
+	ID3D11DepthStencilState* gOverwriteDepthState = nullptr;
 public:
 	//--------------------------------------------------------------------------------------
 	// Scenery Management
 	//--------------------------------------------------------------------------------------
-	//Adds a new model to the model collection. The model collection is used for generic, unimportant models.
-	void NewModel(EMeshType meshIndex, std::vector<ETextureType> textureIndexes, CVector3 position = { 0,0,0 }, float scale = 1, 
-				  CVector3 rotation = { 0,0,0 }, float wiggleStrength = 0, EPixelShaders shaderType = ps_PixelLighting);
-	void NewPortal(CVector3 position = { 0,0,0 }, CVector3 rotation = { 0,0,0 });
+	//Adds a new model to the collection for its material. Mesh and texture indexes are positions in the scene file's lists
+	void NewModel(const SSceneModel& model);
+	//Makes a model from its scene file description without adding it to the scene
+	Model CreateModel(const SSceneModel& model);
+	void NewPortal(CVector3 position = { 0,0,0 }, CVector3 rotation = { 0,0,0 }, unsigned int updateInterval = 1);
+
+	//Stress test for instancing: adds a square grid of identical crates beyond the far side of the scene
+	void AddCrateYard(unsigned int numCrates);
+
+	//Stress test for clustered lighting: adds a grid of small point lights over the scene, and a coarser grid of spotlights above them
+	void AddLightField(unsigned int numPointLights, unsigned int numSpotlights);
 
 	//Light factory
 	void NewLight(const ELightType & type, Mesh* mesh, const CVector3 &colour, const CVector3 &position, const float &strength, 
@@ -223,8 +314,21 @@ public:
 	//--------------------------------------------------------------------------------------
 	// Scene Render and Update
 	//--------------------------------------------------------------------------------------
-	void RenderDepthBufferFromLight(const CSpotlight &light);
-	void RenderSceneFromCamera(Camera* camera);
+	//Both render passes skip models outside the view frustum and return the number of models skipped
+	//The light pass renders the given spotlight's shadow map, unless nothing the light can see has changed
+	unsigned int RenderDepthBufferFromLight(unsigned int spotlight);
+	//Choose the size of each spotlight's tile in the shadow atlas from its importance on screen, and reallocate tiles as needed
+	void UpdateShadowAtlas();
+	//The camera pass also skips models hidden behind the occluders in the given occlusion buffer (if not null), which
+	//must have been built for the camera. Returns how many were hidden in occluded
+	//If the camera is a portal's, that portal is given as the target portal, as its own texture can't be read while rendering it
+	unsigned int RenderSceneFromCamera(Camera* camera, COcclusionBuffer* occlusionBuffer, unsigned int& occluded, CPortal* targetPortal = nullptr);
+	//Find the portals seen this frame, directly or through other portals, filling in mPortalViews and mPortalOrder
+	void PlanPortals(COcclusionBuffer* mainOcclusion);
+	//Size of render target to give a portal whose texture should be the given number of pixels across
+	unsigned int PortalTargetSize(CPortal* portal, float pixels);
+	//Rasterize the occluders the camera can see into the given occlusion buffer
+	void BuildOcclusionBuffer(COcclusionBuffer& occlusionBuffer, Camera* camera);
 	void RenderScene();
 
 	// frameTime is the time passed since the last frame
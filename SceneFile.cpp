@@ -0,0 +1,620 @@
+//--------------------------------------------------------------------------------------
+// Scene description files
+//--------------------------------------------------------------------------------------
+
+#include "SceneFile.h"
+#include "MathHelpers.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+
+//--------------------------------------------------------------------------------------
+// Binary file format
+//--------------------------------------------------------------------------------------
+// The header, then the mesh and texture tables, then the string table (padded to a multiple of 4 bytes), then the
+// model, light and portal records
+
+static const uint32_t SCENE_FILE_ID      = 0x454e4353; // "SCNE"
+static const uint32_t SCENE_FILE_VERSION = 2;          // Increase when the format changes
+
+struct SSceneFileHeader
+{
+    uint32_t id;
+    uint32_t version;
+    uint32_t numMeshes;
+    uint32_t numTextures;
+    uint32_t numModels;
+    uint32_t numLights;
+    uint32_t numPortals;
+    uint32_t stringBytes;       // Size of the string table, including padding
+
+    float    cameraPosition[3];
+    float    cameraRotation[3];
+};
+static_assert(sizeof(SSceneFileHeader) == 56, "Scene file header must have no padding");
+
+// A mesh or texture. The names are offsets into the string table
+struct SSceneFileAsset
+{
+    uint32_t name;
+    uint32_t fileName;
+    uint32_t flags;             // 1 if the mesh requires tangents
+};
+static_assert(sizeof(SSceneFileAsset) == 12, "Scene file asset must have no padding");
+
+// The model, light and portal records are written as they are in memory
+static_assert(sizeof(SSceneModel)  == 48, "Scene model must have no padding");
+static_assert(sizeof(SSceneLight)  == 48, "Scene light must have no padding");
+static_assert(sizeof(SScenePortal) == 28, "Scene portal must have no padding");
+
+
+const char* SceneMaterialName(ESceneMaterial material)
+{
+    static const char* names[] =
+    {
+        "PixelLighting", "Wiggle", "NormalMap", "ParallaxMap", "Fade", "WiggleParallax", "Transparent"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == static_cast<int>(ESceneMaterial::NumMaterials), "Material name missing");
+
+    return names[static_cast<int>(material)];
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Loading
+//--------------------------------------------------------------------------------------
+
+bool CSceneFile::Load(const std::string& fileName)
+{
+    Clear();
+    mError.clear();
+
+    std::ifstream file(fileName, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        mError = "Cannot open scene file " + fileName;
+        return false;
+    }
+    std::streamoff fileSize = file.tellg();
+    std::vector<char> fileData(static_cast<size_t>(fileSize > 0 ? fileSize : 0));
+    file.seekg(0, std::ios::beg);
+    file.read(fileData.data(), fileSize);
+    if (file.fail())
+    {
+        mError = "Error reading scene file " + fileName;
+        return false;
+    }
+
+    uint32_t id = 0;
+    if (fileData.size() >= sizeof(id))  std::memcpy(&id, fileData.data(), sizeof(id));
+    bool loaded = (id == SCENE_FILE_ID) ? LoadBinary(fileData) : LoadText(fileData);
+    if (!loaded)
+    {
+        mError = fileName + ": " + mError;
+        Clear();
+    }
+    return loaded;
+}
+
+
+// Splits a line of a text scene file into words and reads values from them. Each read sets the error flag if the
+// next word is missing or isn't a value of the right type
+class CSceneLineReader
+{
+public:
+    CSceneLineReader(const char* line, const char* end) : mPosition(line), mEnd(end) {}
+
+    // Returns false at the end of the line (or at a comment)
+    bool Next(std::string& word)
+    {
+        while (mPosition < mEnd && (*mPosition == ' ' || *mPosition == '\t' || *mPosition == '\r'))  ++mPosition;
+        if (mPosition == mEnd || *mPosition == '#')  return false;
+
+        const char* start = mPosition;
+        while (mPosition < mEnd && *mPosition != ' ' && *mPosition != '\t' && *mPosition != '\r' && *mPosition != '#')  ++mPosition;
+        word.assign(start, mPosition);
+        return true;
+    }
+
+    float Float()
+    {
+        std::string word;
+        if (!Next(word))  { mFailed = true;  return 0; }
+        char* wordEnd;
+        float value = std::strtof(word.c_str(), &wordEnd);
+        if (*wordEnd != '\0')  mFailed = true;
+        return value;
+    }
+
+    CVector3 Vector()
+    {
+        float x = Float();
+        float y = Float();
+        float z = Float();
+        return { x, y, z };
+    }
+
+    CVector3 Angles()
+    {
+        CVector3 degrees = Vector();
+        return { ToRadians(degrees.x), ToRadians(degrees.y), ToRadians(degrees.z) };
+    }
+
+    bool Failed()  { return mFailed; }
+
+private:
+    const char* mPosition;
+    const char* mEnd;
+    bool        mFailed = false;
+};
+
+
+// Lines are read in a single pass. Names are looked up in a map built as the meshes and textures are listed
+bool CSceneFile::LoadText(const std::vector<char>& fileData)
+{
+    std::vector<std::pair<std::string, uint32_t>> meshNames;
+    std::vector<std::pair<std::string, uint32_t>> textureNames;
+    auto findName = [](const std::vector<std::pair<std::string, uint32_t>>& names, const std::string& name) -> uint32_t
+    {
+        for (auto& entry : names)
+        {
+            if (entry.first == name)  return entry.second;
+        }
+        return NoSceneTexture;
+    };
+
+    // Models are by far the most common item, so guess how many there are from the file size to avoid reallocating
+    mModels.reserve(fileData.size() / 64);
+
+    const char* position = fileData.data();
+    const char* fileEnd  = position + fileData.size();
+    unsigned int lineNumber = 0;
+    while (position < fileEnd)
+    {
+        const char* lineEnd = static_cast<const char*>(std::memchr(position, '\n', fileEnd - position));
+        if (lineEnd == nullptr)  lineEnd = fileEnd;
+        ++lineNumber;
+
+        CSceneLineReader reader(position, lineEnd);
+        position = lineEnd + 1;
+
+        std::string item, word;
+        if (!reader.Next(item))  continue; // Blank line or comment
+        std::string lineError;
+
+        if (item == "mesh" || item == "texture")
+        {
+            std::string name, fileName;
+            if (!reader.Next(name) || !reader.Next(fileName))
+            {
+                lineError = "expected a name and a file name";
+            }
+            else if (item == "mesh")
+            {
+                SSceneMesh mesh;
+                mesh.name = name;
+                mesh.fileName = fileName;
+                while (reader.Next(word))
+                {
+                    if (word == "tangents")  mesh.requireTangents = true;
+                    else                     lineError = "unknown mesh option " + word;
+                }
+                meshNames.push_back({ name, static_cast<uint32_t>(mMeshes.size()) });
+                mMeshes.push_back(mesh);
+            }
+            else
+            {
+                textureNames.push_back({ name, static_cast<uint32_t>(mTextures.size()) });
+                mTextures.push_back({ name, fileName });
+            }
+        }
+        else if (item == "model")
+        {
+            SSceneModel model = {};
+            model.textures[0] = model.textures[1] = NoSceneTexture;
+            model.position = { 0, 0, 0 };
+            model.rotation = { 0, 0, 0 };
+            model.scale = 1;
+            model.material = ESceneMaterial::PixelLighting;
+
+            // Mesh name, then one or two texture names before the options
+            if (!reader.Next(word) || (model.mesh = findName(meshNames, word)) == NoSceneTexture)
+            {
+                lineError = "unknown mesh " + word;
+            }
+            unsigned int numTextures = 0;
+            while (lineError.empty() && reader.Next(word))
+            {
+                if      (word == "material")
+                {
+                    std::string material;
+                    reader.Next(material);
+                    int m = 0;
+                    while (m < static_cast<int>(ESceneMaterial::NumMaterials) && material != SceneMaterialName(static_cast<ESceneMaterial>(m)))  ++m;
+                    if (m == static_cast<int>(ESceneMaterial::NumMaterials))  lineError = "unknown material " + material;
+                    model.material = static_cast<ESceneMaterial>(m);
+                }
+                else if (word == "position")  model.position = reader.Vector();
+                else if (word == "rotation")  model.rotation = reader.Angles();
+                else if (word == "scale")     model.scale = reader.Float();
+                else if (word == "wiggle")    model.wiggleStrength = reader.Float();
+                else if (word == "twosided")  model.flags |= SceneModel_TwoSided;
+                else if (word == "occluder")  model.flags |= SceneModel_Occluder;
+                else if (numTextures < 2 && (model.textures[numTextures] = findName(textureNames, word)) != NoSceneTexture)  ++numTextures;
+                else lineError = "unknown texture or model option " + word;
+            }
+            if (lineError.empty() && numTextures == 0)  lineError = "model has no texture";
+            mModels.push_back(model);
+        }
+        else if (item == "light")
+        {
+            SSceneLight light = {};
+            light.colour = { 1, 1, 1 };
+            light.position = { 0, 0, 0 };
+            light.facing = { 0, 0, 1 };
+            light.strength = 10;
+            light.coneAngle = 90;
+
+            reader.Next(word);
+            if      (word == "point")  light.type = ESceneLightType::Point;
+            else if (word == "spot")   light.type = ESceneLightType::Spot;
+            else lineError = "unknown light type " + word;
+
+            while (lineError.empty() && reader.Next(word))
+            {
+                if      (word == "colour")    light.colour = reader.Vector();
+                else if (word == "position")  light.position = reader.Vector();
+                else if (word == "strength")  light.strength = reader.Float();
+                else if (word == "facing")    light.facing = reader.Vector();
+                else if (word == "cone")      light.coneAngle = reader.Float();
+                else lineError = "unknown light option " + word;
+            }
+            mLights.push_back(light);
+        }
+        else if (item == "portal" || item == "camera")
+        {
+            CVector3 itemPosition = { 0, 0, 0 };
+            CVector3 itemRotation = { 0, 0, 0 };
+            uint32_t updateInterval = 1;
+            while (lineError.empty() && reader.Next(word))
+            {
+                if      (word == "position")  itemPosition = reader.Vector();
+                else if (word == "rotation")  itemRotation = reader.Angles();
+                else if (word == "update" && item == "portal")
+                {
+                    std::string interval;
+                    if (!reader.Next(interval))  lineError = "missing portal update interval";
+                    else if (interval == "ondemand")  updateInterval = ScenePortal_OnDemand;
+                    else
+                    {
+                        char* intervalEnd;
+                        updateInterval = std::strtoul(interval.c_str(), &intervalEnd, 10);
+                        if (*intervalEnd != '\0' || updateInterval == 0)  lineError = "bad portal update interval " + interval;
+                    }
+                }
+                else lineError = "unknown " + item + " option " + word;
+            }
+            if (item == "portal")
+            {
+                mPortals.push_back({ itemPosition, itemRotation, updateInterval });
+            }
+            else
+            {
+                mCameraPosition = itemPosition;
+                mCameraRotation = itemRotation;
+            }
+        }
+        else
+        {
+            lineError = "unknown item " + item;
+        }
+
+        if (lineError.empty() && reader.Failed())  lineError = "missing or bad number";
+        if (!lineError.empty())
+        {
+            mError = "line " + std::to_string(lineNumber) + ": " + lineError;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Every count in the header is checked against the file size before anything is read, and every index and string
+// offset is checked before use, so a damaged file can't cause reads outside the data
+bool CSceneFile::LoadBinary(const std::vector<char>& fileData)
+{
+    if (fileData.size() < sizeof(SSceneFileHeader))
+    {
+        mError = "file is too short";
+        return false;
+    }
+    SSceneFileHeader header;
+    std::memcpy(&header, fileData.data(), sizeof(header));
+    if (header.version != SCENE_FILE_VERSION)
+    {
+        mError = "unsupported scene file version " + std::to_string(header.version);
+        return false;
+    }
+
+    uint64_t expectedSize = sizeof(SSceneFileHeader) +
+                            (static_cast<uint64_t>(header.numMeshes) + header.numTextures) * sizeof(SSceneFileAsset) +
+                            header.stringBytes + static_cast<uint64_t>(header.numModels) * sizeof(SSceneModel) +
+                            static_cast<uint64_t>(header.numLights) * sizeof(SSceneLight) +
+                            static_cast<uint64_t>(header.numPortals) * sizeof(SScenePortal);
+    if (expectedSize != fileData.size())
+    {
+        mError = "file size does not match its header";
+        return false;
+    }
+
+    const char* data = fileData.data() + sizeof(SSceneFileHeader);
+    const SSceneFileAsset* assets = reinterpret_cast<const SSceneFileAsset*>(data);
+    data += (header.numMeshes + header.numTextures) * sizeof(SSceneFileAsset);
+    const char* strings = data;
+    data += header.stringBytes;
+
+    // Strings must start inside the table and be terminated before its end
+    bool stringsValid = (header.stringBytes == 0 || strings[header.stringBytes - 1] == '\0');
+    auto getString = [&](uint32_t offset) -> const char*
+    {
+        if (offset >= header.stringBytes)  { stringsValid = false;  return ""; }
+        return strings + offset;
+    };
+
+    mMeshes.resize(header.numMeshes);
+    for (uint32_t i = 0; i < header.numMeshes && stringsValid; ++i)
+    {
+        mMeshes[i].name            = getString(assets[i].name);
+        mMeshes[i].fileName        = getString(assets[i].fileName);
+        mMeshes[i].requireTangents = (assets[i].flags & 1) != 0;
+    }
+    assets += header.numMeshes;
+    mTextures.resize(header.numTextures);
+    for (uint32_t i = 0; i < header.numTextures && stringsValid; ++i)
+    {
+        mTextures[i].name     = getString(assets[i].name);
+        mTextures[i].fileName = getString(assets[i].fileName);
+    }
+    if (!stringsValid)
+    {
+        mError = "damaged string table";
+        return false;
+    }
+
+    // The records are copied straight into the lists
+    mModels.resize(header.numModels);
+    std::memcpy(mModels.data(), data, mModels.size() * sizeof(SSceneModel));
+    data += mModels.size() * sizeof(SSceneModel);
+    mLights.resize(header.numLights);
+    std::memcpy(mLights.data(), data, mLights.size() * sizeof(SSceneLight));
+    data += mLights.size() * sizeof(SSceneLight);
+    mPortals.resize(header.numPortals);
+    std::memcpy(mPortals.data(), data, mPortals.size() * sizeof(SScenePortal));
+
+    for (auto& model : mModels)
+    {
+        if (model.mesh >= header.numMeshes ||
+            (model.textures[0] >= header.numTextures && model.textures[0] != NoSceneTexture) ||
+            (model.textures[1] >= header.numTextures && model.textures[1] != NoSceneTexture) ||
+            model.material >= ESceneMaterial::NumMaterials)
+        {
+            mError = "model refers to a missing mesh, texture or material";
+            return false;
+        }
+    }
+
+    mCameraPosition = { header.cameraPosition[0], header.cameraPosition[1], header.cameraPosition[2] };
+    mCameraRotation = { header.cameraRotation[0], header.cameraRotation[1], header.cameraRotation[2] };
+    return true;
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Saving
+//--------------------------------------------------------------------------------------
+
+bool CSceneFile::SaveText(const std::string& fileName)
+{
+    std::ofstream file(fileName);
+    if (!file.is_open())
+    {
+        mError = "Cannot create scene file " + fileName;
+        return false;
+    }
+
+    // Enough digits that every float reads back the same. Angles are converted to degrees so may not
+    file << std::setprecision(9);
+    auto writeVector = [&](const CVector3& v)  { file << v.x << " " << v.y << " " << v.z; };
+    auto writeAngles = [&](const CVector3& v)  { writeVector({ ToDegrees(v.x), ToDegrees(v.y), ToDegrees(v.z) }); };
+
+    for (auto& mesh : mMeshes)
+    {
+        file << "mesh " << mesh.name << " " << mesh.fileName << (mesh.requireTangents ? " tangents" : "") << "\n";
+    }
+    for (auto& texture : mTextures)
+    {
+        file << "texture " << texture.name << " " << texture.fileName << "\n";
+    }
+
+    for (auto& model : mModels)
+    {
+        file << "model " << mMeshes[model.mesh].name;
+        for (auto texture : model.textures)
+        {
+            if (texture != NoSceneTexture)  file << " " << mTextures[texture].name;
+        }
+        file << " material " << SceneMaterialName(model.material) << " position ";
+        writeVector(model.position);
+        file << " rotation ";
+        writeAngles(model.rotation);
+        file << " scale " << model.scale << " wiggle " << model.wiggleStrength;
+        if (model.flags & SceneModel_TwoSided)  file << " twosided";
+        if (model.flags & SceneModel_Occluder)  file << " occluder";
+        file << "\n";
+    }
+
+    for (auto& light : mLights)
+    {
+        file << "light " << (light.type == ESceneLightType::Spot ? "spot" : "point") << " colour ";
+        writeVector(light.colour);
+        file << " position ";
+        writeVector(light.position);
+        file << " strength " << light.strength << " facing ";
+        writeVector(light.facing);
+        if (light.type == ESceneLightType::Spot)  file << " cone " << light.coneAngle;
+        file << "\n";
+    }
+
+    for (auto& portal : mPortals)
+    {
+        file << "portal position ";
+        writeVector(portal.position);
+        file << " rotation ";
+        writeAngles(portal.rotation);
+        if (portal.updateInterval == ScenePortal_OnDemand)  file << " update ondemand";
+        else                                                file << " update " << portal.updateInterval;
+        file << "\n";
+    }
+
+    file << "camera position ";
+    writeVector(mCameraPosition);
+    file << " rotation ";
+    writeAngles(mCameraRotation);
+    file << "\n";
+
+    if (file.fail())
+    {
+        mError = "Error writing scene file " + fileName;
+        return false;
+    }
+    return true;
+}
+
+
+bool CSceneFile::SaveBinary(const std::string& fileName)
+{
+    // Build the string table and the asset records that refer to it
+    std::string strings;
+    auto addString = [&](const std::string& s) -> uint32_t
+    {
+        uint32_t offset = static_cast<uint32_t>(strings.size());
+        strings.append(s.c_str(), s.size() + 1);
+        return offset;
+    };
+    std::vector<SSceneFileAsset> assets;
+    assets.reserve(mMeshes.size() + mTextures.size());
+    for (auto& mesh : mMeshes)
+    {
+        uint32_t name = addString(mesh.name);
+        assets.push_back({ name, addString(mesh.fileName), mesh.requireTangents ? 1u : 0u });
+    }
+    for (auto& texture : mTextures)
+    {
+        uint32_t name = addString(texture.name);
+        assets.push_back({ name, addString(texture.fileName), 0 });
+    }
+    strings.resize((strings.size() + 3) & ~3, '\0');
+
+    SSceneFileHeader header = {};
+    header.id          = SCENE_FILE_ID;
+    header.version     = SCENE_FILE_VERSION;
+    header.numMeshes   = static_cast<uint32_t>(mMeshes.size());
+    header.numTextures = static_cast<uint32_t>(mTextures.size());
+    header.numModels   = static_cast<uint32_t>(mModels.size());
+    header.numLights   = static_cast<uint32_t>(mLights.size());
+    header.numPortals  = static_cast<uint32_t>(mPortals.size());
+    header.stringBytes = static_cast<uint32_t>(strings.size());
+    std::memcpy(header.cameraPosition, &mCameraPosition, sizeof(header.cameraPosition));
+    std::memcpy(header.cameraRotation, &mCameraRotation, sizeof(header.cameraRotation));
+
+    std::ofstream file(fileName, std::ios::out | std::ios::binary);
+    if (!file.is_open())
+    {
+        mError = "Cannot create scene file " + fileName;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(assets.data()),  assets.size()   * sizeof(SSceneFileAsset));
+    file.write(strings.data(), strings.size());
+    file.write(reinterpret_cast<const char*>(mModels.data()),  mModels.size()  * sizeof(SSceneModel));
+    file.write(reinterpret_cast<const char*>(mLights.data()),  mLights.size()  * sizeof(SSceneLight));
+    file.write(reinterpret_cast<const char*>(mPortals.data()), mPortals.size() * sizeof(SScenePortal));
+    if (file.fail())
+    {
+        mError = "Error writing scene file " + fileName;
+        return false;
+    }
+    return true;
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Editing
+//--------------------------------------------------------------------------------------
+
+void CSceneFile::Clear()
+{
+    mMeshes.clear();
+    mTextures.clear();
+    mModels.clear();
+    mLights.clear();
+    mPortals.clear();
+    mCameraPosition = { 0, 0, 0 };
+    mCameraRotation = { 0, 0, 0 };
+}
+
+
+// Each generated model is a copy of one of the current models placed in its own cell of a grid, so models don't
+// overlap much as long as they are smaller than the cells
+void CSceneFile::GenerateSynthetic(unsigned int numModels, unsigned int seed /*= 1*/)
+{
+    if (mModels.empty())  return;
+    std::vector<SSceneModel> templates;
+    templates.swap(mModels);
+
+    const float cellSize = 20.0f;
+    unsigned int rowLength = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(numModels))));
+    float corner = -0.5f * rowLength * cellSize;
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    mModels.reserve(numModels);
+    for (unsigned int i = 0; i < numModels; ++i)
+    {
+        SSceneModel model = templates[random() % templates.size()];
+        model.position = { corner + ((i % rowLength) + 0.25f + 0.5f * unit(random)) * cellSize, 0,
+                           corner + ((i / rowLength) + 0.25f + 0.5f * unit(random)) * cellSize };
+        model.rotation = { 0, unit(random) * 2 * PI, 0 };
+        model.scale    = 0.5f + unit(random);
+        mModels.push_back(model);
+    }
+}
+
+
+int CSceneFile::FindMesh(const std::string& name)
+{
+    for (size_t i = 0; i < mMeshes.size(); ++i)
+    {
+        if (mMeshes[i].name == name)  return static_cast<int>(i);
+    }
+    return -1;
+}
+
+int CSceneFile::FindTexture(const std::string& name)
+{
+    for (size_t i = 0; i < mTextures.size(); ++i)
+    {
+        if (mTextures[i].name == name)  return static_cast<int>(i);
+    }
+    return -1;
+}
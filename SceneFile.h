@@ -0,0 +1,172 @@
+//--------------------------------------------------------------------------------------
+// Scene description files
+//--------------------------------------------------------------------------------------
+// A scene file lists everything the scene manager builds at start-up: the meshes and textures to load, the models
+// (mesh, textures, material and transform), the lights, the portals and the camera. Meshes and textures are referred
+// to by their index in the file, so the same asset can be shared by any number of models.
+//
+// There are two forms of the same data:
+// - Text, for authoring. One item per line, '#' starts a comment. Names are single words, angles are in degrees:
+//       mesh    <name> <file> [tangents]
+//       texture <name> <file>
+//       model   <mesh> <texture> [<texture>] [material <material>] [position x y z] [rotation x y z] [scale s]
+//               [wiggle w] [twosided] [occluder]
+//       light   point|spot [colour r g b] [position x y z] [strength s] [facing x y z] [cone degrees]
+//       portal  [position x y z] [rotation x y z] [update frames|ondemand]
+//       camera  [position x y z] [rotation x y z]
+//   Meshes and textures must be listed before the models that use them. Materials are named after their pixel
+//   shader (see SceneMaterialName). Two-sided models are drawn without back face culling (e.g. the teapot, which has holes)
+//   Occluders are large models that hide others, rasterized for occlusion culling (see OcclusionBuffer.h)
+//   Portals update their texture every frame by default, every given number of frames, or only when asked to
+// - Binary, for shipping. A header with the item counts, a string table for the names and file names, then each
+//   list of items as fixed size records. The records are the in-memory structures below, so loading is one file read
+//   and a copy of each list.
+// Load accepts either form, telling them apart from the first bytes of the file.
+
+#ifndef _SCENE_FILE_H_INCLUDED_
+#define _SCENE_FILE_H_INCLUDED_
+
+#include "CVector3.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// Shader set used to draw a model, the scene manager maps these to its model collections
+enum class ESceneMaterial : uint8_t
+{
+    PixelLighting,
+    Wiggle,
+    NormalMap,
+    ParallaxMap,
+    Fade,
+    WiggleParallax,
+    Transparent,
+    NumMaterials
+};
+
+// Name of a material as written in text scene files
+const char* SceneMaterialName(ESceneMaterial material);
+
+
+enum class ESceneLightType : uint8_t
+{
+    Point,
+    Spot,
+};
+
+
+struct SSceneMesh
+{
+    std::string name;
+    std::string fileName;
+    bool        requireTangents = false; // For normal and parallax mapping
+};
+
+struct SSceneTexture
+{
+    std::string name;
+    std::string fileName;
+};
+
+// Texture index meaning the model has no texture in that slot
+static const uint32_t NoSceneTexture = 0xffffffff;
+
+// Model flags
+static const uint8_t SceneModel_TwoSided = 1;
+static const uint8_t SceneModel_Occluder = 2;
+
+struct SSceneModel
+{
+    uint32_t       mesh;           // Index into the mesh list
+    uint32_t       textures[2];    // Indexes into the texture list, the second is usually a normal or height map
+    CVector3       position;
+    CVector3       rotation;       // Radians
+    float          scale;
+    float          wiggleStrength;
+    ESceneMaterial material;
+    uint8_t        flags;
+    uint8_t        padding[2];
+};
+
+struct SSceneLight
+{
+    ESceneLightType type;
+    uint8_t         padding[3];
+    CVector3        colour;
+    CVector3        position;
+    CVector3        facing;        // Point the light faces towards
+    float           strength;
+    float           coneAngle;     // Degrees, spotlights only
+};
+
+// Portal update interval meaning the portal is only updated when asked to (see CPortal)
+static const uint32_t ScenePortal_OnDemand = 0;
+
+struct SScenePortal
+{
+    CVector3 position;
+    CVector3 rotation;             // Radians
+    uint32_t updateInterval;       // Frames between updates of the portal's texture, or ScenePortal_OnDemand
+};
+
+
+class CSceneFile
+{
+public:
+    // Load a text or binary scene file, replacing the current contents. Returns false on failure, with the reason
+    // (and line number for text files) in Error
+    bool Load(const std::string& fileName);
+
+    // Save the contents in either form. Returns false on failure
+    bool SaveText(const std::string& fileName);
+    bool SaveBinary(const std::string& fileName);
+
+    // Replace the models with numModels copies of the current models, each given a random position (on a square
+    // grid of cells around the origin), rotation and scale. The lights, portals and camera are left alone. Used to
+    // generate very large scenes to profile loading and rendering
+    void GenerateSynthetic(unsigned int numModels, unsigned int seed = 1);
+
+    // Remove everything
+    void Clear();
+
+    const std::string& Error()  { return mError; }
+
+
+    //-------------------------------------
+    // Contents
+    //-------------------------------------
+
+    std::vector<SSceneMesh>&    Meshes()    { return mMeshes;   }
+    std::vector<SSceneTexture>& Textures()  { return mTextures; }
+    std::vector<SSceneModel>&   Models()    { return mModels;   }
+    std::vector<SSceneLight>&   Lights()    { return mLights;   }
+    std::vector<SScenePortal>&  Portals()   { return mPortals;  }
+
+    // The camera's starting position and rotation (radians)
+    CVector3 CameraPosition()  { return mCameraPosition; }
+    CVector3 CameraRotation()  { return mCameraRotation; }
+
+    // Index of the mesh or texture with the given name, or -1 if there is none
+    int FindMesh(const std::string& name);
+    int FindTexture(const std::string& name);
+
+
+private:
+    bool LoadText(const std::vector<char>& fileData);
+    bool LoadBinary(const std::vector<char>& fileData);
+
+    std::vector<SSceneMesh>    mMeshes;
+    std::vector<SSceneTexture> mTextures;
+    std::vector<SSceneModel>   mModels;
+    std::vector<SSceneLight>   mLights;
+    std::vector<SScenePortal>  mPortals;
+    CVector3                   mCameraPosition = { 0, 0, 0 };
+    CVector3                   mCameraRotation = { 0, 0, 0 };
+
+    std::string mError;
+};
+
+
+#endif //_SCENE_FILE_H_INCLUDED_
@@ -6,7 +6,6 @@
 #include "Scene.h"
 #include <fstream>
 #include <vector>
-#include <d3dcompiler.h>
 
 //--------------------------------------------------------------------------------------
 // Shader creation / destruction
@@ -32,6 +31,10 @@ bool CSceneManager::LoadShaders()
 	mPixelShaders[ps_ParallaxMap]		= LoadPixelShader("ParallaxMapping_ps");
 	mPixelShaders[ps_Fade]				= LoadPixelShader("Fade_ps");
 	mPixelShaders[ps_Transparent]		= LoadPixelShader("TextureAlpha_ps");
+	mVertexShaders[vs_PixelLightingInstanced]	= LoadVertexShader("ShadowMappingInstanced_vs");
+	mVertexShaders[vs_NormalMapInstanced]		= LoadVertexShader("NormalMappingInstanced_vs");
+	mVertexShaders[vs_BasicTransformInstanced]	= LoadVertexShader("BasicTransformInstanced_vs");
+	mVertexShaders[vs_ShadowTileClear]			= LoadVertexShader("ShadowTileClear_vs");
 
 	for (auto &shader : mVertexShaders)
 	{
@@ -58,11 +61,11 @@ void CSceneManager::ReleaseShaders()
 {
 	for (auto &shader : mVertexShaders)
 	{
-		if (shader) shader->Release();
+		if (shader) gRenderDevice->Release(shader);
 	}
 	for (auto &shader : mPixelShaders)
 	{
-		if (shader) shader->Release();
+		if (shader) gRenderDevice->Release(shader);
 	}
 }
 
@@ -91,7 +94,7 @@ ID3D11VertexShader* LoadVertexShader(std::string shaderName)
 
     // Create shader object from loaded file (we will use the object later when rendering)
     ID3D11VertexShader* shader;
-    HRESULT hr = gD3DDevice->CreateVertexShader(byteCode.data(), byteCode.size(), nullptr, &shader);
+    HRESULT hr = gRenderDevice->CreateVertexShader(byteCode.data(), byteCode.size(), &shader);
     if (FAILED(hr))
     {
         return nullptr;
@@ -125,7 +128,7 @@ ID3D11PixelShader* LoadPixelShader(std::string shaderName)
 
     // Create shader object from loaded file (we will use the object later when rendering)
     ID3D11PixelShader* shader;
-    HRESULT hr = gD3DDevice->CreatePixelShader(byteCode.data(), byteCode.size(), nullptr, &shader);
+    HRESULT hr = gRenderDevice->CreatePixelShader(byteCode.data(), byteCode.size(), &shader);
     if (FAILED(hr))
     {
         return nullptr;
@@ -134,49 +137,6 @@ ID3D11PixelShader* LoadPixelShader(std::string shaderName)
     return shader;
 }
 
-// Very advanced topic: When creating a vertex layout for geometry (see Scene.cpp), you need the signature
-// (bytecode) of a shader that uses that vertex layout. This is an annoying requirement and tends to create
-// unnecessary coupling between shaders and vertex buffers.
-// This is a trick to simplify things - pass a vertex layout to this function and it will write and compile
-// a temporary shader to match. You don't need to know about the actual shaders in use in the app.
-// Release the signature (called a ID3DBlob!) after use. Returns nullptr on failure.
-ID3DBlob* CreateSignatureForVertexLayout(const D3D11_INPUT_ELEMENT_DESC vertexLayout[], int numElements)
-{
-    std::string shaderSource = "float4 main(";
-    for (int elt = 0; elt < numElements; ++elt)
-    {
-        auto& format = vertexLayout[elt].Format;
-        // This list should be more complete for production use
-        if      (format == DXGI_FORMAT_R32G32B32A32_FLOAT) shaderSource += "float4";
-        else if (format == DXGI_FORMAT_R32G32B32_FLOAT)    shaderSource += "float3";
-        else if (format == DXGI_FORMAT_R32G32_FLOAT)       shaderSource += "float2";
-        else if (format == DXGI_FORMAT_R32_FLOAT)          shaderSource += "float";
-        else return nullptr; // Unsupported type in layout
-
-        uint8_t index = static_cast<uint8_t>(vertexLayout[elt].SemanticIndex);
-        std::string semanticName = vertexLayout[elt].SemanticName;
-        semanticName += ('0' + index);
-
-        shaderSource += " ";
-        shaderSource += semanticName;
-        shaderSource += " : ";
-        shaderSource += semanticName;
-        if (elt != numElements - 1)  shaderSource += " , ";
-    }
-    shaderSource += ") : SV_Position {return 0;}";
-
-    ID3DBlob* compiledShader;
-    HRESULT hr = D3DCompile(shaderSource.c_str(), shaderSource.length(), NULL, NULL, NULL, "main",
-        "vs_5_0", D3DCOMPILE_OPTIMIZATION_LEVEL0, 0, &compiledShader, NULL);
-    if (FAILED(hr))
-    {
-        return nullptr;
-    }
-
-    return compiledShader;
-}
-
-
 //--------------------------------------------------------------------------------------
 // Constant buffer creation / destruction
 //--------------------------------------------------------------------------------------
@@ -199,7 +159,7 @@ ID3D11Buffer* CreateConstantBuffer(int size)
     cbDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE; // CPU is only going to write to the constants (not read them)
     cbDesc.MiscFlags = 0;
     ID3D11Buffer* constantBuffer;
-    HRESULT hr = gD3DDevice->CreateBuffer(&cbDesc, nullptr, &constantBuffer);
+    HRESULT hr = gRenderDevice->CreateBuffer(&cbDesc, nullptr, &constantBuffer);
     if (FAILED(hr))
     {
         return nullptr;
@@ -24,8 +24,5 @@ ID3D11PixelShader*  LoadPixelShader(std::string shaderName);
 // The returned pointer needs to be released before quitting. Returns nullptr on failure
 ID3D11Buffer* CreateConstantBuffer(int size);
 
-// Helper function. Returns nullptr on failure.
-ID3DBlob* CreateSignatureForVertexLayout(const D3D11_INPUT_ELEMENT_DESC vertexLayout[], int numElements);
-
 
 #endif //_SHADER_H_INCLUDED_
@@ -0,0 +1,118 @@
+//--------------------------------------------------------------------------------------
+// Shadow atlas tile packer
+//--------------------------------------------------------------------------------------
+
+#include "ShadowAtlas.h"
+
+#include <cstddef>
+
+
+CShadowAtlas::CShadowAtlas(unsigned int atlasSize, unsigned int minTileSize)
+    : mAtlasSize(atlasSize), mMinTileSize(minTileSize)
+{
+    mFreeTiles.resize(Level(mMinTileSize) + 1);
+    Reset();
+}
+
+
+void CShadowAtlas::Reset()
+{
+    for (auto& level : mFreeTiles)
+    {
+        level.clear();
+    }
+    mFreeTiles[0].push_back({ 0, 0 });
+    mUsedArea = 0;
+}
+
+
+unsigned int CShadowAtlas::TileSize(unsigned int size)
+{
+    unsigned int tileSize = mMinTileSize;
+    while (tileSize < size)  tileSize *= 2;
+    return tileSize;
+}
+
+
+unsigned int CShadowAtlas::Level(unsigned int tileSize)
+{
+    unsigned int level = 0;
+    for (unsigned int levelSize = mAtlasSize; levelSize > tileSize; levelSize /= 2)
+    {
+        ++level;
+    }
+    return level;
+}
+
+
+SAtlasTile CShadowAtlas::Allocate(unsigned int size)
+{
+    unsigned int tileSize = TileSize(size);
+    if (tileSize > mAtlasSize)  return SAtlasTile();
+    unsigned int level = Level(tileSize);
+
+    // Find the smallest free tile that is big enough
+    int freeLevel = static_cast<int>(level);
+    while (freeLevel >= 0 && mFreeTiles[freeLevel].empty())  --freeLevel;
+    if (freeLevel < 0)  return SAtlasTile();
+
+    SFreeTile free = mFreeTiles[freeLevel].back();
+    mFreeTiles[freeLevel].pop_back();
+
+    // Split it down to the size needed, keeping the top-left quarter each time and freeing the other three
+    for (unsigned int splitLevel = freeLevel + 1; splitLevel <= level; ++splitLevel)
+    {
+        unsigned int half = mAtlasSize >> splitLevel;
+        mFreeTiles[splitLevel].push_back({ free.x + half, free.y + half });
+        mFreeTiles[splitLevel].push_back({ free.x,        free.y + half });
+        mFreeTiles[splitLevel].push_back({ free.x + half, free.y        });
+    }
+
+    SAtlasTile tile;
+    tile.x = free.x;
+    tile.y = free.y;
+    tile.size = tileSize;
+    mUsedArea += tileSize * tileSize;
+    return tile;
+}
+
+
+void CShadowAtlas::Free(const SAtlasTile& tile)
+{
+    if (!tile.Valid())  return;
+    mUsedArea -= tile.size * tile.size;
+
+    // While the other three quarters of the parent tile are also free, join them into the parent
+    SFreeTile free = { tile.x, tile.y };
+    unsigned int level = Level(tile.size);
+    while (level > 0)
+    {
+        unsigned int size = mAtlasSize >> level;
+        unsigned int parentX = free.x & ~(size * 2 - 1);
+        unsigned int parentY = free.y & ~(size * 2 - 1);
+
+        auto& freeTiles = mFreeTiles[level];
+        unsigned int buddiesFound = 0;
+        for (auto& other : freeTiles)
+        {
+            if ((other.x & ~(size * 2 - 1)) == parentX && (other.y & ~(size * 2 - 1)) == parentY)  ++buddiesFound;
+        }
+        if (buddiesFound < 3)  break;
+
+        for (size_t i = 0; i < freeTiles.size(); )
+        {
+            if ((freeTiles[i].x & ~(size * 2 - 1)) == parentX && (freeTiles[i].y & ~(size * 2 - 1)) == parentY)
+            {
+                freeTiles[i] = freeTiles.back();
+                freeTiles.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+        free = { parentX, parentY };
+        --level;
+    }
+    mFreeTiles[level].push_back(free);
+}
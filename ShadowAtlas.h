@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------------------------
+// Shadow atlas tile packer
+//--------------------------------------------------------------------------------------
+// All spotlight shadow maps are rendered into tiles of one large square depth texture (the atlas). Each light can
+// have a different sized tile, chosen each frame by how important the light is on screen, and lights off screen
+// give their tile up. This class only does the bookkeeping of which parts of the atlas are in use - it creates no
+// GPU objects, so can be used (and tested) without a device.
+//
+// Tiles are square with power of two sizes and are allocated as a quadtree "buddy" system: a free tile that is too
+// big is split into four, and when all four quarters of a tile are free again they are joined back up. Tiles never
+// overlap and are always aligned to their size, so the atlas can't become fragmented into unusable slivers.
+
+#ifndef _SHADOW_ATLAS_H_INCLUDED_
+#define _SHADOW_ATLAS_H_INCLUDED_
+
+#include <vector>
+
+
+// Position and size of a tile in the atlas in pixels. A size of 0 means no tile
+struct SAtlasTile
+{
+    unsigned int x    = 0;
+    unsigned int y    = 0;
+    unsigned int size = 0;
+
+    bool Valid() const  { return size != 0; }
+};
+
+
+class CShadowAtlas
+{
+public:
+    // The atlas size and minimum tile size must be powers of two, with the minimum no larger than the atlas
+    CShadowAtlas(unsigned int atlasSize, unsigned int minTileSize);
+
+    // Allocate a tile of at least the given size (rounded up to a power of two, and to the minimum tile size).
+    // Returns an invalid tile if there is no free space of that size or the size is larger than the atlas
+    SAtlasTile Allocate(unsigned int size);
+
+    // Return a tile to the atlas. Invalid tiles are ignored
+    void Free(const SAtlasTile& tile);
+
+    // Free every tile
+    void Reset();
+
+    unsigned int AtlasSize()    { return mAtlasSize;   }
+    unsigned int MinTileSize()  { return mMinTileSize; }
+
+    // Number of pixels in allocated tiles
+    unsigned int UsedArea()     { return mUsedArea;    }
+
+    // Round a size up to the tile size that would be allocated for it
+    unsigned int TileSize(unsigned int size);
+
+
+private:
+    // Level 0 is the whole atlas, each level down has tiles half the size
+    unsigned int Level(unsigned int tileSize);
+
+    struct SFreeTile
+    {
+        unsigned int x, y;
+    };
+
+    unsigned int mAtlasSize;
+    unsigned int mMinTileSize;
+    unsigned int mUsedArea = 0;
+
+    // Free tiles at each level
+    std::vector<std::vector<SFreeTile>> mFreeTiles;
+};
+
+
+#endif //_SHADOW_ATLAS_H_INCLUDED_
@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Per-Pixel Lighting Vertex Shader - Instanced
+//--------------------------------------------------------------------------------------
+// As ShadowMapping_vs, but the world matrix comes from the instance data rather than the
+// per-model constant buffer, so many copies of a mesh can be drawn in a single draw call
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+LightingPixelShaderInput main(BasicInstancedVertex modelVertex)
+{
+    LightingPixelShaderInput output; // This is the data the pixel shader requires from this vertex shader
+
+    float4x4 worldMatrix = InstanceWorldMatrix(modelVertex.world0, modelVertex.world1, modelVertex.world2, modelVertex.world3);
+
+    float4 modelPosition = float4(modelVertex.position, 1);
+    float4 modelNormal = float4(modelVertex.normal, 0);
+
+    // Transform from model space to world space with this instance's matrix, then on to 2D as usual
+    float4 worldPosition     = mul(worldMatrix,       modelPosition);
+    float4 viewPosition      = mul(gViewMatrix,       worldPosition);
+    output.projectedPosition = mul(gProjectionMatrix, viewPosition);
+
+    output.worldNormal   = mul(worldMatrix, modelNormal).xyz;
+    output.worldPosition = worldPosition.xyz;
+
+    output.uv = modelVertex.uv;
+
+    return output; // Ouput data sent down the pipeline (to the pixel shader)
+}
@@ -0,0 +1,13 @@
+//--------------------------------------------------------------------------------------
+// Shadow Atlas Tile Clear Vertex Shader
+//--------------------------------------------------------------------------------------
+// Depth buffers can only be cleared as a whole, so to clear one tile of the shadow atlas a triangle covering the
+// viewport is drawn at the far depth instead (with a depth state that always writes). No vertex buffer is needed,
+// the three corners come from the vertex number. Draw with 3 vertices and no input layout
+
+float4 main(uint vertexID : SV_VertexID) : SV_Position
+{
+    // Vertices at (-1,-1), (-1,3) and (3,-1) give a triangle enclosing the whole viewport
+    float2 position = float2((vertexID == 2) ? 3.0f : -1.0f, (vertexID == 1) ? 3.0f : -1.0f);
+    return float4(position, 1.0f, 1.0f);
+}
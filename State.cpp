@@ -40,7 +40,7 @@ bool CSceneManager::CreateStates()
 	samplerDesc.MinLOD = 0;                 // --"--
 
 	// Then create a DirectX object for your description that can be used by a shader
-	if (FAILED(gD3DDevice->CreateSamplerState(&samplerDesc, &gPointSampler)))
+	if (FAILED(gRenderDevice->CreateSamplerState(&samplerDesc, &gPointSampler)))
 	{
 		gLastError = "Error creating point sampler";
 		return false;
@@ -58,7 +58,7 @@ bool CSceneManager::CreateStates()
 	samplerDesc.MinLOD = 0;                 // --"--
 
 	// Then create a DirectX object for your description that can be used by a shader
-	if (FAILED(gD3DDevice->CreateSamplerState(&samplerDesc, &gTrilinearSampler)))
+	if (FAILED(gRenderDevice->CreateSamplerState(&samplerDesc, &gTrilinearSampler)))
 	{
 		gLastError = "Error creating point sampler";
 		return false;
@@ -76,7 +76,7 @@ bool CSceneManager::CreateStates()
 	samplerDesc.MinLOD = 0;                 // --"--
 
 	// Then create a DirectX object for your description that can be used by a shader
-	if (FAILED(gD3DDevice->CreateSamplerState(&samplerDesc, &gAnisotropic4xSampler)))
+	if (FAILED(gRenderDevice->CreateSamplerState(&samplerDesc, &gAnisotropic4xSampler)))
 	{
 		gLastError = "Error creating anisotropic 4x sampler";
 		return false;
@@ -98,7 +98,7 @@ bool CSceneManager::CreateStates()
     rasterizerDesc.DepthClipEnable       = TRUE; // Advanced setting - only used in rare cases
 
     // Create a DirectX object for the description above that can be used by a shader
-    if (FAILED(gD3DDevice->CreateRasterizerState(&rasterizerDesc, &gCullBackState)))
+    if (FAILED(gRenderDevice->CreateRasterizerState(&rasterizerDesc, &gCullBackState)))
     {
         gLastError = "Error creating cull-back state";
         return false;
@@ -112,7 +112,7 @@ bool CSceneManager::CreateStates()
     rasterizerDesc.DepthClipEnable       = TRUE; // Advanced setting - only used in rare cases
 
     // Create a DirectX object for the description above that can be used by a shader
-    if (FAILED(gD3DDevice->CreateRasterizerState(&rasterizerDesc, &gCullFrontState)))
+    if (FAILED(gRenderDevice->CreateRasterizerState(&rasterizerDesc, &gCullFrontState)))
     {
         gLastError = "Error creating cull-front state";
         return false;
@@ -126,7 +126,7 @@ bool CSceneManager::CreateStates()
     rasterizerDesc.DepthClipEnable       = TRUE; // Advanced setting - only used in rare cases
 
     // Create a DirectX object for the description above that can be used by a shader
-    if (FAILED(gD3DDevice->CreateRasterizerState(&rasterizerDesc, &gCullNoneState)))
+    if (FAILED(gRenderDevice->CreateRasterizerState(&rasterizerDesc, &gCullNoneState)))
     {
         gLastError = "Error creating cull-none state";
         return false;
@@ -153,7 +153,7 @@ bool CSceneManager::CreateStates()
     blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
 
     // Then create a DirectX object for the description that can be used by a shader
-    if (FAILED(gD3DDevice->CreateBlendState(&blendDesc, &gNoBlendingState)))
+    if (FAILED(gRenderDevice->CreateBlendState(&blendDesc, &gNoBlendingState)))
     {
         gLastError = "Error creating no-blend state";
         return false;
@@ -174,7 +174,7 @@ bool CSceneManager::CreateStates()
     blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
 	
     // Then create a DirectX object for the description that can be used by a shader
-    if (FAILED(gD3DDevice->CreateBlendState(&blendDesc, &gAdditiveBlendingState)))
+    if (FAILED(gRenderDevice->CreateBlendState(&blendDesc, &gAdditiveBlendingState)))
     {
         gLastError = "Error creating additive blending state";
         return false;
@@ -192,7 +192,7 @@ bool CSceneManager::CreateStates()
 	blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
 	blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
 	// Then create a DirectX object for the description that can be used by a shader
-	if (FAILED(gD3DDevice->CreateBlendState(&blendDesc, &gMultiplicativeBlending)))
+	if (FAILED(gRenderDevice->CreateBlendState(&blendDesc, &gMultiplicativeBlending)))
 	{
 		gLastError = "Error creating additive blending state";
 		return false;
@@ -214,7 +214,7 @@ bool CSceneManager::CreateStates()
     depthStencilDesc.StencilEnable    = FALSE;
 
     // Create a DirectX object for the description above that can be used by a shader
-    if (FAILED(gD3DDevice->CreateDepthStencilState(&depthStencilDesc, &gUseDepthBufferState)))
+    if (FAILED(gRenderDevice->CreateDepthStencilState(&depthStencilDesc, &gUseDepthBufferState)))
     {
         gLastError = "Error creating use-depth-buffer state";
         return false;
@@ -229,7 +229,7 @@ bool CSceneManager::CreateStates()
     depthStencilDesc.StencilEnable    = FALSE;
 
     // Create a DirectX object for the description above that can be used by a shader
-    if (FAILED(gD3DDevice->CreateDepthStencilState(&depthStencilDesc, &gDepthReadOnlyState)))
+    if (FAILED(gRenderDevice->CreateDepthStencilState(&depthStencilDesc, &gDepthReadOnlyState)))
     {
         gLastError = "Error creating depth-read-only state";
         return false;
@@ -243,12 +243,27 @@ bool CSceneManager::CreateStates()
     depthStencilDesc.StencilEnable    = FALSE;
 
     // Create a DirectX object for the description above that can be used by a shader
-    if (FAILED(gD3DDevice->CreateDepthStencilState(&depthStencilDesc, &gNoDepthBufferState)))
+    if (FAILED(gRenderDevice->CreateDepthStencilState(&depthStencilDesc, &gNoDepthBufferState)))
     {
         gLastError = "Error creating no-depth-buffer state";
         return false;
     }
 
+
+	////-------- Overwrite depth buffer --------////
+    // Always writes depth, whatever is in the depth buffer already - used to clear a single tile of the shadow atlas
+    depthStencilDesc.DepthEnable      = TRUE;
+    depthStencilDesc.DepthWriteMask   = D3D11_DEPTH_WRITE_MASK_ALL;
+    depthStencilDesc.DepthFunc        = D3D11_COMPARISON_ALWAYS;
+    depthStencilDesc.StencilEnable    = FALSE;
+
+    // Create a DirectX object for the description above that can be used by a shader
+    if (FAILED(gRenderDevice->CreateDepthStencilState(&depthStencilDesc, &gOverwriteDepthState)))
+    {
+        gLastError = "Error creating overwrite-depth state";
+        return false;
+    }
+
     return true;
 }
 
@@ -256,16 +271,17 @@ bool CSceneManager::CreateStates()
 // Release DirectX state objects
 void CSceneManager::ReleaseStates()
 {
-    if (gUseDepthBufferState)    gUseDepthBufferState->Release();
-    if (gDepthReadOnlyState)     gDepthReadOnlyState->Release();
-    if (gNoDepthBufferState)     gNoDepthBufferState->Release();
-    if (gCullBackState)          gCullBackState->Release();
-    if (gCullFrontState)         gCullFrontState->Release();
-    if (gCullNoneState)          gCullNoneState->Release();
-    if (gNoBlendingState)        gNoBlendingState->Release();
-    if (gAdditiveBlendingState)  gAdditiveBlendingState->Release();
-	if (gMultiplicativeBlending)  gMultiplicativeBlending->Release();
-    if (gAnisotropic4xSampler)   gAnisotropic4xSampler->Release();
-    if (gTrilinearSampler)       gTrilinearSampler->Release();
-    if (gPointSampler)           gPointSampler->Release();
+    if (gUseDepthBufferState)    gRenderDevice->Release(gUseDepthBufferState);
+    if (gDepthReadOnlyState)     gRenderDevice->Release(gDepthReadOnlyState);
+    if (gNoDepthBufferState)     gRenderDevice->Release(gNoDepthBufferState);
+    if (gOverwriteDepthState)    gRenderDevice->Release(gOverwriteDepthState);
+    if (gCullBackState)          gRenderDevice->Release(gCullBackState);
+    if (gCullFrontState)         gRenderDevice->Release(gCullFrontState);
+    if (gCullNoneState)          gRenderDevice->Release(gCullNoneState);
+    if (gNoBlendingState)        gRenderDevice->Release(gNoBlendingState);
+    if (gAdditiveBlendingState)  gRenderDevice->Release(gAdditiveBlendingState);
+	if (gMultiplicativeBlending)  gRenderDevice->Release(gMultiplicativeBlending);
+    if (gAnisotropic4xSampler)   gRenderDevice->Release(gAnisotropic4xSampler);
+    if (gTrilinearSampler)       gRenderDevice->Release(gTrilinearSampler);
+    if (gPointSampler)           gRenderDevice->Release(gPointSampler);
 }
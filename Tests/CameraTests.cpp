@@ -0,0 +1,180 @@
+//--------------------------------------------------------------------------------------
+// Camera tests
+//--------------------------------------------------------------------------------------
+// Checks the camera's projection: the normal perspective projection, and the oblique near plane portal cameras use
+// (see Camera.h), which must put the plane at depth 0 and keep the far corners of the frustum within depth 1. Returns
+// non-zero on failure.
+
+#include "Camera.h"
+#include "GraphicsHelpers.h"
+#include "TransformSystem.h"
+
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+
+// Reports a failed check and remembers that the test failed
+static bool sFailed = false;
+static void Check(bool passed, const char* description)
+{
+    if (!passed)
+    {
+        std::cerr << "FAILED: " << description << "\n";
+        sFailed = true;
+    }
+}
+
+static bool MatricesEqual(const CMatrix4x4& a, const CMatrix4x4& b)
+{
+    const float* ea = &a.e00;
+    const float* eb = &b.e00;
+    return std::equal(ea, ea + 16, eb);
+}
+
+
+// Depth buffer value of a world point (z / w after projection)
+static float ProjectedDepth(Camera& camera, const CVector3& p)
+{
+    CMatrix4x4 m = camera.ViewProjectionMatrix();
+    float z = p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32;
+    float w = p.x * m.e03 + p.y * m.e13 + p.z * m.e23 + m.e33;
+    return z / w;
+}
+
+// World direction of the view ray through a point on the screen, given as -1 to 1 across and up
+static CVector3 ViewRay(Camera& camera, float screenX, float screenY)
+{
+    CMatrix4x4 projection = camera.ProjectionMatrix();
+    CVector3 view = { screenX / projection.e00, screenY / projection.e11, 1 };
+    CMatrix4x4 world = InverseAffine(camera.ViewMatrix());
+    return world.GetXAxis() * view.x + world.GetYAxis() * view.y + world.GetZAxis() * view.z;
+}
+
+
+// Depths of the oblique near plane are within this of 0. The plane's depth is a dot product of world positions of
+// size up to about 100 and the scaled plane, so rounding leaves a few units in the last place of those values
+const float DepthTolerance = 1e-4f;
+
+// Check a camera with an oblique near plane through the given world point and normal
+static void CheckObliquePlane(Camera& camera, const CVector3& point, const CVector3& normal, const char* name)
+{
+    // Points where view rays meet the plane, across the screen, are at depth 0. Points a little past the plane are
+    // drawn, those a little before it are clipped
+    bool onPlane = true, pastDrawn = true, beforeClipped = true;
+    int hits = 0;
+    CVector3 origin = camera.WorldPosition();
+    for (float screenY = -1; screenY <= 1; screenY += 0.25f)
+    {
+        for (float screenX = -1; screenX <= 1; screenX += 0.25f)
+        {
+            CVector3 ray = ViewRay(camera, screenX, screenY);
+            float along = Dot(ray, normal);
+            if (along <= 0)  continue; // Ray doesn't reach the plane
+            CVector3 hit = origin + ray * (Dot(point - origin, normal) / along);
+            ++hits;
+
+            onPlane       = onPlane       && std::abs(ProjectedDepth(camera, hit)) < DepthTolerance;
+            pastDrawn     = pastDrawn     && ProjectedDepth(camera, hit + ray * 0.1f) > 0;
+            beforeClipped = beforeClipped && ProjectedDepth(camera, hit - ray * 0.1f) < 0;
+        }
+    }
+    std::string description = std::string(name) + ": ";
+    Check(hits > 0,      (description + "plane in view").c_str());
+    Check(onPlane,       (description + "points on the plane at depth 0").c_str());
+    Check(pastDrawn,     (description + "points past the plane drawn").c_str());
+    Check(beforeClipped, (description + "points before the plane clipped").c_str());
+
+    // The far corners of the frustum are at depth 1 or less, and the one on the plane's side at 1, so the far plane
+    // only ever cuts closer than the far clip distance
+    float furthest = -1;
+    bool cornersInside = true;
+    for (float screenY : { -1.0f, 1.0f })
+    {
+        for (float screenX : { -1.0f, 1.0f })
+        {
+            float depth = ProjectedDepth(camera, origin + ViewRay(camera, screenX, screenY) * camera.FarClip());
+            cornersInside = cornersInside && depth <= 1 + DepthTolerance;
+            furthest = std::max(furthest, depth);
+        }
+    }
+    Check(cornersInside, (description + "far corners at depth 1 or less").c_str());
+    Check(std::abs(furthest - 1) < DepthTolerance, (description + "furthest far corner at depth 1").c_str());
+}
+
+
+int main()
+{
+    std::cout << "Camera tests\n";
+
+    const float fov = ToRadians(70);
+    const float aspectRatio = 16.0f / 9.0f;
+    const float nearClip = 0.5f;
+    const float farClip = 1000;
+    Camera camera({ 10, 5, -20 }, { 0.2f, 0.7f, 0.1f }, fov, aspectRatio, nearClip, farClip);
+    const CMatrix4x4 perspective = MakeProjectionMatrix(aspectRatio, fov, nearClip, farClip);
+
+
+    //-------------------------------------
+    // Perspective
+    //-------------------------------------
+
+    Check(camera.Projection() == Camera::EProjection::Perspective, "cameras start with the perspective projection");
+    Check(MatricesEqual(camera.ProjectionMatrix(), perspective), "perspective projection unchanged");
+    CVector3 ahead = camera.WorldPosition() + ViewRay(camera, 0, 0) * 100;
+    Check(std::abs(ProjectedDepth(camera, camera.WorldPosition() + ViewRay(camera, 0, 0) * nearClip)) < DepthTolerance, "near clip distance at depth 0");
+    Check(ProjectedDepth(camera, ahead) > 0 && ProjectedDepth(camera, ahead) < 1, "point ahead within the depth range");
+
+
+    //-------------------------------------
+    // Oblique near plane
+    //-------------------------------------
+
+    // A plane facing away from the camera a little way ahead, then tilted each way
+    CVector3 forward = Normalise(ViewRay(camera, 0, 0));
+    CVector3 right   = Normalise(ViewRay(camera, 1, 0) - ViewRay(camera, 0, 0));
+    CVector3 up      = Cross(forward, right);
+    CVector3 planePoint = camera.WorldPosition() + forward * 20;
+
+    camera.SetObliqueNearPlane(planePoint, forward);
+    CheckObliquePlane(camera, planePoint, forward, "plane facing the camera");
+
+    CVector3 tilted = Normalise(forward + right * 0.5f + up * 0.3f);
+    camera.SetObliqueNearPlane(planePoint, tilted);
+    CheckObliquePlane(camera, planePoint, tilted, "tilted plane");
+
+    tilted = Normalise(forward - right * 0.8f - up * 0.6f);
+    camera.SetObliqueNearPlane(planePoint, tilted);
+    CheckObliquePlane(camera, planePoint, tilted, "plane tilted the other way");
+
+    // A plane the camera is in front of can't be used, so the perspective projection is
+    camera.SetObliqueNearPlane(camera.WorldPosition() - forward * 5, forward);
+    Check(MatricesEqual(camera.ProjectionMatrix(), perspective), "plane behind the camera gives the perspective projection");
+
+    camera.SetPerspective();
+    Check(MatricesEqual(camera.ProjectionMatrix(), perspective), "perspective projection restored");
+
+
+    //-------------------------------------
+    // Attached camera
+    //-------------------------------------
+
+    // The plane is given relative to the parent, as portal cameras give the portal's plane
+    CTransformSystem transforms;
+    STransformHandle parent = transforms.Add({ 100, -50, 30 }, { 0.3f, -1.2f, 0.5f }, { 1, 1, 1 });
+    Camera attached({ 0, 0, 0 }, { 0.1f, 0.4f, 0 }, fov, aspectRatio, nearClip, farClip);
+    attached.AttachTo(transforms, parent);
+    CVector3 localPoint  = { 2, 1, 15 };
+    CVector3 localNormal = Normalise(CVector3{ 0.2f, -0.1f, 1 });
+    attached.SetObliqueNearPlane(localPoint, localNormal);
+
+    CMatrix4x4 parentMatrix = transforms.WorldMatrix(parent);
+    CVector3 worldPoint  = parentMatrix.TransformPoint(localPoint);
+    CVector3 worldNormal = parentMatrix.GetXAxis() * localNormal.x + parentMatrix.GetYAxis() * localNormal.y +
+                           parentMatrix.GetZAxis() * localNormal.z;
+    CheckObliquePlane(attached, worldPoint, worldNormal, "attached camera");
+
+    if (!sFailed)  std::cout << "All passed\n";
+    return sFailed ? 1 : 0;
+}
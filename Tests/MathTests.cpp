@@ -0,0 +1,323 @@
+//--------------------------------------------------------------------------------------
+// Maths library tests
+//--------------------------------------------------------------------------------------
+// Checks the matrix kernels against plain reference code, the fused matrix builders against the matrices they replace
+// and quaternion rotations against the matrix ones. Built twice (see CMakeLists.txt), with the SIMD kernels and with
+// MATH_NO_SIMD, which must give the same results - both builds check against the same references. Returns non-zero on
+// failure.
+
+#include "CMatrix4x4.h"
+#include "CQuaternion.h"
+#include "MathSIMD.h"
+
+#include <iostream>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+
+// Reports a failed check and remembers that the test failed
+static bool sFailed = false;
+static void Check(bool passed, const char* description)
+{
+    if (!passed)
+    {
+        std::cerr << "FAILED: " << description << "\n";
+        sFailed = true;
+    }
+}
+
+// True if every element of the two matrices is within the tolerance, relative to the element size for large values
+static bool MatricesClose(const CMatrix4x4& a, const CMatrix4x4& b, float tolerance = 1e-4f)
+{
+    const float* ea = &a.e00;
+    const float* eb = &b.e00;
+    for (int i = 0; i < 16; ++i)
+    {
+        float size = std::max(1.0f, std::max(std::abs(ea[i]), std::abs(eb[i])));
+        if (std::abs(ea[i] - eb[i]) > tolerance * size)  return false;
+    }
+    return true;
+}
+
+static bool QuaternionsClose(const CQuaternion& a, const CQuaternion& b, float tolerance = 1e-5f)
+{
+    return std::abs(a.x - b.x) < tolerance && std::abs(a.y - b.y) < tolerance &&
+           std::abs(a.z - b.z) < tolerance && std::abs(a.w - b.w) < tolerance;
+}
+
+
+static bool VectorsClose(const CVector3& a, const CVector3& b, float tolerance = 1e-4f)
+{
+    float size = std::max(1.0f, std::max(Length(a), Length(b)));
+    return Length(a - b) <= tolerance * size;
+}
+
+
+// Reference versions of the matrix kernels, written plainly so they are the same in both builds
+
+static CMatrix4x4 ReferenceMultiply(const CMatrix4x4& m1, const CMatrix4x4& m2)
+{
+    CMatrix4x4 result;
+    const float* e1 = &m1.e00;
+    const float* e2 = &m2.e00;
+    float* out = &result.e00;
+    for (int row = 0; row < 4; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            double sum = 0;
+            for (int i = 0; i < 4; ++i)  sum += static_cast<double>(e1[row * 4 + i]) * e2[i * 4 + column];
+            out[row * 4 + column] = static_cast<float>(sum);
+        }
+    }
+    return result;
+}
+
+// Inverse of an affine matrix by the adjugate of its upper 3x3, in double precision
+static CMatrix4x4 ReferenceInverseAffine(const CMatrix4x4& m)
+{
+    double a[3][3];
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 3; ++column)  a[row][column] = (&m.e00)[row * 4 + column];
+    }
+    double inverse[3][3];
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 3; ++column)
+        {
+            // Cofactor of element (column, row), from the rows and columns after it, which gives the sign
+            int r1 = (column + 1) % 3, r2 = (column + 2) % 3;
+            int c1 = (row + 1) % 3,    c2 = (row + 2) % 3;
+            inverse[row][column] = a[r1][c1] * a[r2][c2] - a[r1][c2] * a[r2][c1];
+        }
+    }
+    double det = a[0][0] * inverse[0][0] + a[0][1] * inverse[1][0] + a[0][2] * inverse[2][0];
+
+    CMatrix4x4 result = MatrixIdentity();
+    float* out = &result.e00;
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 3; ++column)  out[row * 4 + column] = static_cast<float>(inverse[row][column] / det);
+    }
+    for (int column = 0; column < 3; ++column)
+    {
+        double t = 0;
+        for (int i = 0; i < 3; ++i)  t -= (&m.e30)[i] * inverse[i][column] / det;
+        out[12 + column] = static_cast<float>(t);
+    }
+    return result;
+}
+
+static CVector3 ReferenceTransformNormal(const CMatrix4x4& m, const CVector3& n)
+{
+    return { n.x * m.e00 + n.y * m.e10 + n.z * m.e20,
+             n.x * m.e01 + n.y * m.e11 + n.z * m.e21,
+             n.x * m.e02 + n.y * m.e12 + n.z * m.e22 };
+}
+
+
+// The world matrix as models and cameras built it before MatrixFromTRS
+static CMatrix4x4 ComposedTRS(const CVector3& position, const CVector3& rotation, const CVector3& scale)
+{
+    return MatrixScaling(scale) * MatrixRotationZ(rotation.z) * MatrixRotationX(rotation.x) *
+           MatrixRotationY(rotation.y) * MatrixTranslation(position);
+}
+
+
+int main()
+{
+#ifdef MATH_USE_SSE
+    std::cout << "Maths tests (SSE)\n";
+#else
+    std::cout << "Maths tests (scalar)\n";
+#endif
+
+    // Fixed seed so failures can be repeated
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> anyAngle(-2 * PI, 2 * PI);
+    std::uniform_real_distribution<float> pitch(-1.5f, 1.5f); // Clear of gimbal lock, so Euler angles round trip
+    std::uniform_real_distribution<float> coordinate(-1000, 1000);
+    std::uniform_real_distribution<float> scaling(0.1f, 10);
+    const CVector3 noScale = { 1, 1, 1 };
+    const int NumCases = 1000;
+
+
+    //-------------------------------------
+    // Matrix kernels against the reference code
+    //-------------------------------------
+
+    // Multiplying general matrices, as a new matrix, in place, and in place by itself
+    std::uniform_real_distribution<float> element(-10, 10);
+    auto anyMatrix = [&]()
+    {
+        CMatrix4x4 m;
+        for (float* e = &m.e00; e <= &m.e33; ++e)  *e = element(random);
+        return m;
+    };
+    bool productsCorrect = true, inPlaceCorrect = true, selfCorrect = true;
+    for (int i = 0; i < NumCases; ++i)
+    {
+        CMatrix4x4 m1 = anyMatrix();
+        CMatrix4x4 m2 = anyMatrix();
+        CMatrix4x4 expected = ReferenceMultiply(m1, m2);
+        productsCorrect = productsCorrect && MatricesClose(m1 * m2, expected);
+
+        CMatrix4x4 inPlace = m1;
+        inPlace *= m2;
+        inPlaceCorrect = inPlaceCorrect && MatricesClose(inPlace, expected);
+
+        CMatrix4x4 self = m1;
+        self *= self;
+        selfCorrect = selfCorrect && MatricesClose(self, ReferenceMultiply(m1, m1));
+    }
+    Check(productsCorrect, "matrix multiply matches the reference");
+    Check(inPlaceCorrect,  "matrix multiply in place matches the reference");
+    Check(selfCorrect,     "matrix multiplied in place by itself matches the reference");
+
+    // Inverting world matrices, which undoes them
+    bool inversesCorrect = true, inversesUndo = true;
+    for (int i = 0; i < NumCases; ++i)
+    {
+        CVector3 position = { coordinate(random), coordinate(random), coordinate(random) };
+        CVector3 rotation = { anyAngle(random), anyAngle(random), anyAngle(random) };
+        CVector3 scale    = { scaling(random), scaling(random), scaling(random) };
+        CMatrix4x4 m = MatrixFromTRS(position, rotation, scale);
+        CMatrix4x4 inverse = InverseAffine(m);
+        inversesCorrect = inversesCorrect && MatricesClose(inverse, ReferenceInverseAffine(m));
+        inversesUndo    = inversesUndo    && MatricesClose(m * inverse, MatrixIdentity(), 1e-3f);
+    }
+    Check(inversesCorrect, "InverseAffine matches the reference");
+    Check(inversesUndo,    "InverseAffine times the matrix is the identity");
+
+    // Transforming arrays of each length up to a few blocks of four, into a separate array and in place. The elements
+    // after the array must be left alone
+    const size_t MaxCount = 13;
+    const CVector3 guard = { 12345, 12345, 12345 };
+    bool pointsCorrect = true, normalsCorrect = true, pointsInPlace = true, normalsInPlace = true, guardKept = true;
+    for (size_t count = 0; count <= MaxCount; ++count)
+    {
+        CMatrix4x4 m = MatrixFromTRS({ coordinate(random), coordinate(random), coordinate(random) },
+                                     { anyAngle(random), anyAngle(random), anyAngle(random) },
+                                     { scaling(random), scaling(random), scaling(random) });
+        std::vector<CVector3> vectors(count + 1, guard);
+        for (size_t i = 0; i < count; ++i)  vectors[i] = { coordinate(random), coordinate(random), coordinate(random) };
+
+        std::vector<CVector3> points(count + 1, guard), normals(count + 1, guard);
+        TransformPoints (m, vectors.data(), points.data(),  count);
+        TransformNormals(m, vectors.data(), normals.data(), count);
+        std::vector<CVector3> pointsSame = vectors, normalsSame = vectors;
+        TransformPoints (m, pointsSame.data(),  pointsSame.data(),  count);
+        TransformNormals(m, normalsSame.data(), normalsSame.data(), count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            pointsCorrect  = pointsCorrect  && VectorsClose(points[i],      m.TransformPoint(vectors[i]));
+            normalsCorrect = normalsCorrect && VectorsClose(normals[i],     ReferenceTransformNormal(m, vectors[i]));
+            pointsInPlace  = pointsInPlace  && VectorsClose(pointsSame[i],  m.TransformPoint(vectors[i]));
+            normalsInPlace = normalsInPlace && VectorsClose(normalsSame[i], ReferenceTransformNormal(m, vectors[i]));
+        }
+        for (auto* transformed : { &points, &normals, &pointsSame, &normalsSame })
+        {
+            guardKept = guardKept && (*transformed)[count].x == guard.x && (*transformed)[count].y == guard.y &&
+                                     (*transformed)[count].z == guard.z;
+        }
+    }
+    Check(pointsCorrect,  "TransformPoints matches TransformPoint for every length");
+    Check(normalsCorrect, "TransformNormals matches the reference for every length");
+    Check(pointsInPlace,  "TransformPoints in place matches TransformPoint");
+    Check(normalsInPlace, "TransformNormals in place matches the reference");
+    Check(guardKept,      "batch transforms write nothing past the end of the array");
+
+
+    //-------------------------------------
+    // Fused TRS against the composed matrices
+    //-------------------------------------
+
+    bool eulerMatches = true, quaternionMatches = true;
+    for (int i = 0; i < NumCases; ++i)
+    {
+        CVector3 position = { coordinate(random), coordinate(random), coordinate(random) };
+        CVector3 rotation = { anyAngle(random), anyAngle(random), anyAngle(random) };
+        CVector3 scale    = { scaling(random), scaling(random), scaling(random) };
+        CMatrix4x4 composed = ComposedTRS(position, rotation, scale);
+
+        eulerMatches      = eulerMatches      && MatricesClose(MatrixFromTRS(position, rotation, scale), composed);
+        quaternionMatches = quaternionMatches && MatricesClose(MatrixFromTRS(position, QuaternionFromEulerAngles(rotation), scale), composed);
+    }
+    Check(eulerMatches,      "fused TRS with Euler angles matches the composed matrices");
+    Check(quaternionMatches, "fused TRS with a quaternion matches the composed matrices");
+
+    Check(MatricesClose(MatrixFromTRS({ 0, 0, 0 }, { 0, 0, 0 }, noScale), MatrixIdentity(), 0), "fused TRS of nothing is the identity");
+    Check(MatricesClose(MatrixFromTRS({ 0, 0, 0 }, QuaternionIdentity(), noScale), MatrixIdentity(), 0), "identity quaternion gives the identity");
+
+
+    //-------------------------------------
+    // Quaternions
+    //-------------------------------------
+
+    // A rotation about each axis matches the matrix rotation about it
+    bool axesMatch = true;
+    for (int i = 0; i < NumCases; ++i)
+    {
+        float angle = anyAngle(random);
+        axesMatch = axesMatch && MatricesClose(MatrixFromTRS({ 0, 0, 0 }, QuaternionRotationAxis({ 1, 0, 0 }, angle), noScale), MatrixRotationX(angle));
+        axesMatch = axesMatch && MatricesClose(MatrixFromTRS({ 0, 0, 0 }, QuaternionRotationAxis({ 0, 1, 0 }, angle), noScale), MatrixRotationY(angle));
+        axesMatch = axesMatch && MatricesClose(MatrixFromTRS({ 0, 0, 0 }, QuaternionRotationAxis({ 0, 0, 1 }, angle), noScale), MatrixRotationZ(angle));
+    }
+    Check(axesMatch, "axis rotations match the matrix rotations");
+
+    // q1 * q2 rotates by q2 then by q1, which for row vectors is the matrix of q2 times the matrix of q1
+    bool productsMatch = true;
+    for (int i = 0; i < NumCases; ++i)
+    {
+        CQuaternion q1 = QuaternionFromEulerAngles({ anyAngle(random), anyAngle(random), anyAngle(random) });
+        CQuaternion q2 = QuaternionFromEulerAngles({ anyAngle(random), anyAngle(random), anyAngle(random) });
+        CMatrix4x4 product = MatrixFromTRS({ 0, 0, 0 }, q1 * q2, noScale);
+        productsMatch = productsMatch && MatricesClose(product, MatrixFromTRS({ 0, 0, 0 }, q2, noScale) * MatrixFromTRS({ 0, 0, 0 }, q1, noScale));
+    }
+    Check(productsMatch, "quaternion products match matrix products");
+
+    // Euler angles -> quaternion -> matrix -> Euler angles -> quaternion gives the same rotation. The quaternion may
+    // come back negated, which is the same rotation
+    bool roundTrips = true;
+    for (int i = 0; i < NumCases; ++i)
+    {
+        CVector3 rotation = { pitch(random), anyAngle(random), anyAngle(random) };
+        CQuaternion q = QuaternionFromEulerAngles(rotation);
+        CMatrix4x4 m = MatrixFromTRS({ 0, 0, 0 }, q, noScale);
+        CQuaternion back = QuaternionFromEulerAngles(m.GetEulerAngles());
+        CQuaternion negated = { -back.x, -back.y, -back.z, -back.w };
+        roundTrips = roundTrips && (QuaternionsClose(q, back, 1e-4f) || QuaternionsClose(q, negated, 1e-4f));
+    }
+    Check(roundTrips, "quaternions round trip through matrices and Euler angles");
+
+    // And through the scaled world matrix of a model
+    bool scaledRoundTrips = true;
+    for (int i = 0; i < NumCases; ++i)
+    {
+        CVector3 position = { coordinate(random), coordinate(random), coordinate(random) };
+        CVector3 rotation = { pitch(random), anyAngle(random), anyAngle(random) };
+        CVector3 scale    = { scaling(random), scaling(random), scaling(random) };
+        CMatrix4x4 m = MatrixFromTRS(position, QuaternionFromEulerAngles(rotation), scale);
+        CMatrix4x4 rebuilt = MatrixFromTRS(m.GetPosition(), QuaternionFromEulerAngles(m.GetEulerAngles()), m.GetScale());
+        scaledRoundTrips = scaledRoundTrips && MatricesClose(rebuilt, m, 1e-3f);
+    }
+    Check(scaledRoundTrips, "world matrices round trip through position, quaternion and scale");
+
+    // Normalising keeps the rotation, a zero quaternion becomes the identity
+    bool normalised = true;
+    for (int i = 0; i < NumCases; ++i)
+    {
+        CQuaternion q = QuaternionFromEulerAngles({ anyAngle(random), anyAngle(random), anyAngle(random) });
+        float length = scaling(random);
+        normalised = normalised && QuaternionsClose(Normalise({ q.x * length, q.y * length, q.z * length, q.w * length }), q);
+    }
+    Check(normalised, "normalising a scaled quaternion gives it back");
+    Check(QuaternionsClose(Normalise({ 0, 0, 0, 0 }), QuaternionIdentity()), "normalising a zero quaternion gives the identity");
+
+    if (!sFailed)  std::cout << "All passed\n";
+    return sFailed ? 1 : 0;
+}
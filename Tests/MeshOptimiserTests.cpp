@@ -0,0 +1,228 @@
+//--------------------------------------------------------------------------------------
+// Mesh optimiser tests
+//--------------------------------------------------------------------------------------
+// Runs the three optimisation passes (MeshOptimiser.h) on a generated mesh in a shuffled order and checks each keeps
+// the same triangles, leaves the vertex cache no worse and gives valid indices. Returns non-zero on failure.
+
+#include "MeshOptimiser.h"
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+
+// Reports a failed check and remembers that the test failed
+static bool sFailed = false;
+static void Check(bool passed, const char* description)
+{
+    if (!passed)
+    {
+        std::cerr << "FAILED: " << description << "\n";
+        sFailed = true;
+    }
+}
+
+
+// A box of gridSize x gridSize quads on each face, each face with its own vertices. The triangles are clockwise seen
+// from outside, or from inside if inwards is set. Vertices are added to those given
+static void AddBox(std::vector<CVector3>& positions, std::vector<uint32_t>& indices, float halfSize, unsigned int gridSize,
+                   bool inwards = false)
+{
+    const CVector3 axes[3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+    for (int face = 0; face < 6; ++face)
+    {
+        // The face's normal, and two axes across it that give clockwise triangles seen from the normal's side
+        float side = (face < 3) ? 1.0f : -1.0f;
+        CVector3 normal = axes[face % 3] * side;
+        CVector3 across = axes[(face + 1) % 3];
+        CVector3 down   = Cross(normal, across);
+
+        uint32_t first = static_cast<uint32_t>(positions.size());
+        for (unsigned int y = 0; y <= gridSize; ++y)
+        {
+            for (unsigned int x = 0; x <= gridSize; ++x)
+            {
+                float u = (2.0f * x / gridSize - 1) * halfSize;
+                float v = (2.0f * y / gridSize - 1) * halfSize;
+                positions.push_back(normal * halfSize + across * u + down * v);
+            }
+        }
+        for (unsigned int y = 0; y < gridSize; ++y)
+        {
+            for (unsigned int x = 0; x < gridSize; ++x)
+            {
+                uint32_t topLeft = first + y * (gridSize + 1) + x;
+                uint32_t quad[6] = { topLeft, topLeft + 1, topLeft + gridSize + 2, topLeft, topLeft + gridSize + 2, topLeft + gridSize + 1 };
+                if (inwards)
+                {
+                    std::swap(quad[1], quad[2]);
+                    std::swap(quad[4], quad[5]);
+                }
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+    }
+}
+
+// Shuffle the triangles of a list and the order of its vertices, as an unoptimised mesh might be
+static void Shuffle(std::vector<CVector3>& positions, std::vector<uint32_t>& indices, std::mt19937& random)
+{
+    std::vector<std::array<uint32_t, 3>> triangles(indices.size() / 3);
+    for (size_t t = 0; t < triangles.size(); ++t)  triangles[t] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+    std::shuffle(triangles.begin(), triangles.end(), random);
+
+    std::vector<uint32_t> newIndex(positions.size());
+    for (uint32_t v = 0; v < newIndex.size(); ++v)  newIndex[v] = v;
+    std::shuffle(newIndex.begin(), newIndex.end(), random);
+    std::vector<CVector3> oldPositions = positions;
+    for (size_t v = 0; v < positions.size(); ++v)  positions[newIndex[v]] = oldPositions[v];
+
+    for (size_t t = 0; t < triangles.size(); ++t)
+    {
+        for (int corner = 0; corner < 3; ++corner)  indices[t * 3 + corner] = newIndex[triangles[t][corner]];
+    }
+}
+
+
+// The triangles of a list by their corner positions, sorted so lists can be compared whatever their order. Each
+// triangle is rotated to start at its lowest corner, which keeps its winding
+using STriangle = std::array<float, 9>;
+static std::vector<STriangle> Triangles(const std::vector<CVector3>& positions, const uint32_t* indices, size_t numIndices)
+{
+    std::vector<STriangle> triangles;
+    for (size_t i = 0; i + 2 < numIndices; i += 3)
+    {
+        STriangle corners[3];
+        for (int rotation = 0; rotation < 3; ++rotation)
+        {
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                const CVector3& p = positions[indices[i + (rotation + corner) % 3]];
+                corners[rotation][corner * 3 + 0] = p.x;
+                corners[rotation][corner * 3 + 1] = p.y;
+                corners[rotation][corner * 3 + 2] = p.z;
+            }
+        }
+        triangles.push_back(*std::min_element(corners, corners + 3));
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+static bool IndicesValid(const std::vector<uint32_t>& indices, size_t numVertices)
+{
+    return std::all_of(indices.begin(), indices.end(), [&](uint32_t index) { return index < numVertices; });
+}
+
+
+int main()
+{
+    std::cout << "Mesh optimiser tests\n";
+
+    // Fixed seed so failures can be repeated
+    std::mt19937 random(1234);
+
+    // A box with a smaller box inside it facing inwards, so the overdraw sort has clusters facing away from the centre
+    // and towards it
+    std::vector<CVector3> positions;
+    std::vector<uint32_t> indices;
+    AddBox(positions, indices, 10, 16);
+    const size_t numOuterTriangles = indices.size() / 3;
+    AddBox(positions, indices, 2, 8, true);
+    Shuffle(positions, indices, random);
+    const std::vector<STriangle> triangles = Triangles(positions, indices.data(), indices.size());
+    const float shuffledACMR = AnalyseVertexCache(indices.data(), indices.size()).ACMR();
+
+
+    //-------------------------------------
+    // Vertex cache
+    //-------------------------------------
+
+    std::vector<uint32_t> clusters;
+    OptimiseVertexCache(indices.data(), indices.size(), positions.size(), gsVertexCacheSize, &clusters);
+    const float cacheACMR = AnalyseVertexCache(indices.data(), indices.size()).ACMR();
+    std::cout << "ACMR: shuffled " << shuffledACMR << ", vertex cache " << cacheACMR;
+
+    Check(Triangles(positions, indices.data(), indices.size()) == triangles, "vertex cache order keeps the triangles");
+    Check(IndicesValid(indices, positions.size()), "vertex cache order indices valid");
+    Check(cacheACMR <= shuffledACMR, "vertex cache order ACMR no worse");
+    Check(cacheACMR < 1, "vertex cache order ACMR near the best for a grid");
+    Check(!clusters.empty() && clusters[0] == 0, "first cluster starts at the first triangle");
+    bool clustersInOrder = true;
+    for (size_t c = 1; c < clusters.size(); ++c)
+    {
+        clustersInOrder = clustersInOrder && clusters[c] > clusters[c - 1] && clusters[c] < indices.size() / 3;
+    }
+    Check(clustersInOrder, "clusters start at increasing triangles in the list");
+
+
+    //-------------------------------------
+    // Overdraw
+    //-------------------------------------
+
+    const float threshold = 1.05f;
+    OptimiseOverdraw(indices.data(), indices.size(), positions.data(), positions.size(), clusters, threshold);
+    const float overdrawACMR = AnalyseVertexCache(indices.data(), indices.size()).ACMR();
+    std::cout << ", overdraw " << overdrawACMR << "\n";
+
+    Check(Triangles(positions, indices.data(), indices.size()) == triangles, "overdraw order keeps the triangles");
+    Check(IndicesValid(indices, positions.size()), "overdraw order indices valid");
+    Check(overdrawACMR <= shuffledACMR, "overdraw order ACMR no worse than the input");
+    Check(overdrawACMR <= cacheACMR * threshold * 1.1f, "overdraw order ACMR close to the vertex cache order's");
+
+    // Triangles of the inner box face the mesh's centre, so are drawn after all of the outer box's
+    size_t firstInner = indices.size() / 3;
+    size_t lastOuter  = 0;
+    for (size_t t = 0; t < indices.size() / 3; ++t)
+    {
+        const CVector3& p = positions[indices[t * 3]];
+        bool inner = std::abs(p.x) <= 2 && std::abs(p.y) <= 2 && std::abs(p.z) <= 2;
+        if (inner)  firstInner = std::min(firstInner, t);
+        else        lastOuter = t;
+    }
+    Check(firstInner > lastOuter && firstInner == numOuterTriangles, "clusters facing the centre drawn last");
+
+
+    //-------------------------------------
+    // Vertex fetch
+    //-------------------------------------
+
+    // With a vertex no triangle uses, which is moved to the end
+    positions.push_back({ 100, 100, 100 });
+    std::vector<uint32_t> beforeFetch = indices;
+    OptimiseVertexFetch(indices.data(), indices.size(), positions.data(), positions.size(), sizeof(CVector3));
+
+    Check(Triangles(positions, indices.data(), indices.size()) == triangles, "vertex fetch order keeps the triangles");
+    Check(IndicesValid(indices, positions.size() - 1), "vertex fetch order indices valid and leave out the unused vertex");
+    Check(positions.back().x == 100, "unused vertex moved to the end");
+    uint32_t nextNew = 0;
+    bool firstUseOrder = true;
+    for (uint32_t index : indices)
+    {
+        if (index == nextNew)  ++nextNew;
+        else                   firstUseOrder = firstUseOrder && index < nextNew;
+    }
+    Check(firstUseOrder, "vertices numbered in the order first used");
+    Check(AnalyseVertexCache(indices.data(), indices.size()).transforms ==
+          AnalyseVertexCache(beforeFetch.data(), beforeFetch.size()).transforms, "vertex fetch order keeps the cache misses");
+
+
+    //-------------------------------------
+    // Incomplete triangles
+    //-------------------------------------
+
+    // Indices after the last whole triangle are left where they are
+    std::vector<uint32_t> partial(indices.begin(), indices.begin() + 3 * 100);
+    std::vector<STriangle> partialTriangles = Triangles(positions, partial.data(), partial.size());
+    partial.push_back(7);
+    partial.push_back(9);
+    OptimiseVertexCache(partial.data(), partial.size(), positions.size());
+    Check(partial[300] == 7 && partial[301] == 9, "indices after the last triangle left alone");
+    Check(Triangles(positions, partial.data(), 300) == partialTriangles, "whole triangles kept with indices left over");
+
+    if (!sFailed)  std::cout << "All passed\n";
+    return sFailed ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+//--------------------------------------------------------------------------------------
+// Occlusion buffer tests
+//--------------------------------------------------------------------------------------
+// Rasterizes known occluders and checks the depths written and the box tests against them. Built twice (see
+// CMakeLists.txt), with the SIMD rasterizer and with MATH_NO_SIMD, which must give the same results. Returns non-zero
+// on failure.
+//
+// The camera is at the origin looking along +z, so the view-projection matrix is just the projection. With a 90 degree
+// horizontal field of view and the buffer's 2:1 aspect ratio, the screen at depth z spans x = -z..z and y = -z/2..z/2
+
+#include "OcclusionBuffer.h"
+#include "ThreadPool.h"
+#include "MathSIMD.h"
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <utility>
+
+
+// Reports a failed check and remembers that the test failed
+static bool sFailed = false;
+static void Check(bool passed, const char* description)
+{
+    if (!passed)
+    {
+        std::cerr << "FAILED: " << description << "\n";
+        sFailed = true;
+    }
+}
+
+
+const float NearClip = 1;
+const float FarClip  = 100;
+
+// As MakeProjectionMatrix (GraphicsHelpers.cpp), which is not built into this test as it needs the render backend
+static CMatrix4x4 Projection()
+{
+    const float tanFOVx = 1; // 90 degrees
+    float scaleX  = 1.0f / tanFOVx;
+    float scaleY  = (static_cast<float>(COcclusionBuffer::Width) / COcclusionBuffer::Height) / tanFOVx;
+    float scaleZa = FarClip / (FarClip - NearClip);
+    float scaleZb = -NearClip * scaleZa;
+    return CMatrix4x4{ scaleX,   0.0f,    0.0f,   0.0f,
+                         0.0f, scaleY,    0.0f,   0.0f,
+                         0.0f,   0.0f, scaleZa,   1.0f,
+                         0.0f,   0.0f, scaleZb,   0.0f };
+}
+
+// Depth buffer value for a point at view depth z
+static float DepthAt(float z)
+{
+    return FarClip / (FarClip - NearClip) * (1 - NearClip / z);
+}
+
+
+// A quad facing the camera at depth z, covering x = -halfWidth..halfWidth and y = -halfHeight..halfHeight. The
+// corners are clockwise as seen from the camera (front facing) unless reversed
+struct SQuad
+{
+    CVector3 positions[4];
+    uint32_t indices[6];
+};
+
+static SQuad FacingQuad(float halfWidth, float halfHeight, float z, bool reversed = false)
+{
+    SQuad quad = { { { -halfWidth,  halfHeight, z }, { halfWidth,  halfHeight, z },
+                     {  halfWidth, -halfHeight, z }, { -halfWidth, -halfHeight, z } },
+                   { 0, 1, 2, 0, 2, 3 } };
+    if (reversed)
+    {
+        std::swap(quad.indices[1], quad.indices[2]);
+        std::swap(quad.indices[4], quad.indices[5]);
+    }
+    return quad;
+}
+
+
+int main()
+{
+#ifdef MATH_USE_SSE
+    std::cout << "Occlusion buffer tests (SSE)\n";
+#else
+    std::cout << "Occlusion buffer tests (scalar)\n";
+#endif
+
+    const CMatrix4x4 identity = MatrixIdentity();
+    COcclusionBuffer buffer;
+
+    //-------------------------------------
+    // Depths
+    //-------------------------------------
+
+    // At depth 10 the quad covers the middle half of the screen in each direction: pixels 64..191 across, 32..95 down
+    SQuad occluder = FacingQuad(5, 2.5f, 10);
+    buffer.Begin(Projection());
+    buffer.AddOccluder(occluder.positions, occluder.indices, 6, identity, true);
+    buffer.Rasterize();
+
+    Check(buffer.NumTriangles() == 2, "both occluder triangles set up");
+    const float occluderDepth = DepthAt(10);
+    Check(std::abs(buffer.Depth(0, 128, 64) - occluderDepth) < 1e-5f, "centre pixel has the occluder's depth");
+    Check(std::abs(buffer.Depth(0,  64, 32) - occluderDepth) < 1e-5f, "top left pixel of the occluder covered");
+    Check(std::abs(buffer.Depth(0, 191, 95) - occluderDepth) < 1e-5f, "bottom right pixel of the occluder covered");
+    Check(buffer.Depth(0,  63, 64) == 1.0f, "pixel left of the occluder cleared");
+    Check(buffer.Depth(0, 192, 64) == 1.0f, "pixel right of the occluder cleared");
+    Check(buffer.Depth(0, 128, 31) == 1.0f, "pixel above the occluder cleared");
+    Check(buffer.Depth(0, 128, 96) == 1.0f, "pixel below the occluder cleared");
+    Check(buffer.Depth(0,   0,  0) == 1.0f, "corner pixel cleared");
+
+    // Each pyramid texel is the furthest of the four below it
+    Check(std::abs(buffer.Depth(1, 64, 32) - occluderDepth) < 1e-5f, "pyramid texel inside the occluder");
+    Check(buffer.Depth(1, 31, 32) == 1.0f, "pyramid texel outside the occluder");
+    Check(buffer.Depth(buffer.NumLevels() - 1, 0, 0) == 1.0f, "top of the pyramid is the furthest depth");
+
+    // Tiles shared among a thread pool give the same buffer
+    std::vector<float> singleThread;
+    for (unsigned int y = 0; y < COcclusionBuffer::Height; ++y)
+    {
+        for (unsigned int x = 0; x < COcclusionBuffer::Width; ++x)  singleThread.push_back(buffer.Depth(0, x, y));
+    }
+    {
+        CThreadPool pool(4);
+        buffer.Begin(Projection());
+        buffer.AddOccluder(occluder.positions, occluder.indices, 6, identity, true);
+        buffer.Rasterize(&pool);
+    }
+    bool same = true;
+    for (unsigned int y = 0; y < COcclusionBuffer::Height; ++y)
+    {
+        for (unsigned int x = 0; x < COcclusionBuffer::Width; ++x)  same = same && buffer.Depth(0, x, y) == singleThread[y * COcclusionBuffer::Width + x];
+    }
+    Check(same, "thread pool rasterizes the same depths");
+
+
+    //-------------------------------------
+    // Box tests
+    //-------------------------------------
+
+    const CVector3 boxMin = { -0.5f, -0.5f, -0.5f };
+    const CVector3 boxMax = {  0.5f,  0.5f,  0.5f };
+    Check(!buffer.IsBoxVisible(boxMin, boxMax, MatrixTranslation({ 0, 0, 20 })), "box behind the occluder hidden");
+    Check(!buffer.IsBoxVisible(boxMin, boxMax, MatrixTranslation({ 5, 2, 30 })), "box behind the occluder off centre hidden");
+    Check( buffer.IsBoxVisible(boxMin, boxMax, MatrixTranslation({ 0, 0,  5 })), "box in front of the occluder visible");
+    Check( buffer.IsBoxVisible(boxMin, boxMax, MatrixTranslation({ 0, 0, 10 })), "box through the occluder visible");
+    Check( buffer.IsBoxVisible(boxMin, boxMax, MatrixTranslation({ 20, 0, 30 })), "box beside the occluder visible");
+    Check( buffer.IsBoxVisible(boxMin, boxMax, MatrixScaling({ 40, 20, 1 }) * MatrixTranslation({ 0, 0, 20 })),
+           "box behind the occluder but wider than it visible");
+
+    // A box crossing the near plane is always visible, even if most of it is behind the occluder
+    Check( buffer.IsBoxVisible({ -0.5f, -0.5f, 0 }, { 0.5f, 0.5f, 50 }, identity), "box crossing the near plane visible");
+
+
+    //-------------------------------------
+    // Rejected triangles
+    //-------------------------------------
+
+    // A triangle crossing the near plane is left out, so occludes nothing. Moving the top right corner of a quad
+    // covering the screen in front of the near plane leaves only the bottom left triangle
+    SQuad crossing = FacingQuad(50, 25, 20);
+    crossing.positions[1].z = 0.5f;
+    buffer.Begin(Projection());
+    buffer.AddOccluder(crossing.positions, crossing.indices, 6, identity, false);
+    buffer.Rasterize();
+    Check(buffer.NumTriangles() == 1, "triangle crossing the near plane left out");
+    Check(buffer.Depth(0, COcclusionBuffer::Width - 1, 0) == 1.0f, "triangle crossing the near plane not rasterized");
+    Check(std::abs(buffer.Depth(0, 0, COcclusionBuffer::Height - 1) - DepthAt(20)) < 1e-5f, "other triangle rasterized");
+
+    // Back faces are left out when culling, and flipped when not
+    SQuad backFacing = FacingQuad(5, 2.5f, 10, true);
+    buffer.Begin(Projection());
+    buffer.AddOccluder(backFacing.positions, backFacing.indices, 6, identity, true);
+    buffer.Rasterize();
+    Check(buffer.NumTriangles() == 0, "back faces culled");
+    Check(buffer.IsBoxVisible(boxMin, boxMax, MatrixTranslation({ 0, 0, 20 })), "culled back faces occlude nothing");
+
+    buffer.Begin(Projection());
+    buffer.AddOccluder(backFacing.positions, backFacing.indices, 6, identity, false);
+    buffer.Rasterize();
+    Check(buffer.NumTriangles() == 2, "back faces kept for two-sided occluders");
+    Check(std::abs(buffer.Depth(0, 128, 64) - occluderDepth) < 1e-5f, "two-sided back faces rasterized");
+    Check(!buffer.IsBoxVisible(boxMin, boxMax, MatrixTranslation({ 0, 0, 20 })), "two-sided back faces occlude");
+
+    if (!sFailed)  std::cout << "All passed\n";
+    return sFailed ? 1 : 0;
+}
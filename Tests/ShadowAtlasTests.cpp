@@ -0,0 +1,182 @@
+//--------------------------------------------------------------------------------------
+// Shadow atlas tests
+//--------------------------------------------------------------------------------------
+// Allocates and frees tiles of the shadow atlas packer (ShadowAtlas.h) and checks the tiles given out. Uses the
+// scene's atlas and minimum tile sizes. Returns non-zero on failure.
+
+#include "ShadowAtlas.h"
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+
+// Reports a failed check and remembers that the test failed
+static bool sFailed = false;
+static void Check(bool passed, const char* description)
+{
+    if (!passed)
+    {
+        std::cerr << "FAILED: " << description << "\n";
+        sFailed = true;
+    }
+}
+
+
+const unsigned int AtlasSize   = 2048;
+const unsigned int MinTileSize = 128;
+
+static bool Overlap(const SAtlasTile& a, const SAtlasTile& b)
+{
+    return a.x < b.x + b.size && b.x < a.x + a.size && a.y < b.y + b.size && b.y < a.y + a.size;
+}
+
+// True if every tile is valid, lies in the atlas, is aligned to its size and overlaps no other
+static bool TilesValid(const std::vector<SAtlasTile>& tiles)
+{
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        const SAtlasTile& tile = tiles[i];
+        if (!tile.Valid() || tile.x + tile.size > AtlasSize || tile.y + tile.size > AtlasSize)  return false;
+        if (tile.x % tile.size != 0 || tile.y % tile.size != 0)  return false;
+        for (size_t j = 0; j < i; ++j)
+        {
+            if (Overlap(tile, tiles[j]))  return false;
+        }
+    }
+    return true;
+}
+
+static unsigned int Area(const std::vector<SAtlasTile>& tiles)
+{
+    unsigned int area = 0;
+    for (auto& tile : tiles)  area += tile.size * tile.size;
+    return area;
+}
+
+// Allocate tiles of the given size until the atlas is full
+static std::vector<SAtlasTile> Fill(CShadowAtlas& atlas, unsigned int size)
+{
+    std::vector<SAtlasTile> tiles;
+    for (SAtlasTile tile = atlas.Allocate(size); tile.Valid(); tile = atlas.Allocate(size))  tiles.push_back(tile);
+    return tiles;
+}
+
+
+int main()
+{
+    std::cout << "Shadow atlas tests\n";
+
+    // Fixed seed so failures can be repeated
+    std::mt19937 random(1234);
+    CShadowAtlas atlas(AtlasSize, MinTileSize);
+
+
+    //-------------------------------------
+    // Tile sizes
+    //-------------------------------------
+
+    // Each size from the minimum to the whole atlas, on an empty atlas
+    bool eachSize = true;
+    for (unsigned int size = MinTileSize; size <= AtlasSize; size *= 2)
+    {
+        atlas.Reset();
+        SAtlasTile tile = atlas.Allocate(size);
+        eachSize = eachSize && tile.size == size && TilesValid({ tile }) && atlas.UsedArea() == size * size;
+    }
+    Check(eachSize, "a tile of each size allocated on an empty atlas");
+
+    atlas.Reset();
+    Check(atlas.Allocate(1).size   == MinTileSize, "small sizes rounded up to the minimum tile size");
+    Check(atlas.Allocate(300).size == 512,         "sizes rounded up to a power of two");
+    Check(!atlas.Allocate(AtlasSize + 1).Valid(),  "tile larger than the atlas not allocated");
+    Check(atlas.TileSize(129) == 256 && atlas.TileSize(128) == 128, "tile size rounds up to a power of two");
+
+
+    //-------------------------------------
+    // Full atlas
+    //-------------------------------------
+
+    // The atlas holds exactly its area in tiles of one size, then allocation fails
+    bool fillsExactly = true;
+    for (unsigned int size = MinTileSize; size <= AtlasSize; size *= 2)
+    {
+        atlas.Reset();
+        std::vector<SAtlasTile> tiles = Fill(atlas, size);
+        fillsExactly = fillsExactly && tiles.size() == (AtlasSize / size) * (AtlasSize / size) && TilesValid(tiles);
+        fillsExactly = fillsExactly && !atlas.Allocate(MinTileSize).Valid();
+    }
+    Check(fillsExactly, "full atlas holds its area in tiles without overlap, then allocation fails");
+
+    // Tiles of random sizes never overlap, and enough requests fill the atlas with no space wasted
+    atlas.Reset();
+    std::vector<SAtlasTile> tiles;
+    std::uniform_int_distribution<unsigned int> anySize(1, AtlasSize / 2);
+    for (int i = 0; i < 1000; ++i)
+    {
+        SAtlasTile tile = atlas.Allocate(anySize(random));
+        if (tile.Valid())  tiles.push_back(tile);
+    }
+    Check(TilesValid(tiles), "tiles of mixed sizes don't overlap");
+    Check(atlas.UsedArea() == Area(tiles), "used area is the area of the tiles");
+    Check(atlas.UsedArea() == AtlasSize * AtlasSize, "mixed sizes fill the atlas");
+
+
+    //-------------------------------------
+    // Freeing
+    //-------------------------------------
+
+    // Freeing every tile in any order joins the quarters back up into the whole atlas
+    std::shuffle(tiles.begin(), tiles.end(), random);
+    for (auto& tile : tiles)  atlas.Free(tile);
+    Check(atlas.UsedArea() == 0, "no area used after freeing every tile");
+    Check(atlas.Allocate(AtlasSize).Valid(), "freed quarters merged back into the whole atlas");
+
+    atlas.Reset();
+    tiles = Fill(atlas, MinTileSize);
+    std::shuffle(tiles.begin(), tiles.end(), random);
+    for (auto& tile : tiles)  atlas.Free(tile);
+    Check(atlas.Allocate(AtlasSize).Valid(), "freed minimum size tiles merged back into the whole atlas");
+
+    // Three free quarters are not joined, so a tile of the parent's size doesn't fit there
+    atlas.Reset();
+    tiles = Fill(atlas, AtlasSize / 4);
+    SAtlasTile parent = { tiles[0].x & ~(AtlasSize / 2 - 1), tiles[0].y & ~(AtlasSize / 2 - 1), AtlasSize / 2 };
+    std::vector<SAtlasTile> inParent;
+    for (auto& tile : tiles)
+    {
+        if (Overlap(tile, parent))  inParent.push_back(tile);
+    }
+    for (size_t i = 0; i < 3; ++i)  atlas.Free(inParent[i]);
+    Check(!atlas.Allocate(AtlasSize / 2).Valid(), "three free quarters not merged");
+    atlas.Free(inParent[3]);
+    SAtlasTile merged = atlas.Allocate(AtlasSize / 2);
+    Check(merged.Valid() && merged.x == parent.x && merged.y == parent.y, "four free quarters merged into their parent");
+
+    // Freed tiles are given out again, and don't overlap those still in use
+    atlas.Reset();
+    tiles = Fill(atlas, MinTileSize);
+    std::shuffle(tiles.begin(), tiles.end(), random);
+    std::vector<SAtlasTile> kept(tiles.begin() + tiles.size() / 2, tiles.end());
+    for (size_t i = 0; i < tiles.size() / 2; ++i)  atlas.Free(tiles[i]);
+    std::vector<SAtlasTile> reused = Fill(atlas, MinTileSize);
+    Check(reused.size() == tiles.size() / 2, "every freed tile given out again");
+    reused.insert(reused.end(), kept.begin(), kept.end());
+    Check(TilesValid(reused), "reused tiles don't overlap the tiles in use");
+
+    atlas.Reset();
+    SAtlasTile first = atlas.Allocate(256);
+    atlas.Allocate(256);
+    atlas.Free(first);
+    SAtlasTile again = atlas.Allocate(256);
+    Check(again.x == first.x && again.y == first.y, "a freed tile is reused before splitting another");
+
+    // Invalid tiles are ignored
+    unsigned int usedArea = atlas.UsedArea();
+    atlas.Free(SAtlasTile());
+    Check(atlas.UsedArea() == usedArea, "freeing an invalid tile does nothing");
+
+    if (!sFailed)  std::cout << "All passed\n";
+    return sFailed ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+//--------------------------------------------------------------------------------------
+// Transform system tests
+//--------------------------------------------------------------------------------------
+// Checks the world matrices the transform system (TransformSystem.h) builds, in batches and one at a time, and its
+// hierarchies: changes reaching every descendant and no other entry, cycles refused and removal detaching children.
+// Built twice (see CMakeLists.txt), with the SIMD batches and with MATH_NO_SIMD. Returns non-zero on failure.
+
+#include "TransformSystem.h"
+#include "ThreadPool.h"
+#include "MathSIMD.h"
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+
+// Reports a failed check and remembers that the test failed
+static bool sFailed = false;
+static void Check(bool passed, const char* description)
+{
+    if (!passed)
+    {
+        std::cerr << "FAILED: " << description << "\n";
+        sFailed = true;
+    }
+}
+
+// True if every element of the two matrices is within the tolerance, relative to the element size for large values
+static bool MatricesClose(const CMatrix4x4& a, const CMatrix4x4& b, float tolerance)
+{
+    const float* ea = &a.e00;
+    const float* eb = &b.e00;
+    for (int i = 0; i < 16; ++i)
+    {
+        float size = std::max(1.0f, std::max(std::abs(ea[i]), std::abs(eb[i])));
+        if (std::abs(ea[i] - eb[i]) > tolerance * size)  return false;
+    }
+    return true;
+}
+
+// Tolerance of matrices built in different ways, relative to each element's size. The batched update computes sine
+// and cosine with its own polynomials (SinCosSSE) rather than std::sin and std::cos, both accurate to about a unit in
+// the last place, and hierarchies multiply their matrices in a different order to the expected results here, so the
+// elements may differ by a few units in the last place (about 1e-7 each)
+const float Tolerance = 1e-5f;
+
+
+// The local matrix of an entry, as its transform describes it
+static CMatrix4x4 LocalMatrix(CTransformSystem& transforms, STransformHandle h)
+{
+    return MatrixFromTRS(transforms.Position(h), transforms.Rotation(h), transforms.Scale(h));
+}
+
+// The world matrix of an entry by multiplying the local matrices up the chain of its ancestors
+static CMatrix4x4 ChainMatrix(CTransformSystem& transforms, STransformHandle h)
+{
+    CMatrix4x4 world = LocalMatrix(transforms, h);
+    for (STransformHandle ancestor = transforms.Parent(h); ancestor.Valid(); ancestor = transforms.Parent(ancestor))
+    {
+        world = world * LocalMatrix(transforms, ancestor);
+    }
+    return world;
+}
+
+
+int main()
+{
+#ifdef MATH_USE_SSE
+    std::cout << "Transform system tests (SSE)\n";
+#else
+    std::cout << "Transform system tests (scalar)\n";
+#endif
+
+    // Fixed seed so failures can be repeated
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> angle(-100, 100); // Several turns either way, so the batches reduce angles
+    std::uniform_real_distribution<float> coordinate(-1000, 1000);
+    std::uniform_real_distribution<float> scaling(0.1f, 10);
+    auto anyPosition = [&]() { return CVector3{ coordinate(random), coordinate(random), coordinate(random) }; };
+    auto anyRotation = [&]() { return CVector3{ angle(random), angle(random), angle(random) }; };
+    auto anyScale    = [&]() { return CVector3{ scaling(random), scaling(random), scaling(random) }; };
+
+
+    //-------------------------------------
+    // Batched against single updates
+    //-------------------------------------
+
+    // Sizes that leave the last group of four part used, and enough entries to share batches among a thread pool
+    CThreadPool pool(4);
+    bool batchesMatch = true, allRebuilt = true;
+    for (uint32_t numEntries : { 1u, 2u, 3u, 5u, 7u, 1001u, 40003u })
+    {
+        CTransformSystem batched, single;
+        std::vector<STransformHandle> handles;
+        for (uint32_t i = 0; i < numEntries; ++i)
+        {
+            CVector3 position = anyPosition(), rotation = anyRotation(), scale = anyScale();
+            handles.push_back(batched.Add(position, rotation, scale));
+            single.Add(position, rotation, scale);
+        }
+        batched.UpdateAll(numEntries > 1000 ? &pool : nullptr);
+        allRebuilt = allRebuilt && batched.Rebuilds() == numEntries;
+
+        // Reading a matrix rebuilds that entry alone with std::sin and std::cos
+        for (auto h : handles)  batchesMatch = batchesMatch && MatricesClose(batched.WorldMatrix(h), single.WorldMatrix(h), Tolerance);
+
+        // Changing some entries rebuilds only those
+        batched.ResetRebuilds();
+        for (uint32_t i = 0; i < numEntries; i += 3)
+        {
+            CVector3 rotation = anyRotation();
+            batched.SetRotation(handles[i], rotation);
+            single.SetRotation(handles[i], rotation);
+        }
+        batched.UpdateAll(numEntries > 1000 ? &pool : nullptr);
+        allRebuilt = allRebuilt && batched.Rebuilds() == (numEntries + 2) / 3;
+        for (auto h : handles)  batchesMatch = batchesMatch && MatricesClose(batched.WorldMatrix(h), single.WorldMatrix(h), Tolerance);
+    }
+    Check(batchesMatch, "batched updates match single updates for every size");
+    Check(allRebuilt,   "batched updates rebuild exactly the changed entries");
+
+
+    //-------------------------------------
+    // Hierarchy
+    //-------------------------------------
+
+    // root
+    //  |- a
+    //  |  |- c
+    //  |  |  '- e
+    //  |  '- d
+    //  '- b
+    // other - f         unrelated hierarchy
+    // alone             in no hierarchy
+    CTransformSystem transforms;
+    auto add = [&]() { return transforms.Add(anyPosition() * 0.01f, anyRotation(), anyScale() * 0.2f); };
+    STransformHandle root = add(), a = add(), b = add(), c = add(), d = add(), e = add();
+    STransformHandle other = add(), f = add(), alone = add();
+    transforms.SetParent(a, root);
+    transforms.SetParent(b, root);
+    transforms.SetParent(c, a);
+    transforms.SetParent(d, a);
+    transforms.SetParent(e, c);
+    transforms.SetParent(f, other);
+    transforms.UpdateAll();
+    std::vector<STransformHandle> all = { root, a, b, c, d, e, other, f, alone };
+
+    auto chainsMatch = [&]()
+    {
+        bool match = true;
+        for (auto h : all)  match = match && MatricesClose(transforms.WorldMatrix(h), ChainMatrix(transforms, h), Tolerance);
+        return match;
+    };
+    Check(chainsMatch(), "world matrices are the product of the local matrices up the hierarchy");
+
+    // Changing an entry rebuilds it and every descendant, and nothing else
+    auto changeAndUpdate = [&](STransformHandle changed, std::vector<STransformHandle> expected, const char* description)
+    {
+        std::vector<unsigned int> versions;
+        for (auto h : all)  versions.push_back(transforms.Version(h));
+        transforms.SetPosition(changed, anyPosition() * 0.01f);
+        transforms.ResetRebuilds();
+        transforms.UpdateAll();
+
+        bool rebuiltExpected = transforms.Rebuilds() == expected.size();
+        for (size_t i = 0; i < all.size(); ++i)
+        {
+            bool shouldChange = std::find_if(expected.begin(), expected.end(), [&](STransformHandle h) { return h.index == all[i].index; }) != expected.end();
+            rebuiltExpected = rebuiltExpected && (transforms.Version(all[i]) != versions[i]) == shouldChange;
+        }
+        Check(rebuiltExpected, description);
+        Check(chainsMatch(), "world matrices follow the change");
+    };
+    changeAndUpdate(root,  { root, a, b, c, d, e }, "changing the root rebuilds the whole hierarchy");
+    changeAndUpdate(a,     { a, c, d, e },          "changing a parent rebuilds its subtree only");
+    changeAndUpdate(c,     { c, e },                "changing a grandchild rebuilds its subtree only");
+    changeAndUpdate(b,     { b },                   "changing a leaf rebuilds the leaf only");
+    changeAndUpdate(f,     { f },                   "changing another hierarchy leaves this one alone");
+    changeAndUpdate(alone, { alone },               "changing an entry outside any hierarchy rebuilds it alone");
+
+    // Reading a descendant's matrix between updates brings it up to date with its ancestors
+    transforms.SetRotation(root, anyRotation());
+    Check(MatricesClose(transforms.WorldMatrix(e), ChainMatrix(transforms, e), Tolerance), "reading a matrix updates it from a changed ancestor");
+    transforms.UpdateAll();
+    Check(chainsMatch(), "update after reading a matrix");
+
+    // A long chain, deeper than a recursive update could manage
+    CTransformSystem chain;
+    std::vector<STransformHandle> links;
+    for (int i = 0; i < 10000; ++i)
+    {
+        links.push_back(chain.Add({ 0, 0, 1 }, { 0, 0, 0 }, { 1, 1, 1 }));
+        if (i > 0)  chain.SetParent(links[i], links[i - 1]);
+    }
+    chain.UpdateAll();
+    chain.SetPosition(links[0], { 5, 0, 0 });
+    chain.UpdateAll();
+    CVector3 end = chain.WorldMatrix(links.back()).GetPosition();
+    Check(end.x == 5 && end.y == 0 && end.z == 9999, "moving the root of a long chain moves its end");
+
+
+    //-------------------------------------
+    // Reparenting and cycles
+    //-------------------------------------
+
+    Check(!transforms.SetParent(root, e),    "attaching an entry to its descendant refused");
+    Check(!transforms.SetParent(a, a),       "attaching an entry to itself refused");
+    Check(!transforms.Parent(root).Valid(),  "refused attachment changes nothing");
+    Check(transforms.Parent(a).index == root.index, "refused attachment keeps the parent");
+
+    Check(transforms.SetParent(c, other), "moving a subtree to another hierarchy");
+    transforms.UpdateAll();
+    Check(transforms.Parent(e).index == c.index && chainsMatch(), "moved subtree follows its new parent");
+    changeAndUpdate(other, { other, f, c, e }, "changing the new parent rebuilds the moved subtree");
+    changeAndUpdate(a,     { a, d },           "changing the old parent no longer rebuilds the moved subtree");
+
+
+    //-------------------------------------
+    // Removal
+    //-------------------------------------
+
+    // Removing a parent leaves its children in no hierarchy, placed by their own transforms, and their children still
+    // attached to them
+    size_t size = transforms.Size();
+    transforms.Remove(other);
+    all.erase(std::find_if(all.begin(), all.end(), [&](STransformHandle h) { return h.index == other.index; }));
+    transforms.UpdateAll();
+    Check(transforms.Size() == size - 1, "removed entry no longer counted");
+    Check(!transforms.Parent(f).Valid() && !transforms.Parent(c).Valid(), "removing a parent detaches its children");
+    Check(transforms.Parent(e).index == c.index, "removing a parent keeps its grandchildren attached");
+    Check(MatricesClose(transforms.WorldMatrix(f), LocalMatrix(transforms, f), Tolerance), "detached child placed by its own transform");
+    Check(MatricesClose(transforms.WorldMatrix(e), ChainMatrix(transforms, e), Tolerance), "grandchild follows its detached parent");
+    changeAndUpdate(c, { c, e }, "detached child still updates its own subtree");
+
+    STransformHandle reused = transforms.Add({ 0, 0, 0 }, { 0, 0, 0 }, { 1, 1, 1 });
+    Check(reused.index == other.index && !transforms.Parent(reused).Valid(), "removed entry reused with no parent");
+
+    if (!sFailed)  std::cout << "All passed\n";
+    return sFailed ? 1 : 0;
+}
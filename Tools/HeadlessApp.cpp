@@ -0,0 +1,164 @@
+//--------------------------------------------------------------------------------------
+// Shared set-up for the headless tools
+//--------------------------------------------------------------------------------------
+
+#include "HeadlessApp.h"
+#include "Direct3DSetup.h"
+#include "HeadlessRenderBackend.h"
+
+#include <memory>
+#include <stdexcept>
+#include <cstring>
+
+
+//--------------------------------------------------------------------------------------
+// Global Variables
+//--------------------------------------------------------------------------------------
+// Defined by Main.cpp and Scene.cpp in the app
+
+int gViewportWidth  = 1280;
+int gViewportHeight = 720;
+
+std::string gLastError;
+
+const float ROTATION_SPEED = 2.0f;
+const float MOVEMENT_SPEED = 50.0f;
+
+PerFrameConstants gPerFrameConstants;
+ID3D11Buffer*     gPerFrameConstantBuffer = nullptr;
+PerViewConstants  gPerViewConstants;
+ID3D11Buffer*     gPerViewConstantBuffer  = nullptr;
+PerModelConstants gPerModelConstants;
+ID3D11Buffer*     gPerModelConstantBuffer = nullptr;
+
+
+
+//--------------------------------------------------------------------------------------
+// Initialise / uninitialise
+//--------------------------------------------------------------------------------------
+
+// As CreateConstantBuffer in Shader.cpp, which is part of the scene so isn't in the portable build
+static ID3D11Buffer* CreateHeadlessConstantBuffer(unsigned int size)
+{
+    D3D11_BUFFER_DESC cbDesc = {};
+    cbDesc.BindFlags      = D3D11_BIND_CONSTANT_BUFFER;
+    cbDesc.ByteWidth      = 16 * ((size + 15) / 16);
+    cbDesc.Usage          = D3D11_USAGE_DYNAMIC;
+    cbDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    ID3D11Buffer* constantBuffer = nullptr;
+    if (FAILED(gRenderDevice->CreateBuffer(&cbDesc, nullptr, &constantBuffer)))  return nullptr;
+    return constantBuffer;
+}
+
+
+CHeadlessRenderContext* InitHeadlessApp()
+{
+    CHeadlessRenderContext* context = InitHeadlessRenderer();
+    if (context == nullptr)  return nullptr;
+
+    gPerFrameConstantBuffer = CreateHeadlessConstantBuffer(sizeof(gPerFrameConstants));
+    gPerViewConstantBuffer  = CreateHeadlessConstantBuffer(sizeof(gPerViewConstants));
+    gPerModelConstantBuffer = CreateHeadlessConstantBuffer(sizeof(gPerModelConstants));
+    if (gPerFrameConstantBuffer == nullptr || gPerViewConstantBuffer == nullptr || gPerModelConstantBuffer == nullptr)
+    {
+        gLastError = "Error creating constant buffers";
+        ShutdownHeadlessApp();
+        return nullptr;
+    }
+    return context;
+}
+
+
+void ShutdownHeadlessApp()
+{
+    if (gRenderDevice)
+    {
+        gRenderDevice->Release(gPerModelConstantBuffer);
+        gRenderDevice->Release(gPerViewConstantBuffer);
+        gRenderDevice->Release(gPerFrameConstantBuffer);
+    }
+    gPerModelConstantBuffer = nullptr;
+    gPerViewConstantBuffer  = nullptr;
+    gPerFrameConstantBuffer = nullptr;
+    ShutdownHeadlessRenderer();
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Resources
+//--------------------------------------------------------------------------------------
+
+static const unsigned char sPlaceholderByteCode[4] = { 'D', 'X', 'B', 'C' };
+
+ID3D11VertexShader* CreateHeadlessVertexShader()
+{
+    ID3D11VertexShader* shader = nullptr;
+    gRenderDevice->CreateVertexShader(sPlaceholderByteCode, sizeof(sPlaceholderByteCode), &shader);
+    return shader;
+}
+
+ID3D11PixelShader* CreateHeadlessPixelShader()
+{
+    ID3D11PixelShader* shader = nullptr;
+    gRenderDevice->CreatePixelShader(sPlaceholderByteCode, sizeof(sPlaceholderByteCode), &shader);
+    return shader;
+}
+
+
+Mesh* CreateBoxMesh(const CVector3& size /*= { 1, 1, 1 }*/)
+{
+    struct SVertex
+    {
+        CVector3 position;
+        CVector3 normal;
+        CVector2 uv;
+    };
+    const unsigned int NumFaces = 6;
+
+    SMeshSource source;
+    source.vertices = std::make_unique<unsigned char[]>(NumFaces * 4 * sizeof(SVertex));
+    source.indices  = std::make_unique<unsigned char[]>(NumFaces * 6 * sizeof(uint16_t));
+    SVertex*  vertices = reinterpret_cast<SVertex*>(source.vertices.get());
+    uint16_t* indices  = reinterpret_cast<uint16_t*>(source.indices.get());
+
+    // Each face is a quad seen from outside the box with "right" and "up" axes, its corners in clockwise order
+    CVector3 halfSize = size * 0.5f;
+    const CVector3 normals[NumFaces] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    for (unsigned int face = 0; face < NumFaces; ++face)
+    {
+        CVector3 normal = normals[face];
+        CVector3 up     = (normal.y != 0) ? CVector3{ 0, 0, 1 } : CVector3{ 0, 1, 0 };
+        CVector3 right  = Cross(normal, up);
+        const float cornerRight[4] = { -1,  1,  1, -1 };
+        const float cornerUp[4]    = {  1,  1, -1, -1 };
+        for (unsigned int corner = 0; corner < 4; ++corner)
+        {
+            CVector3 position = normal + right * cornerRight[corner] + up * cornerUp[corner];
+            SVertex& vertex = vertices[face * 4 + corner];
+            vertex.position = { position.x * halfSize.x, position.y * halfSize.y, position.z * halfSize.z };
+            vertex.normal   = normal;
+            vertex.uv       = { (cornerRight[corner] + 1) * 0.5f, (1 - cornerUp[corner]) * 0.5f };
+        }
+        const uint16_t quad[6] = { 0, 1, 2, 0, 2, 3 };
+        for (unsigned int i = 0; i < 6; ++i)  indices[face * 6 + i] = static_cast<uint16_t>(face * 4 + quad[i]);
+    }
+
+    SMeshData& data = source.data;
+    data.vertexElements.push_back( { "Position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(SVertex, position), D3D11_INPUT_PER_VERTEX_DATA, 0 } );
+    data.vertexElements.push_back( { "Normal",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(SVertex, normal),   D3D11_INPUT_PER_VERTEX_DATA, 0 } );
+    data.vertexElements.push_back( { "UV",       0, DXGI_FORMAT_R32G32_FLOAT,    0, offsetof(SVertex, uv),       D3D11_INPUT_PER_VERTEX_DATA, 0 } );
+    data.vertexSize     = sizeof(SVertex);
+    data.numVertices    = NumFaces * 4;
+    data.numIndices     = NumFaces * 6;
+    data.indexSize      = sizeof(uint16_t);
+    data.subMeshes.push_back( { 0, data.numIndices, 0, 0 } );
+    data.vertices       = source.vertices.get();
+    data.indices        = source.indices.get();
+    data.boundsMin      = -halfSize;
+    data.boundsMax      = halfSize;
+    data.boundingCentre = { 0, 0, 0 };
+    data.boundingRadius = Length(halfSize);
+
+    return new Mesh("Box", source);
+}
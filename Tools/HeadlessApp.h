@@ -0,0 +1,33 @@
+//--------------------------------------------------------------------------------------
+// Shared set-up for the headless tools
+//--------------------------------------------------------------------------------------
+// Stands in for Main.cpp and the start of Scene.cpp in the tools of the portable build (see CMakeLists.txt): defines
+// the globals they define, starts the headless render backend and creates the constant buffers. Meshes are built in
+// code, as the portable build has no assimp to load mesh files with.
+
+#ifndef _HEADLESS_APP_H_INCLUDED_
+#define _HEADLESS_APP_H_INCLUDED_
+
+#include "Common.h"
+#include "Mesh.h"
+
+class CHeadlessRenderContext;
+
+
+// Start the headless render backend and create the per-frame, per-view and per-model constant buffers. Returns the
+// context to read the command log from, or nullptr on failure (with gLastError set)
+CHeadlessRenderContext* InitHeadlessApp();
+
+// Release the constant buffers and the backend
+void ShutdownHeadlessApp();
+
+// Placeholder for a shader, made from a few bytes instead of compiled code, which is all the headless device checks
+ID3D11VertexShader* CreateHeadlessVertexShader();
+ID3D11PixelShader*  CreateHeadlessPixelShader();
+
+// A box of the given size centred on the origin, with positions, normals and uvs as an imported mesh would have.
+// Throws a std::runtime_error exception on failure, as the mesh constructor does
+Mesh* CreateBoxMesh(const CVector3& size = { 1, 1, 1 });
+
+
+#endif //_HEADLESS_APP_H_INCLUDED_
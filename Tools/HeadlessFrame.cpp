@@ -0,0 +1,193 @@
+//--------------------------------------------------------------------------------------
+// Headless frame test
+//--------------------------------------------------------------------------------------
+// Renders a few frames of a simple scene through the headless render backend, the way CSceneManager::RenderScene
+// does - per-frame and per-view constants, light binning, frustum culling, then the sorted draw queue - and checks
+// what reached the command log. Also checks that every object created is freed again. Run with the number of frames
+// as the argument (default 1). Returns non-zero on failure, so it can run as a test on machines without a GPU.
+
+#include "HeadlessApp.h"
+#include "HeadlessRenderBackend.h"
+#include "Direct3DSetup.h"
+#include "GraphicsHelpers.h"
+#include "Camera.h"
+#include "Model.h"
+#include "ModelPool.h"
+#include "DrawQueue.h"
+#include "LightClusters.h"
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <stdexcept>
+
+
+// Reports a failed check and remembers that the test failed
+static bool sFailed = false;
+static void Check(bool passed, const char* description)
+{
+    if (!passed)
+    {
+        std::cerr << "FAILED: " << description << "\n";
+        sFailed = true;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    unsigned int numFrames = (argc > 1) ? static_cast<unsigned int>(std::atoi(argv[1])) : 1;
+    if (numFrames == 0)  numFrames = 1;
+
+    CHeadlessRenderContext* context = InitHeadlessApp();
+    if (context == nullptr)
+    {
+        std::cerr << "Error starting headless renderer: " << gLastError << "\n";
+        return 1;
+    }
+    auto device = static_cast<CHeadlessRenderDevice*>(gRenderDevice);
+    const unsigned int baseObjects = device->NumObjects();
+
+    {
+        //-------------------------------------
+        // Scene set-up
+        //-------------------------------------
+
+        Mesh* boxMesh = nullptr;
+        try
+        {
+            boxMesh = CreateBoxMesh({ 2, 2, 2 });
+        }
+        catch (std::runtime_error& e)
+        {
+            std::cerr << "Error creating box mesh: " << e.what() << "\n";
+            ShutdownHeadlessApp();
+            return 1;
+        }
+
+        // A grid of boxes in front of the camera, all in view, and the same grid behind it, all culled
+        const unsigned int GridSize = 10;
+        const float        GridSpacing = 4;
+        CModelPool models;
+        models.Reserve(GridSize * GridSize * 2);
+        for (float z : { 100.0f, -100.0f })
+        {
+            for (unsigned int y = 0; y < GridSize; ++y)
+            {
+                for (unsigned int x = 0; x < GridSize; ++x)
+                {
+                    CVector3 position = { (x - GridSize * 0.5f) * GridSpacing, (y - GridSize * 0.5f) * GridSpacing, z };
+                    models.Add(Model(boxMesh, position));
+                }
+            }
+        }
+        const unsigned int numVisible = GridSize * GridSize;
+
+        const unsigned int NumLights = 16;
+        std::vector<PointLight> pointLights(NumLights);
+        for (unsigned int i = 0; i < NumLights; ++i)
+        {
+            pointLights[i].position = { (i % 4) * 10.0f - 15, (i / 4) * 10.0f - 15, 95 };
+            pointLights[i].range    = 20;
+            pointLights[i].colour   = { 1, 1, 1 };
+        }
+        CLightClusters lightClusters;
+        Check(lightClusters.CreateResources(NumLights, 1), "light cluster resources created");
+
+        Camera camera({ 0, 0, 0 }, { 0, 0, 0 }, PI / 3, static_cast<float>(gViewportWidth) / gViewportHeight, 1, 1000);
+
+        SDrawState state;
+        state.vertexShader          = CreateHeadlessVertexShader();
+        state.instancedVertexShader = CreateHeadlessVertexShader();
+        state.pixelShader           = CreateHeadlessPixelShader();
+        CDrawQueue drawQueue(1);
+
+
+        //-------------------------------------
+        // Frames
+        //-------------------------------------
+
+        unsigned int culled = 0;
+        for (unsigned int frame = 0; frame < numFrames; ++frame)
+        {
+            Model::Transforms().UpdateAll();
+
+            gPerFrameConstants.ambientColour = { 0.2f, 0.2f, 0.2f };
+            gPerFrameConstants.specularPower = 256;
+            gPerFrameConstants.clusterCountX = lightClusters.CountX();
+            gPerFrameConstants.clusterCountY = lightClusters.CountY();
+            gPerFrameConstants.clusterCountZ = lightClusters.CountZ();
+            UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
+            gRenderContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+            gRenderContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+            gRenderContext->VSSetConstantBuffers(2, 1, &gPerViewConstantBuffer);
+            gRenderContext->PSSetConstantBuffers(2, 1, &gPerViewConstantBuffer);
+            lightClusters.SetLights(pointLights.data(), NumLights, nullptr, 0);
+
+            gRenderContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
+            const FLOAT background[4] = { 0.2f, 0.2f, 0.3f, 1 };
+            gRenderContext->ClearRenderTargetView(gBackBufferRenderTarget, background);
+            gRenderContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+            D3D11_VIEWPORT vp = { 0, 0, static_cast<FLOAT>(gViewportWidth), static_cast<FLOAT>(gViewportHeight), 0, 1 };
+            gRenderContext->RSSetViewports(1, &vp);
+
+            // As RenderSceneFromCamera
+            gPerViewConstants.viewMatrix           = camera.ViewMatrix();
+            gPerViewConstants.projectionMatrix     = camera.ProjectionMatrix();
+            gPerViewConstants.viewProjectionMatrix = camera.ViewProjectionMatrix();
+            gPerViewConstants.cameraPosition       = camera.WorldPosition();
+            lightClusters.Bin(gPerViewConstants.viewMatrix, gPerViewConstants.projectionMatrix, camera.NearClip(), camera.FarClip());
+            gPerViewConstants.clusterDepthScale    = lightClusters.DepthScale();
+            gPerViewConstants.clusterDepthBias     = lightClusters.DepthBias();
+            UpdateConstantBuffer(gPerViewConstantBuffer, gPerViewConstants);
+            lightClusters.Upload(6);
+
+            CFrustum frustum(gPerViewConstants.viewProjectionMatrix);
+            drawQueue.Clear();
+            for (auto& model : models)
+            {
+                if (!model.IsInFrustum(frustum)) { ++culled; continue; }
+                drawQueue.Add(0, state, &model);
+            }
+            drawQueue.Sort();
+            drawQueue.Submit();
+
+            gRenderContext->Present();
+        }
+
+
+        //-------------------------------------
+        // Checks
+        //-------------------------------------
+
+        Check(context->Count(ERenderCommand::Present) == numFrames, "one present per frame");
+        Check(culled == (models.Size() - numVisible) * numFrames, "boxes behind the camera culled");
+        Check(drawQueue.ModelsDrawn() == numVisible * numFrames, "boxes in front of the camera drawn");
+        Check(drawQueue.DrawCalls() > 0 && drawQueue.DrawCalls() <= numFrames, "identical boxes instanced into one draw per frame");
+        Check(context->Count(ERenderCommand::DrawIndexedInstanced) == drawQueue.DrawCalls(), "draw calls reach the context");
+        Check(lightClusters.NumLightIndices() > 0, "lights binned into clusters");
+
+        std::cout << numFrames << " frame(s): " << context->Commands().size() << " commands, "
+                  << drawQueue.DrawCalls() << " draw calls for " << drawQueue.ModelsDrawn() << " models, "
+                  << culled << " culled, " << drawQueue.BindsIssued() << " binds issued, "
+                  << drawQueue.BindsSkipped() << " skipped, " << context->BytesUploaded() << " bytes uploaded\n";
+
+
+        //-------------------------------------
+        // Release
+        //-------------------------------------
+
+        drawQueue.ReleaseResources();
+        lightClusters.ReleaseResources();
+        gRenderDevice->Release(state.vertexShader);
+        gRenderDevice->Release(state.instancedVertexShader);
+        gRenderDevice->Release(state.pixelShader);
+        models.Clear();
+        delete boxMesh;
+    }
+
+    Check(device->NumObjects() == baseObjects, "every object created by the frame released");
+
+    ShutdownHeadlessApp();
+    return sFailed ? 1 : 0;
+}
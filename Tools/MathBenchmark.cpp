@@ -0,0 +1,173 @@
+//--------------------------------------------------------------------------------------
+// Maths library benchmark
+//--------------------------------------------------------------------------------------
+// Times the matrix kernels (MathSIMD.h) and the world matrix builders over arrays of elements and reports the cost
+// per element. Run with the number of elements as the argument (default 100,000). Each case is run several times and
+// the fastest run is reported. Built twice (see CMakeLists.txt): compare MathBenchmark with MathBenchmarkNoSIMD, the
+// same code on the scalar path, to see the gain from the SIMD kernels.
+
+#include "CMatrix4x4.h"
+#include "CQuaternion.h"
+#include "MathSIMD.h"
+#include "Timer.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <cstdlib>
+
+
+// Time the given function, returning the fastest of a few runs in seconds
+template <class Function>
+static float Fastest(Function function)
+{
+    const int NumRuns = 5;
+    Timer timer;
+    float fastest = 0;
+    for (int run = 0; run < NumRuns; ++run)
+    {
+        timer.Reset();
+        function();
+        float time = timer.GetTime();
+        if (run == 0 || time < fastest)  fastest = time;
+    }
+    return fastest;
+}
+
+// Print a result as nanoseconds per element, with the speed up over a baseline time if given
+static void Report(const char* name, float time, size_t count, float baseline = 0)
+{
+    std::cout << "  " << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(8) << time * 1e9f / count << " ns";
+    if (baseline > 0)  std::cout << "  (x" << baseline / time << ")";
+    std::cout << "\n";
+}
+
+// Results are summed into this so the timed loops aren't optimised away
+static volatile float sSink;
+static void Consume(const std::vector<CMatrix4x4>& matrices)
+{
+    float sum = 0;
+    for (auto& m : matrices)  sum += m.e00 + m.e31;
+    sSink = sum;
+}
+
+
+int main(int argc, char* argv[])
+{
+    size_t count = (argc > 1) ? static_cast<size_t>(std::atol(argv[1])) : 100000;
+    if (count == 0)  count = 1;
+
+#ifdef MATH_USE_SSE
+    std::cout << "Maths benchmark (SSE), " << count << " elements\n";
+#else
+    std::cout << "Maths benchmark (scalar), " << count << " elements\n";
+#endif
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> angle(-PI, PI);
+    std::uniform_real_distribution<float> coordinate(-1000, 1000);
+    std::uniform_real_distribution<float> scaling(0.1f, 10);
+
+    std::vector<CVector3>    positions(count), rotations(count), scales(count);
+    std::vector<CQuaternion> quaternions(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        positions[i]   = { coordinate(random), coordinate(random), coordinate(random) };
+        rotations[i]   = { angle(random), angle(random), angle(random) };
+        scales[i]      = { scaling(random), scaling(random), scaling(random) };
+        quaternions[i] = QuaternionFromEulerAngles(rotations[i]);
+    }
+    std::vector<CMatrix4x4> matrices(count);
+    for (size_t i = 0; i < count; ++i)  matrices[i] = MatrixFromTRS(positions[i], rotations[i], scales[i]);
+
+
+    //-------------------------------------
+    // Kernels
+    //-------------------------------------
+
+    std::cout << "Matrix kernels per element:\n";
+    std::vector<CMatrix4x4> results(count);
+    float multiply = Fastest([&]()
+    {
+        for (size_t i = 0; i + 1 < count; ++i)  results[i] = matrices[i] * matrices[i + 1];
+    });
+    Consume(results);
+    Report("matrix multiply", multiply, count);
+
+    float multiplyInPlace = Fastest([&]()
+    {
+        for (size_t i = 0; i + 1 < count; ++i)
+        {
+            results[i] = matrices[i];
+            results[i] *= matrices[i + 1];
+        }
+    });
+    Consume(results);
+    Report("matrix multiply in place", multiplyInPlace, count);
+
+    float inverse = Fastest([&]()
+    {
+        for (size_t i = 0; i < count; ++i)  results[i] = InverseAffine(matrices[i]);
+    });
+    Consume(results);
+    Report("InverseAffine", inverse, count);
+
+    // The batch functions against transforming each vector in turn
+    std::vector<CVector3> transformed(count);
+    const CMatrix4x4& m = matrices[0];
+    float onePoint = Fastest([&]()
+    {
+        for (size_t i = 0; i < count; ++i)  transformed[i] = m.TransformPoint(positions[i]);
+    });
+    sSink = transformed[count - 1].x;
+    Report("TransformPoint, one at a time", onePoint, count);
+
+    float points = Fastest([&]()
+    {
+        TransformPoints(m, positions.data(), transformed.data(), count);
+    });
+    sSink = transformed[count - 1].x;
+    Report("TransformPoints", points, count, onePoint);
+
+    float normals = Fastest([&]()
+    {
+        TransformNormals(m, positions.data(), transformed.data(), count);
+    });
+    sSink = transformed[count - 1].x;
+    Report("TransformNormals", normals, count);
+
+
+    //-------------------------------------
+    // World matrices
+    //-------------------------------------
+
+    std::cout << "World matrix per model:\n";
+    float composed = Fastest([&]()
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            matrices[i] = MatrixScaling(scales[i]) * MatrixRotationZ(rotations[i].z) * MatrixRotationX(rotations[i].x) *
+                          MatrixRotationY(rotations[i].y) * MatrixTranslation(positions[i]);
+        }
+    });
+    Consume(matrices);
+    Report("five composed matrices", composed, count);
+
+    float fusedEuler = Fastest([&]()
+    {
+        for (size_t i = 0; i < count; ++i)  matrices[i] = MatrixFromTRS(positions[i], rotations[i], scales[i]);
+    });
+    Consume(matrices);
+    Report("MatrixFromTRS, Euler angles", fusedEuler, count, composed);
+
+    float fusedQuaternion = Fastest([&]()
+    {
+        for (size_t i = 0; i < count; ++i)  matrices[i] = MatrixFromTRS(positions[i], quaternions[i], scales[i]);
+    });
+    Consume(matrices);
+    Report("MatrixFromTRS, quaternion", fusedQuaternion, count, composed);
+
+    return 0;
+}
@@ -0,0 +1,410 @@
+//--------------------------------------------------------------------------------------
+// Scene benchmarks
+//--------------------------------------------------------------------------------------
+// Times the CPU side of the scene's systems at stress sizes, rendering through the headless backend so no window or
+// GPU is needed:
+// - Draw queue submit for 5,000 models, with the constant arena and with an upload for every draw
+// - A culling pass over 100,000 models, held contiguously (CModelPool) and separately allocated
+// - Rebuilding 1,000,000 world matrices on one thread and on all the workers
+// - Updating a 100,000 node hierarchy with 1% of the nodes changed
+// - Loading a generated 100,000 model scene in text and binary form
+// - Binning a thousand lights into clusters
+// Run with the scene file to generate the large scenes from (default Default.scene). The generated scene files are
+// written to the working directory.
+
+#include "HeadlessApp.h"
+#include "HeadlessRenderBackend.h"
+#include "Camera.h"
+#include "Model.h"
+#include "ModelPool.h"
+#include "DrawQueue.h"
+#include "LightClusters.h"
+#include "TransformSystem.h"
+#include "SceneFile.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <string>
+#include <cmath>
+#include <stdexcept>
+
+
+//--------------------------------------------------------------------------------------
+// Draw queue submit
+//--------------------------------------------------------------------------------------
+
+// Seconds per frame to submit numModels boxes with a few different states, each drawn separately (no instancing) so
+// every model costs a draw and a set of per-model constants. Headless uploads cost nothing, so this is only the CPU
+// side of submitting, not the driver renaming the constant buffer that the arena avoids on a GPU
+static void BenchmarkSubmit(CHeadlessRenderContext* context, Mesh* mesh, unsigned int numModels)
+{
+    // A few shader and texture combinations, as the scene's materials give
+    const unsigned int NumShaders  = 4;
+    const unsigned int NumTextures = 8;
+    ID3D11VertexShader* vertexShader = CreateHeadlessVertexShader();
+    ID3D11PixelShader*  pixelShaders[NumShaders];
+    ID3D11Resource*           textures[NumTextures];
+    ID3D11ShaderResourceView* textureSRVs[NumTextures];
+    for (auto& shader : pixelShaders)  shader = CreateHeadlessPixelShader();
+    for (unsigned int i = 0; i < NumTextures; ++i)  gRenderDevice->LoadTexture("Texture" + std::to_string(i), &textures[i], &textureSRVs[i]);
+
+    // A square grid of boxes in front of the camera
+    CModelPool models;
+    models.Reserve(numModels);
+    unsigned int rowLength = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(numModels))));
+    for (unsigned int i = 0; i < numModels; ++i)
+    {
+        models.Add(Model(mesh, { (i % rowLength - rowLength * 0.5f) * 3, (i / rowLength - rowLength * 0.5f) * 3, 500 }));
+    }
+    Model::Transforms().UpdateAll();
+
+    CDrawQueue drawQueue(1);
+    drawQueue.SetInstancing(false);
+    context->SetRecording(false);
+
+    const int NumFrames = 20;
+    auto timeSubmits = [&](bool constantArena)
+    {
+        drawQueue.SetConstantArena(constantArena);
+        drawQueue.ResetStatistics();
+        for (int frame = 0; frame < NumFrames; ++frame)
+        {
+            drawQueue.Clear();
+            unsigned int i = 0;
+            for (auto& model : models)
+            {
+                SDrawState state;
+                state.vertexShader = vertexShader;
+                state.pixelShader  = pixelShaders[i % NumShaders];
+                state.textures[0]  = textureSRVs[i % NumTextures];
+                drawQueue.Add(0, state, &model);
+                ++i;
+            }
+            drawQueue.Sort();
+            drawQueue.Submit();
+        }
+        return drawQueue.SubmitTime() / NumFrames;
+    };
+    float arenaTime = timeSubmits(true);
+    unsigned int arenaUploads = drawQueue.ConstantUploads() / NumFrames;
+    float perDrawTime = timeSubmits(false);
+    unsigned int perDrawUploads = drawQueue.ConstantUploads() / NumFrames;
+    context->SetRecording(true);
+    context->Clear();
+
+    std::cout << "Submit, " << numModels << " models: constant arena " << arenaTime * 1000 << "ms (" << arenaUploads
+              << " uploads), upload per draw " << perDrawTime * 1000 << "ms (" << perDrawUploads << " uploads) per frame\n";
+
+    drawQueue.ReleaseResources();
+    models.Clear();
+    for (unsigned int i = 0; i < NumTextures; ++i)
+    {
+        gRenderDevice->Release(textureSRVs[i]);
+        gRenderDevice->Release(textures[i]);
+    }
+    for (auto& shader : pixelShaders)  gRenderDevice->Release(shader);
+    gRenderDevice->Release(vertexShader);
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Model iteration
+//--------------------------------------------------------------------------------------
+
+// Times a frustum test and constant write over numModels models generated from the scene file, held contiguously as
+// the scene's collections are and separately allocated as they used to be. All models use the given mesh, as the
+// scene's meshes can't be imported here
+static void BenchmarkModelIteration(CSceneFile sceneFile, Mesh* mesh, unsigned int numModels)
+{
+    // Copies of the scene's models spread over a large area around the camera, so the pass culls some of them
+    sceneFile.GenerateSynthetic(numModels);
+    if (sceneFile.Models().empty())  return;
+    std::vector<CTexture> textures(sceneFile.Textures().size());
+
+    // The pooled layout, as the collections now store their models
+    CModelPool pool;
+    pool.Reserve(numModels);
+    for (auto& model : sceneFile.Models())
+    {
+        CTexture* texture0 = (model.textures[0] != NoSceneTexture) ? &textures[model.textures[0]] : nullptr;
+        CTexture* texture1 = (model.textures[1] != NoSceneTexture) ? &textures[model.textures[1]] : nullptr;
+        pool.Add(Model(mesh, { texture0, texture1 }, model.position, model.rotation, model.scale));
+    }
+
+    // The old layout - each model allocated separately, with its texture list in a second allocation. Both are
+    // allocated in turn as the old model constructor did, so the heap is laid out the same way
+    std::vector<Model*> pointers;
+    std::vector<std::vector<CTexture*>*> textureLists;
+    pointers.reserve(numModels);
+    textureLists.reserve(numModels);
+    for (auto& model : pool)
+    {
+        pointers.push_back(new Model(model));
+        textureLists.push_back(new std::vector<CTexture*>{ model.GetTexture(0), model.GetTexture(1) });
+    }
+
+    // The work of a render pass on each model, without the draw queue: a frustum test, then reading the textures and
+    // writing the constants of visible models. The first pass of each builds the world matrices so isn't timed
+    Camera camera(sceneFile.CameraPosition(), sceneFile.CameraRotation(), PI / 3, static_cast<float>(gViewportWidth) / gViewportHeight);
+    CFrustum frustum(camera.ViewProjectionMatrix());
+    PerModelConstants constants;
+    unsigned int visible = 0;
+    auto passPooled = [&]()
+    {
+        for (auto& model : pool)
+        {
+            if (!model.IsInFrustum(frustum))  continue;
+            if (model.GetTexture(0) != nullptr)  ++visible;
+            model.WriteConstants(constants);
+        }
+    };
+    auto passPointers = [&]()
+    {
+        for (size_t i = 0; i < pointers.size(); ++i)
+        {
+            if (!pointers[i]->IsInFrustum(frustum))  continue;
+            if ((*textureLists[i])[0] != nullptr)  ++visible;
+            pointers[i]->WriteConstants(constants);
+        }
+    };
+
+    const int numPasses = 10;
+    Timer timer;
+    passPooled();
+    timer.Reset();
+    for (int pass = 0; pass < numPasses; ++pass)  passPooled();
+    float pooledTime = timer.GetTime() / numPasses;
+
+    passPointers();
+    timer.Reset();
+    for (int pass = 0; pass < numPasses; ++pass)  passPointers();
+    float pointerTime = timer.GetTime() / numPasses;
+
+    for (size_t i = 0; i < pointers.size(); ++i)
+    {
+        delete pointers[i];
+        delete textureLists[i];
+    }
+
+    std::cout << "Model iteration, " << numModels << " models (" << visible / (2 * (numPasses + 1)) << " visible): pooled "
+              << pooledTime * 1000 << "ms, pointers " << pointerTime * 1000 << "ms per pass\n";
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Transforms
+//--------------------------------------------------------------------------------------
+
+// Times rebuilding numTransforms world matrices, all changed before each rebuild, on this thread and on all the workers
+static void BenchmarkTransforms(CThreadPool& workers, unsigned int numTransforms)
+{
+    CTransformSystem transforms;
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<STransformHandle> handles;
+    handles.reserve(numTransforms);
+    for (unsigned int i = 0; i < numTransforms; ++i)
+    {
+        handles.push_back(transforms.Add({ unit(random) * 1000, unit(random) * 100, unit(random) * 1000 },
+                                         { unit(random) * PI, unit(random) * PI, unit(random) * PI }, { 1, 1, 1 }));
+    }
+
+    // Every transform is changed before each update, the worst case of a fully dynamic scene. The first update of
+    // each kind is not timed, to leave the caches in the same state for both
+    const int numUpdates = 5;
+    auto timeUpdates = [&](CThreadPool* pool)
+    {
+        Timer timer;
+        float time = 0;
+        for (int update = 0; update <= numUpdates; ++update)
+        {
+            for (auto& handle : handles)  transforms.SetRotation(handle, transforms.Rotation(handle) + CVector3{ 0.01f, 0.02f, 0.03f });
+            timer.Reset();
+            transforms.UpdateAll(pool);
+            if (update > 0)  time += timer.GetTime();
+        }
+        return time / numUpdates;
+    };
+    float oneThread  = timeUpdates(nullptr);
+    float allThreads = timeUpdates(&workers);
+
+    std::cout << "Transforms, " << numTransforms << " world matrices: " << oneThread * 1000 << "ms on one thread, "
+              << allThreads * 1000 << "ms on " << workers.NumThreads() << " threads\n";
+}
+
+
+// Times updating a tree of numNodes transforms with 1% of the nodes turned before each update
+static void BenchmarkHierarchy(CThreadPool& workers, unsigned int numNodes)
+{
+    // Each node after the first is attached to a random earlier node, giving a tree of mixed depth and branching
+    CTransformSystem transforms;
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<STransformHandle> nodes;
+    nodes.reserve(numNodes);
+    for (unsigned int i = 0; i < numNodes; ++i)
+    {
+        nodes.push_back(transforms.Add({ unit(random) * 10, unit(random) * 10, unit(random) * 10 },
+                                       { unit(random) * PI, unit(random) * PI, unit(random) * PI }, { 1, 1, 1 }));
+        if (i > 0)  transforms.SetParent(nodes[i], nodes[random() % i]);
+    }
+    transforms.UpdateAll(&workers);
+
+    // 1% of the nodes are turned before each update. Changing a node rebuilds its whole subtree, so more matrices
+    // than that are rebuilt
+    const int numUpdates = 20;
+    const unsigned int numChanged = numNodes / 100;
+    Timer timer;
+    float time = 0;
+    transforms.ResetRebuilds();
+    for (int update = 0; update < numUpdates; ++update)
+    {
+        for (unsigned int i = 0; i < numChanged; ++i)
+        {
+            STransformHandle node = nodes[random() % numNodes];
+            transforms.SetRotation(node, transforms.Rotation(node) + CVector3{ 0.01f, 0.02f, 0.03f });
+        }
+        timer.Reset();
+        transforms.UpdateAll(&workers);
+        time += timer.GetTime();
+    }
+
+    std::cout << "Hierarchy, " << numNodes << " nodes with " << numChanged << " changed: " << time / numUpdates * 1000
+              << "ms per update, " << transforms.Rebuilds() / numUpdates << " matrices rebuilt\n";
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Scene files
+//--------------------------------------------------------------------------------------
+
+// Generates a scene of numModels models from the given scene file, saves it in both forms and times loading each back
+static void BenchmarkSceneFiles(CSceneFile sceneFile, unsigned int numModels)
+{
+    sceneFile.GenerateSynthetic(numModels);
+    if (!sceneFile.SaveText("Synthetic.scene") || !sceneFile.SaveBinary("Synthetic.sceneb"))
+    {
+        std::cout << "Scene files: " << sceneFile.Error() << "\n";
+        return;
+    }
+
+    Timer timer;
+    timer.Reset();
+    bool textLoaded = sceneFile.Load("Synthetic.scene");
+    float textTime = timer.GetTime();
+    timer.Reset();
+    bool binaryLoaded = sceneFile.Load("Synthetic.sceneb");
+    float binaryTime = timer.GetTime();
+
+    std::cout << "Scene files, " << numModels << " models: text " << textTime * 1000 << "ms" << (textLoaded ? "" : " (failed)")
+              << ", binary " << binaryTime * 1000 << "ms" << (binaryLoaded ? "" : " (failed)") << "\n";
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Light binning
+//--------------------------------------------------------------------------------------
+
+// Times binning a grid of point lights, and a coarser grid of spotlights pointing down, over a field in front of the
+// camera, as the scene's light field stress test lays them out
+static void BenchmarkLightBinning(unsigned int numPointLights, unsigned int numSpotlights)
+{
+    const float fieldSize = 400;
+    std::vector<PointLight> pointLights(numPointLights);
+    unsigned int rowLength = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(numPointLights))));
+    float spacing = fieldSize / rowLength;
+    for (unsigned int i = 0; i < numPointLights; ++i)
+    {
+        pointLights[i].position = { -0.5f * fieldSize + (i % rowLength + 0.5f) * spacing, 4, (i / rowLength + 0.5f) * spacing };
+        pointLights[i].range    = spacing * 1.5f;
+        pointLights[i].colour   = { 1, 1, 1 };
+    }
+    std::vector<Spotlight> spotlights(numSpotlights);
+    rowLength = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(numSpotlights))));
+    spacing = fieldSize / rowLength;
+    for (unsigned int i = 0; i < numSpotlights; ++i)
+    {
+        spotlights[i].position     = { -0.5f * fieldSize + (i % rowLength + 0.5f) * spacing, 40, (i / rowLength + 0.5f) * spacing };
+        spotlights[i].range        = 80;
+        spotlights[i].colour       = { 1, 1, 1 };
+        spotlights[i].facing       = Normalise(CVector3{ 0, -40, 5 });
+        spotlights[i].cosHalfAngle = std::cos(ToRadians(25));
+    }
+
+    CLightClusters lightClusters;
+    if (!lightClusters.CreateResources(numPointLights, numSpotlights))
+    {
+        std::cout << "Light binning: error creating light buffers\n";
+        return;
+    }
+    lightClusters.SetLights(pointLights.data(), numPointLights, spotlights.data(), numSpotlights);
+
+    Camera camera({ 0, 20, -20 }, { ToRadians(15), 0, 0 }, PI / 3, static_cast<float>(gViewportWidth) / gViewportHeight, 0.1f, 1000);
+    const int numBins = 20;
+    float time = 0;
+    for (int bin = 0; bin < numBins; ++bin)
+    {
+        lightClusters.Bin(camera.ViewMatrix(), camera.ProjectionMatrix(), camera.NearClip(), camera.FarClip());
+        time += lightClusters.BinTime();
+    }
+
+    std::cout << "Light binning, " << numPointLights << " point lights and " << numSpotlights << " spotlights: "
+              << time / numBins * 1000 << "ms per bin, " << lightClusters.NumLightIndices() << " light indices, most "
+              << lightClusters.MaxLightsInCluster() << " in a cluster\n";
+    lightClusters.ReleaseResources();
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    std::string sceneFileName = (argc > 1) ? argv[1] : "Default.scene";
+    CSceneFile sceneFile;
+    if (!sceneFile.Load(sceneFileName))
+    {
+        std::cerr << "Error loading " << sceneFileName << ": " << sceneFile.Error() << "\n";
+        return 1;
+    }
+
+    CHeadlessRenderContext* context = InitHeadlessApp();
+    if (context == nullptr)
+    {
+        std::cerr << "Error starting headless renderer: " << gLastError << "\n";
+        return 1;
+    }
+
+    Mesh* boxMesh = nullptr;
+    try
+    {
+        boxMesh = CreateBoxMesh();
+    }
+    catch (std::runtime_error& e)
+    {
+        std::cerr << "Error creating box mesh: " << e.what() << "\n";
+        ShutdownHeadlessApp();
+        return 1;
+    }
+
+    CThreadPool workers;
+    BenchmarkSubmit(context, boxMesh, 5000);
+    BenchmarkModelIteration(sceneFile, boxMesh, 100000);
+    BenchmarkTransforms(workers, 1000000);
+    BenchmarkHierarchy(workers, 100000);
+    BenchmarkSceneFiles(sceneFile, 100000);
+    BenchmarkLightBinning(1024, 64);
+
+    delete boxMesh;
+    ShutdownHeadlessApp();
+    return 0;
+}
@@ -0,0 +1,402 @@
+//--------------------------------------------------------------------------------------
+// Transform storage and world matrix building for many objects
+//--------------------------------------------------------------------------------------
+
+#include "TransformSystem.h"
+#include "ThreadPool.h"
+#include "MathSIMD.h"
+
+#include <cstring>
+
+const uint32_t CTransformSystem::NoEntry; // Defined here too as vector::push_back takes it by reference
+
+
+//--------------------------------------------------------------------------------------
+// Entries
+//--------------------------------------------------------------------------------------
+
+STransformHandle CTransformSystem::Add(const CVector3& position, const CVector3& rotation, const CVector3& scale)
+{
+    uint32_t index;
+    if (!mFreeEntries.empty())
+    {
+        index = mFreeEntries.back();
+        mFreeEntries.pop_back();
+    }
+    else
+    {
+        index = static_cast<uint32_t>(mMatrices.size());
+        mMatrices.emplace_back();
+        mLocalMatrices.emplace_back();
+        mVersions.push_back(0);
+        mParent.push_back(NoEntry);
+        mFirstChild.push_back(NoEntry);
+        mNextSibling.push_back(NoEntry);
+
+        // Grow the component arrays four entries at a time, see header
+        if (index >= mPositionX.size())
+        {
+            size_t size = mPositionX.size() + 4;
+            for (auto component : { &mPositionX, &mPositionY, &mPositionZ, &mRotationX, &mRotationY, &mRotationZ,
+                                    &mScaleX, &mScaleY, &mScaleZ })
+            {
+                component->resize(size, 0.0f);
+            }
+            mDirty.resize(size, 0);
+        }
+    }
+
+    mPositionX[index] = position.x;  mPositionY[index] = position.y;  mPositionZ[index] = position.z;
+    mRotationX[index] = rotation.x;  mRotationY[index] = rotation.y;  mRotationZ[index] = rotation.z;
+    mScaleX[index]    = scale.x;     mScaleY[index]    = scale.y;     mScaleZ[index]    = scale.z;
+    mDirty[index] = LocalDirty;
+    return { index };
+}
+
+
+void CTransformSystem::Remove(STransformHandle handle)
+{
+    if (!handle.Valid())  return;
+    uint32_t index = handle.index;
+
+    if (InHierarchy(index))
+    {
+        Detach(index);
+        for (uint32_t child = mFirstChild[index]; child != NoEntry; )
+        {
+            uint32_t next = mNextSibling[child];
+            mParent[child] = NoEntry;
+            mNextSibling[child] = NoEntry;
+            mDirty[child] = LocalDirty;
+            child = next;
+        }
+        mFirstChild[index] = NoEntry;
+        mOrderChanged = true;
+    }
+
+    mDirty[index] = Clean; // So updates skip it
+    mFreeEntries.push_back(index);
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Hierarchy
+//--------------------------------------------------------------------------------------
+
+bool CTransformSystem::SetParent(STransformHandle child, STransformHandle parent)
+{
+    uint32_t c = child.index;
+    uint32_t p = parent.index;
+    for (uint32_t ancestor = p; ancestor != NoEntry; ancestor = mParent[ancestor])
+    {
+        if (ancestor == c)  return false;
+    }
+    if (mParent[c] == p)  return true;
+
+    Detach(c);
+    if (p != NoEntry)
+    {
+        // A parent joining a hierarchy needs its local matrix, which entries outside hierarchies don't keep
+        if (!InHierarchy(p))  mDirty[p] = LocalDirty;
+        mParent[c] = p;
+        mNextSibling[c] = mFirstChild[p];
+        mFirstChild[p] = c;
+    }
+    mDirty[c] = LocalDirty;
+    mOrderChanged = true;
+    return true;
+}
+
+
+void CTransformSystem::Detach(uint32_t index)
+{
+    uint32_t parent = mParent[index];
+    if (parent == NoEntry)  return;
+
+    uint32_t* link = &mFirstChild[parent];
+    while (*link != index)  link = &mNextSibling[*link];
+    *link = mNextSibling[index];
+
+    mParent[index] = NoEntry;
+    mNextSibling[index] = NoEntry;
+    mDirty[index] = LocalDirty;
+    mOrderChanged = true;
+}
+
+
+void CTransformSystem::BuildOrder()
+{
+    mOrder.clear();
+    mOrderPosition.assign(mMatrices.size(), NoEntry);
+
+    // Depth first from each root that has children, children pushed on a stack rather than recursing as
+    // hierarchies can be very deep
+    std::vector<uint32_t> stack;
+    for (uint32_t root = 0; root < mMatrices.size(); ++root)
+    {
+        if (mParent[root] != NoEntry || mFirstChild[root] == NoEntry)  continue;
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            uint32_t entry = stack.back();
+            stack.pop_back();
+            mOrderPosition[entry] = static_cast<uint32_t>(mOrder.size());
+            mOrder.push_back(entry);
+            for (uint32_t child = mFirstChild[entry]; child != NoEntry; child = mNextSibling[child])  stack.push_back(child);
+        }
+    }
+
+    // Subtree sizes, added up from the end so each child is complete before it is added to its parent
+    mSubtreeEnd.assign(mOrder.size(), 1);
+    for (size_t position = mOrder.size(); position-- > 0; )
+    {
+        uint32_t parent = mParent[mOrder[position]];
+        if (parent != NoEntry)  mSubtreeEnd[mOrderPosition[parent]] += mSubtreeEnd[position];
+    }
+    for (size_t position = 0; position < mOrder.size(); ++position)
+    {
+        mSubtreeEnd[position] += static_cast<uint32_t>(position);
+    }
+    mOrderChanged = false;
+}
+
+
+unsigned int CTransformSystem::UpdateSubtree(uint32_t orderPosition)
+{
+    uint32_t end = mSubtreeEnd[orderPosition];
+    for (uint32_t position = orderPosition; position < end; ++position)
+    {
+        uint32_t i = mOrder[position];
+        if (mDirty[i] == LocalDirty)
+        {
+            mLocalMatrices[i] = MatrixFromTRS({ mPositionX[i], mPositionY[i], mPositionZ[i] }, { mRotationX[i], mRotationY[i], mRotationZ[i] },
+                                              { mScaleX[i], mScaleY[i], mScaleZ[i] });
+        }
+        uint32_t parent = mParent[i];
+        mMatrices[i] = (parent != NoEntry) ? mLocalMatrices[i] * mMatrices[parent] : mLocalMatrices[i];
+        mDirty[i] = Clean;
+        ++mVersions[i];
+    }
+    return end - orderPosition;
+}
+
+
+void CTransformSystem::SetPosition(STransformHandle h, const CVector3& position)
+{
+    mPositionX[h.index] = position.x;  mPositionY[h.index] = position.y;  mPositionZ[h.index] = position.z;
+    mDirty[h.index] = LocalDirty;
+}
+
+void CTransformSystem::SetRotation(STransformHandle h, const CVector3& rotation)
+{
+    mRotationX[h.index] = rotation.x;  mRotationY[h.index] = rotation.y;  mRotationZ[h.index] = rotation.z;
+    mDirty[h.index] = LocalDirty;
+}
+
+void CTransformSystem::SetScale(STransformHandle h, const CVector3& scale)
+{
+    mScaleX[h.index] = scale.x;  mScaleY[h.index] = scale.y;  mScaleZ[h.index] = scale.z;
+    mDirty[h.index] = LocalDirty;
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Update
+//--------------------------------------------------------------------------------------
+
+void CTransformSystem::UpdateAll(CThreadPool* pool /*= nullptr*/)
+{
+    uint32_t numEntries = static_cast<uint32_t>(mMatrices.size());
+    if (pool == nullptr || numEntries <= BatchSize)
+    {
+        mRebuilds += UpdateRange(0, numEntries);
+    }
+    else
+    {
+        // Batches are a multiple of four entries so each starts on a group of four. They write to separate entries
+        // so need no locking
+        for (uint32_t first = 0; first < numEntries; first += BatchSize)
+        {
+            uint32_t last = (first + BatchSize < numEntries) ? first + BatchSize : numEntries;
+            pool->Add([this, first, last]() { mRebuilds += UpdateRange(first, last); });
+        }
+        pool->Wait();
+    }
+
+    // Parents come before their children in the order, so each subtree is rebuilt from an up to date parent
+    if (mOrderChanged)  BuildOrder();
+    unsigned int rebuilt = 0;
+    for (uint32_t position = 0; position < mOrder.size(); )
+    {
+        if (mDirty[mOrder[position]] != Clean)
+        {
+            rebuilt += UpdateSubtree(position);
+            position = mSubtreeEnd[position];
+        }
+        else
+        {
+            ++position;
+        }
+    }
+    mRebuilds += rebuilt;
+}
+
+
+void CTransformSystem::UpdateOne(uint32_t i)
+{
+    if (InHierarchy(i))
+    {
+        uint32_t highest = NoEntry;
+        for (uint32_t ancestor = i; ancestor != NoEntry; ancestor = mParent[ancestor])
+        {
+            if (mDirty[ancestor] != Clean)  highest = ancestor;
+        }
+        if (highest == NoEntry)  return;
+
+        if (mOrderChanged)  BuildOrder();
+        mRebuilds += UpdateSubtree(mOrderPosition[highest]);
+        return;
+    }
+
+    mMatrices[i] = MatrixFromTRS({ mPositionX[i], mPositionY[i], mPositionZ[i] }, { mRotationX[i], mRotationY[i], mRotationZ[i] },
+                                 { mScaleX[i], mScaleY[i], mScaleZ[i] });
+    mDirty[i] = Clean;
+    ++mVersions[i];
+    ++mRebuilds;
+}
+
+
+#ifdef MATH_USE_SSE
+
+// Sine and cosine of four angles. The angle is reduced to within a quarter turn of zero, where short polynomials
+// (from the Cephes library) are accurate to about a unit in the last place, then the quadrant picks which of the
+// two results is the sine and cosine and their signs. Loses accuracy for angles beyond several thousand radians
+static inline void SinCosSSE(__m128 angle, __m128& sinOut, __m128& cosOut)
+{
+    // Quadrant, and the angle within it. Pi/2 is subtracted in two parts to keep the bits lost from the first
+    __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(angle, _mm_set1_ps(0.636619772f))); // Rounds to nearest
+    __m128  q = _mm_cvtepi32_ps(quadrant);
+    __m128  x = _mm_sub_ps(angle, _mm_mul_ps(q, _mm_set1_ps(1.5703125f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(4.83826794897e-4f)));
+    __m128  x2 = _mm_mul_ps(x, x);
+
+    __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), x2), _mm_set1_ps(8.3321608736e-3f));
+    s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.6666654611e-1f));
+    s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, x2), x), x);
+
+    __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), x2), _mm_set1_ps(-1.388731625493765e-3f));
+    c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(4.166664568298827e-2f));
+    c = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c, x2), x2), _mm_mul_ps(x2, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+    // Odd quadrants swap sine and cosine. The sine is negated in quadrants 2 and 3, the cosine in 1 and 2
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    __m128 swap    = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+    __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+    __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+    sinOut = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s)), sinSign);
+    cosOut = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c)), cosSign);
+}
+
+
+// Four entries at a time, the same calculation as MatrixFromTRS with one entry in each lane. The rows of the four
+// matrices are then transposed out of the lanes. Only the out of date entries are written
+unsigned int CTransformSystem::UpdateRange(uint32_t first, uint32_t last)
+{
+    unsigned int rebuilt = 0;
+    for (uint32_t i = first; i < last; i += 4)
+    {
+        uint32_t dirty;
+        std::memcpy(&dirty, &mDirty[i], sizeof(dirty));
+        if (dirty == 0)  continue;
+
+        __m128 sX, cX, sY, cY, sZ, cZ;
+        SinCosSSE(_mm_loadu_ps(&mRotationX[i]), sX, cX);
+        SinCosSSE(_mm_loadu_ps(&mRotationY[i]), sY, cY);
+        SinCosSSE(_mm_loadu_ps(&mRotationZ[i]), sZ, cZ);
+        __m128 scaleX = _mm_loadu_ps(&mScaleX[i]);
+        __m128 scaleY = _mm_loadu_ps(&mScaleY[i]);
+        __m128 scaleZ = _mm_loadu_ps(&mScaleZ[i]);
+
+        __m128 sXsY = _mm_mul_ps(sX, sY);
+        __m128 sXcY = _mm_mul_ps(sX, cY);
+        __m128 row0[4] = { _mm_mul_ps(scaleX, _mm_add_ps(_mm_mul_ps(cZ, cY), _mm_mul_ps(sZ, sXsY))),
+                           _mm_mul_ps(scaleX, _mm_mul_ps(sZ, cX)),
+                           _mm_mul_ps(scaleX, _mm_sub_ps(_mm_mul_ps(sZ, sXcY), _mm_mul_ps(cZ, sY))),
+                           _mm_setzero_ps() };
+        __m128 row1[4] = { _mm_mul_ps(scaleY, _mm_sub_ps(_mm_mul_ps(cZ, sXsY), _mm_mul_ps(sZ, cY))),
+                           _mm_mul_ps(scaleY, _mm_mul_ps(cZ, cX)),
+                           _mm_mul_ps(scaleY, _mm_add_ps(_mm_mul_ps(sZ, sY), _mm_mul_ps(cZ, sXcY))),
+                           _mm_setzero_ps() };
+        __m128 row2[4] = { _mm_mul_ps(scaleZ, _mm_mul_ps(cX, sY)),
+                           _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(scaleZ, sX)),
+                           _mm_mul_ps(scaleZ, _mm_mul_ps(cX, cY)),
+                           _mm_setzero_ps() };
+        __m128 row3[4] = { _mm_loadu_ps(&mPositionX[i]), _mm_loadu_ps(&mPositionY[i]), _mm_loadu_ps(&mPositionZ[i]),
+                           _mm_set1_ps(1.0f) };
+        _MM_TRANSPOSE4_PS(row0[0], row0[1], row0[2], row0[3]);
+        _MM_TRANSPOSE4_PS(row1[0], row1[1], row1[2], row1[3]);
+        _MM_TRANSPOSE4_PS(row2[0], row2[1], row2[2], row2[3]);
+        _MM_TRANSPOSE4_PS(row3[0], row3[1], row3[2], row3[3]);
+
+        for (uint32_t lane = 0; lane < 4; ++lane)
+        {
+            uint32_t entry = i + lane;
+            if (mDirty[entry] == Clean)  continue;
+
+            // Entries in a hierarchy only get their local matrix here, the hierarchy update finishes them
+            bool inHierarchy = InHierarchy(entry);
+            if (inHierarchy && mDirty[entry] == WorldDirty)  continue;
+            float* m = inHierarchy ? &mLocalMatrices[entry].e00 : &mMatrices[entry].e00;
+            _mm_storeu_ps(m,      row0[lane]);
+            _mm_storeu_ps(m + 4,  row1[lane]);
+            _mm_storeu_ps(m + 8,  row2[lane]);
+            _mm_storeu_ps(m + 12, row3[lane]);
+            if (inHierarchy)
+            {
+                mDirty[entry] = WorldDirty;
+            }
+            else
+            {
+                mDirty[entry] = Clean;
+                ++mVersions[entry];
+                ++rebuilt;
+            }
+        }
+    }
+    return rebuilt;
+}
+
+#else
+
+unsigned int CTransformSystem::UpdateRange(uint32_t first, uint32_t last)
+{
+    unsigned int rebuilt = 0;
+    for (uint32_t i = first; i < last; ++i)
+    {
+        if (mDirty[i] == Clean)  continue;
+
+        // Entries in a hierarchy only get their local matrix here, the hierarchy update finishes them
+        bool inHierarchy = InHierarchy(i);
+        if (inHierarchy && mDirty[i] == WorldDirty)  continue;
+        CMatrix4x4 matrix = MatrixFromTRS({ mPositionX[i], mPositionY[i], mPositionZ[i] }, { mRotationX[i], mRotationY[i], mRotationZ[i] },
+                                          { mScaleX[i], mScaleY[i], mScaleZ[i] });
+        if (inHierarchy)
+        {
+            mLocalMatrices[i] = matrix;
+            mDirty[i] = WorldDirty;
+        }
+        else
+        {
+            mMatrices[i] = matrix;
+            mDirty[i] = Clean;
+            ++mVersions[i];
+            ++rebuilt;
+        }
+    }
+    return rebuilt;
+}
+
+#endif // MATH_USE_SSE
@@ -0,0 +1,175 @@
+//--------------------------------------------------------------------------------------
+// Transform storage and world matrix building for many objects
+//--------------------------------------------------------------------------------------
+// Positions, rotations (Euler angles, as Model uses) and scales are held as structure-of-arrays: one array for each
+// component of each vector. That suits building world matrices four at a time with SSE, as four neighbouring
+// entries fill one register per component. The world matrices are output to their own array, where the renderer
+// reads them whole.
+//
+// Changing a transform only marks it dirty. UpdateAll rebuilds every dirty matrix in one go, in batches shared
+// among the workers of a thread pool. Reading the matrix of a dirty entry rebuilds that entry alone, so code
+// working between updates (e.g. FaceTarget) always sees up to date matrices.
+//
+// Entries can be attached to a parent entry, making their position, rotation and scale relative to the parent so
+// they move with it. The entries in hierarchies are also listed in a flat array in depth first order, so every
+// subtree is one contiguous range with each parent before its children. Updating walks that array once: a clean
+// entry is stepped over, a changed one has its whole range rebuilt (each child from its parent's new matrix) and is
+// then skipped past. Only changed subtrees are rebuilt, and entries outside any hierarchy cost nothing here.
+//
+// Entries are addressed by handles, which stay valid until the entry is removed. Removed entries are reused by
+// later additions. The system is not thread safe: add, remove and change entries from one thread only.
+
+#ifndef _TRANSFORM_SYSTEM_H_INCLUDED_
+#define _TRANSFORM_SYSTEM_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+class CThreadPool;
+
+
+// Handle to an entry in a transform system
+struct STransformHandle
+{
+    uint32_t index = 0xffffffff;
+
+    bool Valid() const  { return index != 0xffffffff; }
+};
+
+
+class CTransformSystem
+{
+public:
+    //-------------------------------------
+    // Entries
+    //-------------------------------------
+
+    STransformHandle Add(const CVector3& position, const CVector3& rotation, const CVector3& scale);
+    void Remove(STransformHandle handle);
+
+    // Number of entries in use
+    size_t Size()  { return mMatrices.size() - mFreeEntries.size(); }
+
+
+    //-------------------------------------
+    // Hierarchy
+    //-------------------------------------
+
+    // Attach an entry to a parent, after which its position, rotation and scale are relative to the parent's. An
+    // invalid parent detaches the entry. Returns false, changing nothing, if the parent is the entry itself or one of
+    // its descendants. Removing an entry detaches its children, leaving them where their own transforms place them
+    bool SetParent(STransformHandle child, STransformHandle parent);
+
+    STransformHandle Parent(STransformHandle h)  { return { mParent[h.index] }; }
+
+
+    //-------------------------------------
+    // Data access
+    //-------------------------------------
+
+    CVector3 Position(STransformHandle h)  { return { mPositionX[h.index], mPositionY[h.index], mPositionZ[h.index] }; }
+    CVector3 Rotation(STransformHandle h)  { return { mRotationX[h.index], mRotationY[h.index], mRotationZ[h.index] }; }
+    CVector3 Scale(STransformHandle h)     { return { mScaleX[h.index],    mScaleY[h.index],    mScaleZ[h.index]    }; }
+
+    // These are relative to the parent for attached entries. Setters mark the world matrix as out of date
+    void SetPosition(STransformHandle h, const CVector3& position);
+    void SetRotation(STransformHandle h, const CVector3& rotation);
+    void SetScale   (STransformHandle h, const CVector3& scale);
+
+    // The world matrix, rebuilt first if it or an ancestor is out of date. The reference is only valid until the next Add
+    const CMatrix4x4& WorldMatrix(STransformHandle h)
+    {
+        if (mDirty[h.index] || mParent[h.index] != NoEntry)  UpdateOne(h.index);
+        return mMatrices[h.index];
+    }
+
+    // Increases each time the world matrix is rebuilt (including when an ancestor moves), so anything cached from
+    // the transform can tell whether it is out of date
+    unsigned int Version(STransformHandle h)
+    {
+        if (mDirty[h.index] || mParent[h.index] != NoEntry)  UpdateOne(h.index);
+        return mVersions[h.index];
+    }
+
+
+    //-------------------------------------
+    // Update
+    //-------------------------------------
+
+    // Rebuild every out of date world matrix. The entries are split into batches run on the given pool's workers,
+    // or all on this thread if the pool is null. Waits for the workers to finish, then brings the hierarchies up to
+    // date on this thread
+    void UpdateAll(CThreadPool* pool = nullptr);
+
+    // Number of world matrices rebuilt since the last reset
+    unsigned int Rebuilds()       { return mRebuilds;  }
+    void         ResetRebuilds()  { mRebuilds = 0;     }
+
+
+private:
+    static const uint32_t NoEntry = 0xffffffff;
+
+    // Values of the dirty flags. Entries in a hierarchy go through both steps, the others are finished in one
+    enum EDirty : uint8_t
+    {
+        Clean = 0,
+        LocalDirty = 1, // Position, rotation or scale changed
+        WorldDirty = 2, // Local matrix rebuilt, world matrix waiting for the hierarchy update
+    };
+
+    bool InHierarchy(uint32_t index)  { return mParent[index] != NoEntry || mFirstChild[index] != NoEntry; }
+
+    // Rebuild one entry with the scalar code. In a hierarchy, rebuilds the subtree of the highest out of date ancestor
+    void UpdateOne(uint32_t index);
+
+    // Rebuild the local matrices of out of date entries in a range, which must start on a multiple of four. Entries
+    // outside any hierarchy are finished, their local matrix is their world matrix. Returns the number finished
+    unsigned int UpdateRange(uint32_t first, uint32_t last);
+
+    // Rebuild the world matrices of the subtree at the given position of the depth first order. Returns the number rebuilt
+    unsigned int UpdateSubtree(uint32_t orderPosition);
+
+    // Remove an entry from its parent's list of children
+    void Detach(uint32_t index);
+
+    // List the hierarchies in depth first order (see header comment)
+    void BuildOrder();
+
+    // Entries are processed in batches of this many by each job. Large enough that queuing a job costs little
+    // in comparison, small enough to share out evenly when only part of the array is dirty
+    static const uint32_t BatchSize = 16384;
+
+    // Component arrays. They are always allocated in multiples of four entries (see Add), so the SSE code can read
+    // four entries at any multiple of four without going past the end. The padding entries are never dirty
+    std::vector<float> mPositionX, mPositionY, mPositionZ;
+    std::vector<float> mRotationX, mRotationY, mRotationZ;
+    std::vector<float> mScaleX,    mScaleY,    mScaleZ;
+    std::vector<uint8_t> mDirty;
+
+    std::vector<CMatrix4x4>   mMatrices;      // World
+    std::vector<CMatrix4x4>   mLocalMatrices; // Relative to the parent, only used by entries in a hierarchy
+    std::vector<unsigned int> mVersions;
+
+    // Hierarchy links. Children are a singly linked list through their next sibling
+    std::vector<uint32_t> mParent;
+    std::vector<uint32_t> mFirstChild;
+    std::vector<uint32_t> mNextSibling;
+
+    // Entries in hierarchies in depth first order, the end of each one's subtree in the order, and each entry's
+    // position in the order. Rebuilt when the hierarchy changes
+    std::vector<uint32_t> mOrder;
+    std::vector<uint32_t> mSubtreeEnd;
+    std::vector<uint32_t> mOrderPosition;
+    bool                  mOrderChanged = false;
+
+    std::vector<uint32_t> mFreeEntries; // Removed entries, reused by Add
+
+    std::atomic<unsigned int> mRebuilds{ 0 };
+};
+
+
+#endif //_TRANSFORM_SYSTEM_H_INCLUDED_
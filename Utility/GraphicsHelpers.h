@@ -6,9 +6,6 @@
 #ifndef _SCENE_HELPERS_H_INCLUDED_
 #define _SCENE_HELPERS_H_INCLUDED_
 
-#include <WICTextureLoader.h>
-#include <DDSTextureLoader.h>
-
 #include "CMatrix4x4.h"
 #include "../Common.h"
 
@@ -23,10 +20,7 @@
 template <class T>
 void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData)
 {
-    D3D11_MAPPED_SUBRESOURCE cb;
-    gD3DContext->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &cb);
-    memcpy(cb.pData, &bufferData, sizeof(T));
-    gD3DContext->Unmap(buffer, 0);
+    gRenderContext->UpdateBuffer(buffer, &bufferData, sizeof(T));
 }
 
 
@@ -34,7 +28,7 @@ void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData)
 // Texture Loading
 //--------------------------------------------------------------------------------------
 
-// Using Microsoft's open source DirectX Tool Kit (DirectXTK) to simplify file loading
+// Loading is done by the render backend, the Direct3D backend uses Microsoft's open source DirectX Tool Kit (DirectXTK)
 // This function requires you to pass a ID3D11Resource* (e.g. &gTilesDiffuseMap), which manages the GPU memory for the
 // texture and also a ID3D11ShaderResourceView* (e.g. &gTilesDiffuseMapSRV), which allows us to use the texture in shaders
 // The function will fill in these pointers with usable data. Returns false on failure
@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------
+// Pool of worker threads running queued jobs
+//--------------------------------------------------------------------------------------
+
+#include "ThreadPool.h"
+
+// Index of the worker running on this thread, -1 on threads that aren't pool workers
+static thread_local int sWorkerIndex = -1;
+
+
+CThreadPool::CThreadPool(unsigned int numThreads /*= 0*/)
+{
+    if (numThreads == 0)  numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0)  numThreads = 1; // Hardware concurrency is 0 if it can't be determined
+
+    for (unsigned int i = 0; i < numThreads; ++i)
+    {
+        mThreads.emplace_back(&CThreadPool::WorkerLoop, this, static_cast<int>(i));
+    }
+}
+
+
+CThreadPool::~CThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mJobAdded.notify_all();
+    for (auto& thread : mThreads)
+    {
+        thread.join();
+    }
+}
+
+
+void CThreadPool::Add(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push_back(std::move(job));
+    }
+    mJobAdded.notify_one();
+}
+
+
+void CThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mJobFinished.wait(lock, [this] { return mJobs.empty() && mJobsRunning == 0; });
+}
+
+
+int CThreadPool::WorkerIndex()
+{
+    return sWorkerIndex;
+}
+
+
+void CThreadPool::WorkerLoop(int index)
+{
+    sWorkerIndex = index;
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        // Workers only stop once the queue is empty, so jobs added before destruction still run
+        mJobAdded.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+        if (mJobs.empty())  return;
+
+        std::function<void()> job = std::move(mJobs.front());
+        mJobs.pop_front();
+        ++mJobsRunning;
+
+        lock.unlock();
+        job();
+        lock.lock();
+
+        --mJobsRunning;
+        if (mJobs.empty() && mJobsRunning == 0)  mJobFinished.notify_all();
+    }
+}
@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------
+// Pool of worker threads running queued jobs
+//--------------------------------------------------------------------------------------
+// Jobs are run in the order they are added, by whichever worker is free first. Jobs must not throw - catch any
+// exceptions inside the job and record them somewhere the caller can check after waiting.
+
+#ifndef _THREAD_POOL_H_INCLUDED_
+#define _THREAD_POOL_H_INCLUDED_
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class CThreadPool
+{
+public:
+    // Start the given number of worker threads, 0 to use one per hardware thread
+    CThreadPool(unsigned int numThreads = 0);
+
+    // Finishes all queued jobs then stops the workers
+    ~CThreadPool();
+
+    // Queue a job to run on a worker thread
+    void Add(std::function<void()> job);
+
+    // Wait until every job added so far has finished
+    void Wait();
+
+    unsigned int NumThreads()  { return static_cast<unsigned int>(mThreads.size()); }
+
+    // Index of the worker thread calling this function (0 to NumThreads-1), or -1 if not called from a worker
+    static int WorkerIndex();
+
+
+private:
+    CThreadPool(const CThreadPool&) = delete;
+    CThreadPool& operator=(const CThreadPool&) = delete;
+
+    void WorkerLoop(int index);
+
+    std::vector<std::thread>          mThreads;
+    std::deque<std::function<void()>> mJobs;
+    unsigned int                      mJobsRunning = 0;
+    bool                              mStopping = false;
+
+    std::mutex              mMutex;
+    std::condition_variable mJobAdded;    // Signalled when a job is queued or the pool is stopping
+    std::condition_variable mJobFinished; // Signalled when a job finishes
+};
+
+
+#endif //_THREAD_POOL_H_INCLUDED_
@@ -2,9 +2,10 @@
 // Timer class - works like a stopwatch
 //--------------------------------------------------------------------------------------
 
-#include "Windows.h"
 #include "Timer.h"
 
+#ifdef _WIN32
+
 // Constructor //
 
 Timer::Timer()
@@ -173,3 +174,75 @@ float Timer::GetLapTime()
 	}
 	return fTime;
 }
+
+#else // Steady clock version for other platforms
+
+// Constructor //
+
+Timer::Timer()
+{
+	// Reset and start the timer
+	Reset();
+	mRunning = true;
+}
+
+
+// Timer control //
+
+// Start the timer running
+void Timer::Start()
+{
+	if (!mRunning)
+	{
+		mRunning = true;
+
+		// Get restart time - add time passed since stop time to the start and lap times
+		Clock::time_point newTime = Clock::now();
+		mStart += newTime - mStop;
+		mLap   += newTime - mStop;
+	}
+}
+
+// Stop the timer running
+void Timer::Stop()
+{
+	mRunning = false;
+	mStop = Clock::now();
+}
+
+// Reset the timer to zero
+void Timer::Reset()
+{
+	// Reset start, lap and stop times to current time
+	mStart = Clock::now();
+	mLap   = mStart;
+	mStop  = mStart;
+}
+
+
+// Timing //
+
+// Get frequency of the timer being used (in counts per second)
+float Timer::GetFrequency()
+{
+	return static_cast<float>(Clock::period::den) / static_cast<float>(Clock::period::num);
+}
+
+// Get time passed (seconds) since since timer was started or last reset
+float Timer::GetTime()
+{
+	Clock::time_point newTime = mRunning ? Clock::now() : mStop;
+	return std::chrono::duration<float>(newTime - mStart).count();
+}
+
+// Get time passed (seconds) since last call to this function. If this is the first call, then
+// the time since timer was started or the last reset is returned
+float Timer::GetLapTime()
+{
+	Clock::time_point newTime = mRunning ? Clock::now() : mStop;
+	float fTime = std::chrono::duration<float>(newTime - mLap).count();
+	mLap = newTime;
+	return fTime;
+}
+
+#endif
@@ -5,7 +5,11 @@
 #ifndef _TIMER_H_INCLUDED_
 #define _TIMER_H_INCLUDED_
 
-#include "Windows.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif
 
 class Timer
 {
@@ -46,6 +50,7 @@ private:
 	bool mRunning;
 
 
+#ifdef _WIN32
 	// Using high resolution timer and if so its frequency
 	bool          mHighRes;
 	LARGE_INTEGER mHighResFreq;
@@ -64,6 +69,15 @@ private:
 
 	// Time when low-resolution timer was stopped (if it has been)
 	DWORD mLowResStop;
+#else
+	// Other platforms use the standard library's steady clock, which is high resolution
+	typedef std::chrono::steady_clock Clock;
+
+	// Start time, last lap start time and the time the timer was stopped (if it has been)
+	Clock::time_point mStart;
+	Clock::time_point mLap;
+	Clock::time_point mStop;
+#endif
 };
 
 